@@ -0,0 +1,53 @@
+# Measures how late the triac gate pulses start, with the real-time engine on core0
+# (sharing it with the interpreter) and then on core1, under a GC and flash stress load.
+# Wire SIM_PIN to SENSE_PIN: a 50Hz PWM square wave stands in for the zero-cross detector.
+# TRIGGER_PIN may be left unconnected, or drive an LED.
+
+import gc
+import os
+import time
+from machine import Pin, PWM
+import Triac
+
+SIM_PIN = 2
+SENSE_PIN = 3
+TRIGGER_PIN = 4
+SECONDS = 10
+
+
+def stress(seconds):
+    # allocations that keep the GC busy, plus the occasional flash write
+    end = time.ticks_add(time.ticks_ms(), seconds * 1000)
+    junk = []
+    n = 0
+    while time.ticks_diff(end, time.ticks_ms()) > 0:
+        junk.append(bytearray(256))
+        if len(junk) > 64:
+            junk = []
+            gc.collect()
+        n += 1
+        if n % 2000 == 0:
+            with open("jitter.tmp", "wb") as f:
+                f.write(bytearray(4096))
+
+
+def measure(label):
+    controller = Triac.Controller(SENSE_PIN, TRIGGER_PIN, 1, percent=50, watchdogUs=(SECONDS + 5) * 1000000)
+    time.sleep_ms(500)  # PLL lock
+    controller.percent(50)
+    Triac.firing_stats()
+    stress(SECONDS)
+    count, mean, worst = Triac.firing_stats()
+    print("%s: %d pulses, late by %dus on average, %dus at worst" % (label, count, mean, worst))
+    controller.close()
+
+
+sim = PWM(Pin(SIM_PIN))
+sim.freq(50)
+sim.duty_u16(32768)
+
+measure("core0")
+Triac.realtime(1)
+measure("core1")
+sim.deinit()
+os.remove("jitter.tmp")
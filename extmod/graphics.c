@@ -8,6 +8,11 @@ static const mp_rom_map_elem_t graphics_module_globals_table[] = {
 
     { MP_ROM_QSTR(MP_QSTR_Sprite), MP_ROM_PTR(&mp_graphics_sprite_type) },
     { MP_ROM_QSTR(MP_QSTR_Typer), MP_ROM_PTR(&mp_graphics_typer_type) },
+
+    { MP_ROM_QSTR(MP_QSTR_transition), MP_ROM_PTR(&graphics_transition_obj) },
+    { MP_ROM_QSTR(MP_QSTR_SLIDE), MP_ROM_INT(GRAPHICS_TRANSITION_SLIDE) },
+    { MP_ROM_QSTR(MP_QSTR_WIPE), MP_ROM_INT(GRAPHICS_TRANSITION_WIPE) },
+    { MP_ROM_QSTR(MP_QSTR_DITHER), MP_ROM_INT(GRAPHICS_TRANSITION_DITHER) },
 };
 static MP_DEFINE_CONST_DICT(graphics_module_globals, graphics_module_globals_table);
 
@@ -46,6 +46,13 @@ typedef struct _mp_graphics_typer_obj_t {
 extern const mp_obj_type_t mp_graphics_typer_type;
 extern const mp_obj_type_t mp_graphics_sprite_type;
 
+// Graphics.transition kinds
+#define GRAPHICS_TRANSITION_SLIDE (0)
+#define GRAPHICS_TRANSITION_WIPE (1)
+#define GRAPHICS_TRANSITION_DITHER (2)
+
+MP_DECLARE_CONST_FUN_OBJ_KW(graphics_transition_obj);
+
 void graphics_sprite_copy_from_helper(
     uint8_t x, uint8_t y,
     uint8_t destWidth, uint8_t destHeight, uint8_t destOffX, uint8_t destOffY, uint8_t destStride, uint8_t* destBuffer,
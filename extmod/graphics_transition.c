@@ -0,0 +1,191 @@
+#include <string.h>
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/runtime.h"
+#include "graphics.h"
+#include "py/obj.h"
+#include "extmod/modmachine.h"
+
+// Transitions between two pre-rendered frames, composed column by column straight into the
+// display buffer. Every frame is sent from here too (over I2C, or through a callable), so a
+// whole slide costs a single call from Python instead of one redraw and one display() per step.
+
+// Bayer 4x4 ordered dither, threshold by (x&3, y&3), in 0..15
+static const uint8_t graphics_transition_bayer[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+// Helpers ==============================================================================================
+static mp_graphics_sprite_obj_t *graphics_transition_get_sprite(mp_obj_t obj){
+    // SSD1306 and the like subclass Sprite in Python, so look for the native part
+    mp_obj_t native = mp_obj_cast_to_native_base(obj, MP_OBJ_FROM_PTR(&mp_graphics_sprite_type));
+    if(native==MP_OBJ_NULL) mp_raise_ValueError(MP_ERROR_TEXT("Invalid source object"));
+    return (mp_graphics_sprite_obj_t*) MP_OBJ_TO_PTR(native);
+}
+
+// Only the machine I2C types carry an mp_machine_i2c_p_t protocol; streams have one of their own
+static bool graphics_transition_is_i2c(mp_obj_t obj){
+    #if MICROPY_PY_MACHINE_I2C
+    if(mp_obj_is_type(obj, &machine_i2c_type)) return true;
+    #endif
+    #if MICROPY_PY_MACHINE_SOFTI2C
+    if(mp_obj_is_type(obj, &mp_machine_soft_i2c_type)) return true;
+    #endif
+    (void)obj;
+    return false;
+}
+
+static inline uint64_t graphics_transition_get_column(mp_graphics_sprite_obj_t *s, int x){
+    uint64_t col = 0;
+    memcpy(&col, s->buffer + s->stride*(x+s->offsetX), s->stride>8?8:s->stride);
+    return col>>s->offsetY;
+}
+
+// Pixels of a column taken from the new frame, at a dither level of 0..16
+static inline uint64_t graphics_transition_dither_mask(int x, int level){
+    uint64_t pattern = 0;
+    for(int y=0; y<4; y++){
+        if(graphics_transition_bayer[y][x&3]<level) pattern |= 1ULL<<y;
+    }
+    return pattern*0x1111111111111111ULL;
+}
+
+// Composes one frame in dest, from step out of steps; only the columns in [x0, x1) change
+static void graphics_transition_compose(
+    mp_graphics_sprite_obj_t *dest, mp_graphics_sprite_obj_t *from, mp_graphics_sprite_obj_t *to,
+    int kind, int direction, int step, int steps, int x0, int x1
+){
+    int band = x1-x0;
+    int shift = band*step/steps;
+    int level = 16*step/steps;
+    uint8_t bytes = dest->stride>8?8:dest->stride;
+    // the rows of dest, the bits around them (other sprites sharing the buffer) are kept
+    uint64_t rows = (dest->height>=64 ? ~0ULL : (1ULL<<dest->height)-1)<<dest->offsetY;
+    for(int x=x0; x<x1; x++){
+        uint64_t col;
+        int i = x-x0;
+        switch(kind){
+        case GRAPHICS_TRANSITION_SLIDE:
+            // direction>0: the content moves left and the new frame comes from the right
+            if(direction>0){
+                col = (i+shift<band) ? graphics_transition_get_column(from, x+shift) : graphics_transition_get_column(to, x+shift-band);
+            } else {
+                col = (i-shift>=0) ? graphics_transition_get_column(from, x-shift) : graphics_transition_get_column(to, x-shift+band);
+            }
+            break;
+        case GRAPHICS_TRANSITION_WIPE:
+            if(direction>0) col = graphics_transition_get_column(i<shift ? to : from, x);
+            else col = graphics_transition_get_column((band-i)<=shift ? to : from, x);
+            break;
+        default:{ // GRAPHICS_TRANSITION_DITHER
+            uint64_t mask = graphics_transition_dither_mask(x, level);
+            col = (graphics_transition_get_column(to, x)&mask) | (graphics_transition_get_column(from, x)&~mask);
+            break;
+        }
+        }
+        uint8_t *ptr = dest->buffer + dest->stride*(x+dest->offsetX);
+        uint64_t old = 0;
+        memcpy(&old, ptr, bytes);
+        col = (old&~rows) | ((col<<dest->offsetY)&rows);
+        memcpy(ptr, &col, bytes);
+    }
+}
+
+// Main methods =====================================================================
+static mp_obj_t graphics_transition(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_dest, ARG_from, ARG_to, ARG_kind, ARG_steps, ARG_direction, ARG_x, ARG_width, ARG_send, ARG_i2c, ARG_addr, ARG_setup, ARG_header };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_dest, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_from, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_to, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_kind, MP_ARG_INT, {.u_int = GRAPHICS_TRANSITION_SLIDE} },
+        { MP_QSTR_steps, MP_ARG_INT, {.u_int = 8} },
+        { MP_QSTR_direction, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
+        { MP_QSTR_x, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_width, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_send, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_i2c, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_addr, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 60} },
+        { MP_QSTR_setup, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_header, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0x40} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_graphics_sprite_obj_t *dest = graphics_transition_get_sprite(args[ARG_dest].u_obj);
+    mp_graphics_sprite_obj_t *from = graphics_transition_get_sprite(args[ARG_from].u_obj);
+    mp_graphics_sprite_obj_t *to = graphics_transition_get_sprite(args[ARG_to].u_obj);
+    int kind = args[ARG_kind].u_int;
+    int steps = args[ARG_steps].u_int;
+    int direction = args[ARG_direction].u_int;
+    int x0 = args[ARG_x].u_int;
+    int x1 = args[ARG_width].u_obj==mp_const_none ? dest->width : x0+mp_obj_get_int(args[ARG_width].u_obj);
+
+    if(dest->raw!=NULL || dest->width==0){
+        mp_raise_TypeError(MP_ERROR_TEXT("Destination must be a buffered Sprite!"));
+    }
+    if(from->width!=dest->width || from->height!=dest->height || to->width!=dest->width || to->height!=dest->height){
+        mp_raise_ValueError(MP_ERROR_TEXT("Frames must match the destination size!"));
+    }
+    if(dest->height>64){
+        mp_raise_ValueError(MP_ERROR_TEXT("Transitions are limited to 64 lines!"));
+    }
+    if(kind<GRAPHICS_TRANSITION_SLIDE || kind>GRAPHICS_TRANSITION_DITHER){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid transition!"));
+    }
+    if(steps<1 || x0<0 || x1>dest->width || x1<=x0){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid transition range!"));
+    }
+
+    // The sink: an I2C bus gets the setup bytes then header+buffer as one transfer, without going
+    // through Python; otherwise send() is called after every frame
+    mp_obj_base_t *i2c = NULL;
+    mp_buffer_info_t setup = {.buf = NULL, .len = 0};
+    if(args[ARG_i2c].u_obj!=mp_const_none){
+        if(!graphics_transition_is_i2c(args[ARG_i2c].u_obj)){
+            mp_raise_ValueError(MP_ERROR_TEXT("Invalid I2C object!"));
+        }
+        i2c = (mp_obj_base_t*) MP_OBJ_TO_PTR(args[ARG_i2c].u_obj);
+        if(args[ARG_setup].u_obj!=mp_const_none){
+            mp_get_buffer_raise(args[ARG_setup].u_obj, &setup, MP_BUFFER_READ);
+        }
+    }
+    mp_obj_t send = args[ARG_send].u_obj;
+    // one header+frame buffer for the whole transition, so ports with single-buffer transfers
+    // don't allocate and join the two on every frame
+    size_t frame_len = dest->stride*dest->width;
+    uint8_t *frame = i2c==NULL ? NULL : m_new(uint8_t, frame_len+1);
+    if(frame!=NULL) frame[0] = args[ARG_header].u_int;
+
+    for(int step=1; step<=steps; step++){
+        graphics_transition_compose(dest, from, to, kind, direction, step, steps, x0, x1);
+        #if MICROPY_PY_MACHINE_I2C || MICROPY_PY_MACHINE_SOFTI2C
+        if(i2c!=NULL){
+            mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(i2c->type, protocol);
+            int ret = 0;
+            if(setup.len>0){
+                mp_machine_i2c_buf_t buf = {.len = setup.len, .buf = (uint8_t*)setup.buf};
+                ret = i2c_p->transfer(i2c, args[ARG_addr].u_int, 1, &buf, MP_MACHINE_I2C_FLAG_STOP);
+            }
+            if(ret>=0){
+                memcpy(frame+1, dest->buffer, frame_len);
+                mp_machine_i2c_buf_t buf = {.len = frame_len+1, .buf = frame};
+                ret = i2c_p->transfer(i2c, args[ARG_addr].u_int, 1, &buf, MP_MACHINE_I2C_FLAG_STOP);
+            }
+            if(ret<0){
+                m_del(uint8_t, frame, frame_len+1);
+                mp_raise_OSError(-ret);
+            }
+        } else
+        #endif
+        if(send!=mp_const_none){
+            mp_call_function_0(send);
+        }
+    }
+    if(frame!=NULL) m_del(uint8_t, frame, frame_len+1);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(graphics_transition_obj, 3, graphics_transition);
@@ -25,7 +25,10 @@
  * THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include "py/mphal.h"
+#include "py/objtuple.h"
 #include "py/runtime.h"
 #include "py/smallint.h"
 #include "extmod/modtime.h"
@@ -36,9 +39,11 @@
 #include MICROPY_PY_TIME_INCLUDEFILE
 #endif
 
-#if MICROPY_PY_TIME_GMTIME_LOCALTIME_MKTIME
-
+#if MICROPY_PY_TIME_GMTIME_LOCALTIME_MKTIME || MICROPY_PY_TIME_NORMALIZE
 #include "shared/timeutils/timeutils.h"
+#endif
+
+#if MICROPY_PY_TIME_GMTIME_LOCALTIME_MKTIME
 
 // localtime([secs])
 // Convert a time expressed in seconds since the Epoch into an 8-tuple which
@@ -98,6 +103,107 @@ MP_DEFINE_CONST_FUN_OBJ_1(mp_time_mktime_obj, time_mktime);
 
 #endif // MICROPY_PY_TIME_GMTIME_LOCALTIME_MKTIME
 
+#if MICROPY_PY_TIME_NORMALIZE
+
+// More days than 65536 years hold; a larger mday can't land in range.
+#define TIME_NORMALIZE_MAX_DAYS (65536 * 366)
+
+// Carries the fields of a time tuple/list over into each other, after adding
+// delta seconds. Everything is plain arithmetic on a day count, so the cost
+// doesn't depend on how far out of range the fields are, and a list is
+// updated in place without allocating.
+static mp_obj_t time_normalize_helper(mp_obj_t t, mp_int_t delta) {
+    size_t len;
+    mp_obj_t *elem;
+    mp_obj_get_array(t, &len, &elem);
+
+    // (year, month, mday, hour, minute, second[, weekday, yearday[, isdst]])
+    if (len < 6 || len > 9) {
+        mp_raise_TypeError(MP_ERROR_TEXT("time tuple needs 6 to 9 fields"));
+    }
+
+    mp_int_t seconds = mp_obj_get_int(elem[5]) + delta;
+    mp_int_t minutes = mp_obj_get_int(elem[4]) + seconds / 60;
+    if ((seconds = seconds % 60) < 0) {
+        seconds += 60;
+        minutes--;
+    }
+    mp_int_t hours = mp_obj_get_int(elem[3]) + minutes / 60;
+    if ((minutes = minutes % 60) < 0) {
+        minutes += 60;
+        hours--;
+    }
+    mp_int_t mday = mp_obj_get_int(elem[2]) + hours / 24;
+    if ((hours = hours % 24) < 0) {
+        hours += 24;
+        mday--;
+    }
+
+    // tm_year is a uint16_t, so the carried year has to stay in [0, 65535].
+    // Bounding year and mday first also keeps the day count within 32 bits.
+    mp_int_t year = mp_obj_get_int(elem[0]);
+    mp_int_t month = mp_obj_get_int(elem[1]) - 1;
+    if (year < -TIME_NORMALIZE_MAX_DAYS || year > TIME_NORMALIZE_MAX_DAYS) {
+        mp_raise_msg(&mp_type_OverflowError, MP_ERROR_TEXT("year out of range"));
+    }
+    year += month / 12;
+    if ((month = month % 12) < 0) {
+        month += 12;
+        year--;
+    }
+    if (year < 0 || year > 0xffff || mday < -TIME_NORMALIZE_MAX_DAYS || mday > TIME_NORMALIZE_MAX_DAYS) {
+        mp_raise_msg(&mp_type_OverflowError, MP_ERROR_TEXT("year out of range"));
+    }
+    mp_int_t days = timeutils_days_since_2000(year, month + 1, mday);
+    if (days < timeutils_days_since_2000(0, 1, 1) || days > timeutils_days_since_2000(0xffff, 12, 31)) {
+        mp_raise_msg(&mp_type_OverflowError, MP_ERROR_TEXT("year out of range"));
+    }
+
+    timeutils_struct_time_t tm;
+    timeutils_days_since_2000_to_struct_time(days, &tm);
+
+    mp_obj_t fields[8] = {
+        MP_OBJ_NEW_SMALL_INT(tm.tm_year),
+        MP_OBJ_NEW_SMALL_INT(tm.tm_mon),
+        MP_OBJ_NEW_SMALL_INT(tm.tm_mday),
+        MP_OBJ_NEW_SMALL_INT(hours),
+        MP_OBJ_NEW_SMALL_INT(minutes),
+        MP_OBJ_NEW_SMALL_INT(seconds),
+        MP_OBJ_NEW_SMALL_INT(tm.tm_wday),
+        MP_OBJ_NEW_SMALL_INT(tm.tm_yday),
+    };
+    size_t n = len < 8 ? len : 8;
+    if (mp_obj_is_type(t, &mp_type_list)) {
+        // isdst, if given, is kept as is
+        memcpy(elem, fields, n * sizeof(mp_obj_t));
+        return t;
+    }
+    mp_obj_tuple_t *tuple = MP_OBJ_TO_PTR(mp_obj_new_tuple(len, elem));
+    memcpy(tuple->items, fields, n * sizeof(mp_obj_t));
+    return MP_OBJ_FROM_PTR(tuple);
+}
+
+// normalize(t)
+// Brings every field of t (as per localtime, 6 to 9 fields) back in range:
+// month 13 becomes January of the next year, mday 0 the last day of the
+// previous month, second 90 a minute and a half, and so on. weekday and
+// yearday, when present, are recomputed. A list is updated in place and
+// returned; a tuple gives a new tuple. OverflowError is raised when the
+// year would leave [0, 65535].
+static mp_obj_t time_normalize(mp_obj_t t) {
+    return time_normalize_helper(t, 0);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mp_time_normalize_obj, time_normalize);
+
+// add(t, seconds)
+// Like normalize(), after adding seconds (which may be negative) to t.
+static mp_obj_t time_add(mp_obj_t t, mp_obj_t seconds) {
+    return time_normalize_helper(t, mp_obj_get_int(seconds));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(mp_time_add_obj, time_add);
+
+#endif // MICROPY_PY_TIME_NORMALIZE
+
 #if MICROPY_PY_TIME_TIME_TIME_NS
 
 // time()
@@ -205,6 +311,11 @@ static const mp_rom_map_elem_t mp_module_time_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_mktime), MP_ROM_PTR(&mp_time_mktime_obj) },
     #endif
 
+    #if MICROPY_PY_TIME_NORMALIZE
+    { MP_ROM_QSTR(MP_QSTR_normalize), MP_ROM_PTR(&mp_time_normalize_obj) },
+    { MP_ROM_QSTR(MP_QSTR_add), MP_ROM_PTR(&mp_time_add_obj) },
+    #endif
+
     #if MICROPY_PY_TIME_TIME_TIME_NS
     { MP_ROM_QSTR(MP_QSTR_time), MP_ROM_PTR(&mp_time_time_obj) },
     { MP_ROM_QSTR(MP_QSTR_time_ns), MP_ROM_PTR(&mp_time_time_ns_obj) },
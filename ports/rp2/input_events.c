@@ -0,0 +1,414 @@
+#include <string.h>
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/stream.h"
+#include "input_events.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+#ifndef ALARM_ID_INVALID
+#define ALARM_ID_INVALID (-1)
+#endif
+
+// Input events =======================================================================================
+// Buttons debounced in the interruptions: the first edge of a button is taken right away (reaction
+// within the interrupt latency), then its edges are ignored for debounce_us, after which the pin is
+// sampled again to catch a change that happened during the lockout. One alarm does the end of the
+// lockouts and the auto repeat, and only runs while a button is held or locked: an idle keypad
+// costs no CPU at all. Events go into a ring, read by get_event() (blocking, sleeps in WFE) or as a
+// stream (select/asyncio). Everything runs on core0, whatever the Triac real-time engine does.
+
+static input_buttons_obj_t input_singleton = {
+    .base = {&input_buttons_type},
+    .count = 0,
+    .alarm = ALARM_ID_INVALID,
+};
+
+static inline uint8_t input_sample(uint8_t index) {
+    return gpio_get(input_singleton.pins[index]) != input_singleton.active_low;
+}
+
+static void input_push(uint8_t kind, uint8_t buttons, uint64_t now) {
+    // Producer side, interruptions only. A full ring drops the new event.
+    uint32_t head = input_singleton.head;
+    if(head-input_singleton.tail>=INPUT_EVENTS){
+        input_singleton.dropped++;
+        return;
+    }
+    input_event_t *event = &input_singleton.events[head&(INPUT_EVENTS-1)];
+    event->timestamp_ms = now/1000;
+    event->kind = kind;
+    event->buttons = buttons;
+    event->held = input_singleton.held;
+    event->reserved = 0;
+    __dmb();
+    input_singleton.head = head+1;
+    __sev(); // wakes get_event() out of WFE
+}
+
+static void input_change(uint8_t index, uint8_t pressed, uint64_t now) {
+    uint8_t bit = 1<<index;
+    if(pressed){
+        input_singleton.held |= bit;
+        if(input_singleton.held==bit){
+            input_singleton.chord = 0;
+            input_singleton.repeat_at = now+input_singleton.repeat_delay_us;
+            input_push(INPUT_PRESS, bit, now);
+        }else{
+            input_singleton.chord = 1;
+            input_push(INPUT_CHORD, input_singleton.held, now);
+        }
+    }else{
+        input_singleton.held &= ~bit;
+        if(input_singleton.held==0) input_singleton.chord = 0;
+        input_push(INPUT_RELEASE, bit, now);
+    }
+    // locked out from now, the alarm samples it again at the end
+    input_singleton.locked |= bit;
+    input_singleton.unlock[index] = now+input_singleton.debounce_us;
+}
+
+static uint8_t input_repeating(void) {
+    uint8_t held = input_singleton.held;
+    return input_singleton.repeat_delay_us && !input_singleton.chord && held && !(held&(held-1));
+}
+
+static int64_t input_irq_tick(alarm_id_t id, void *user_data) {
+    uint64_t now = time_us_64();
+    uint64_t next = UINT64_MAX;
+    for(uint8_t i=0; i<input_singleton.count; i++){
+        uint8_t bit = 1<<i;
+        if(!(input_singleton.locked&bit)) continue;
+        if(now>=input_singleton.unlock[i]){
+            input_singleton.locked &= ~bit;
+            uint8_t pressed = input_sample(i);
+            if(pressed!=((input_singleton.held>>i)&1)) input_change(i, pressed, now);
+        }
+        if((input_singleton.locked&bit) && input_singleton.unlock[i]<next) next = input_singleton.unlock[i];
+    }
+    if(input_repeating()){
+        if(now>=input_singleton.repeat_at){
+            input_push(INPUT_REPEAT, input_singleton.held, now);
+            input_singleton.repeat_at += input_singleton.repeat_us;
+            if(input_singleton.repeat_at<=now) input_singleton.repeat_at = now+input_singleton.repeat_us;
+        }
+        if(input_singleton.repeat_at<next) next = input_singleton.repeat_at;
+    }
+    if(next==UINT64_MAX){
+        input_singleton.alarm = ALARM_ID_INVALID;
+        return 0;
+    }
+    if(next<now+100) next = now+100;
+    input_singleton.alarm_at = next;
+    return next-now;
+}
+
+static void input_schedule(uint64_t at) {
+    // Edges and the alarm are both core0 interruptions at the same level: no overlap. A pending
+    // alarm later than that (the next repeat) is brought forward.
+    if(input_singleton.alarm!=ALARM_ID_INVALID){
+        if(input_singleton.alarm_at<=at) return;
+        cancel_alarm(input_singleton.alarm);
+    }
+    alarm_id_t alarm = add_alarm_at(from_us_since_boot(at), input_irq_tick, NULL, true);
+    input_singleton.alarm = (alarm>0) ? alarm : ALARM_ID_INVALID;
+    input_singleton.alarm_at = at;
+}
+
+static void input_gpio_irq_listener(void) {
+    // Runs before machine.Pin's handler, which acknowledges whatever is left
+    io_bank0_irq_ctrl_hw_t *irq_ctrl_base = get_core_num() ? &io_bank0_hw->proc1_irq_ctrl : &io_bank0_hw->proc0_irq_ctrl;
+    uint64_t now = 0;
+    for(uint8_t i=0; i<input_singleton.count; i++){
+        uint8_t gpio = input_singleton.pins[i];
+        uint32_t events = (irq_ctrl_base->ints[gpio>>3u]>>(4*(gpio&7)))&0xfu;
+        if(events==0) continue;
+        gpio_acknowledge_irq(gpio, events);
+        if(input_singleton.locked&(1<<i)) continue;
+        if(now==0) now = time_us_64();
+        uint8_t pressed = input_sample(i);
+        if(pressed!=((input_singleton.held>>i)&1)){
+            input_change(i, pressed, now);
+        }
+    }
+    if(now!=0 && input_singleton.locked){
+        input_schedule(now+input_singleton.debounce_us);
+    }
+}
+
+static void input_stop(void) {
+    for(uint8_t i=0; i<input_singleton.count; i++){
+        gpio_set_irq_enabled(input_singleton.pins[i], GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false);
+    }
+    if(input_singleton.count){
+        irq_remove_handler(IO_IRQ_BANK0, input_gpio_irq_listener);
+    }
+    if(input_singleton.alarm!=ALARM_ID_INVALID){
+        cancel_alarm(input_singleton.alarm);
+        input_singleton.alarm = ALARM_ID_INVALID;
+    }
+    input_singleton.count = 0;
+    input_singleton.held = 0;
+    input_singleton.locked = 0;
+    input_singleton.chord = 0;
+}
+
+void input_events_deinit(void) {
+    // Soft reset, before machine.Pin's handler goes away
+    input_stop();
+    input_singleton.head = 0;
+    input_singleton.tail = 0;
+    input_singleton.dropped = 0;
+}
+
+// General configs ======================================================================================
+
+static void mp_input_buttons_init_helper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_pins, ARG_debounce_ms, ARG_repeat_delay_ms, ARG_repeat_ms, ARG_active_low, ARG_pull };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_pins,            MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_debounce_ms,     MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 20} },
+        { MP_QSTR_repeat_delay_ms, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1000} },
+        { MP_QSTR_repeat_ms,       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 150} },
+        { MP_QSTR_active_low,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_pull,            MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    size_t count;
+    mp_obj_t *items;
+    mp_obj_get_array(args[ARG_pins].u_obj, &count, &items);
+    if(count==0 || count>INPUT_MAX_BUTTONS){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid number of pins!"));
+    }
+    uint8_t pins[INPUT_MAX_BUTTONS];
+    for(size_t i=0; i<count; i++){
+        pins[i] = mp_hal_get_pin_obj(items[i]);
+        for(size_t j=0; j<i; j++){
+            if(pins[j]==pins[i]) mp_raise_ValueError(MP_ERROR_TEXT("Repeated pin!"));
+        }
+    }
+    if(args[ARG_debounce_ms].u_int<1 || args[ARG_debounce_ms].u_int>1000){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid debounce!"));
+    }
+    if(args[ARG_repeat_delay_ms].u_int<0 || args[ARG_repeat_delay_ms].u_int>60000 ||
+        args[ARG_repeat_ms].u_int<10 || args[ARG_repeat_ms].u_int>60000){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid repeat!"));
+    }
+
+    uint32_t state = save_and_disable_interrupts();
+    input_stop();
+    restore_interrupts(state);
+    input_singleton.debounce_us = args[ARG_debounce_ms].u_int*1000;
+    input_singleton.repeat_delay_us = args[ARG_repeat_delay_ms].u_int*1000;
+    input_singleton.repeat_us = args[ARG_repeat_ms].u_int*1000;
+    input_singleton.active_low = args[ARG_active_low].u_bool;
+    for(size_t i=0; i<count; i++){
+        uint8_t pin = pins[i];
+        input_singleton.pins[i] = pin;
+        gpio_init(pin);
+        gpio_set_dir(pin, GPIO_IN);
+        if(args[ARG_pull].u_bool){
+            gpio_set_pulls(pin, input_singleton.active_low, !input_singleton.active_low);
+        }else{
+            gpio_disable_pulls(pin);
+        }
+    }
+
+    // Buttons held at start count as held, with no event
+    mp_hal_delay_us(10); // pulls settle
+    state = save_and_disable_interrupts();
+    input_singleton.count = count;
+    for(size_t i=0; i<count; i++){
+        if(input_sample(i)) input_singleton.held |= 1<<i;
+        gpio_acknowledge_irq(pins[i], GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE);
+    }
+    input_singleton.chord = (input_singleton.held!=0); // no repeat for those
+    irq_add_shared_handler(IO_IRQ_BANK0, input_gpio_irq_listener, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY+10);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+    for(size_t i=0; i<count; i++){
+        gpio_set_irq_enabled(pins[i], GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true);
+    }
+    restore_interrupts(state);
+}
+
+static mp_obj_t mp_input_buttons_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    // A single set of buttons, owning its pins until close() or soft reset
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+    mp_input_buttons_init_helper(n_args, args, &kw_args);
+    return MP_OBJ_FROM_PTR(&input_singleton);
+}
+
+static void mp_input_buttons_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mp_printf(print, "Buttons(pins=(");
+    for(uint8_t i=0; i<input_singleton.count; i++){
+        mp_printf(print, i ? ", %u" : "%u", input_singleton.pins[i]);
+    }
+    mp_printf(print, "), debounce_ms=%u, held=0x%02x)", (unsigned)(input_singleton.debounce_us/1000), input_singleton.held);
+}
+
+static mp_obj_t mp_input_buttons_init(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    mp_input_buttons_init_helper(n_args - 1, args + 1, kw_args);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(input_buttons_init_obj, 1, mp_input_buttons_init);
+
+static mp_obj_t mp_input_buttons_close(mp_obj_t self_in) {
+    // Releases the pin interruptions, the events still queued stay readable
+    uint32_t state = save_and_disable_interrupts();
+    input_stop();
+    restore_interrupts(state);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(input_buttons_close_obj, mp_input_buttons_close);
+
+// Main methods =====================================================================================
+static mp_obj_t input_buttons_event_tuple(const input_event_t *event) {
+    mp_obj_t tuple[4] = {
+        MP_OBJ_NEW_SMALL_INT(event->kind),
+        MP_OBJ_NEW_SMALL_INT(event->buttons),
+        MP_OBJ_NEW_SMALL_INT(event->held),
+        mp_obj_new_int_from_uint(event->timestamp_ms),
+    };
+    return mp_obj_new_tuple(4, tuple);
+}
+
+static uint8_t input_buttons_pop(input_event_t *event) {
+    // Consumer side, the interpreter only
+    uint32_t tail = input_singleton.tail;
+    if(input_singleton.head==tail) return 0;
+    __dmb();
+    *event = input_singleton.events[tail&(INPUT_EVENTS-1)];
+    __dmb();
+    input_singleton.tail = tail+1;
+    return 1;
+}
+
+static mp_obj_t input_buttons_get_event(size_t n_args, const mp_obj_t *args) {
+    // (kind, buttons, held, timestamp_ms), or None after timeout_ms (-1: no timeout, 0: no wait)
+    mp_int_t timeout_ms = (n_args==2 && args[1]!=mp_const_none) ? mp_obj_get_int(args[1]) : -1;
+    mp_uint_t start = mp_hal_ticks_ms();
+    input_event_t event;
+    for(;;){
+        if(input_buttons_pop(&event)) return input_buttons_event_tuple(&event);
+        if(timeout_ms<0){
+            mp_event_wait_indefinite();
+        }else{
+            mp_uint_t elapsed = mp_hal_ticks_ms()-start;
+            if(elapsed>=(mp_uint_t)timeout_ms) return mp_const_none;
+            mp_event_wait_ms(timeout_ms-elapsed);
+        }
+    }
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(input_buttons_get_event_obj, 1, 2, input_buttons_get_event);
+
+static mp_obj_t input_buttons_held(mp_obj_t self_obj) {
+    return MP_OBJ_NEW_SMALL_INT(input_singleton.held);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(input_buttons_held_obj, input_buttons_held);
+
+static mp_obj_t input_buttons_any(mp_obj_t self_obj) {
+    return mp_obj_new_int_from_uint(input_singleton.head-input_singleton.tail);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(input_buttons_any_obj, input_buttons_any);
+
+static mp_obj_t input_buttons_clear(mp_obj_t self_obj) {
+    input_singleton.tail = input_singleton.head;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(input_buttons_clear_obj, input_buttons_clear);
+
+static mp_obj_t input_buttons_dropped(mp_obj_t self_obj) {
+    return mp_obj_new_int_from_uint(input_singleton.dropped);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(input_buttons_dropped_obj, input_buttons_dropped);
+
+// Stream ===========================================================================================
+static mp_uint_t input_buttons_stream_read(mp_obj_t self_in, void *buf_in, mp_uint_t size, int *errcode) {
+    // Whole events, struct "<IBBBx", never blocks
+    if(size<sizeof(input_event_t)){
+        *errcode = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+    input_event_t *buf = buf_in;
+    mp_uint_t count = 0;
+    while(count<size/sizeof(input_event_t) && input_buttons_pop(&buf[count])){
+        count++;
+    }
+    if(count==0){
+        *errcode = MP_EAGAIN;
+        return MP_STREAM_ERROR;
+    }
+    return count*sizeof(input_event_t);
+}
+
+static mp_uint_t input_buttons_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    if(request==MP_STREAM_POLL){
+        mp_uint_t ret = 0;
+        if((arg&MP_STREAM_POLL_RD) && input_singleton.head!=input_singleton.tail){
+            ret |= MP_STREAM_POLL_RD;
+        }
+        return ret;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+static const mp_stream_p_t input_buttons_stream_p = {
+    .read = input_buttons_stream_read,
+    .ioctl = input_buttons_stream_ioctl,
+    .is_text = false,
+};
+
+static const mp_rom_map_elem_t input_buttons_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_init), MP_ROM_PTR(&input_buttons_init_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&input_buttons_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_get_event), MP_ROM_PTR(&input_buttons_get_event_obj) },
+    { MP_ROM_QSTR(MP_QSTR_held), MP_ROM_PTR(&input_buttons_held_obj) },
+    { MP_ROM_QSTR(MP_QSTR_any), MP_ROM_PTR(&input_buttons_any_obj) },
+    { MP_ROM_QSTR(MP_QSTR_clear), MP_ROM_PTR(&input_buttons_clear_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dropped), MP_ROM_PTR(&input_buttons_dropped_obj) },
+    // Stream
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    // Event kinds
+    { MP_ROM_QSTR(MP_QSTR_PRESS), MP_ROM_INT(INPUT_PRESS) },
+    { MP_ROM_QSTR(MP_QSTR_RELEASE), MP_ROM_INT(INPUT_RELEASE) },
+    { MP_ROM_QSTR(MP_QSTR_REPEAT), MP_ROM_INT(INPUT_REPEAT) },
+    { MP_ROM_QSTR(MP_QSTR_CHORD), MP_ROM_INT(INPUT_CHORD) },
+    { MP_ROM_QSTR(MP_QSTR_EVENT_SIZE), MP_ROM_INT(sizeof(input_event_t)) },
+};
+static MP_DEFINE_CONST_DICT(input_buttons_locals_dict, input_buttons_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    input_buttons_type,
+    MP_QSTR_Buttons,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_input_buttons_make_new,
+    print, mp_input_buttons_print,
+    protocol, &input_buttons_stream_p,
+    locals_dict, &input_buttons_locals_dict
+    );
+
+// Module ===========================================================================================
+static const mp_rom_map_elem_t input_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_Input) },
+    { MP_ROM_QSTR(MP_QSTR_Buttons), MP_ROM_PTR(&input_buttons_type) },
+    { MP_ROM_QSTR(MP_QSTR_PRESS), MP_ROM_INT(INPUT_PRESS) },
+    { MP_ROM_QSTR(MP_QSTR_RELEASE), MP_ROM_INT(INPUT_RELEASE) },
+    { MP_ROM_QSTR(MP_QSTR_REPEAT), MP_ROM_INT(INPUT_REPEAT) },
+    { MP_ROM_QSTR(MP_QSTR_CHORD), MP_ROM_INT(INPUT_CHORD) },
+};
+static MP_DEFINE_CONST_DICT(input_module_globals, input_module_globals_table);
+
+const mp_obj_module_t mp_module_input = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t *)&input_module_globals,
+};
+
+MP_REGISTER_MODULE(MP_QSTR_Input, mp_module_input);
@@ -0,0 +1,53 @@
+#ifndef MICROPY_INCLUDED_RP2_INPUT_EVENTS_H
+#define MICROPY_INCLUDED_RP2_INPUT_EVENTS_H
+
+#include <stdint.h>
+#include "py/obj.h"
+#include "pico/time.h"
+
+#define INPUT_MAX_BUTTONS (8)
+#define INPUT_EVENTS (32) // ring size, power of 2
+
+// Event kinds
+#define INPUT_PRESS (1) // a button went down, with no other held
+#define INPUT_RELEASE (2)
+#define INPUT_REPEAT (3) // a single button still held, after repeat_delay_ms then every repeat_ms
+#define INPUT_CHORD (4) // a button went down while others were held, buttons is the whole set
+
+// Packed as read from the stream: struct format "<IBBBx"
+typedef struct _input_event_t {
+    uint32_t timestamp_ms;
+    uint8_t kind;
+    uint8_t buttons; // mask, bit i is the button at pins[i]
+    uint8_t held; // mask of the buttons held after the event
+    uint8_t reserved;
+} input_event_t;
+
+typedef struct _input_buttons_obj_t {
+    mp_obj_base_t base;
+    uint8_t count; // 0: closed
+    uint8_t pins[INPUT_MAX_BUTTONS];
+    uint8_t active_low;
+    uint32_t debounce_us;
+    uint32_t repeat_delay_us; // 0: no repeat
+    uint32_t repeat_us;
+    // interruption side: debounced state, and the buttons locked out after a change
+    volatile uint8_t held;
+    volatile uint8_t locked;
+    uint8_t chord; // set by a chord, until all the buttons are released
+    uint64_t unlock[INPUT_MAX_BUTTONS];
+    uint64_t repeat_at;
+    volatile alarm_id_t alarm;
+    uint64_t alarm_at;
+    // single-producer (interruptions) single-consumer ring
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+    input_event_t events[INPUT_EVENTS];
+} input_buttons_obj_t;
+
+extern const mp_obj_type_t input_buttons_type;
+
+void input_events_deinit(void);
+
+#endif // MICROPY_INCLUDED_RP2_INPUT_EVENTS_H
@@ -28,6 +28,8 @@
 #include "py/mphal.h"
 #include "py/mperrno.h"
 #include "extmod/modmachine.h"
+#include "modmachine.h"
+#include "modrp2.h"
 
 #include "hardware/i2c.h"
 
@@ -151,6 +153,13 @@ mp_obj_t machine_i2c_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 static int machine_i2c_transfer_single(mp_obj_base_t *self_in, uint16_t addr, size_t len, uint8_t *buf, unsigned int flags) {
     machine_i2c_obj_t *self = (machine_i2c_obj_t *)self_in;
     int ret;
+    // Transactions queued with rp2.I2CQueue go first, a stuck one aborts the queue.
+    ret = rp2_i2c_queue_wait_idle(self->i2c_id, self->timeout);
+    if (ret < 0) {
+        return ret;
+    }
+    // The SDK transfers busy-wait on the bus, counted apart by rp2.CPUAccounting.
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_I2C);
     bool nostop = !(flags & MP_MACHINE_I2C_FLAG_STOP);
     if (flags & MP_MACHINE_I2C_FLAG_READ) {
         ret = i2c_read_timeout_us(self->i2c_inst, addr, buf, len, nostop, self->timeout);
@@ -173,11 +182,13 @@ static int machine_i2c_transfer_single(mp_obj_base_t *self_in, uint16_t addr, si
             ret = mp_machine_soft_i2c_transfer(&soft_i2c.base, addr, 1, &bufs, flags);
             gpio_set_function(self->scl, GPIO_FUNC_I2C);
             gpio_set_function(self->sda, GPIO_FUNC_I2C);
+            rp2_cpu_exit(cpu);
             return ret;
         } else {
             ret = i2c_write_timeout_us(self->i2c_inst, addr, buf, len, nostop, self->timeout);
         }
     }
+    rp2_cpu_exit(cpu);
     if (ret < 0) {
         if (ret == PICO_ERROR_TIMEOUT) {
             return -MP_ETIMEDOUT;
@@ -189,6 +200,20 @@ static int machine_i2c_transfer_single(mp_obj_base_t *self_in, uint16_t addr, si
     }
 }
 
+// For rp2.I2CQueue, that runs its transactions on the bus of a machine.I2C object.
+int machine_i2c_get_id(mp_obj_t o) {
+    if (!mp_obj_is_type(o, &machine_i2c_type)) {
+        mp_raise_TypeError(MP_ERROR_TEXT("expecting an I2C object"));
+    }
+    machine_i2c_obj_t *self = MP_OBJ_TO_PTR(o);
+    return self->i2c_id;
+}
+
+uint32_t machine_i2c_get_timeout(mp_obj_t o) {
+    machine_i2c_obj_t *self = MP_OBJ_TO_PTR(o);
+    return self->timeout;
+}
+
 static const mp_machine_i2c_p_t machine_i2c_p = {
     .transfer = mp_machine_i2c_transfer_adaptor,
     .transfer_single = machine_i2c_transfer_single,
@@ -47,6 +47,7 @@
 #include "genhdr/mpversion.h"
 #include "mp_usbd.h"
 #include "triac.h"
+#include "input_events.h"
 
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
@@ -225,11 +226,17 @@ int main(int argc, char **argv) {
         MICROPY_BOARD_START_SOFT_RESET();
 
         triac_power_analyzer_deinit();
+        input_events_deinit();
+        rp2_bm8563_deinit();
+        rp2_idle_deinit();
+        rp2_cpu_deinit();
         #if MICROPY_PY_NETWORK
         mod_network_deinit();
         #endif
         machine_i2s_deinit_all();
+        rp2_i2c_queue_deinit();
         rp2_dma_deinit();
+        rp2_quad_encoder_deinit();
         rp2_pio_deinit();
         #if MICROPY_PY_BLUETOOTH
         mp_bluetooth_deinit();
@@ -260,12 +267,14 @@ int main(int argc, char **argv) {
 }
 
 void gc_collect(void) {
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_GC);
     gc_collect_start();
     gc_helper_collect_regs_and_stack();
     #if MICROPY_PY_THREAD
     mp_thread_gc_others();
     #endif
     gc_collect_end();
+    rp2_cpu_exit(cpu);
 }
 
 void nlr_jump_fail(void *val) {
@@ -11,5 +11,7 @@ void machine_pwm_deinit_all(void);
 void machine_uart_deinit_all(void);
 
 struct _machine_spi_obj_t *spi_from_mp_obj(mp_obj_t o);
+int machine_i2c_get_id(mp_obj_t o);
+uint32_t machine_i2c_get_timeout(mp_obj_t o);
 
 #endif // MICROPY_INCLUDED_RP2_MODMACHINE_H
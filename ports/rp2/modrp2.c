@@ -89,6 +89,11 @@ static const mp_rom_map_elem_t rp2_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_PIO),                 MP_ROM_PTR(&rp2_pio_type) },
     { MP_ROM_QSTR(MP_QSTR_StateMachine),        MP_ROM_PTR(&rp2_state_machine_type) },
     { MP_ROM_QSTR(MP_QSTR_DMA),                 MP_ROM_PTR(&rp2_dma_type) },
+    { MP_ROM_QSTR(MP_QSTR_QuadEncoder),         MP_ROM_PTR(&rp2_quad_encoder_type) },
+    { MP_ROM_QSTR(MP_QSTR_I2CQueue),            MP_ROM_PTR(&rp2_i2c_queue_type) },
+    { MP_ROM_QSTR(MP_QSTR_BM8563),              MP_ROM_PTR(&rp2_bm8563_type) },
+    { MP_ROM_QSTR(MP_QSTR_Idle),                MP_ROM_PTR(&rp2_idle_type) },
+    { MP_ROM_QSTR(MP_QSTR_CPUAccounting),       MP_ROM_PTR(&rp2_cpu_accounting_type) },
     { MP_ROM_QSTR(MP_QSTR_bootsel_button),      MP_ROM_PTR(&rp2_bootsel_button_obj) },
 
     #if MICROPY_PY_NETWORK_CYW43
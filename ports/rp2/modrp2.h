@@ -32,9 +32,36 @@ extern const mp_obj_type_t rp2_flash_type;
 extern const mp_obj_type_t rp2_pio_type;
 extern const mp_obj_type_t rp2_state_machine_type;
 extern const mp_obj_type_t rp2_dma_type;
+extern const mp_obj_type_t rp2_quad_encoder_type;
+extern const mp_obj_type_t rp2_i2c_queue_type;
+extern const mp_obj_type_t rp2_bm8563_type;
+extern const mp_obj_type_t rp2_idle_type;
+extern const mp_obj_type_t rp2_cpu_accounting_type;
 
 void rp2_pio_init(void);
 void rp2_pio_deinit(void);
+void rp2_quad_encoder_deinit(void);
+void rp2_i2c_queue_deinit(void);
+int rp2_i2c_queue_wait_idle(uint8_t id, uint32_t timeout_us);
+uint8_t rp2_i2c_queue_busy(void);
+void rp2_bm8563_deinit(void);
+void rp2_idle_deinit(void);
+
+// rp2.CPUAccounting sources: time between rp2_cpu_enter() and rp2_cpu_exit() goes to the source
+enum {
+    RP2_CPU_PYTHON,
+    RP2_CPU_GC,
+    RP2_CPU_IDLE,
+    RP2_CPU_I2C,
+    RP2_CPU_TRIAC,
+    RP2_CPU_ANALYZER,
+    RP2_CPU_PENDSV,
+    RP2_CPU_SOURCES
+};
+#define RP2_CPU_NONE (0xFF) // from rp2_cpu_enter() while disabled
+uint8_t rp2_cpu_enter(uint8_t source);
+void rp2_cpu_exit(uint8_t previous);
+void rp2_cpu_deinit(void);
 
 void rp2_dma_init(void);
 void rp2_dma_deinit(void);
@@ -0,0 +1,356 @@
+import asyncio
+import struct
+import time
+from micropython import const
+from menu import fix_datetime, print_center_x
+
+# Asyncio version of menu.py: the widgets are small state machines fed by an input task, and a
+# render task redraws the top one only when its state changed, at most fps times per second.
+# Everything else (regulation, logging, RTC sync) keeps running in its own tasks meanwhile.
+#
+#   ui = UI(display, font, events=Input.Buttons((left, right, ok, cancel)))
+#   ui.start()
+#   value = await ui.run(ValueInput(ui, 10, caption='temp'))
+
+LEFT = const(1)
+RIGHT = const(2)
+OK = const(3)
+CANCEL = const(4)
+
+_EVENT = "<IBBBx" # Input.Buttons events, as read from the stream
+_MASK_KEYS = {1: LEFT, 2: RIGHT, 4: OK, 8: CANCEL}
+
+
+class Widget():
+    # key() and tick() return True when the state changed, and a redraw is needed. A widget
+    # ends by calling finish(result).
+    def __init__(self, ui):
+        self.ui = ui
+        self.result = None
+        self._done = asyncio.Event()
+
+    def finish(self, result=None):
+        self.result = result
+        self._done.set()
+
+    def key(self, key, steps):
+        return False
+
+    def tick(self, ms):
+        return False
+
+    def draw(self, display):
+        pass
+
+
+class Message(Widget):
+    # Text until any key
+    def __init__(self, ui, text):
+        super().__init__(ui)
+        self._text = text
+
+    def key(self, key, steps):
+        self.finish()
+        return False
+
+    def draw(self, display):
+        self.ui.font.print(self._text, 0, 0)
+
+
+class GlyphMenu(Widget):
+    # Same screen as Menu.horizontal_glyph_menu, without the slide: the result is the index
+    # chosen with OK, None with CANCEL (unless no_back).
+    def __init__(self, ui, items, no_back=False, first_field=0):
+        super().__init__(ui)
+        self._items = items
+        self._no_back = no_back
+        self._index = first_field%len(items)
+        self._pressed = 0
+        self._layout = []
+        font = ui.font
+        for item in items:
+            cap_size = font.calculateSize(item[0]) # x, y, maxx
+            cap_y = ui.h-(cap_size[1]+font.lineHeight())
+            glyph = ui.glyph if (item[1] is None) else item[1]
+            self._layout.append((item[0], glyph, (ui.w-cap_size[2])//2, cap_y, (ui.w-glyph.width())//2, (cap_y-glyph.height())//2))
+
+    def key(self, key, steps):
+        self._pressed = key
+        if key==LEFT: self._index = (self._index-steps)%len(self._items)
+        elif key==RIGHT: self._index = (self._index+steps)%len(self._items)
+        elif key==OK: self.finish(self._index)
+        elif key==CANCEL and not self._no_back: self.finish(None)
+        return True
+
+    def draw(self, display):
+        ui = self.ui
+        caption, glyph, cap_x, cap_y, glyph_x, glyph_y = self._layout[self._index]
+        ui.font.print('<', 0, ui.h//2)
+        ui.font.print('>', ui.w-5, ui.h//2)
+        display.copyFrom(glyph, glyph_x, glyph_y)
+        ui.font.print(caption, cap_x, cap_y)
+        if self._pressed==LEFT: display.rect(0, -3+ui.h//2, 5, ui.font.height()+3+ui.h//2, None)
+        if self._pressed==RIGHT: display.rect(ui.w-8, -3+ui.h//2, ui.w, ui.font.height()+3+ui.h//2, None)
+
+
+class ValueInput(Widget):
+    # Same screen as Menu.read_value: LEFT/RIGHT (or the encoder, accelerated) change the value,
+    # OK returns it, CANCEL returns None.
+    def __init__(self, ui, val=0, min_val=-2147483647, max_val=2147483647, increment=1, display_mult=1, formato="{}", caption='value', val_font=None, on_update=None):
+        super().__init__(ui)
+        self._val = min(max(val, min_val), max_val)
+        self._min = min_val
+        self._max = max_val
+        self._increment = increment
+        self._mult = display_mult
+        self._formato = formato
+        self._caption = caption
+        self._font = ui.font if val_font is None else val_font
+        self._on_update = on_update
+        self._pressed = 0
+        cap_size = ui.font.calculateSize(caption) # x, y, maxx
+        self._cap_off = (ui.w-cap_size[2])//2
+        val_top = cap_size[1]+ui.font.height()
+        self._arrow_y = val_top+((ui.h-val_top)//2)-(ui.font.height()//2)
+        self._val_y = val_top+((ui.h-val_top)//2)-(self._font.height()//2)
+
+    def key(self, key, steps):
+        self._pressed = key
+        if key==OK: self.finish(self._val)
+        elif key==CANCEL: self.finish(None)
+        else:
+            val = self._val+(steps if key==RIGHT else -steps)*self._increment
+            val = min(max(val, self._min), self._max)
+            if val!=self._val and not (self._on_update is None): self._on_update(val)
+            self._val = val
+        return True
+
+    def draw(self, display):
+        ui = self.ui
+        ui.font.print(self._caption, self._cap_off, 0)
+        ui.font.print('<', 0, self._arrow_y)
+        ui.font.print('>', ui.w-5, self._arrow_y)
+        val_str = self._formato.format(self._val*self._mult)
+        val_size = self._font.calculateSize(val_str)
+        self._font.print(val_str, ui.h-(val_size[2]//2), self._val_y)
+        if self._pressed==LEFT: display.rect(0, self._arrow_y-3, 5, self._arrow_y+ui.font.height()+3, None)
+        if self._pressed==RIGHT: display.rect(ui.w-8, self._arrow_y-3, ui.w, self._arrow_y+ui.font.height()+3, None)
+
+
+class DateTimeInput(Widget):
+    # Same screen as Menu.read_datetime: OK/CANCEL walk the fields, the result is the list
+    # [year, month, day, hour, minute, second] after OK on the last one, or None.
+    def __init__(self, ui, val=[2025,4,20,15,10,30], live=True, caption='data', on_update=None, first_field=0):
+        super().__init__(ui)
+        self._val = fix_datetime(list(val))
+        self._live = live
+        self._caption = caption
+        self._on_update = on_update
+        self._field = first_field
+        self._blink = False
+        self._second = time.ticks_ms()//1000
+        font = ui.font
+        cap_size = font.calculateSize(caption) # x, y, maxx
+        self._cap_off = (ui.w-cap_size[2])//2
+        val_top = cap_size[1]+font.height()
+        self._arrow_y = val_top+((ui.h-val_top)//2)-(font.height()//2)
+        third_x = (ui.w-10)//3
+        self._third_x = third_x
+        self._third_centers = (5+third_x//2, 5+third_x+third_x//2, 5+third_x*2+third_x//2)
+        self._half_y = (ui.h-(cap_size[1]+font.lineHeight()))//2
+        self._half_tops = (cap_size[1]+font.lineHeight(), cap_size[1]+font.lineHeight()+self._half_y)
+        self._half_offs = (self._half_tops[0]+(self._half_y-font.height())//2, self._half_tops[1]+(self._half_y-font.height())//2)
+
+    def _changed(self):
+        self._val = fix_datetime(self._val)
+        if not (self._on_update is None): self._on_update(self._val)
+
+    def key(self, key, steps):
+        if key==CANCEL:
+            if self._field==0: self.finish(None)
+            self._field = max(self._field-1, 0)
+        elif key==OK:
+            if self._field==5: self.finish(self._val)
+            self._field = min(self._field+1, 5)
+        else:
+            field = self._field if self._field>2 else 2-self._field
+            self._val[field] = self._val[field]+(steps if key==RIGHT else -steps)
+            self._changed()
+        return True
+
+    def tick(self, ms):
+        blink = (ms%1000)<500
+        changed = blink!=self._blink and self._live
+        self._blink = blink
+        second = ms//1000
+        if self._live and second!=self._second:
+            self._val[5] = self._val[5]+(second-self._second)
+            self._changed()
+            changed = True
+        self._second = second
+        return changed
+
+    def draw(self, display):
+        font = self.ui.font
+        val = self._val
+        centers = self._third_centers
+        third_x = self._third_x
+        offs = self._half_offs
+        font.print(self._caption, self._cap_off, 0)
+        font.print('<', 0, self._arrow_y)
+        font.print('>', self.ui.w-5, self._arrow_y)
+        font.print('/', centers[0]+third_x//2-2, offs[0])
+        font.print('/', centers[1]+third_x//2-2, offs[0])
+        if not self._live or self._blink:
+            font.print(':', centers[0]+third_x//2-2, offs[1])
+            font.print(':', centers[1]+third_x//2-2, offs[1])
+        print_center_x(str(val[0]), centers[2], offs[0], font)
+        print_center_x(f"{val[1]:02d}", centers[1], offs[0], font)
+        print_center_x(f"{val[2]:02d}", centers[0], offs[0], font)
+        print_center_x(f"{val[3]:02d}", centers[0], offs[1], font)
+        print_center_x(f"{val[4]:02d}", centers[1], offs[1], font)
+        print_center_x(f"{val[5]:02d}", centers[2], offs[1], font)
+        field = self._field
+        display.rect(centers[field%3]+4-third_x//2, self._half_tops[field//3], centers[field%3]-4+third_x//2, self._half_tops[field//3]+self._half_y, None)
+
+
+class UI():
+    # events: Input.Buttons((left, right, ok, cancel)), or buttons: the same 4 Pins, polled.
+    # encoder: optional rp2.QuadEncoder, turns into LEFT/RIGHT steps, accelerated when spun fast.
+    # idle_divider: while started, the core sleeps between events (rp2.Idle), with clk_sys divided by it.
+    def __init__(self, display, default_font, events=None, buttons=None, encoder=None, encoder_step=4, fps=20, glyph=None, idle_divider=None):
+        from Graphics import Sprite
+        self.display = display
+        self.font = default_font
+        self.w = display.width()
+        self.h = display.height()
+        self.glyph = Sprite(raw=b'\x08\x08\x01\xc3\xe7~<<~\xe7\xc3') if glyph is None else glyph
+        self.frames = 0
+        self._events = events
+        self._buttons = buttons
+        self._encoder = encoder
+        self._encoder_step = encoder_step
+        self._frame_ms = 1000//fps
+        self._stack = []
+        self._dirty = asyncio.Event()
+        self._tasks = []
+        self._idle_divider = idle_divider
+        self._idle = None
+
+    def start(self):
+        if not (self._idle_divider is None):
+            import rp2
+            self._idle = rp2.Idle(divider=self._idle_divider)
+        self._tasks.append(asyncio.create_task(self._render_task()))
+        self._tasks.append(asyncio.create_task(self._tick_task()))
+        if not (self._events is None):
+            self._tasks.append(asyncio.create_task(self._events_task()))
+        elif not (self._buttons is None):
+            self._tasks.append(asyncio.create_task(self._poll_task()))
+        if not (self._encoder is None):
+            self._tasks.append(asyncio.create_task(self._encoder_task()))
+
+    def stop(self):
+        for task in self._tasks:
+            task.cancel()
+        self._tasks = []
+        if not (self._idle is None):
+            self._idle.close()
+            self._idle = None
+
+    def invalidate(self):
+        self._dirty.set()
+
+    async def run(self, widget):
+        # Shows widget on top until it finishes, returns its result
+        self._stack.append(widget)
+        self.invalidate()
+        try:
+            await widget._done.wait()
+        finally:
+            self._stack.remove(widget)
+            self.invalidate()
+        return widget.result
+
+    async def menu(self, items, no_back=False, first_field=0):
+        # Menu.horizontal_glyph_menu: [caption, glyph, callback, params, named params], the
+        # callbacks may be coroutines. Returns the index of an item with no callback, or None.
+        index = first_field
+        while True:
+            index = await self.run(GlyphMenu(self, items, no_back, index))
+            if index is None: return None
+            item = items[index]
+            if item[2] is None: return index
+            try:
+                result = item[2](*([] if item[3] is None else item[3]), **({} if item[4] is None else item[4]))
+                if hasattr(result, 'send'): await result
+            except Exception as e:
+                print(repr(e))
+                await self.run(Message(self, repr(e)))
+
+    def key(self, key, steps=1):
+        if self._stack and self._stack[-1].key(key, steps):
+            self.invalidate()
+
+    async def _render_task(self):
+        # One frame per burst of changes, no more than fps of them
+        while True:
+            await self._dirty.wait()
+            self._dirty.clear()
+            start = time.ticks_ms()
+            if self._stack:
+                self.display.clear()
+                self._stack[-1].draw(self.display)
+                self.display.display()
+                self.frames += 1
+            wait = self._frame_ms-time.ticks_diff(time.ticks_ms(), start)
+            if wait>0: await asyncio.sleep_ms(wait)
+
+    async def _tick_task(self):
+        while True:
+            await asyncio.sleep_ms(100)
+            if self._stack and self._stack[-1].tick(time.ticks_ms()):
+                self.invalidate()
+
+    async def _events_task(self):
+        reader = asyncio.StreamReader(self._events)
+        size = struct.calcsize(_EVENT)
+        while True:
+            data = await reader.read(size*8)
+            for offset in range(0, len(data), size):
+                _, kind, buttons, _ = struct.unpack_from(_EVENT, data, offset)
+                key = _MASK_KEYS.get(buttons, 0)
+                if kind==self._events.PRESS or (kind==self._events.REPEAT and (key==LEFT or key==RIGHT)):
+                    if key: self.key(key)
+
+    async def _poll_task(self):
+        # Press edges of the pins (active low), LEFT/RIGHT repeat after 1s every 150ms
+        last = 0
+        repeat_at = 0
+        while True:
+            await asyncio.sleep_ms(20)
+            pressed = 0
+            for i in range(4):
+                if not self._buttons[i].value(): pressed |= 1<<i
+            key = _MASK_KEYS.get(pressed, 0)
+            now = time.ticks_ms()
+            if pressed!=last and key:
+                repeat_at = time.ticks_add(now, 1000)
+                self.key(key)
+            elif pressed==last and (key==LEFT or key==RIGHT) and time.ticks_diff(now, repeat_at)>=0:
+                repeat_at = time.ticks_add(now, 150)
+                self.key(key)
+            last = pressed
+
+    async def _encoder_task(self):
+        # Detents since the last poll, times 10 or 100 when spun quickly (as Menu.read_value)
+        last = self._encoder.value()
+        while True:
+            await asyncio.sleep_ms(20)
+            steps = int((self._encoder.value()-last)/self._encoder_step)
+            if steps==0: continue
+            last = last+steps*self._encoder_step
+            speed = abs(self._encoder.velocity())/self._encoder_step
+            if speed>=25: steps = steps*100
+            elif speed>=8: steps = steps*10
+            self.key(RIGHT if steps>0 else LEFT, abs(steps))
@@ -1,30 +1,51 @@
 import time
-from Graphics import Sprite
+from array import array
+from micropython import const
+from Graphics import Sprite, transition, SLIDE
 
-def days_in_month(year, month):
-    dim = [31, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31]
-    if month==2:
-        return 29 if (((year%4)==0) and ((year%100)!=0)) or (year%400)==0 else 28
-    return dim[month] if month>=0 and month<=12 else 0
+# Precompiled layouts: the geometry of a screen is computed once into an array('h') and the
+# renderers read it at these fixed offsets, instead of recomputing it or going through dicts
+# on every frame. read_datetime and read_value keep theirs per caption (and font) across calls,
+# in a small LRU so that captions built from changing values don't grow it without bound.
+_LAYOUT_CACHE = const(8)
+
+_GM_CAP_X = const(0) # horizontal_glyph_menu, per item
+_GM_CAP_Y = const(1)
+_GM_GLYPH_X = const(2)
+_GM_GLYPH_Y = const(3)
+_GM_SEL_X1 = const(4)
+_GM_SEL_Y1 = const(5)
+_GM_SIZE = const(6)
+
+_DT_CAP_X = const(0) # read_datetime
+_DT_ARROW_Y = const(1)
+_DT_ARROW_Y0 = const(2)
+_DT_ARROW_Y1 = const(3)
+_DT_SEP0_X = const(4)
+_DT_SEP1_X = const(5)
+_DT_ROW0_Y = const(6)
+_DT_ROW1_Y = const(7)
+_DT_COL0_X = const(8)
+_DT_COL1_X = const(9)
+_DT_COL2_X = const(10)
+_DT_FIELDS = const(11) # 6 field frames of x0, y0, x1, y1
+_DT_SIZE = const(35)
+
+_RV_CAP_X = const(0) # read_value
+_RV_ARROW_Y = const(1)
+_RV_ARROW_Y0 = const(2)
+_RV_ARROW_Y1 = const(3)
+_RV_VAL_Y = const(4)
+_RV_VAL_Y1 = const(5)
+_RV_SIZE = const(6)
 
 def fix_datetime(value):
-    while value[5]>=60: value[5], value[4] = (value[5]-60, value[4]+1)
-    while value[5]<0: value[5], value[4] = (value[5]+60, value[4]-1)
-    while value[4]>=60: value[4], value[3] = (value[4]-60, value[3]+1)
-    while value[4]<0: value[4], value[3] = (value[4]+60, value[3]-1)
-    while value[3]>=24: value[3], value[2] = (value[3]-24, value[2]+1)
-    while value[3]<0: value[3], value[2] = (value[3]+24, value[2]-1)
-    while value[0]<2000 or value[0]>2200 or value[1]<1 or value[1]>12 or value[2]<1 or value[2]>days_in_month(value[0], value[1]):
-        if value[0]<2000: value[0] = 2000
-        if value[0]>2200: value[0] = 2200
-        if value[1]>12: value[1], value[0] = (value[1]-12, value[0]+1)
-        while value[1]<1: value[1], value[0] = (value[1]+12, value[0]-1)
-        if value[2]>days_in_month(value[0], value[1]):
-            value[2], value[1] = (value[2]-days_in_month(value[0], value[1]), value[1]+1)
-            continue
-        while value[2]<1:
-            value[1] = value[1]-1
-            value[2] = value[2]+days_in_month(value[0], value[1])
+    # time.normalize carries every field in place and in constant time; the year stays in
+    # [2000, 2200], keeping month and day (normalizing again only for a 29/02 that got clamped)
+    time.normalize(value)
+    if value[0]<2000 or value[0]>2200:
+        value[0] = 2000 if value[0]<2000 else 2200
+        time.normalize(value)
     return value
 
 def print_center_x(text, x, y, font):
@@ -32,7 +53,10 @@ def print_center_x(text, x, y, font):
     font.print(text, x-size[2]//2, y)
 
 class Menu():
-    def __init__(self, display, default_font, btn_left, btn_right, btn_cancel, btn_ok):
+    def __init__(self, display, default_font, btn_left, btn_right, btn_cancel, btn_ok, events=None, encoder=None, encoder_step=4):
+        # events: optional Input.Buttons((left, right, ok, cancel)), debounced in the interruptions.
+        # The loops then wake on each button event instead of sampling the pins every 50ms.
+        # encoder: optional rp2.QuadEncoder, encoder_step counts per detent, for read_value.
         self._display = display
         self._w = display.width()
         self._h = display.height()
@@ -41,64 +65,78 @@ class Menu():
         self._btn_right = btn_right
         self._btn_cancel = btn_cancel
         self._btn_ok = btn_ok
+        self._events = events
+        self._held = None
+        self._encoder = encoder
+        self._encoder_step = encoder_step
+        self._encoder_last = 0
         self._def_glyph_data = b'\x08\x08\x01\xc3\xe7~<<~\xe7\xc3'
         self._def_glyph = Sprite(raw=self._def_glyph_data)
+        self._layouts = {}
+        self._frames = None
 
     def horizontal_glyph_menu(self, items=[['item', None, None, None, None]], no_back=False, on_loop=None, first_field=0, preselected=None):
-        internal=[] #                      Caption, Glyph, Callback, Params, Named Params
-        for i in items:
-            cap_size = self._def_font.calculateSize(i[0]) # x, y, maxx
-            cap_y = self._display.height()-(cap_size[1]+self._def_font.lineHeight())
+        # Compiled once per screen: actions by item, geometry in an array by fixed offsets
+        font = self._def_font
+        disp = self._display
+        w = self._w
+        h2 = self._h//2
+        arrow_bottom = font.height()+3+h2
+        count = len(items)
+        captions = []
+        glyphs = []
+        actions = [] #                     Callback, Params, Named Params
+        geometry = array('h', bytes(2*_GM_SIZE*count))
+        for n, i in enumerate(items):
+            cap_size = font.calculateSize(i[0]) # x, y, maxx
+            cap_y = self._h-(cap_size[1]+font.lineHeight())
             glyph = self._def_glyph if (i[1] is None) else i[1]
-            internal.append({
-                'caption': i[0],
-                'glyph': glyph,
-                'callback': i[2],
-                'cb_params': [] if i[3] is None else i[3],
-                'cb_named_params': {} if i[4] is None else i[4],
-                'cap_x': (self._display.width()-cap_size[2])//2,
-                'cap_y': cap_y,
-                'glyph_x': (self._display.width()-glyph.width())//2,
-                'glyph_y': (cap_y-glyph.height())//2,
-                })
-        index = first_field%len(internal)
+            captions.append(i[0])
+            glyphs.append(glyph)
+            actions.append((i[2], [] if i[3] is None else i[3], {} if i[4] is None else i[4]))
+            g = n*_GM_SIZE
+            geometry[g+_GM_CAP_X] = (w-cap_size[2])//2
+            geometry[g+_GM_CAP_Y] = cap_y
+            geometry[g+_GM_GLYPH_X] = (w-glyph.width())//2
+            geometry[g+_GM_GLYPH_Y] = (cap_y-glyph.height())//2
+            geometry[g+_GM_SEL_X1] = geometry[g+_GM_GLYPH_X]+3+glyph.width()
+            geometry[g+_GM_SEL_Y1] = geometry[g+_GM_GLYPH_Y]+3+glyph.height()
+        index = first_field%count
         last_input = 0
-        def horizontal_glyph_menu_update_display(offset):
-            self._display.clear()
+        def horizontal_glyph_menu_update_display(offset, show=True):
+            disp.clear()
             
-            self._def_font.print('<', 0, self._h//2)
-            self._def_font.print('>', self._w-5, self._h//2)
-            if offset==0:
-                self._display.copyFrom(internal[index]['glyph'], internal[index]['glyph_x'], internal[index]['glyph_y'])
-                self._def_font.print(internal[index]['caption'], internal[index]['cap_x'], internal[index]['cap_y'])
-            elif offset>0:
-                other = (index+len(internal)-1)%len(internal)
-                self._display.copyFrom(internal[index]['glyph'], internal[index]['glyph_x']+offset, internal[index]['glyph_y'])
-                self._def_font.print(internal[index]['caption'], internal[index]['cap_x']+offset, internal[index]['cap_y'])
-                self._display.copyFrom(internal[other]['glyph'], internal[other]['glyph_x']+offset-self._w, internal[other]['glyph_y'])
-                self._def_font.print(internal[other]['caption'], internal[other]['cap_x']+offset-self._w, internal[other]['cap_y'])
-            else:
-                other = (index+1)%len(internal)
-                self._display.copyFrom(internal[index]['glyph'], internal[index]['glyph_x']+offset, internal[index]['glyph_y'])
-                self._def_font.print(internal[index]['caption'], internal[index]['cap_x']+offset, internal[index]['cap_y'])
-                self._display.copyFrom(internal[other]['glyph'], internal[other]['glyph_x']+offset+self._w, internal[other]['glyph_y'])
-                self._def_font.print(internal[other]['caption'], internal[other]['cap_x']+offset+self._w, internal[other]['cap_y'])
+            font.print('<', 0, h2)
+            font.print('>', w-5, h2)
+            g = index*_GM_SIZE
+            disp.copyFrom(glyphs[index], geometry[g+_GM_GLYPH_X]+offset, geometry[g+_GM_GLYPH_Y])
+            font.print(captions[index], geometry[g+_GM_CAP_X]+offset, geometry[g+_GM_CAP_Y])
+            if offset!=0:
+                if offset>0:
+                    other = (index+count-1)%count
+                    shift = offset-w
+                else:
+                    other = (index+1)%count
+                    shift = offset+w
+                o = other*_GM_SIZE
+                disp.copyFrom(glyphs[other], geometry[o+_GM_GLYPH_X]+shift, geometry[o+_GM_GLYPH_Y])
+                font.print(captions[other], geometry[o+_GM_CAP_X]+shift, geometry[o+_GM_CAP_Y])
             
-            if last_input==1: self._display.rect(0, -3+self._h//2, 5, self._def_font.height()+3+self._h//2, None)
-            if last_input==2: self._display.rect(self._w-8, -3+self._h//2, self._w, self._def_font.height()+3+self._h//2, None)
-            if last_input==3 and offset==0: self._display.rect(
-                internal[index]['glyph_x']-3,
-                internal[index]['glyph_y']-3,
-                internal[index]['glyph_x']+3+internal[index]['glyph'].width(),
-                internal[index]['glyph_y']+3+internal[index]['glyph'].height(),
+            if last_input==1: disp.rect(0, h2-3, 5, arrow_bottom, None)
+            if last_input==2: disp.rect(w-8, h2-3, w, arrow_bottom, None)
+            if last_input==3 and offset==0: disp.rect(
+                geometry[g+_GM_GLYPH_X]-3,
+                geometry[g+_GM_GLYPH_Y]-3,
+                geometry[g+_GM_SEL_X1],
+                geometry[g+_GM_SEL_Y1],
                 None)
             
-            self._display.display()
+            if show: disp.display()
         if preselected!=None:
-            index = first_field%len(internal)
-            if not internal[index]['callback'] is None:
+            index = first_field%count
+            if not actions[index][0] is None:
                 try:
-                    internal[index]['callback'](*internal[index]['cb_params'],**internal[index]['cb_named_params'])
+                    actions[index][0](*actions[index][1],**actions[index][2])
                 except Exception as e:
                     self._display.clear()
                     self._def_font.print(repr(e),0,0)
@@ -108,27 +146,15 @@ class Menu():
 
         horizontal_glyph_menu_update_display(0)
         while True:
-            curval = 0
-            if not self._btn_left.value(): curval = 1 if curval==0 else 5
-            if not self._btn_right.value(): curval = 2 if curval==0 else 5
-            if not self._btn_ok.value(): curval = 3 if curval==0 else 5
-            if not self._btn_cancel.value(): curval = 4 if curval==0 else 5
+            curval = self._buttons()
             
             if curval!=0:
                 if (last_input==0 or curval==1 or curval==2)and last_input!=5:
-                    if curval==1:
-                        last_input = curval
-                        for i in range(self._w//16, self._w, self._w//8):
-                            horizontal_glyph_menu_update_display(i)
-                            if not (on_loop is None): on_loop(val)
-                        index = (index+len(internal)-1)%len(internal)
-                    if curval==2:
+                    if curval==1 or curval==2:
                         last_input = curval
-                        for i in range(self._w//16, self._w, self._w//8):
-                            horizontal_glyph_menu_update_display(-i)
-                            if not (on_loop is None): on_loop(val)
-                        index = (index+1)%len(internal)
-                    horizontal_glyph_menu_update_display(0)
+                        index = (index+(count-1 if curval==1 else 1))%count
+                        self._slide(lambda: horizontal_glyph_menu_update_display(0, False), -1 if curval==1 else 1)
+                        if not (on_loop is None): on_loop(val)
 
                 if last_input!=0 and last_input!=curval:
                     curval = 5
@@ -139,11 +165,11 @@ class Menu():
             elif last_input!=0:
                 if last_input==4 and not no_back: return None
                 if last_input==3:
-                    if internal[index]['callback'] is None:
+                    if actions[index][0] is None:
                         if not no_back: return index
                     else:
                         try:
-                            internal[index]['callback'](*internal[index]['cb_params'],**internal[index]['cb_named_params'])
+                            actions[index][0](*actions[index][1],**actions[index][2])
                         except Exception as e:
                             self._display.clear()
                             self._def_font.print(repr(e),0,0)
@@ -154,10 +180,68 @@ class Menu():
                 horizontal_glyph_menu_update_display(0)
 
             last_input = curval
-            time.sleep(0.05)
+            self._wait(50)
             if not (on_loop is None): on_loop(val)
 
+    def _slide(self, draw, direction, steps=8):
+        # The current screen is still on the display buffer; draw() renders the next one and the
+        # frames between them are composed and sent natively. The arrows at the borders stay put.
+        disp = self._display
+        if self._frames is None:
+            self._frames = (Sprite(width=self._w, height=self._h, stride=disp.stride()),
+                Sprite(width=self._w, height=self._h, stride=disp.stride()))
+        old, new = self._frames
+        old.buffer()[:] = disp.buffer()
+        draw()
+        new.buffer()[:] = disp.buffer()
+        if hasattr(disp, 'transition'):
+            disp.transition(old, new, SLIDE, steps, direction, x=6, width=self._w-14)
+        else:
+            transition(disp, old, new, SLIDE, steps, direction=direction, x=6, width=self._w-14, send=disp.display)
+
+    def _buttons(self):
+        # 0: none, 1: left, 2: right, 3: ok, 4: cancel, 5: more than one
+        if self._events is None:
+            curval = 0
+            if not self._btn_left.value(): curval = 1 if curval==0 else 5
+            if not self._btn_right.value(): curval = 2 if curval==0 else 5
+            if not self._btn_ok.value(): curval = 3 if curval==0 else 5
+            if not self._btn_cancel.value(): curval = 4 if curval==0 else 5
+            return curval
+        # the state after the last event, so a short tap is not lost between two loops
+        held = self._events.held() if self._held is None else self._held
+        self._held = None
+        return {0: 0, 1: 1, 2: 2, 4: 3, 8: 4}.get(held & 15, 5)
+
+    def _wait(self, ms):
+        if self._events is None:
+            time.sleep_ms(ms)
+            return
+        event = self._events.get_event(ms)
+        if not (event is None): self._held = event[2]
+
+    def _encoder_steps(self):
+        # detents turned since the last call, times 10 or 100 when spun quickly
+        count = self._encoder.value()
+        steps = int((count-self._encoder_last)/self._encoder_step)
+        self._encoder_last = self._encoder_last+steps*self._encoder_step
+        speed = abs(self._encoder.velocity())/self._encoder_step # detents/s
+        if speed>=25: return steps*100
+        if speed>=8: return steps*10
+        return steps
+
     def press_any(self):
+        if not (self._events is None):
+            self._events.clear()
+            while self._events.held()==0: self._events.get_event()
+            self._display.clear(None)
+            self._display.display()
+            while self._events.held()!=0: self._events.get_event()
+            self._events.clear()
+            self._held = None
+            self._display.clear(None)
+            self._display.display()
+            return
         anyPressed = False
         while not anyPressed:
             anyPressed = not (self._btn_left.value() and self._btn_right.value() and self._btn_ok.value() and self._btn_cancel.value())
@@ -170,16 +254,53 @@ class Menu():
         self._display.clear(None)
         self._display.display()
 
-    def read_datetime(self, val=[2025,4,20,15,10,30], live=True, caption='data', on_loop=None, on_update=None, first_field=0):
-        cap_size = self._def_font.calculateSize(caption) # x, y, maxx
-        cap_off = (self._w-cap_size[2])//2
-        val_top = cap_size[1]+self._def_font.height()
-        arrow_y = val_top+((self._h-val_top)//2)-(self._def_font.height()//2)
+    def _layout_get(self, key):
+        layout = self._layouts.pop(key, None)
+        if not (layout is None): self._layouts[key] = layout # most recent last
+        return layout
+
+    def _layout_put(self, key, layout):
+        if len(self._layouts)>=_LAYOUT_CACHE: del self._layouts[next(iter(self._layouts))]
+        self._layouts[key] = layout
+
+    def _datetime_layout(self, caption):
+        key = ('dt', caption)
+        layout = self._layout_get(key)
+        if not (layout is None): return layout
+        font = self._def_font
+        cap_size = font.calculateSize(caption) # x, y, maxx
+        val_top = cap_size[1]+font.height()
+        arrow_y = val_top+((self._h-val_top)//2)-(font.height()//2)
         third_x = (self._w-10)//3
         third_centers = (5+third_x//2, 5+third_x+third_x//2, 5+third_x*2+third_x//2)
-        half_y = (self._h-(cap_size[1]+self._def_font.lineHeight()))//2
-        half_tops = (cap_size[1]+self._def_font.lineHeight(), cap_size[1]+self._def_font.lineHeight()+half_y)
-        half_offs = (half_tops[0]+(half_y-self._def_font.height())//2, half_tops[1]+(half_y-self._def_font.height())//2)
+        half_y = (self._h-(cap_size[1]+font.lineHeight()))//2
+        half_tops = (cap_size[1]+font.lineHeight(), cap_size[1]+font.lineHeight()+half_y)
+        layout = array('h', bytes(2*_DT_SIZE))
+        layout[_DT_CAP_X] = (self._w-cap_size[2])//2
+        layout[_DT_ARROW_Y] = arrow_y
+        layout[_DT_ARROW_Y0] = arrow_y-3
+        layout[_DT_ARROW_Y1] = arrow_y+font.height()+3
+        layout[_DT_SEP0_X] = third_centers[0]+third_x//2-2
+        layout[_DT_SEP1_X] = third_centers[1]+third_x//2-2
+        layout[_DT_ROW0_Y] = half_tops[0]+(half_y-font.height())//2
+        layout[_DT_ROW1_Y] = half_tops[1]+(half_y-font.height())//2
+        layout[_DT_COL0_X] = third_centers[0]
+        layout[_DT_COL1_X] = third_centers[1]
+        layout[_DT_COL2_X] = third_centers[2]
+        for field in range(6):
+            f = _DT_FIELDS+4*field
+            layout[f] = third_centers[field%3]+4-third_x//2
+            layout[f+1] = half_tops[field//3]
+            layout[f+2] = third_centers[field%3]-4+third_x//2
+            layout[f+3] = half_tops[field//3]+half_y
+        self._layout_put(key, layout)
+        return layout
+
+    def read_datetime(self, val=[2025,4,20,15,10,30], live=True, caption='data', on_loop=None, on_update=None, first_field=0):
+        L = self._datetime_layout(caption)
+        font = self._def_font
+        disp = self._display
+        w = self._w
         
         dateSig = lambda value: ((((((value[0]-2000)*12+value[1])*31+value[2])*24+value[3])*60+value[4])*60+value[5])
         lastSig = dateSig(val)
@@ -187,26 +308,27 @@ class Menu():
         field = first_field
         last_input = 0
         def read_datetime_update_display():
-            self._display.clear()
-            self._def_font.print(caption, cap_off, 0)
-            self._def_font.print('<', 0, arrow_y)
-            self._def_font.print('>', self._w-5, arrow_y)
-            self._def_font.print('/', third_centers[0]+third_x//2-2, half_offs[0])
-            self._def_font.print('/', third_centers[1]+third_x//2-2, half_offs[0])
+            disp.clear()
+            font.print(caption, L[_DT_CAP_X], 0)
+            font.print('<', 0, L[_DT_ARROW_Y])
+            font.print('>', w-5, L[_DT_ARROW_Y])
+            font.print('/', L[_DT_SEP0_X], L[_DT_ROW0_Y])
+            font.print('/', L[_DT_SEP1_X], L[_DT_ROW0_Y])
             if not live or (time.ticks_ms()%1000)<500:
-                self._def_font.print(':', third_centers[0]+third_x//2-2, half_offs[1])
-                self._def_font.print(':', third_centers[1]+third_x//2-2, half_offs[1])
-            print_center_x(str(val[0]), third_centers[2], half_offs[0], self._def_font)
-            print_center_x(f"{val[1]:02d}", third_centers[1], half_offs[0], self._def_font)
-            print_center_x(f"{val[2]:02d}", third_centers[0], half_offs[0], self._def_font)
+                font.print(':', L[_DT_SEP0_X], L[_DT_ROW1_Y])
+                font.print(':', L[_DT_SEP1_X], L[_DT_ROW1_Y])
+            print_center_x(str(val[0]), L[_DT_COL2_X], L[_DT_ROW0_Y], font)
+            print_center_x(f"{val[1]:02d}", L[_DT_COL1_X], L[_DT_ROW0_Y], font)
+            print_center_x(f"{val[2]:02d}", L[_DT_COL0_X], L[_DT_ROW0_Y], font)
             
-            print_center_x(f"{val[3]:02d}", third_centers[0], half_offs[1], self._def_font)
-            print_center_x(f"{val[4]:02d}", third_centers[1], half_offs[1], self._def_font)
-            print_center_x(f"{val[5]:02d}", third_centers[2], half_offs[1], self._def_font)
-            self._display.rect(third_centers[field%3]+4-third_x//2, half_tops[field//3], third_centers[field%3]-4+third_x//2, half_tops[field//3]+half_y, None)
-            if last_input==1: self._display.rect(0, arrow_y-3, 5, arrow_y+self._def_font.height()+3, None)
-            if last_input==2: self._display.rect(self._w-8, arrow_y-3, self._w, arrow_y+self._def_font.height()+3, None)
-            self._display.display()
+            print_center_x(f"{val[3]:02d}", L[_DT_COL0_X], L[_DT_ROW1_Y], font)
+            print_center_x(f"{val[4]:02d}", L[_DT_COL1_X], L[_DT_ROW1_Y], font)
+            print_center_x(f"{val[5]:02d}", L[_DT_COL2_X], L[_DT_ROW1_Y], font)
+            f = _DT_FIELDS+4*field
+            disp.rect(L[f], L[f+1], L[f+2], L[f+3], None)
+            if last_input==1: disp.rect(0, L[_DT_ARROW_Y0], 5, L[_DT_ARROW_Y1], None)
+            if last_input==2: disp.rect(w-8, L[_DT_ARROW_Y0], w, L[_DT_ARROW_Y1], None)
+            disp.display()
         
         val = fix_datetime(val)
         prev_update = (time.ticks_ms()%1000)>500
@@ -219,11 +341,7 @@ class Menu():
         lastSig = currentSig
         
         while True:
-            curval = 0
-            if not self._btn_left.value(): curval = 1 if curval==0 else 5
-            if not self._btn_right.value(): curval = 2 if curval==0 else 5
-            if not self._btn_ok.value(): curval = 3 if curval==0 else 5
-            if not self._btn_cancel.value(): curval = 4 if curval==0 else 5
+            curval = self._buttons()
             
             if curval!=0:
                 if last_input==0 or (last_input!=5 and repeat_avoid<time.ticks_ms()):
@@ -270,35 +388,55 @@ class Menu():
                 read_datetime_update_display()
             prev_update = current_update
         
-            time.sleep(0.05)
+            self._wait(50)
             if not (on_loop is None): on_loop(val)
 
+    def _value_layout(self, caption, val_font):
+        key = ('rv', caption, val_font)
+        layout = self._layout_get(key)
+        if not (layout is None): return layout
+        font = self._def_font
+        cap_size = font.calculateSize(caption) # x, y, maxx
+        val_top = cap_size[1]+font.height()
+        arrow_y = val_top+((self._h-val_top)//2)-(font.height()//2)
+        val_y = val_top+((self._h-val_top)//2)-(val_font.height()//2)
+        layout = array('h', bytes(2*_RV_SIZE))
+        layout[_RV_CAP_X] = (self._w-cap_size[2])//2
+        layout[_RV_ARROW_Y] = arrow_y
+        layout[_RV_ARROW_Y0] = arrow_y-3
+        layout[_RV_ARROW_Y1] = arrow_y+font.height()+3
+        layout[_RV_VAL_Y] = val_y
+        layout[_RV_VAL_Y1] = val_y+val_font.height()
+        self._layout_put(key, layout)
+        return layout
+
     def read_value(self, val=0, min_val=-2147483647, max_val=2147483647, increment=1, display_mult=1, formato="{}", caption='value', val_font=None, on_loop=None, on_update=None):
         if val_font is None: val_font = self._def_font
-        cap_size = self._def_font.calculateSize(caption) # x, y, maxx
-        cap_off = (self._w-cap_size[2])//2
-        val_top = cap_size[1]+self._def_font.height()
-        arrow_y = val_top+((self._h-val_top)//2)-(self._def_font.height()//2)
-        val_y = val_top+((self._h-val_top)//2)-(val_font.height()//2)
+        L = self._value_layout(caption, val_font)
+        font = self._def_font
+        disp = self._display
+        w = self._w
+        h = self._h
         last_input = 0
         repeat_avoid = 0
         last_val = val
         
         def read_value_update_display():
-            self._display.clear()
-            self._def_font.print(caption, cap_off, 0)
-            self._def_font.print('<', 0, arrow_y)
-            self._def_font.print('>', self._w-5, arrow_y)
+            disp.clear()
+            font.print(caption, L[_RV_CAP_X], 0)
+            font.print('<', 0, L[_RV_ARROW_Y])
+            font.print('>', w-5, L[_RV_ARROW_Y])
             val_str = formato.format(val*display_mult)
-            val_size = val_font.calculateSize(val_str)
-            val_font.print(val_str, self._h-(val_size[2]//2), val_y)
-            if last_input==1: self._display.rect(0, arrow_y-3, 5, arrow_y+self._def_font.height()+3, None)
-            if last_input==2: self._display.rect(self._w-8, arrow_y-3, self._w, arrow_y+self._def_font.height()+3, None)
-            if last_input==3: self._display.rect(self._h-(val_size[2]//2)-3, val_y-3, self._h+(val_size[2]//2)+3, val_y+val_font.height()+3, None)
+            half = val_font.calculateSize(val_str)[2]//2
+            val_y = L[_RV_VAL_Y]
+            val_font.print(val_str, h-half, val_y)
+            if last_input==1: disp.rect(0, L[_RV_ARROW_Y0], 5, L[_RV_ARROW_Y1], None)
+            if last_input==2: disp.rect(w-8, L[_RV_ARROW_Y0], w, L[_RV_ARROW_Y1], None)
+            if last_input==3: disp.rect(h-half-3, val_y-3, h+half+3, L[_RV_VAL_Y1]+3, None)
             if last_input==4:
-                self._display.line(self._h-(val_size[2]//2)-5, val_y-5, self._h+(val_size[2]//2)+5, val_y+val_font.height()+5, True)
-                self._display.line(self._h-(val_size[2]//2)-5, val_y+val_font.height()+5, self._h+(val_size[2]//2)+5, val_y-5, True)
-            self._display.display()
+                disp.line(h-half-5, val_y-5, h+half+5, L[_RV_VAL_Y1]+5, True)
+                disp.line(h-half-5, L[_RV_VAL_Y1]+5, h+half+5, val_y-5, True)
+            disp.display()
         
         if val<min_val:
             val = min_val
@@ -309,13 +447,19 @@ class Menu():
         if last_val!=val and not (on_update is None):
             on_update(val)
         last_val = val
+        if not (self._encoder is None): self._encoder_last = self._encoder.value()
 
         while True:
-            curval = 0
-            if not self._btn_left.value(): curval = 1 if curval==0 else 5
-            if not self._btn_right.value(): curval = 2 if curval==0 else 5
-            if not self._btn_ok.value(): curval = 3 if curval==0 else 5
-            if not self._btn_cancel.value(): curval = 4 if curval==0 else 5
+            if not (self._encoder is None):
+                steps = self._encoder_steps()
+                if steps!=0:
+                    val = min(max(val+steps*increment, min_val), max_val)
+                    if last_val!=val and not (on_update is None):
+                        on_update(val)
+                    last_val = val
+                    read_value_update_display()
+
+            curval = self._buttons()
             
             if curval!=0:
                 if last_input==0 or (last_input!=5 and repeat_avoid<time.ticks_ms()):
@@ -345,6 +489,6 @@ class Menu():
                 last_input = curval
                 read_value_update_display()
             
-            time.sleep(0.05)
+            self._wait(50)
             if not (on_loop is None): on_loop(val)
 
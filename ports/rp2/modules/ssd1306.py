@@ -1,5 +1,6 @@
-from Graphics import Sprite
+from Graphics import Sprite, transition, SLIDE
 from machine import Pin, I2C
+import rp2
 
 
 SSD1306_COMMAND_HEADER = 0x00  # See datasheet
@@ -84,11 +85,14 @@ SSD1306_dlist1 = bytes([
 
 
 class SSD1306(Sprite):
-    def __init__(self, scl=Pin(27), sda=Pin(26), i2cmod=1, address=60, startup=True, rotation=False):
+    def __init__(self, scl=Pin(27), sda=Pin(26), i2cmod=1, address=60, startup=True, rotation=False, queue=False):
         super().__init__(width=128, height=64, stride=8)
         self.i2c = I2C(i2cmod, sda=sda, scl=scl, freq=400_000)
         self.addr = address
         self._rotation = rotation
+        # queue: display() hands the frame to rp2.I2CQueue and returns, the bus is fed by DMA
+        self._queue = rp2.I2CQueue(self.i2c, depth=4) if queue else None
+        self._frame = bytearray(1+len(self.buffer())) if queue else None
         if startup:
             self.init()
             self.display()
@@ -108,8 +112,24 @@ class SSD1306(Sprite):
         self.i2c.writeto(self.addr, SSD1306_init5)
 
     def display(self):
+        if self._queue is not None:
+            q = self._queue
+            q.wait() # the previous frame, this one is copied at submit and the buffer is free again
+            q.submit(self.addr, bytes([SSD1306_COMMAND_HEADER, SSD1306_COMSCANDEC if self._rotation else SSD1306_COMSCANINC]))
+            q.submit(self.addr, bytes([SSD1306_COMMAND_HEADER, SSD1306_SEGREMAP | (1 if self._rotation else 0)]))
+            q.submit(self.addr, SSD1306_dlist1)
+            self._frame[0] = SSD1306_DATA_HEADER
+            self._frame[1:] = self.buffer()
+            q.submit(self.addr, self._frame)
+            return
         self.i2c.writeto(self.addr, bytes([SSD1306_COMMAND_HEADER, SSD1306_COMSCANDEC if self._rotation else SSD1306_COMSCANINC]))
         self.i2c.writeto(self.addr, bytes([SSD1306_COMMAND_HEADER, SSD1306_SEGREMAP | (1 if self._rotation else 0)]))
         self.i2c.writeto(self.addr, SSD1306_dlist1)
         self.i2c.writeto(self.addr, bytes([SSD1306_DATA_HEADER])+self.buffer())
 
+    def transition(self, old, new, kind=SLIDE, steps=8, direction=1, x=0, width=None):
+        # Frames composed in C and sent straight to the bus; ends with new on the buffer
+        self.i2c.writeto(self.addr, bytes([SSD1306_COMMAND_HEADER, SSD1306_COMSCANDEC if self._rotation else SSD1306_COMSCANINC]))
+        self.i2c.writeto(self.addr, bytes([SSD1306_COMMAND_HEADER, SSD1306_SEGREMAP | (1 if self._rotation else 0)]))
+        transition(self, old, new, kind, steps, direction=direction, x=x, width=width,
+            i2c=self.i2c, addr=self.addr, setup=SSD1306_dlist1, header=SSD1306_DATA_HEADER)
@@ -173,6 +173,11 @@
 #define MICROPY_PY_LWIP_PPP                     (MICROPY_PY_NETWORK_PPP_LWIP)
 #define MICROPY_PY_LWIP_SOCK_RAW                (MICROPY_PY_LWIP)
 
+// Triac engine kernels exposed to Python (burst_pattern, block_stats, ...), for test builds only
+#ifndef MICROPY_PY_TRIAC_TEST_HOOKS
+#define MICROPY_PY_TRIAC_TEST_HOOKS             (0)
+#endif
+
 // Hardware timer alarm index. Available range 0-3.
 // Number 3 is currently used by pico-sdk (PICO_TIME_DEFAULT_ALARM_POOL_HARDWARE_ALARM_NUM)
 #define MICROPY_HW_SOFT_TIMER_ALARM_NUM         (2)
@@ -273,7 +273,7 @@ void mp_wfe_or_timeout(uint32_t timeout_ms) {
     soft_timer_static_init(&timer, SOFT_TIMER_MODE_ONE_SHOT, 0, NULL);
     soft_timer_insert(&timer, timeout_ms);
 
-    __wfe();
+    rp2_idle_wfe();
 
     // Clean up the timer node if it's not already
     soft_timer_remove(&timer);
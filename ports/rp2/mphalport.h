@@ -59,7 +59,7 @@
 #define MICROPY_INTERNAL_WFE(TIMEOUT_MS) \
     do {                                 \
         if ((TIMEOUT_MS) < 0) { \
-            __wfe(); \
+            rp2_idle_wfe(); \
         } else { \
             mp_wfe_or_timeout(TIMEOUT_MS); \
         } \
@@ -71,6 +71,9 @@ extern ringbuf_t stdin_ringbuf;
 // Port-specific function to create a wakeup interrupt after timeout_ms and enter WFE
 void mp_wfe_or_timeout(uint32_t timeout_ms);
 
+// WFE of the interpreter waits, the low-power idle hook once rp2.Idle() is enabled
+void rp2_idle_wfe(void);
+
 uint32_t mp_thread_begin_atomic_section(void);
 void mp_thread_end_atomic_section(uint32_t);
 
@@ -28,6 +28,7 @@
 #include "py/mpconfig.h"
 #include "mutex_extra.h"
 #include "pendsv.h"
+#include "modrp2.h"
 
 #if PICO_RP2040
 #include "RP2040.h"
@@ -109,6 +110,7 @@ void PendSV_Handler(void) {
     CYW43_STAT_INC(PENDSV_RUN_COUNT);
     #endif
 
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_PENDSV);
     for (size_t i = 0; i < PENDSV_DISPATCH_NUM_SLOTS; ++i) {
         if (pendsv_dispatch_table[i] != NULL) {
             pendsv_dispatch_t f = pendsv_dispatch_table[i];
@@ -116,6 +118,7 @@ void PendSV_Handler(void) {
             f();
         }
     }
+    rp2_cpu_exit(cpu);
 
     recursive_mutex_nowait_exit(&pendsv_mutex);
 }
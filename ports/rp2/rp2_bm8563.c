@@ -0,0 +1,427 @@
+#include <time.h>
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/mperrno.h"
+#include "extmod/modmachine.h"
+#include "shared/timeutils/timeutils.h"
+#include "modrp2.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/aon_timer.h"
+
+// BM8563 RTC =========================================================================================
+// The time registers (seconds to years) are read and written in a single burst and converted with
+// lookup tables. sync() copies the chip into the RP2040 RTC. The alarm and the countdown timer drive
+// the INT pin (open drain, active low): its falling edge is an interruption, so it wakes the core out
+// of WFE/WFI and lightsleep, and irq(handler) runs handler(flags) once the flags were cleared.
+
+#define BM8563_CONTROL1 (0x00)
+#define BM8563_CONTROL2 (0x01)
+#define BM8563_SECONDS (0x02) // to 0x08: seconds, minutes, hours, days, weekdays, months, years
+#define BM8563_ALARM (0x09) // to 0x0C: minute, hour, day, weekday
+#define BM8563_CLKOUT (0x0D)
+#define BM8563_TIMER_CONTROL (0x0E)
+#define BM8563_TIMER (0x0F)
+
+#define BM8563_CONTROL2_TIE (0x01)
+#define BM8563_CONTROL2_AIE (0x02)
+#define BM8563_CONTROL2_TF (0x04)
+#define BM8563_CONTROL2_AF (0x08)
+#define BM8563_VL (0x80) // seconds: the oscillator stopped, time not to be trusted
+#define BM8563_CENTURY (0x80) // months: 21xx
+#define BM8563_ALARM_DISABLE (0x80)
+#define BM8563_TIMER_ENABLE (0x80)
+#define BM8563_TIMER_1HZ (0x02)
+#define BM8563_TIMER_1_60HZ (0x03)
+
+// irq(handler) flags
+#define BM8563_IRQ_ALARM (1)
+#define BM8563_IRQ_TIMER (2)
+
+#define BCD_ROW(t) t*10, t*10+1, t*10+2, t*10+3, t*10+4, t*10+5, t*10+6, t*10+7, t*10+8, t*10+9, 0, 0, 0, 0, 0, 0
+static const uint8_t rp2_bm8563_from_bcd[160] = {
+    BCD_ROW(0), BCD_ROW(1), BCD_ROW(2), BCD_ROW(3), BCD_ROW(4),
+    BCD_ROW(5), BCD_ROW(6), BCD_ROW(7), BCD_ROW(8), BCD_ROW(9),
+};
+
+#define TO_BCD_ROW(t) (t<<4), (t<<4)|1, (t<<4)|2, (t<<4)|3, (t<<4)|4, (t<<4)|5, (t<<4)|6, (t<<4)|7, (t<<4)|8, (t<<4)|9
+static const uint8_t rp2_bm8563_to_bcd[100] = {
+    TO_BCD_ROW(0), TO_BCD_ROW(1), TO_BCD_ROW(2), TO_BCD_ROW(3), TO_BCD_ROW(4),
+    TO_BCD_ROW(5), TO_BCD_ROW(6), TO_BCD_ROW(7), TO_BCD_ROW(8), TO_BCD_ROW(9),
+};
+
+static inline uint8_t rp2_bm8563_bcd(uint8_t bcd) {
+    return bcd<sizeof(rp2_bm8563_from_bcd) ? rp2_bm8563_from_bcd[bcd] : 0;
+}
+
+typedef struct _rp2_bm8563_obj_t {
+    mp_obj_base_t base;
+    mp_obj_t i2c; // machine.I2C or machine.SoftI2C
+    uint8_t addr;
+    uint8_t trusted;
+    int8_t irq_pin; // -1: none
+    mp_obj_t handler;
+    volatile uint32_t wakeups;
+} rp2_bm8563_obj_t;
+
+// The one with the INT pin, for the GPIO interruption
+MP_REGISTER_ROOT_POINTER(void *rp2_bm8563_irq_obj);
+
+// Registers ==========================================================================================
+static void rp2_bm8563_read(rp2_bm8563_obj_t *self, uint8_t reg, uint8_t *buf, size_t len) {
+    mp_obj_base_t *i2c = (mp_obj_base_t *)MP_OBJ_TO_PTR(self->i2c);
+    mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(i2c->type, protocol);
+    mp_machine_i2c_buf_t bufs = {.len = 1, .buf = &reg};
+    int ret = i2c_p->transfer(i2c, self->addr, 1, &bufs, 0);
+    if(ret>=0){
+        bufs.len = len;
+        bufs.buf = buf;
+        ret = i2c_p->transfer(i2c, self->addr, 1, &bufs, MP_MACHINE_I2C_FLAG_READ | MP_MACHINE_I2C_FLAG_STOP);
+    }
+    if(ret<0) mp_raise_OSError(-ret);
+}
+
+static void rp2_bm8563_write(rp2_bm8563_obj_t *self, uint8_t reg, const uint8_t *buf, size_t len) {
+    mp_obj_base_t *i2c = (mp_obj_base_t *)MP_OBJ_TO_PTR(self->i2c);
+    mp_machine_i2c_p_t *i2c_p = (mp_machine_i2c_p_t *)MP_OBJ_TYPE_GET_SLOT(i2c->type, protocol);
+    uint8_t data[8];
+    data[0] = reg;
+    for(size_t i=0; i<len && i<7; i++){
+        data[i+1] = buf[i];
+    }
+    mp_machine_i2c_buf_t bufs = {.len = len+1, .buf = data};
+    int ret = i2c_p->transfer(i2c, self->addr, 1, &bufs, MP_MACHINE_I2C_FLAG_STOP);
+    if(ret<0) mp_raise_OSError(-ret);
+}
+
+static inline void rp2_bm8563_write_byte(rp2_bm8563_obj_t *self, uint8_t reg, uint8_t value) {
+    rp2_bm8563_write(self, reg, &value, 1);
+}
+
+static void rp2_bm8563_read_time(rp2_bm8563_obj_t *self, timeutils_struct_time_t *tm) {
+    uint8_t b[7];
+    rp2_bm8563_read(self, BM8563_SECONDS, b, sizeof(b));
+    self->trusted = (b[0] & BM8563_VL)==0;
+    tm->tm_sec = rp2_bm8563_bcd(b[0]&0x7F);
+    tm->tm_min = rp2_bm8563_bcd(b[1]&0x7F);
+    tm->tm_hour = rp2_bm8563_bcd(b[2]&0x3F);
+    tm->tm_mday = rp2_bm8563_bcd(b[3]&0x3F);
+    tm->tm_wday = rp2_bm8563_bcd(b[4]&0x07);
+    tm->tm_mon = rp2_bm8563_bcd(b[5]&0x1F);
+    tm->tm_year = ((b[5] & BM8563_CENTURY) ? 2100 : 2000)+rp2_bm8563_bcd(b[6]);
+    tm->tm_yday = 0;
+}
+
+// Interruption =======================================================================================
+static mp_obj_t rp2_bm8563_service(mp_obj_t self_in) {
+    // Scheduled by the INT edge: clears the flags (that releases the pin), then calls the handler
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    uint8_t control;
+    rp2_bm8563_read(self, BM8563_CONTROL2, &control, 1);
+    mp_int_t flags = ((control & BM8563_CONTROL2_AF) ? BM8563_IRQ_ALARM : 0) | ((control & BM8563_CONTROL2_TF) ? BM8563_IRQ_TIMER : 0);
+    if(flags==0) return mp_const_none;
+    // writing 1 leaves a flag as it is, 0 clears it
+    rp2_bm8563_write_byte(self, BM8563_CONTROL2, control & ~(BM8563_CONTROL2_AF | BM8563_CONTROL2_TF));
+    if(self->handler!=mp_const_none){
+        mp_call_function_1(self->handler, MP_OBJ_NEW_SMALL_INT(flags));
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_bm8563_service_obj, rp2_bm8563_service);
+
+static void rp2_bm8563_gpio_irq(void) {
+    // Shared with machine.Pin, which acknowledges whatever is left
+    rp2_bm8563_obj_t *self = MP_STATE_PORT(rp2_bm8563_irq_obj);
+    if(self==NULL || self->irq_pin<0) return;
+    io_bank0_irq_ctrl_hw_t *irq_ctrl_base = get_core_num() ? &io_bank0_hw->proc1_irq_ctrl : &io_bank0_hw->proc0_irq_ctrl;
+    uint8_t gpio = self->irq_pin;
+    uint32_t events = (irq_ctrl_base->ints[gpio>>3u]>>(4*(gpio&7)))&0xfu;
+    if(events==0) return;
+    gpio_acknowledge_irq(gpio, events);
+    self->wakeups++;
+    mp_sched_schedule(MP_OBJ_FROM_PTR(&rp2_bm8563_service_obj), MP_OBJ_FROM_PTR(self));
+}
+
+static void rp2_bm8563_release_irq(void) {
+    rp2_bm8563_obj_t *self = MP_STATE_PORT(rp2_bm8563_irq_obj);
+    if(self==NULL) return;
+    gpio_set_irq_enabled(self->irq_pin, GPIO_IRQ_EDGE_FALL, false);
+    irq_remove_handler(IO_IRQ_BANK0, rp2_bm8563_gpio_irq);
+    self->irq_pin = -1;
+    MP_STATE_PORT(rp2_bm8563_irq_obj) = NULL;
+}
+
+void rp2_bm8563_deinit(void) {
+    // Soft reset, before machine.Pin's handler goes away
+    rp2_bm8563_release_irq();
+}
+
+// General configs ======================================================================================
+
+static mp_obj_t rp2_bm8563_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_i2c, ARG_address, ARG_irq_pin, ARG_init };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_i2c,     MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_address, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 81} },
+        { MP_QSTR_irq_pin, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_init,    MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mp_obj_t i2c = args[ARG_i2c].u_obj;
+    // only the machine I2C types carry an mp_machine_i2c_p_t protocol; streams have one of their own
+    if(!mp_obj_is_type(i2c, &machine_i2c_type) && !mp_obj_is_type(i2c, &mp_machine_soft_i2c_type)){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid I2C object!"));
+    }
+    if(args[ARG_address].u_int<0 || args[ARG_address].u_int>127){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid address!"));
+    }
+    int8_t irq_pin = -1;
+    if(args[ARG_irq_pin].u_obj!=mp_const_none){
+        irq_pin = mp_hal_get_pin_obj(args[ARG_irq_pin].u_obj);
+    }
+
+    rp2_bm8563_obj_t *self = mp_obj_malloc(rp2_bm8563_obj_t, &rp2_bm8563_type);
+    self->i2c = i2c;
+    self->addr = args[ARG_address].u_int;
+    self->trusted = 0;
+    self->irq_pin = -1;
+    self->handler = mp_const_none;
+    self->wakeups = 0;
+
+    if(args[ARG_init].u_bool){
+        // Clock running, alarm and timer interruptions off, CLKOUT off, timer stopped at 1/60Hz
+        static const uint8_t control[2] = {0x00, 0x00};
+        static const uint8_t clkout[2] = {0x03, 0x03};
+        rp2_bm8563_write(self, BM8563_CONTROL1, control, 2);
+        rp2_bm8563_write(self, BM8563_CLKOUT, clkout, 2);
+    }
+
+    if(irq_pin>=0){
+        uint32_t state = save_and_disable_interrupts();
+        rp2_bm8563_release_irq();
+        restore_interrupts(state);
+        gpio_init(irq_pin);
+        gpio_set_dir(irq_pin, GPIO_IN);
+        gpio_pull_up(irq_pin); // INT is open drain
+        self->irq_pin = irq_pin;
+        MP_STATE_PORT(rp2_bm8563_irq_obj) = self;
+        gpio_acknowledge_irq(irq_pin, GPIO_IRQ_EDGE_FALL);
+        irq_add_shared_handler(IO_IRQ_BANK0, rp2_bm8563_gpio_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY+10);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+        gpio_set_irq_enabled(irq_pin, GPIO_IRQ_EDGE_FALL, true);
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void rp2_bm8563_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "BM8563(address=%u, irq_pin=%d)", self->addr, self->irq_pin);
+}
+
+static mp_obj_t rp2_bm8563_close(mp_obj_t self_in) {
+    // Releases the INT pin, the chip keeps its alarm and timer
+    if(MP_STATE_PORT(rp2_bm8563_irq_obj)==MP_OBJ_TO_PTR(self_in)){
+        uint32_t state = save_and_disable_interrupts();
+        rp2_bm8563_release_irq();
+        restore_interrupts(state);
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_bm8563_close_obj, rp2_bm8563_close);
+
+// Main methods =====================================================================================
+static mp_obj_t rp2_bm8563_datetime(size_t n_args, const mp_obj_t *args) {
+    // datetime(): (year, month, day, weekday, hours, minutes, seconds, 0) as machine.RTC.datetime()
+    // datetime(dt): dt in that form, or (year, month, day, hours, minutes, seconds)
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    if(n_args==1){
+        timeutils_struct_time_t tm;
+        rp2_bm8563_read_time(self, &tm);
+        mp_obj_t tuple[8] = {
+            MP_OBJ_NEW_SMALL_INT(tm.tm_year),
+            MP_OBJ_NEW_SMALL_INT(tm.tm_mon),
+            MP_OBJ_NEW_SMALL_INT(tm.tm_mday),
+            MP_OBJ_NEW_SMALL_INT(tm.tm_wday),
+            MP_OBJ_NEW_SMALL_INT(tm.tm_hour),
+            MP_OBJ_NEW_SMALL_INT(tm.tm_min),
+            MP_OBJ_NEW_SMALL_INT(tm.tm_sec),
+            MP_OBJ_NEW_SMALL_INT(0),
+        };
+        return mp_obj_new_tuple(8, tuple);
+    }
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(args[1], &len, &items);
+    if(len!=6 && len!=8){
+        mp_raise_ValueError(MP_ERROR_TEXT("datetime must have 6 or 8 fields!"));
+    }
+    size_t t = (len==8) ? 4 : 3; // first time field
+    mp_int_t year = mp_obj_get_int(items[0]);
+    mp_int_t month = mp_obj_get_int(items[1]);
+    mp_int_t day = mp_obj_get_int(items[2]);
+    mp_int_t hour = mp_obj_get_int(items[t]);
+    mp_int_t minute = mp_obj_get_int(items[t+1]);
+    mp_int_t second = mp_obj_get_int(items[t+2]);
+    if(year<2000 || year>2199) mp_raise_ValueError(MP_ERROR_TEXT("Invalid year!"));
+    if(month<1 || month>12) mp_raise_ValueError(MP_ERROR_TEXT("Invalid month!"));
+    if(day<1 || (mp_uint_t)day>timeutils_days_in_month(year, month)) mp_raise_ValueError(MP_ERROR_TEXT("Invalid day!"));
+    if(hour<0 || hour>23) mp_raise_ValueError(MP_ERROR_TEXT("Invalid hour!"));
+    if(minute<0 || minute>59) mp_raise_ValueError(MP_ERROR_TEXT("Invalid minute!"));
+    if(second<0 || second>59) mp_raise_ValueError(MP_ERROR_TEXT("Invalid second!"));
+
+    uint8_t b[7] = {
+        rp2_bm8563_to_bcd[second], // clears VL
+        rp2_bm8563_to_bcd[minute],
+        rp2_bm8563_to_bcd[hour],
+        rp2_bm8563_to_bcd[day],
+        timeutils_calc_weekday(year, month, day),
+        rp2_bm8563_to_bcd[month] | (year>2099 ? BM8563_CENTURY : 0),
+        rp2_bm8563_to_bcd[year%100],
+    };
+    rp2_bm8563_write(self, BM8563_SECONDS, b, sizeof(b));
+    self->trusted = 1;
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rp2_bm8563_datetime_obj, 1, 2, rp2_bm8563_datetime);
+
+static mp_obj_t rp2_bm8563_sync(mp_obj_t self_in) {
+    // The chip's time into the RP2040 RTC (machine.RTC, time.localtime), True if it can be trusted
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    timeutils_struct_time_t tm;
+    rp2_bm8563_read_time(self, &tm);
+    struct timespec ts = { 0, 0 };
+    ts.tv_sec = timeutils_seconds_since_epoch(tm.tm_year, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    aon_timer_set_time(&ts);
+    mp_hal_time_ns_set_from_rtc();
+    return mp_obj_new_bool(self->trusted);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_bm8563_sync_obj, rp2_bm8563_sync);
+
+static mp_obj_t rp2_bm8563_trusted(mp_obj_t self_in) {
+    // False when the oscillator stopped (battery out) and the time was not set since, as of the last read
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_bool(self->trusted);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_bm8563_trusted_obj, rp2_bm8563_trusted);
+
+static void rp2_bm8563_set_interrupt(rp2_bm8563_obj_t *self, uint8_t enable, uint8_t on) {
+    uint8_t control;
+    rp2_bm8563_read(self, BM8563_CONTROL2, &control, 1);
+    control = on ? (control|enable) : (control&~enable);
+    // flags written as 1 stay as they are
+    rp2_bm8563_write_byte(self, BM8563_CONTROL2, control | BM8563_CONTROL2_AF | BM8563_CONTROL2_TF);
+}
+
+static mp_obj_t rp2_bm8563_alarm(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // alarm(minute=None, hour=None, day=None, weekday=None): fires when all the given fields match,
+    // none given disables it. Shares the registers with bm8563.py readAlarmRam/writeAlarmRam.
+    enum { ARG_minute, ARG_hour, ARG_day, ARG_weekday };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_minute,  MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_hour,    MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_day,     MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_weekday, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    static const uint8_t limits[4][2] = {{0, 59}, {0, 23}, {1, 31}, {0, 6}};
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    uint8_t b[4];
+    uint8_t any = 0;
+    for(uint8_t i=0; i<4; i++){
+        if(args[i].u_obj==mp_const_none){
+            b[i] = BM8563_ALARM_DISABLE;
+            continue;
+        }
+        mp_int_t value = mp_obj_get_int(args[i].u_obj);
+        if(value<limits[i][0] || value>limits[i][1]){
+            mp_raise_ValueError(MP_ERROR_TEXT("Invalid alarm!"));
+        }
+        b[i] = rp2_bm8563_to_bcd[value];
+        any = 1;
+    }
+    rp2_bm8563_set_interrupt(self, BM8563_CONTROL2_AIE, 0);
+    rp2_bm8563_write(self, BM8563_ALARM, b, sizeof(b));
+    if(any){
+        // a stale flag would hold INT low and hide the edge
+        uint8_t control;
+        rp2_bm8563_read(self, BM8563_CONTROL2, &control, 1);
+        rp2_bm8563_write_byte(self, BM8563_CONTROL2, (control & ~BM8563_CONTROL2_AF) | BM8563_CONTROL2_TF | BM8563_CONTROL2_AIE);
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(rp2_bm8563_alarm_obj, 1, rp2_bm8563_alarm);
+
+static mp_obj_t rp2_bm8563_timer(mp_obj_t self_in, mp_obj_t seconds_in) {
+    // timer(seconds): one countdown, counted in seconds up to 255 s, then in minutes (rounded up) up
+    // to 255 min; timer(0) stops it. Shares the register with readAlarmRam/writeAlarmRam.
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_int_t seconds = mp_obj_get_int(seconds_in);
+    if(seconds<0 || seconds>255*60){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid timer!"));
+    }
+    rp2_bm8563_set_interrupt(self, BM8563_CONTROL2_TIE, 0);
+    rp2_bm8563_write_byte(self, BM8563_TIMER_CONTROL, BM8563_TIMER_1_60HZ);
+    if(seconds==0) return mp_const_none;
+    uint8_t b[2];
+    if(seconds<=255){
+        b[0] = BM8563_TIMER_ENABLE | BM8563_TIMER_1HZ;
+        b[1] = seconds;
+    }else{
+        b[0] = BM8563_TIMER_ENABLE | BM8563_TIMER_1_60HZ;
+        b[1] = (seconds+59)/60;
+    }
+    uint8_t control;
+    rp2_bm8563_read(self, BM8563_CONTROL2, &control, 1);
+    rp2_bm8563_write_byte(self, BM8563_CONTROL2, (control & ~BM8563_CONTROL2_TF) | BM8563_CONTROL2_AF | BM8563_CONTROL2_TIE);
+    rp2_bm8563_write_byte(self, BM8563_TIMER, b[1]);
+    rp2_bm8563_write_byte(self, BM8563_TIMER_CONTROL, b[0]);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(rp2_bm8563_timer_obj, rp2_bm8563_timer);
+
+static mp_obj_t rp2_bm8563_irq(size_t n_args, const mp_obj_t *args) {
+    // irq(handler): handler(flags) after the alarm and/or the timer fired, flags of ALARM and TIMER.
+    // Needs irq_pin; returns the number of INT edges seen so far.
+    rp2_bm8563_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    if(n_args==2){
+        if(self->irq_pin<0){
+            mp_raise_ValueError(MP_ERROR_TEXT("No irq_pin!"));
+        }
+        if(args[1]!=mp_const_none && !mp_obj_is_callable(args[1])){
+            mp_raise_ValueError(MP_ERROR_TEXT("Invalid handler!"));
+        }
+        self->handler = args[1];
+    }
+    return mp_obj_new_int_from_uint(self->wakeups);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rp2_bm8563_irq_obj, 1, 2, rp2_bm8563_irq);
+
+static const mp_rom_map_elem_t rp2_bm8563_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&rp2_bm8563_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_datetime), MP_ROM_PTR(&rp2_bm8563_datetime_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sync), MP_ROM_PTR(&rp2_bm8563_sync_obj) },
+    { MP_ROM_QSTR(MP_QSTR_trusted), MP_ROM_PTR(&rp2_bm8563_trusted_obj) },
+    { MP_ROM_QSTR(MP_QSTR_alarm), MP_ROM_PTR(&rp2_bm8563_alarm_obj) },
+    { MP_ROM_QSTR(MP_QSTR_timer), MP_ROM_PTR(&rp2_bm8563_timer_obj) },
+    { MP_ROM_QSTR(MP_QSTR_irq), MP_ROM_PTR(&rp2_bm8563_irq_obj) },
+    // irq flags
+    { MP_ROM_QSTR(MP_QSTR_ALARM), MP_ROM_INT(BM8563_IRQ_ALARM) },
+    { MP_ROM_QSTR(MP_QSTR_TIMER), MP_ROM_INT(BM8563_IRQ_TIMER) },
+};
+static MP_DEFINE_CONST_DICT(rp2_bm8563_locals_dict, rp2_bm8563_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    rp2_bm8563_type,
+    MP_QSTR_BM8563,
+    MP_TYPE_FLAG_NONE,
+    make_new, rp2_bm8563_make_new,
+    print, rp2_bm8563_print,
+    locals_dict, &rp2_bm8563_locals_dict
+    );
@@ -0,0 +1,201 @@
+#include <string.h>
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "modrp2.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/timer.h"
+
+// CPU accounting =====================================================================================
+// Each core is always running on behalf of one source: the interpreter by default, or GC, idle, a
+// blocking I2C transfer, the triac interruptions, the analyzer DMA interruption or the PendSV
+// dispatch. Entering and leaving a source charges the time since the last switch to the one that
+// was running, so a nested interruption is taken out of what it interrupted. Time is counted in
+// CPU cycles with SysTick (free running, as for the triac telemetry) and kept in ns at the clk_sys
+// frequency of the moment (machine.freq() may change it), or from the 1MHz timer for idle (the
+// clock may be divided while asleep) and for spans long enough for SysTick to wrap.
+// Interruptions without a hook count with whatever they interrupted.
+
+#define RP2_CPU_SYSTICK_MASK (0x00FFFFFF)
+#define RP2_CPU_SYSTICK_SPAN (0x00800000) // cycles, above that the timer is used
+
+typedef struct _rp2_cpu_core_t {
+    uint8_t current;
+    uint8_t fresh; // last_systick is not from this core's SysTick yet
+    uint32_t last_systick;
+    uint32_t last_us;
+    uint64_t ns[RP2_CPU_SOURCES];
+} rp2_cpu_core_t;
+
+static volatile uint8_t rp2_cpu_enabled = 0;
+static uint32_t rp2_cpu_hz = 0;
+static uint32_t rp2_cpu_ns_per_cycle; // 16.16 fixed point
+static uint32_t rp2_cpu_span_us; // RP2_CPU_SYSTICK_SPAN in us
+static rp2_cpu_core_t rp2_cpu_cores[2];
+static spin_lock_t *rp2_cpu_lock = NULL;
+
+typedef struct _rp2_cpu_obj_t {
+    mp_obj_base_t base;
+} rp2_cpu_obj_t;
+
+static const rp2_cpu_obj_t rp2_cpu_obj = {{&rp2_cpu_accounting_type}};
+
+// Hooks ==============================================================================================
+// Spin lock held. Only recomputed when clk_sys changes
+static inline void rp2_cpu_clock(void) {
+    uint32_t hz = clock_get_hz(clk_sys);
+    if(hz==rp2_cpu_hz) return;
+    rp2_cpu_hz = hz;
+    rp2_cpu_ns_per_cycle = (1000000000ULL<<16)/hz;
+    rp2_cpu_span_us = ((uint64_t)RP2_CPU_SYSTICK_SPAN*1000000)/hz;
+}
+
+// Spin lock held
+static inline void rp2_cpu_charge(rp2_cpu_core_t *core) {
+    if(!(systick_hw->csr&1)){
+        // SysTick is per core, and only the engine core had it started
+        systick_hw->rvr = RP2_CPU_SYSTICK_MASK;
+        systick_hw->csr = 5; // CPU clock, no interruption
+        core->fresh = 1;
+    }
+    uint32_t systick = systick_hw->cvr;
+    uint32_t us = timer_hw->timerawl;
+    uint32_t elapsed_us = us-core->last_us;
+    uint32_t cycles = (core->last_systick-systick)&RP2_CPU_SYSTICK_MASK; // counts down
+    rp2_cpu_clock();
+    if(core->fresh || core->current==RP2_CPU_IDLE || elapsed_us>=rp2_cpu_span_us){
+        core->ns[core->current] += (uint64_t)elapsed_us*1000;
+    } else {
+        core->ns[core->current] += ((uint64_t)cycles*rp2_cpu_ns_per_cycle)>>16;
+    }
+    core->last_systick = systick;
+    core->last_us = us;
+    core->fresh = 0;
+}
+
+uint8_t rp2_cpu_enter(uint8_t source) {
+    if(!rp2_cpu_enabled) return RP2_CPU_NONE;
+    uint32_t state = spin_lock_blocking(rp2_cpu_lock);
+    rp2_cpu_core_t *core = &rp2_cpu_cores[get_core_num()];
+    rp2_cpu_charge(core);
+    uint8_t previous = core->current;
+    core->current = source;
+    spin_unlock(rp2_cpu_lock, state);
+    return previous;
+}
+
+void rp2_cpu_exit(uint8_t previous) {
+    if(previous==RP2_CPU_NONE) return;
+    uint32_t state = spin_lock_blocking(rp2_cpu_lock);
+    rp2_cpu_core_t *core = &rp2_cpu_cores[get_core_num()];
+    rp2_cpu_charge(core);
+    core->current = previous;
+    spin_unlock(rp2_cpu_lock, state);
+}
+
+// Spin lock held. The other core's first span is counted from the timer
+static void rp2_cpu_reset(void) {
+    uint32_t us = timer_hw->timerawl;
+    for(uint8_t i=0; i<2; i++){
+        memset(rp2_cpu_cores[i].ns, 0, sizeof(rp2_cpu_cores[i].ns));
+        rp2_cpu_cores[i].last_systick = systick_hw->cvr;
+        rp2_cpu_cores[i].last_us = us;
+        rp2_cpu_cores[i].fresh = (i!=get_core_num());
+    }
+}
+
+void rp2_cpu_deinit(void) {
+    rp2_cpu_enabled = 0;
+}
+
+// General configs ======================================================================================
+
+static mp_obj_t rp2_cpu_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    mp_arg_check_num(n_args, n_kw, 0, 0, false);
+    if(rp2_cpu_lock==NULL){
+        rp2_cpu_lock = spin_lock_init(spin_lock_claim_unused(true));
+    }
+    if(!rp2_cpu_enabled){
+        uint32_t state = spin_lock_blocking(rp2_cpu_lock);
+        rp2_cpu_clock();
+        rp2_cpu_reset();
+        rp2_cpu_cores[0].current = RP2_CPU_PYTHON;
+        rp2_cpu_cores[1].current = RP2_CPU_PYTHON;
+        rp2_cpu_enabled = 1;
+        spin_unlock(rp2_cpu_lock, state);
+    }
+    return MP_OBJ_FROM_PTR(&rp2_cpu_obj);
+}
+
+static void rp2_cpu_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mp_printf(print, "CPUAccounting(%s)", rp2_cpu_enabled ? "on" : "off");
+}
+
+static mp_obj_t rp2_cpu_close(mp_obj_t self_in) {
+    rp2_cpu_enabled = 0;
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_cpu_close_obj, rp2_cpu_close);
+
+// Main methods =====================================================================
+
+static mp_obj_t rp2_cpu_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // stats(core=0, reset=False): us spent on each source (indexed by PYTHON, GC, ...) since the
+    // last reset, including the span still running. reset restarts the counts of both cores.
+    enum { ARG_self, ARG_core, ARG_reset };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_self, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_core, MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_reset, MP_ARG_BOOL, {.u_bool = false} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mp_int_t core = args[ARG_core].u_int;
+    if(core<0 || core>1){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid core!"));
+    }
+    if(!rp2_cpu_enabled){
+        mp_raise_ValueError(MP_ERROR_TEXT("CPUAccounting closed!"));
+    }
+
+    uint64_t ns[RP2_CPU_SOURCES];
+    uint32_t state = spin_lock_blocking(rp2_cpu_lock);
+    // the other core's running span is charged on its next switch
+    if(core==get_core_num()) rp2_cpu_charge(&rp2_cpu_cores[core]);
+    memcpy(ns, rp2_cpu_cores[core].ns, sizeof(ns));
+    if(args[ARG_reset].u_bool) rp2_cpu_reset();
+    spin_unlock(rp2_cpu_lock, state);
+
+    mp_obj_t tuple[RP2_CPU_SOURCES];
+    for(uint8_t i=0; i<RP2_CPU_SOURCES; i++){
+        tuple[i] = mp_obj_new_int_from_ull(ns[i]/1000);
+    }
+    return mp_obj_new_tuple(RP2_CPU_SOURCES, tuple);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(rp2_cpu_stats_obj, 1, rp2_cpu_stats);
+
+static const mp_rom_map_elem_t rp2_cpu_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&rp2_cpu_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&rp2_cpu_stats_obj) },
+    // stats() indexes
+    { MP_ROM_QSTR(MP_QSTR_PYTHON), MP_ROM_INT(RP2_CPU_PYTHON) },
+    { MP_ROM_QSTR(MP_QSTR_GC), MP_ROM_INT(RP2_CPU_GC) },
+    { MP_ROM_QSTR(MP_QSTR_IDLE), MP_ROM_INT(RP2_CPU_IDLE) },
+    { MP_ROM_QSTR(MP_QSTR_I2C), MP_ROM_INT(RP2_CPU_I2C) },
+    { MP_ROM_QSTR(MP_QSTR_TRIAC), MP_ROM_INT(RP2_CPU_TRIAC) },
+    { MP_ROM_QSTR(MP_QSTR_ANALYZER), MP_ROM_INT(RP2_CPU_ANALYZER) },
+    { MP_ROM_QSTR(MP_QSTR_PENDSV), MP_ROM_INT(RP2_CPU_PENDSV) },
+    { MP_ROM_QSTR(MP_QSTR_SOURCES), MP_ROM_INT(RP2_CPU_SOURCES) },
+};
+static MP_DEFINE_CONST_DICT(rp2_cpu_locals_dict, rp2_cpu_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    rp2_cpu_accounting_type,
+    MP_QSTR_CPUAccounting,
+    MP_TYPE_FLAG_NONE,
+    make_new, rp2_cpu_make_new,
+    print, rp2_cpu_print,
+    locals_dict, &rp2_cpu_locals_dict
+    );
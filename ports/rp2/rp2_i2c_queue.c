@@ -0,0 +1,537 @@
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/mperrno.h"
+#include "py/stream.h"
+#include "modrp2.h"
+#include "modmachine.h"
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+// I2C transaction queue ==============================================================================
+// Transactions (a write, a read, or a write then a read with a restart) are queued per bus and run
+// in the background: at submit() the bytes are turned into IC_DATA_CMD entries, one DMA channel feeds
+// them to the TX FIFO and another one empties the RX FIFO into the read buffer. The I2C interruption
+// (STOP_DET or TX_ABRT) closes a transaction and starts the next one, so the interpreter only pays for
+// the submit. Completions are signalled by callback(queue) (scheduled), by wait(), and as a stream of
+// (tag, status) records for select/asyncio. The blocking machine.I2C methods wait for the queue first.
+// A wait gives up when no transaction ends within the timeout of the machine.I2C object (a slave
+// holding SCL, a STOP_DET that never comes): the queue is aborted and ETIMEDOUT raised.
+
+#define I2C_QUEUE_SLOTS (16) // max depth, power of 2
+#define I2C_QUEUE_DONE (16) // completions kept for read(), power of 2
+#define I2C_QUEUE_STOP_TIMEOUT_US (100000)
+
+typedef struct _rp2_i2c_queue_slot_t {
+    uint16_t tag;
+    uint8_t addr;
+    uint16_t *cmds; // write bytes then read commands, as fed to IC_DATA_CMD
+    size_t cmds_alloc; // entries, kept across transactions
+    size_t cmds_len;
+    uint8_t *rbuf;
+    size_t rlen;
+    mp_obj_t read_obj; // keeps the read buffer alive until the transaction ends
+} rp2_i2c_queue_slot_t;
+
+// Packed as read from the stream: struct format "<Hh", status is 0 or -errno
+typedef struct _rp2_i2c_queue_done_t {
+    uint16_t tag;
+    int16_t status;
+} rp2_i2c_queue_done_t;
+
+typedef struct _rp2_i2c_queue_obj_t {
+    mp_obj_base_t base;
+    uint8_t id; // I2C bus
+    uint8_t active;
+    uint8_t depth;
+    uint8_t dma_tx;
+    uint8_t dma_rx;
+    uint32_t timeout_us; // of the machine.I2C object, for wait()
+    volatile uint8_t running; // the slot at tail is on the bus
+    volatile int16_t error; // of the running transaction
+    uint16_t next_tag;
+    volatile uint32_t head; // transactions submitted
+    volatile uint32_t tail; // transactions finished
+    volatile uint32_t done_head;
+    volatile uint32_t done_tail;
+    volatile uint32_t dropped;
+    mp_obj_t callback;
+    rp2_i2c_queue_slot_t slots[I2C_QUEUE_SLOTS];
+    rp2_i2c_queue_done_t done[I2C_QUEUE_DONE];
+} rp2_i2c_queue_obj_t;
+
+MP_REGISTER_ROOT_POINTER(void *rp2_i2c_queue_obj[2]);
+
+static inline rp2_i2c_queue_obj_t *rp2_i2c_queue_of(uint8_t id) {
+    return MP_STATE_PORT(rp2_i2c_queue_obj[id]);
+}
+
+// Interruption side ==================================================================================
+static void rp2_i2c_queue_start(rp2_i2c_queue_obj_t *self) {
+    // Interruptions disabled, or from the I2C interruption
+    rp2_i2c_queue_slot_t *slot = &self->slots[self->tail&(I2C_QUEUE_SLOTS-1)];
+    i2c_inst_t *inst = i2c_get_instance(self->id);
+    i2c_hw_t *hw = i2c_get_hw(inst);
+    self->running = 1;
+    self->error = 0;
+    hw->enable = 0;
+    hw->tar = slot->addr;
+    hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+    (void)hw->clr_tx_abrt;
+    (void)hw->clr_stop_det;
+    if(slot->rlen){
+        dma_channel_config config = dma_channel_get_default_config(self->dma_rx);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+        channel_config_set_dreq(&config, i2c_get_dreq(inst, false));
+        dma_channel_configure(self->dma_rx, &config, slot->rbuf, &hw->data_cmd, slot->rlen, true);
+    }
+    dma_channel_config config = dma_channel_get_default_config(self->dma_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, i2c_get_dreq(inst, true));
+    dma_channel_configure(self->dma_tx, &config, &hw->data_cmd, slot->cmds, slot->cmds_len, true);
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+}
+
+static void rp2_i2c_queue_record(rp2_i2c_queue_obj_t *self) {
+    // Closes the slot at tail with self->error
+    rp2_i2c_queue_slot_t *slot = &self->slots[self->tail&(I2C_QUEUE_SLOTS-1)];
+    uint32_t done_head = self->done_head;
+    if(done_head-self->done_tail>=I2C_QUEUE_DONE){
+        self->dropped++;
+    }else{
+        rp2_i2c_queue_done_t *done = &self->done[done_head&(I2C_QUEUE_DONE-1)];
+        done->tag = slot->tag;
+        done->status = -self->error;
+        __dmb();
+        self->done_head = done_head+1;
+    }
+    slot->rbuf = NULL;
+    slot->rlen = 0;
+    slot->read_obj = MP_OBJ_NULL;
+    self->tail++;
+}
+
+static void rp2_i2c_queue_signal(rp2_i2c_queue_obj_t *self) {
+    if(self->callback!=mp_const_none){
+        mp_sched_schedule(self->callback, MP_OBJ_FROM_PTR(self));
+    }
+    __sev(); // wakes wait() out of WFE
+}
+
+static void rp2_i2c_queue_finish(rp2_i2c_queue_obj_t *self) {
+    rp2_i2c_queue_record(self);
+    if(self->head!=self->tail){
+        rp2_i2c_queue_start(self);
+    }else{
+        self->running = 0;
+        // unmasked, STOP_DET would be taken from the blocking machine.I2C transfers
+        i2c_get_hw(i2c_get_instance(self->id))->intr_mask = 0;
+    }
+    rp2_i2c_queue_signal(self);
+}
+
+static void rp2_i2c_queue_abort(rp2_i2c_queue_obj_t *self) {
+    // Interruptions disabled. The running transaction and the queued ones end with ETIMEDOUT
+    i2c_hw_t *hw = i2c_get_hw(i2c_get_instance(self->id));
+    hw->intr_mask = 0;
+    dma_channel_abort(self->dma_tx);
+    dma_channel_abort(self->dma_rx);
+    hw->enable = 0; // flushes the FIFOs and lets the bus go, the next start enables it again
+    while(self->head!=self->tail){
+        self->error = MP_ETIMEDOUT;
+        rp2_i2c_queue_record(self);
+    }
+    self->running = 0;
+    rp2_i2c_queue_signal(self);
+}
+
+static void rp2_i2c_queue_irq(uint8_t id) {
+    rp2_i2c_queue_obj_t *self = rp2_i2c_queue_of(id);
+    i2c_hw_t *hw = i2c_get_hw(i2c_get_instance(id));
+    uint32_t status = hw->raw_intr_stat & hw->intr_mask;
+    if(self==NULL || !self->running){
+        hw->intr_mask = 0;
+        return;
+    }
+    if(status & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS){
+        // the controller flushes the TX FIFO and sends a STOP, that ends the transaction. The FIFO
+        // stays flushed until TX_ABRT is cleared: the channels must be stopped first, or the TX one
+        // would push the remaining commands and start a stray transaction
+        uint32_t source = hw->tx_abrt_source;
+        dma_channel_abort(self->dma_tx);
+        dma_channel_abort(self->dma_rx);
+        while(dma_channel_is_busy(self->dma_tx) || dma_channel_is_busy(self->dma_rx)){
+            tight_loop_contents();
+        }
+        (void)hw->clr_tx_abrt;
+        self->error = (source & I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS) ? MP_ENODEV : MP_EIO;
+    }
+    if(status & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS){
+        (void)hw->clr_stop_det;
+        // everything read is in the RX FIFO by now, the channel takes a few cycles to empty it
+        for(uint32_t i=0; !self->error && dma_channel_is_busy(self->dma_rx); i++){
+            if(i>=1000){
+                dma_channel_abort(self->dma_rx);
+                self->error = MP_EIO;
+            }
+        }
+        rp2_i2c_queue_finish(self);
+    }
+}
+
+static void rp2_i2c_queue_i2c0_irq(void) {
+    rp2_i2c_queue_irq(0);
+}
+
+static void rp2_i2c_queue_i2c1_irq(void) {
+    rp2_i2c_queue_irq(1);
+}
+
+static inline irq_handler_t rp2_i2c_queue_handler(uint8_t id) {
+    return id ? rp2_i2c_queue_i2c1_irq : rp2_i2c_queue_i2c0_irq;
+}
+
+// Setup ==============================================================================================
+static void rp2_i2c_queue_stop(rp2_i2c_queue_obj_t *self) {
+    // Drops what was not started, gives the running transaction a moment to end, releases the bus
+    if(self==NULL || !self->active) return;
+    uint32_t state = save_and_disable_interrupts();
+    self->head = self->tail+self->running;
+    restore_interrupts(state);
+    uint64_t limit = time_us_64()+I2C_QUEUE_STOP_TIMEOUT_US;
+    while(self->running && time_us_64()<limit){
+        tight_loop_contents();
+    }
+    state = save_and_disable_interrupts();
+    i2c_get_hw(i2c_get_instance(self->id))->intr_mask = 0;
+    if(self->running){
+        dma_channel_abort(self->dma_tx);
+        dma_channel_abort(self->dma_rx);
+        self->running = 0;
+    }
+    self->tail = self->head;
+    restore_interrupts(state);
+    for(uint8_t i=0; i<I2C_QUEUE_SLOTS; i++){
+        self->slots[i].read_obj = MP_OBJ_NULL;
+    }
+    irq_remove_handler(I2C0_IRQ+self->id, rp2_i2c_queue_handler(self->id));
+    dma_channel_unclaim(self->dma_tx);
+    dma_channel_unclaim(self->dma_rx);
+    self->active = 0;
+    MP_STATE_PORT(rp2_i2c_queue_obj[self->id]) = NULL;
+}
+
+void rp2_i2c_queue_deinit(void) {
+    // Soft reset, before the DMA channels are released
+    for(uint8_t id=0; id<2; id++){
+        rp2_i2c_queue_stop(rp2_i2c_queue_of(id));
+    }
+}
+
+static int rp2_i2c_queue_wait_empty(rp2_i2c_queue_obj_t *self, uint32_t timeout_us, mp_int_t limit_ms) {
+    // Until the queue is empty: 0, or 1 after limit_ms (-1: no limit). -MP_ETIMEDOUT when no
+    // transaction ended for timeout_us, the queue is aborted then
+    mp_uint_t start = mp_hal_ticks_ms();
+    uint32_t tail = self->tail;
+    uint32_t progress = time_us_32();
+    while(self->head!=self->tail){
+        uint32_t now = time_us_32();
+        if(self->tail!=tail){
+            tail = self->tail;
+            progress = now;
+        }
+        uint32_t stalled = now-progress;
+        if(stalled>=timeout_us){
+            uint32_t state = save_and_disable_interrupts();
+            bool stuck = (self->tail==tail && self->head!=self->tail);
+            if(stuck) rp2_i2c_queue_abort(self);
+            restore_interrupts(state);
+            if(stuck) return -MP_ETIMEDOUT;
+            continue; // ended meanwhile
+        }
+        mp_uint_t wait_ms = (timeout_us-stalled)/1000+1;
+        if(limit_ms>=0){
+            mp_uint_t elapsed = mp_hal_ticks_ms()-start;
+            if(elapsed>=(mp_uint_t)limit_ms) return 1;
+            if(limit_ms-elapsed<wait_ms) wait_ms = limit_ms-elapsed;
+        }
+        mp_event_wait_ms(wait_ms);
+    }
+    return 0;
+}
+
+int rp2_i2c_queue_wait_idle(uint8_t id, uint32_t timeout_us) {
+    // The blocking machine.I2C transfers take the bus once the queued ones are done
+    rp2_i2c_queue_obj_t *self = rp2_i2c_queue_of(id);
+    if(self==NULL) return 0;
+    return rp2_i2c_queue_wait_empty(self, timeout_us, -1);
+}
+
+uint8_t rp2_i2c_queue_busy(void) {
+    // A transfer on the bus, whose SCL comes from clk_sys (for the idle clock lowering)
+    for(uint8_t id=0; id<2; id++){
+        rp2_i2c_queue_obj_t *self = rp2_i2c_queue_of(id);
+        if(self!=NULL && self->running) return 1;
+    }
+    return 0;
+}
+
+// General configs ======================================================================================
+
+static rp2_i2c_queue_obj_t *rp2_i2c_queue_get(mp_obj_t self_in) {
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if(!self->active) mp_raise_ValueError(MP_ERROR_TEXT("I2CQueue closed!"));
+    return self;
+}
+
+static mp_obj_t rp2_i2c_queue_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_i2c, ARG_depth, ARG_callback };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_i2c,      MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_depth,    MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 8} },
+        { MP_QSTR_callback, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    uint8_t id = machine_i2c_get_id(args[ARG_i2c].u_obj);
+    uint32_t timeout_us = machine_i2c_get_timeout(args[ARG_i2c].u_obj);
+    if(args[ARG_depth].u_int<1 || args[ARG_depth].u_int>I2C_QUEUE_SLOTS){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid depth!"));
+    }
+    if(args[ARG_callback].u_obj!=mp_const_none && !mp_obj_is_callable(args[ARG_callback].u_obj)){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid callback!"));
+    }
+
+    // one queue per bus, a new one replaces the old
+    rp2_i2c_queue_stop(rp2_i2c_queue_of(id));
+    int dma_tx = dma_claim_unused_channel(false);
+    int dma_rx = dma_claim_unused_channel(false);
+    if(dma_tx<0 || dma_rx<0){
+        if(dma_tx>=0) dma_channel_unclaim(dma_tx);
+        if(dma_rx>=0) dma_channel_unclaim(dma_rx);
+        mp_raise_OSError(MP_EBUSY);
+    }
+
+    rp2_i2c_queue_obj_t *self = mp_obj_malloc(rp2_i2c_queue_obj_t, &rp2_i2c_queue_type);
+    self->id = id;
+    self->depth = args[ARG_depth].u_int;
+    self->dma_tx = dma_tx;
+    self->dma_rx = dma_rx;
+    self->timeout_us = timeout_us;
+    self->running = 0;
+    self->error = 0;
+    self->next_tag = 0;
+    self->head = 0;
+    self->tail = 0;
+    self->done_head = 0;
+    self->done_tail = 0;
+    self->dropped = 0;
+    self->callback = args[ARG_callback].u_obj;
+    for(uint8_t i=0; i<I2C_QUEUE_SLOTS; i++){
+        self->slots[i].cmds = NULL;
+        self->slots[i].cmds_alloc = 0;
+        self->slots[i].rbuf = NULL;
+        self->slots[i].rlen = 0;
+        self->slots[i].read_obj = MP_OBJ_NULL;
+    }
+
+    i2c_hw_t *hw = i2c_get_hw(i2c_get_instance(id));
+    hw->intr_mask = 0;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+    hw->dma_tdlr = 8; // TX DREQ at half FIFO
+    hw->dma_rdlr = 0; // RX DREQ for every byte
+    MP_STATE_PORT(rp2_i2c_queue_obj[id]) = self;
+    self->active = 1;
+    irq_add_shared_handler(I2C0_IRQ+id, rp2_i2c_queue_handler(id), PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(I2C0_IRQ+id, true);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void rp2_i2c_queue_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "I2CQueue(%u, depth=%u, pending=%u, %s)", self->id, self->depth,
+        (unsigned)(self->head-self->tail), self->active ? "active" : "closed");
+}
+
+static mp_obj_t rp2_i2c_queue_close(mp_obj_t self_in) {
+    rp2_i2c_queue_stop(MP_OBJ_TO_PTR(self_in));
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_i2c_queue_close_obj, rp2_i2c_queue_close);
+
+// Main methods =====================================================================================
+static mp_obj_t rp2_i2c_queue_submit(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // submit(addr, write=None, read=None): tag of the transaction, OSError(EAGAIN) with the queue full.
+    // write is copied, so its buffer can change right away; read is filled in the background.
+    enum { ARG_addr, ARG_write, ARG_read };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_addr,  MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_write, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_read,  MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    rp2_i2c_queue_obj_t *self = rp2_i2c_queue_get(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if(args[ARG_addr].u_int<0 || args[ARG_addr].u_int>127){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid address!"));
+    }
+    mp_buffer_info_t wbuf = {.buf = NULL, .len = 0};
+    mp_buffer_info_t rbuf = {.buf = NULL, .len = 0};
+    if(args[ARG_write].u_obj!=mp_const_none){
+        mp_get_buffer_raise(args[ARG_write].u_obj, &wbuf, MP_BUFFER_READ);
+    }
+    if(args[ARG_read].u_obj!=mp_const_none){
+        mp_get_buffer_raise(args[ARG_read].u_obj, &rbuf, MP_BUFFER_WRITE);
+    }
+    size_t len = wbuf.len+rbuf.len;
+    if(len==0){
+        mp_raise_ValueError(MP_ERROR_TEXT("Empty transaction!"));
+    }
+    if(self->head-self->tail>=self->depth){
+        mp_raise_OSError(MP_EAGAIN);
+    }
+
+    // the slot at head is not on the bus, the interruption leaves it alone
+    rp2_i2c_queue_slot_t *slot = &self->slots[self->head&(I2C_QUEUE_SLOTS-1)];
+    if(slot->cmds_alloc<len){
+        slot->cmds = m_renew(uint16_t, slot->cmds, slot->cmds_alloc, len);
+        slot->cmds_alloc = len;
+    }
+    const uint8_t *src = wbuf.buf;
+    for(size_t i=0; i<wbuf.len; i++){
+        slot->cmds[i] = src[i];
+    }
+    for(size_t i=0; i<rbuf.len; i++){
+        slot->cmds[wbuf.len+i] = I2C_IC_DATA_CMD_CMD_BITS | ((i==0 && wbuf.len) ? I2C_IC_DATA_CMD_RESTART_BITS : 0);
+    }
+    slot->cmds[len-1] |= I2C_IC_DATA_CMD_STOP_BITS;
+    slot->cmds_len = len;
+    slot->addr = args[ARG_addr].u_int;
+    slot->rbuf = rbuf.buf;
+    slot->rlen = rbuf.len;
+    slot->read_obj = args[ARG_read].u_obj;
+    slot->tag = self->next_tag++;
+
+    __dmb();
+    uint32_t state = save_and_disable_interrupts();
+    self->head++;
+    if(!self->running) rp2_i2c_queue_start(self);
+    restore_interrupts(state);
+    return MP_OBJ_NEW_SMALL_INT(slot->tag);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(rp2_i2c_queue_submit_obj, 2, rp2_i2c_queue_submit);
+
+static mp_obj_t rp2_i2c_queue_done(mp_obj_t self_in, mp_obj_t tag_in) {
+    // Whether the transaction tagged tag is over (done or failed)
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    uint16_t tag = mp_obj_get_int(tag_in);
+    uint32_t state = save_and_disable_interrupts();
+    uint32_t tail = self->tail;
+    uint32_t head = self->head;
+    restore_interrupts(state);
+    for(uint32_t i=tail; i!=head; i++){
+        if(self->slots[i&(I2C_QUEUE_SLOTS-1)].tag==tag) return mp_const_false;
+    }
+    return mp_const_true;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(rp2_i2c_queue_done_obj, rp2_i2c_queue_done);
+
+static mp_obj_t rp2_i2c_queue_wait(size_t n_args, const mp_obj_t *args) {
+    // Until the queue is empty, False after timeout_ms (-1: no timeout). OSError(ETIMEDOUT) when a
+    // transaction takes longer than the I2C timeout: the queue is aborted, all end with ETIMEDOUT
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t timeout_ms = (n_args==2 && args[1]!=mp_const_none) ? mp_obj_get_int(args[1]) : -1;
+    int ret = rp2_i2c_queue_wait_empty(self, self->timeout_us, timeout_ms);
+    if(ret<0) mp_raise_OSError(-ret);
+    return mp_obj_new_bool(ret==0);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rp2_i2c_queue_wait_obj, 1, 2, rp2_i2c_queue_wait);
+
+static mp_obj_t rp2_i2c_queue_pending(mp_obj_t self_in) {
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return MP_OBJ_NEW_SMALL_INT(self->head-self->tail);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_i2c_queue_pending_obj, rp2_i2c_queue_pending);
+
+static mp_obj_t rp2_i2c_queue_dropped(mp_obj_t self_in) {
+    // Completion records lost because nobody read them
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_int_from_uint(self->dropped);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_i2c_queue_dropped_obj, rp2_i2c_queue_dropped);
+
+// Stream ===========================================================================================
+static mp_uint_t rp2_i2c_queue_stream_read(mp_obj_t self_in, void *buf_in, mp_uint_t size, int *errcode) {
+    // Whole completion records, struct "<Hh", never blocks
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if(size<sizeof(rp2_i2c_queue_done_t)){
+        *errcode = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+    rp2_i2c_queue_done_t *buf = buf_in;
+    mp_uint_t count = 0;
+    while(count<size/sizeof(rp2_i2c_queue_done_t) && self->done_head!=self->done_tail){
+        uint32_t tail = self->done_tail;
+        __dmb();
+        buf[count++] = self->done[tail&(I2C_QUEUE_DONE-1)];
+        __dmb();
+        self->done_tail = tail+1;
+    }
+    if(count==0){
+        *errcode = MP_EAGAIN;
+        return MP_STREAM_ERROR;
+    }
+    return count*sizeof(rp2_i2c_queue_done_t);
+}
+
+static mp_uint_t rp2_i2c_queue_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    rp2_i2c_queue_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if(request==MP_STREAM_POLL){
+        mp_uint_t ret = 0;
+        if((arg&MP_STREAM_POLL_RD) && self->done_head!=self->done_tail){
+            ret |= MP_STREAM_POLL_RD;
+        }
+        return ret;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+static const mp_stream_p_t rp2_i2c_queue_stream_p = {
+    .read = rp2_i2c_queue_stream_read,
+    .ioctl = rp2_i2c_queue_stream_ioctl,
+    .is_text = false,
+};
+
+static const mp_rom_map_elem_t rp2_i2c_queue_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&rp2_i2c_queue_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_submit), MP_ROM_PTR(&rp2_i2c_queue_submit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_done), MP_ROM_PTR(&rp2_i2c_queue_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_wait), MP_ROM_PTR(&rp2_i2c_queue_wait_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pending), MP_ROM_PTR(&rp2_i2c_queue_pending_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dropped), MP_ROM_PTR(&rp2_i2c_queue_dropped_obj) },
+    // Stream
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_RECORD_SIZE), MP_ROM_INT(sizeof(rp2_i2c_queue_done_t)) },
+};
+static MP_DEFINE_CONST_DICT(rp2_i2c_queue_locals_dict, rp2_i2c_queue_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    rp2_i2c_queue_type,
+    MP_QSTR_I2CQueue,
+    MP_TYPE_FLAG_NONE,
+    make_new, rp2_i2c_queue_make_new,
+    print, rp2_i2c_queue_print,
+    protocol, &rp2_i2c_queue_stream_p,
+    locals_dict, &rp2_i2c_queue_locals_dict
+    );
@@ -0,0 +1,217 @@
+#include <string.h>
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/mpthread.h"
+#include "modrp2.h"
+#include "triac.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+#include "hardware/structs/pwm.h"
+#include "hardware/structs/scb.h"
+#include "hardware/structs/timer.h"
+#if MICROPY_HW_ENABLE_USBDEV
+#include "tusb.h"
+#endif
+
+// Low-power idle =====================================================================================
+// Every wait of the interpreter (time.sleep, asyncio, select, the REPL) ends in rp2_idle_wfe(). Once
+// rp2.Idle() is enabled, core0 sleeps there with the interruptions masked and SEVONPEND set: any GPIO,
+// encoder, alarm, DMA or USB interruption still wakes the core, but its handler only runs after the
+// clock is back. So clk_sys can be divided while asleep without slowing down the triac interruptions,
+// which keep their timing from the 1MHz timer anyway (clk_ref). Nothing is lowered while something
+// else depends on clk_sys: core1 running (engine or _thread), PWM slices, I2CQueue transfers, USB, an
+// enabled UART or SPI (clk_peri comes from clk_sys, a lowered clock would change the baud rate of the
+// UART REPL or of a transfer in flight), a running PowerAnalyzer (its ADC DMA would fall behind and
+// the FIFO overrun) or an enabled PIO state machine (a QuadEncoder would sample too slowly and miss
+// edges). Wakes by the soft timer alarm measure the wake-up latency: from the alarm to the code
+// running again at full clock.
+
+#define RP2_IDLE_SCR_SEVONPEND (1u<<4) // same bit in ARMv6-M and ARMv8-M
+#define RP2_IDLE_MAX_DIVIDER (255)
+
+typedef struct _rp2_idle_stats_t {
+    uint32_t sleeps;
+    uint32_t lowered; // sleeps with clk_sys divided
+    uint64_t sleep_us;
+    uint32_t timed; // wakes by the soft timer alarm
+    uint64_t latency_sum;
+    uint32_t latency_max;
+} rp2_idle_stats_t;
+
+static volatile uint8_t rp2_idle_enabled = 0;
+static uint32_t rp2_idle_divider = 1;
+static rp2_idle_stats_t rp2_idle_stats;
+
+typedef struct _rp2_idle_obj_t {
+    mp_obj_base_t base;
+} rp2_idle_obj_t;
+
+static const rp2_idle_obj_t rp2_idle_obj = {{&rp2_idle_type}};
+
+// Idle hook ==========================================================================================
+static inline bool rp2_idle_can_lower(void) {
+    if(rp2_idle_divider<=1) return false;
+    if(triac_realtime_core()!=0) return false;
+    #if MICROPY_PY_THREAD
+    if(core1_entry!=NULL) return false;
+    #endif
+    if(pwm_hw->en!=0) return false;
+    if(rp2_i2c_queue_busy()) return false;
+    if(uart_is_enabled(uart0) || uart_is_enabled(uart1)) return false;
+    if((spi_get_const_hw(spi0)->cr1|spi_get_const_hw(spi1)->cr1)&SPI_SSPCR1_SSE_BITS) return false;
+    if(triac_power_analyzer_active()) return false;
+    for(uint i=0; i<NUM_PIOS; i++){
+        if(pio_get_instance(i)->ctrl&PIO_CTRL_SM_ENABLE_BITS) return false;
+    }
+    #if MICROPY_HW_ENABLE_USBDEV
+    if(tud_mounted()) return false;
+    #endif
+    return true;
+}
+
+void rp2_idle_wfe(void) {
+    if(!rp2_idle_enabled || get_core_num()!=0){
+        uint8_t cpu = rp2_cpu_enter(RP2_CPU_IDLE);
+        __wfe();
+        rp2_cpu_exit(cpu);
+        return;
+    }
+    #if PICO_ARM
+    uint32_t state = save_and_disable_interrupts();
+    // Scheduled in an interruption since the last mp_handle_pending(): don't sleep
+    #if MICROPY_ENABLE_SCHEDULER
+    if(MP_STATE_VM(sched_state)!=MP_SCHED_IDLE){
+        restore_interrupts(state);
+        return;
+    }
+    #endif
+    uint32_t alarm = 1u<<MICROPY_HW_SOFT_TIMER_ALARM_NUM;
+    bool armed = (timer_hw->armed&alarm)!=0;
+    uint32_t target = timer_hw->alarm[MICROPY_HW_SOFT_TIMER_ALARM_NUM];
+    uint32_t div = clocks_hw->clk[clk_sys].div;
+    bool lower = rp2_idle_can_lower();
+    uint32_t start = timer_hw->timerawl;
+
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_IDLE);
+    if(lower) clocks_hw->clk[clk_sys].div = rp2_idle_divider<<CLOCKS_CLK_SYS_DIV_INT_LSB;
+    __wfe();
+    if(lower) clocks_hw->clk[clk_sys].div = div;
+    rp2_cpu_exit(cpu);
+
+    uint32_t now = timer_hw->timerawl;
+    rp2_idle_stats.sleeps++;
+    rp2_idle_stats.lowered += lower;
+    rp2_idle_stats.sleep_us += now-start;
+    if(armed && (timer_hw->intr&alarm)){
+        uint32_t latency = now-target;
+        rp2_idle_stats.timed++;
+        rp2_idle_stats.latency_sum += latency;
+        if(latency>rp2_idle_stats.latency_max) rp2_idle_stats.latency_max = latency;
+    }
+    restore_interrupts(state);
+    #else
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_IDLE);
+    __wfe();
+    rp2_cpu_exit(cpu);
+    rp2_idle_stats.sleeps++;
+    #endif
+}
+
+static void rp2_idle_enable(uint8_t enable) {
+    uint32_t state = save_and_disable_interrupts();
+    #if PICO_ARM
+    if(enable) scb_hw->scr |= RP2_IDLE_SCR_SEVONPEND;
+    else scb_hw->scr &= ~RP2_IDLE_SCR_SEVONPEND;
+    #endif
+    rp2_idle_enabled = enable;
+    restore_interrupts(state);
+}
+
+void rp2_idle_deinit(void) {
+    rp2_idle_enable(0);
+    rp2_idle_divider = 1;
+}
+
+// General configs ======================================================================================
+
+static uint32_t rp2_idle_get_divider(mp_obj_t divider_in) {
+    mp_int_t divider = mp_obj_get_int(divider_in);
+    if(divider<1 || divider>RP2_IDLE_MAX_DIVIDER){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid divider!"));
+    }
+    return divider;
+}
+
+static mp_obj_t rp2_idle_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_divider };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_divider, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_SMALL_INT(1)} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    // A single hook: a new Idle() only changes the settings
+    rp2_idle_divider = rp2_idle_get_divider(args[ARG_divider].u_obj);
+    rp2_idle_enable(1);
+    return MP_OBJ_FROM_PTR(&rp2_idle_obj);
+}
+
+static void rp2_idle_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mp_printf(print, "Idle(%s, divider=%u)", rp2_idle_enabled ? "on" : "off", (unsigned)rp2_idle_divider);
+}
+
+static mp_obj_t rp2_idle_close(mp_obj_t self_in) {
+    rp2_idle_enable(0);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_idle_close_obj, rp2_idle_close);
+
+// Main methods =====================================================================
+
+static mp_obj_t rp2_idle_divider_fun(size_t n_args, const mp_obj_t *args) {
+    // divider([n]): clk_sys divider while asleep, 1 keeps the clock
+    if(n_args==2){
+        rp2_idle_divider = rp2_idle_get_divider(args[1]);
+    }
+    return MP_OBJ_NEW_SMALL_INT(rp2_idle_divider);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rp2_idle_divider_obj, 1, 2, rp2_idle_divider_fun);
+
+static mp_obj_t rp2_idle_stats_fun(size_t n_args, const mp_obj_t *args) {
+    // (sleeps, lowered, asleep in us, timed wakes, mean and max wake-up latency in us), since the
+    // last reset. stats(True) also resets them.
+    uint32_t state = save_and_disable_interrupts();
+    rp2_idle_stats_t stats = rp2_idle_stats;
+    if(n_args==2 && mp_obj_is_true(args[1])) memset(&rp2_idle_stats, 0, sizeof(rp2_idle_stats));
+    restore_interrupts(state);
+    mp_obj_t tuple[6] = {
+        mp_obj_new_int_from_uint(stats.sleeps),
+        mp_obj_new_int_from_uint(stats.lowered),
+        mp_obj_new_int_from_ull(stats.sleep_us),
+        mp_obj_new_int_from_uint(stats.timed),
+        mp_obj_new_int_from_uint(stats.timed ? stats.latency_sum/stats.timed : 0),
+        mp_obj_new_int_from_uint(stats.latency_max),
+    };
+    return mp_obj_new_tuple(6, tuple);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rp2_idle_stats_obj, 1, 2, rp2_idle_stats_fun);
+
+static const mp_rom_map_elem_t rp2_idle_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&rp2_idle_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_divider), MP_ROM_PTR(&rp2_idle_divider_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&rp2_idle_stats_obj) },
+};
+static MP_DEFINE_CONST_DICT(rp2_idle_locals_dict, rp2_idle_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    rp2_idle_type,
+    MP_QSTR_Idle,
+    MP_TYPE_FLAG_NONE,
+    make_new, rp2_idle_make_new,
+    print, rp2_idle_print,
+    locals_dict, &rp2_idle_locals_dict
+    );
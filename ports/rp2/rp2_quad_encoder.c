@@ -0,0 +1,339 @@
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "modrp2.h"
+#include "hardware/clocks.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+// Quadrature encoder =================================================================================
+// The state machine decodes the two pins and pushes the count only when it changes, the RX FIFO
+// interruption (PIO IRQ1, IRQ0 stays with rp2.PIO) keeps the latest count and a short history of
+// (time, count). Reading is O(1) and never blocks; the velocity and the acceleration are estimated
+// from the history when asked, nothing runs while the knob is still.
+
+#define QUAD_ENCODER_HISTORY (16) // power of 2
+#define QUAD_ENCODER_UPDATE_PC (17)
+
+// Same decoder as pico-examples quadrature_encoder.pio, but every "no change" entry of the jump table,
+// 15 (last 11 current 11, the resting state with pull ups) included, goes to the sampling (19) instead
+// of the push (17), so a still knob pushes nothing. The table is indexed by mov pc: offset 0 only.
+static const uint16_t rp2_quad_encoder_instructions[] = {
+    0x0013, //  0: jmp 19      last 00 current 00
+    0x0010, //  1: jmp 16      last 00 current 01: decrement
+    0x0017, //  2: jmp 23      last 00 current 10: increment
+    0x0013, //  3: jmp 19      last 00 current 11
+    0x0017, //  4: jmp 23      last 01 current 00: increment
+    0x0013, //  5: jmp 19      last 01 current 01
+    0x0013, //  6: jmp 19      last 01 current 10
+    0x0010, //  7: jmp 16      last 01 current 11: decrement
+    0x0010, //  8: jmp 16      last 10 current 00: decrement
+    0x0013, //  9: jmp 19      last 10 current 01
+    0x0013, // 10: jmp 19      last 10 current 10
+    0x0017, // 11: jmp 23      last 10 current 11: increment
+    0x0013, // 12: jmp 19      last 11 current 00
+    0x0017, // 13: jmp 23      last 11 current 01: increment
+    0x0010, // 14: jmp 16      last 11 current 10: decrement
+    0x0013, // 15: jmp 19      last 11 current 11
+    0x0091, // 16: jmp y--, 17 decrement
+    0xa0c2, // 17: mov isr, y  update (wrap target)
+    0x8000, // 18: push noblock
+    0x60c2, // 19: out isr, 2  sample
+    0x4002, // 20: in pins, 2
+    0xa0e6, // 21: mov osr, isr
+    0xa0a6, // 22: mov pc, isr
+    0xa04a, // 23: mov y, ~y   increment
+    0x0099, // 24: jmp y--, 25
+    0xa04a, // 25: mov y, ~y   (wrap)
+};
+
+static const struct pio_program rp2_quad_encoder_program = {
+    .instructions = rp2_quad_encoder_instructions,
+    .length = MP_ARRAY_SIZE(rp2_quad_encoder_instructions),
+    .origin = 0,
+};
+
+typedef struct _rp2_quad_encoder_history_t {
+    uint32_t head; // entries written
+    uint32_t times[QUAD_ENCODER_HISTORY]; // us
+    int32_t counts[QUAD_ENCODER_HISTORY];
+} rp2_quad_encoder_history_t;
+
+typedef struct _rp2_quad_encoder_obj_t {
+    mp_obj_base_t base;
+    uint8_t id; // StateMachine id
+    uint8_t active;
+    uint8_t invert;
+    uint8_t pin;
+    uint32_t window_us;
+    int32_t offset; // set by value(x)
+    volatile int32_t count;
+    rp2_quad_encoder_history_t history;
+} rp2_quad_encoder_obj_t;
+
+static rp2_quad_encoder_obj_t rp2_quad_encoder_obj[NUM_PIOS * 4];
+static uint8_t rp2_quad_encoder_users[NUM_PIOS]; // state machines running the program, per PIO
+
+static inline PIO rp2_quad_encoder_pio(uint8_t id) {
+    return pio_get_instance(id/4);
+}
+
+static void rp2_quad_encoder_irq(uint8_t pio_index) {
+    PIO pio = pio_get_instance(pio_index);
+    uint32_t now = time_us_32();
+    for(uint8_t sm=0; sm<4; sm++){
+        rp2_quad_encoder_obj_t *self = &rp2_quad_encoder_obj[pio_index*4+sm];
+        if(!self->active || pio_sm_is_rx_fifo_empty(pio, sm)) continue;
+        int32_t count = self->count;
+        while(!pio_sm_is_rx_fifo_empty(pio, sm)){
+            count = (int32_t)pio_sm_get(pio, sm);
+        }
+        uint32_t i = self->history.head&(QUAD_ENCODER_HISTORY-1);
+        self->history.times[i] = now;
+        self->history.counts[i] = count;
+        self->history.head++;
+        self->count = count;
+    }
+}
+
+static void rp2_quad_encoder_pio0_irq(void) {
+    rp2_quad_encoder_irq(0);
+}
+
+static void rp2_quad_encoder_pio1_irq(void) {
+    rp2_quad_encoder_irq(1);
+}
+
+#if NUM_PIOS >= 3
+static void rp2_quad_encoder_pio2_irq(void) {
+    rp2_quad_encoder_irq(2);
+}
+#endif
+
+static irq_handler_t rp2_quad_encoder_handler(uint8_t pio_index) {
+    #if NUM_PIOS >= 3
+    if(pio_index==2) return rp2_quad_encoder_pio2_irq;
+    #endif
+    return pio_index ? rp2_quad_encoder_pio1_irq : rp2_quad_encoder_pio0_irq;
+}
+
+static void rp2_quad_encoder_stop(rp2_quad_encoder_obj_t *self) {
+    if(!self->active) return;
+    PIO pio = rp2_quad_encoder_pio(self->id);
+    uint8_t pio_index = self->id/4;
+    uint8_t sm = self->id%4;
+    pio_sm_set_enabled(pio, sm, false);
+    pio_set_irqn_source_enabled(pio, 1, pis_sm0_rx_fifo_not_empty+sm, false);
+    self->active = 0;
+    pio_sm_unclaim(pio, sm);
+    if(--rp2_quad_encoder_users[pio_index]==0){
+        irq_remove_handler(pio_get_irq_num(pio, 1), rp2_quad_encoder_handler(pio_index));
+        pio_remove_program(pio, &rp2_quad_encoder_program, 0);
+    }
+}
+
+void rp2_quad_encoder_deinit(void) {
+    // Soft reset, before rp2.PIO releases its state machines
+    for(uint8_t i=0; i<NUM_PIOS*4; i++){
+        rp2_quad_encoder_stop(&rp2_quad_encoder_obj[i]);
+    }
+}
+
+// Velocity ===========================================================================================
+
+// Counts per second up to end: from the last count known window_us before (or the oldest one kept)
+// to the last count at end. Falls towards 0 once the changes stop, 0 with no change in the history.
+static float rp2_quad_encoder_speed(const rp2_quad_encoder_history_t *history, uint32_t end, uint32_t window_us) {
+    uint32_t kept = (history->head<QUAD_ENCODER_HISTORY) ? history->head : QUAD_ENCODER_HISTORY;
+    uint8_t found = 0;
+    int32_t count_end = 0;
+    int32_t count_start = 0;
+    uint32_t time_start = end;
+    for(uint32_t k=1; k<=kept; k++){
+        uint32_t i = (history->head-k)&(QUAD_ENCODER_HISTORY-1);
+        int32_t age = (int32_t)(end-history->times[i]);
+        if(age<0) continue; // after end
+        if(!found) count_end = history->counts[i];
+        found = 1;
+        count_start = history->counts[i];
+        time_start = history->times[i];
+        if(age>=(int32_t)window_us) break;
+    }
+    if(!found || end==time_start) return 0.0f;
+    return (float)(count_end-count_start)*1e6f/(float)(end-time_start);
+}
+
+static void rp2_quad_encoder_snapshot(rp2_quad_encoder_obj_t *self, rp2_quad_encoder_history_t *out) {
+    uint32_t state = save_and_disable_interrupts();
+    *out = self->history;
+    restore_interrupts(state);
+}
+
+// General configs ======================================================================================
+
+static rp2_quad_encoder_obj_t *rp2_quad_encoder_get(mp_obj_t self_in) {
+    rp2_quad_encoder_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if(!self->active) mp_raise_ValueError(MP_ERROR_TEXT("QuadEncoder closed!"));
+    return self;
+}
+
+static mp_obj_t rp2_quad_encoder_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_id, ARG_pin, ARG_invert, ARG_freq, ARG_pull, ARG_window_ms };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_id,        MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_pin,       MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_invert,    MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_freq,      MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1000000} },
+        { MP_QSTR_pull,      MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_window_ms, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 100} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mp_int_t id = args[ARG_id].u_int;
+    if(id<0 || id>=NUM_PIOS*4){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid StateMachine!"));
+    }
+    uint8_t pin = mp_hal_get_pin_obj(args[ARG_pin].u_obj);
+    if(pin+1>=NUM_BANK0_GPIOS){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid pin!"));
+    }
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    if(args[ARG_freq].u_int<2000 || (uint32_t)args[ARG_freq].u_int>sys_hz){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid frequency!"));
+    }
+    if(args[ARG_window_ms].u_int<1 || args[ARG_window_ms].u_int>10000){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid window!"));
+    }
+
+    rp2_quad_encoder_obj_t *self = &rp2_quad_encoder_obj[id];
+    rp2_quad_encoder_stop(self);
+    PIO pio = rp2_quad_encoder_pio(id);
+    uint8_t pio_index = id/4;
+    uint8_t sm = id%4;
+    if(pio_sm_is_claimed(pio, sm)){
+        mp_raise_ValueError(MP_ERROR_TEXT("StateMachine in use!"));
+    }
+    if(rp2_quad_encoder_users[pio_index]==0){
+        if(!pio_can_add_program_at_offset(pio, &rp2_quad_encoder_program, 0)){
+            mp_raise_ValueError(MP_ERROR_TEXT("PIO instruction memory in use!"));
+        }
+        pio_add_program_at_offset(pio, &rp2_quad_encoder_program, 0);
+        irq_add_shared_handler(pio_get_irq_num(pio, 1), rp2_quad_encoder_handler(pio_index), PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(pio_get_irq_num(pio, 1), true);
+    }
+    rp2_quad_encoder_users[pio_index]++;
+    pio_sm_claim(pio, sm);
+
+    self->base.type = &rp2_quad_encoder_type;
+    self->id = id;
+    self->pin = pin;
+    self->invert = args[ARG_invert].u_bool;
+    self->window_us = args[ARG_window_ms].u_int*1000;
+    self->offset = 0;
+    self->count = 0;
+    self->history.times[0] = time_us_32(); // the reference of the first change
+    self->history.counts[0] = 0;
+    self->history.head = 1;
+
+    for(uint8_t i=0; i<2; i++){
+        pio_gpio_init(pio, pin+i);
+        if(args[ARG_pull].u_bool){
+            gpio_pull_up(pin+i);
+        }else{
+            gpio_disable_pulls(pin+i);
+        }
+    }
+    pio_sm_config config = pio_get_default_sm_config();
+    sm_config_set_wrap(&config, 17, 25);
+    sm_config_set_in_pins(&config, pin);
+    sm_config_set_in_shift(&config, false, false, 32);
+    sm_config_set_out_shift(&config, true, false, 32);
+    sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&config, (float)sys_hz/(float)args[ARG_freq].u_int);
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 2, false);
+    pio_sm_init(pio, sm, QUAD_ENCODER_UPDATE_PC, &config);
+    pio_sm_exec(pio, sm, pio_encode_set(pio_y, 0));
+    // The first sample compares with the pins as they are now, and the update pushes the initial 0
+    pio_sm_exec(pio, sm, pio_encode_mov(pio_osr, pio_pins));
+    pio_sm_clear_fifos(pio, sm);
+
+    self->active = 1;
+    pio_set_irqn_source_enabled(pio, 1, pis_sm0_rx_fifo_not_empty+sm, true);
+    pio_sm_set_enabled(pio, sm, true);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+static void rp2_quad_encoder_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    rp2_quad_encoder_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "QuadEncoder(%u, pin=%u, %s)", self->id, self->pin, self->active ? "active" : "closed");
+}
+
+static mp_obj_t rp2_quad_encoder_close(mp_obj_t self_in) {
+    rp2_quad_encoder_stop(MP_OBJ_TO_PTR(self_in));
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_quad_encoder_close_obj, rp2_quad_encoder_close);
+
+// Main methods =====================================================================================
+static mp_obj_t rp2_quad_encoder_value(size_t n_args, const mp_obj_t *args) {
+    // Count of edges (4 per full cycle of the pins), value(x) moves it to x
+    rp2_quad_encoder_obj_t *self = rp2_quad_encoder_get(args[0]);
+    int32_t count = self->invert ? -self->count : self->count;
+    if(n_args==2){
+        self->offset = mp_obj_get_int(args[1])-count;
+        return mp_const_none;
+    }
+    return mp_obj_new_int(count+self->offset);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rp2_quad_encoder_value_obj, 1, 2, rp2_quad_encoder_value);
+
+static mp_obj_t rp2_quad_encoder_velocity(mp_obj_t self_in) {
+    // Counts/s over the last window_ms
+    rp2_quad_encoder_obj_t *self = rp2_quad_encoder_get(self_in);
+    rp2_quad_encoder_history_t history;
+    rp2_quad_encoder_snapshot(self, &history);
+    float speed = rp2_quad_encoder_speed(&history, time_us_32(), self->window_us);
+    return mp_obj_new_float(self->invert ? -speed : speed);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_quad_encoder_velocity_obj, rp2_quad_encoder_velocity);
+
+static mp_obj_t rp2_quad_encoder_acceleration(mp_obj_t self_in) {
+    // Counts/s^2, from the velocities of the last two windows
+    rp2_quad_encoder_obj_t *self = rp2_quad_encoder_get(self_in);
+    rp2_quad_encoder_history_t history;
+    rp2_quad_encoder_snapshot(self, &history);
+    uint32_t now = time_us_32();
+    float recent = rp2_quad_encoder_speed(&history, now, self->window_us);
+    float before = rp2_quad_encoder_speed(&history, now-self->window_us, self->window_us);
+    float acceleration = (recent-before)*1e6f/(float)self->window_us;
+    return mp_obj_new_float(self->invert ? -acceleration : acceleration);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_quad_encoder_acceleration_obj, rp2_quad_encoder_acceleration);
+
+static mp_obj_t rp2_quad_encoder_changes(mp_obj_t self_in) {
+    // Number of count updates seen, to tell whether anything moved since the last call
+    rp2_quad_encoder_obj_t *self = rp2_quad_encoder_get(self_in);
+    return mp_obj_new_int_from_uint(self->history.head);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(rp2_quad_encoder_changes_obj, rp2_quad_encoder_changes);
+
+static const mp_rom_map_elem_t rp2_quad_encoder_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&rp2_quad_encoder_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_value), MP_ROM_PTR(&rp2_quad_encoder_value_obj) },
+    { MP_ROM_QSTR(MP_QSTR_velocity), MP_ROM_PTR(&rp2_quad_encoder_velocity_obj) },
+    { MP_ROM_QSTR(MP_QSTR_acceleration), MP_ROM_PTR(&rp2_quad_encoder_acceleration_obj) },
+    { MP_ROM_QSTR(MP_QSTR_changes), MP_ROM_PTR(&rp2_quad_encoder_changes_obj) },
+};
+static MP_DEFINE_CONST_DICT(rp2_quad_encoder_locals_dict, rp2_quad_encoder_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    rp2_quad_encoder_type,
+    MP_QSTR_QuadEncoder,
+    MP_TYPE_FLAG_NONE,
+    make_new, rp2_quad_encoder_make_new,
+    print, rp2_quad_encoder_print,
+    locals_dict, &rp2_quad_encoder_locals_dict
+    );
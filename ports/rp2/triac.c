@@ -1,13 +1,318 @@
 #include "py/builtin.h"
 #include "py/runtime.h"
 #include "triac.h"
+#include "triac_dsp.h"
 
+#if MICROPY_PY_TRIAC_TEST_HOOKS
+// Test hooks: the engine kernels run over Python buffers, without any hardware, so the tests
+// and benchmarks can check them against a reference. Only in builds made for testing.
+
+// Runs the burst-fire distributor, without any hardware, returning which of the
+// next count half-cycles would conduct (1) or not (0). Useful to check the spread.
+static mp_obj_t triac_burst_pattern(mp_obj_t level_in, mp_obj_t count_in) {
+    mp_int_t level = mp_obj_get_int(level_in);
+    mp_int_t count = mp_obj_get_int(count_in);
+    if(level<0 || level>TRIAC_LEVEL_MAX) mp_raise_ValueError(MP_ERROR_TEXT("Invalid level!"));
+    if(count<0) mp_raise_ValueError(MP_ERROR_TEXT("Invalid count!"));
+    vstr_t vstr;
+    vstr_init_len(&vstr, count);
+    uint16_t accumulator = 0;
+    for(mp_int_t i=0; i<count; i++){
+        vstr.buf[i] = triac_burst_step(&accumulator, level);
+    }
+    return mp_obj_new_bytes_from_vstr(&vstr);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(triac_burst_pattern_obj, triac_burst_pattern);
+
+// Runs the PowerAnalyzer block kernel over a buffer of interleaved 12 bit sample pairs
+// (an array('H')). Returns (pairs, (sum_a, sum_b), (min_a, min_b), (max_a, max_b),
+// (sqsum_a, sqsum_b), cross, (centered_sqsum_a, centered_sqsum_b), centered_cross).
+static mp_obj_t triac_block_stats_fun(mp_obj_t buf_in) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    if(bufinfo.typecode!='H' || (bufinfo.len&3)!=0) mp_raise_ValueError(MP_ERROR_TEXT("Needs an array('H') of sample pairs!"));
+    triac_block_stats_t stats;
+    triac_block_stats(bufinfo.buf, bufinfo.len/4, &stats);
+    mp_obj_t pair[2];
+    mp_obj_t result[8];
+    result[0] = mp_obj_new_int_from_uint(stats.count);
+    pair[0] = mp_obj_new_int_from_ull(stats.sum[0]);
+    pair[1] = mp_obj_new_int_from_ull(stats.sum[1]);
+    result[1] = mp_obj_new_tuple(2, pair);
+    pair[0] = MP_OBJ_NEW_SMALL_INT(stats.min[0]);
+    pair[1] = MP_OBJ_NEW_SMALL_INT(stats.min[1]);
+    result[2] = mp_obj_new_tuple(2, pair);
+    pair[0] = MP_OBJ_NEW_SMALL_INT(stats.max[0]);
+    pair[1] = MP_OBJ_NEW_SMALL_INT(stats.max[1]);
+    result[3] = mp_obj_new_tuple(2, pair);
+    pair[0] = mp_obj_new_int_from_ull(stats.sqsum[0]);
+    pair[1] = mp_obj_new_int_from_ull(stats.sqsum[1]);
+    result[4] = mp_obj_new_tuple(2, pair);
+    result[5] = mp_obj_new_int_from_ull(stats.cross);
+    pair[0] = mp_obj_new_int_from_ull(triac_block_stats_centered_sqsum(&stats, 0));
+    pair[1] = mp_obj_new_int_from_ull(triac_block_stats_centered_sqsum(&stats, 1));
+    result[6] = mp_obj_new_tuple(2, pair);
+    result[7] = mp_obj_new_int_from_ll(triac_block_stats_centered_cross(&stats));
+    return mp_obj_new_tuple(8, result);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(triac_block_stats_obj, triac_block_stats_fun);
+
+static mp_obj_t triac_frame_stats_fun(mp_obj_t buf_in, mp_obj_t channels_in, mp_obj_t reference_in) {
+    // Same as block_stats, for frames of 2 to 4 channels, cross-products against the reference channel
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    mp_int_t channels = mp_obj_get_int(channels_in);
+    mp_int_t reference = mp_obj_get_int(reference_in);
+    if(channels<2 || channels>TRIAC_DSP_MAX_CHANNELS || reference<0 || reference>=channels){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid channels!"));
+    }
+    if(bufinfo.typecode!='H' || (bufinfo.len%(2*channels))!=0) mp_raise_ValueError(MP_ERROR_TEXT("Needs an array('H') of sample frames!"));
+    triac_frame_stats_t stats;
+    triac_frame_stats(bufinfo.buf, bufinfo.len/(2*channels), channels, reference, &stats);
+    mp_obj_t items[7][TRIAC_DSP_MAX_CHANNELS];
+    for(mp_int_t ch=0; ch<channels; ch++){
+        items[0][ch] = mp_obj_new_int_from_ull(stats.sum[ch]);
+        items[1][ch] = MP_OBJ_NEW_SMALL_INT(stats.min[ch]);
+        items[2][ch] = MP_OBJ_NEW_SMALL_INT(stats.max[ch]);
+        items[3][ch] = mp_obj_new_int_from_ull(stats.sqsum[ch]);
+        items[4][ch] = mp_obj_new_int_from_ull(stats.cross[ch]);
+        items[5][ch] = mp_obj_new_int_from_ull(triac_frame_stats_centered_sqsum(&stats, ch));
+        items[6][ch] = mp_obj_new_int_from_ll(triac_frame_stats_centered_cross(&stats, ch));
+    }
+    mp_obj_t result[8];
+    result[0] = mp_obj_new_int_from_uint(stats.count);
+    for(uint i=0; i<7; i++){
+        result[1+i] = mp_obj_new_tuple(channels, items[i]);
+    }
+    return mp_obj_new_tuple(8, result);
+}
+static MP_DEFINE_CONST_FUN_OBJ_3(triac_frame_stats_obj, triac_frame_stats_fun);
+
+static mp_obj_t triac_harmonics_fun(mp_obj_t buf_in, mp_obj_t count_in) {
+    // Same analysis as the PowerAnalyzer, locked to the first channel of the pairs.
+    // Returns (period, [(amplitude0, phase0, amplitude1, phase1), ...]), or None without lock.
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    if(bufinfo.typecode!='H' || (bufinfo.len&3)!=0) mp_raise_ValueError(MP_ERROR_TEXT("Needs an array('H') of sample pairs!"));
+    mp_int_t count = mp_obj_get_int(count_in);
+    if(count<1 || count>TRIAC_DSP_MAX_HARMONICS) mp_raise_ValueError(MP_ERROR_TEXT("Invalid number of harmonics!"));
+    uint32_t pairs = bufinfo.len/4;
+    if(pairs==0) return mp_const_none;
+
+    triac_block_stats_t stats;
+    triac_block_stats(bufinfo.buf, pairs, &stats);
+    int16_t offset[2] = {stats.sum[0]/pairs, stats.sum[1]/pairs};
+    triac_goertzel_t bank[TRIAC_DSP_MAX_HARMONICS];
+    float period;
+    static const uint8_t slot[2] = {0, 1};
+    uint32_t analyzed = triac_harmonic_analysis(bufinfo.buf, pairs, 2, slot, offset, 0, (stats.max[0]-offset[0])/4, bank, count, &period);
+    if(analyzed<2) return mp_const_none;
+    float result[TRIAC_DSP_MAX_HARMONICS][4];
+    triac_harmonic_results(bank, count, analyzed, 0, result);
+
+    mp_obj_t list = mp_obj_new_list(count, NULL);
+    for(mp_int_t h=0; h<count; h++){
+        mp_obj_t tuple[4];
+        for(uint i=0; i<4; i++) tuple[i] = mp_obj_new_float(result[h][i]);
+        mp_obj_list_store(list, MP_OBJ_NEW_SMALL_INT(h), mp_obj_new_tuple(4, tuple));
+    }
+    mp_obj_t pair[2] = {mp_obj_new_float(period), list};
+    return mp_obj_new_tuple(2, pair);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(triac_harmonics_obj, triac_harmonics_fun);
+
+static mp_obj_t triac_pll_track_fun(mp_obj_t buf_in, mp_obj_t half_period_in) {
+    // Runs the zero-cross tracking of the Controller over edge times (array('I'), in us).
+    // Returns (half_period, skew, error, locked, next) with the predicted next crossing in us.
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    if(bufinfo.typecode!='I') mp_raise_ValueError(MP_ERROR_TEXT("Needs an array('I') of edge times!"));
+    mp_int_t half_period = mp_obj_get_int(half_period_in);
+    if(half_period<100 || half_period>1000000) mp_raise_ValueError(MP_ERROR_TEXT("Invalid half period!"));
+    const uint32_t *edges = bufinfo.buf;
+    uint32_t count = bufinfo.len/4;
+    if(count==0) return mp_const_none;
+
+    triac_pll_t pll;
+    triac_pll_reset(&pll, half_period, 1);
+    for(uint32_t i=0; i<count; i++){
+        // relative to the first edge, so the 32 bit times may wrap around
+        triac_pll_edge(&pll, (int64_t)(uint32_t)(edges[i]-edges[0])<<TRIAC_PLL_SHIFT);
+    }
+    const float scale = 1.0f/(1<<TRIAC_PLL_SHIFT);
+    int64_t next = (triac_pll_predict(&pll) + (1<<(TRIAC_PLL_SHIFT-1)))>>TRIAC_PLL_SHIFT;
+    mp_obj_t result[5] = {
+        mp_obj_new_float(pll.half_period*scale),
+        mp_obj_new_float(pll.skew*scale),
+        mp_obj_new_float(pll.error*scale),
+        mp_obj_new_bool(pll.locked>=TRIAC_PLL_LOCK_COUNT),
+        mp_obj_new_int_from_uint((uint32_t)(edges[0]+next)),
+    };
+    return mp_obj_new_tuple(5, result);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(triac_pll_track_obj, triac_pll_track_fun);
+
+static mp_obj_t triac_ramp_profile_fun(size_t n_args, const mp_obj_t *args) {
+    // Runs the level ramp of the Controller, from level start to target at rate %/s, over
+    // count half-cycles of half_period us. Returns the level applied on each half-cycle.
+    mp_int_t start = mp_obj_get_int(args[0]);
+    mp_int_t target = mp_obj_get_int(args[1]);
+    float rate = mp_obj_get_float(args[2]);
+    mp_int_t half_period = mp_obj_get_int(args[3]);
+    mp_int_t count = mp_obj_get_int(args[4]);
+    uint8_t s_curve = (n_args==6) ? mp_obj_is_true(args[5]) : 0;
+    if(start<0 || start>TRIAC_LEVEL_MAX || target<0 || target>TRIAC_LEVEL_MAX) mp_raise_ValueError(MP_ERROR_TEXT("Invalid level!"));
+    if(rate<0.0f) mp_raise_ValueError(MP_ERROR_TEXT("Invalid ramp rate!"));
+    if(half_period<100 || half_period>1000000) mp_raise_ValueError(MP_ERROR_TEXT("Invalid half period!"));
+    if(count<0) mp_raise_ValueError(MP_ERROR_TEXT("Invalid count!"));
+    triac_ramp_t ramp;
+    triac_ramp_reset(&ramp, start);
+    triac_ramp_target(&ramp, target, triac_ramp_rate(rate*TRIAC_LEVEL_MAX/100.0f), s_curve);
+    mp_obj_t list = mp_obj_new_list(count, NULL);
+    for(mp_int_t i=0; i<count; i++){
+        mp_obj_list_store(list, MP_OBJ_NEW_SMALL_INT(i), MP_OBJ_NEW_SMALL_INT(triac_ramp_step(&ramp, half_period)));
+    }
+    return list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_ramp_profile_obj, 5, 6, triac_ramp_profile_fun);
+
+static mp_obj_t triac_curve_fun(mp_obj_t calibration_in, mp_obj_t levels_in) {
+    // Loads a calibration blob as Controller.calibration() does (None: the ideal sine curve).
+    // Returns (blob, delays): the blob dumped back from the table, and the firing delay of each
+    // level as the interruption gets it (0: off, else 1 + delay fraction of the half-cycle).
+    const uint16_t *table = triac_controller_parse_calibration(calibration_in);
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    mp_obj_iter_buf_t iter_buf;
+    mp_obj_t iterable = mp_getiter(levels_in, &iter_buf);
+    mp_obj_t item;
+    while((item = mp_iternext(iterable))!=MP_OBJ_STOP_ITERATION){
+        mp_int_t level = mp_obj_get_int(item);
+        if(level<0 || level>TRIAC_LEVEL_MAX) mp_raise_ValueError(MP_ERROR_TEXT("Invalid level!"));
+        mp_obj_list_append(list, mp_obj_new_int_from_uint(triac_controller_curve_delay(table, level)));
+    }
+    mp_obj_t result[2] = {triac_controller_calibration_blob(table), list};
+    return mp_obj_new_tuple(2, result);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(triac_curve_obj, triac_curve_fun);
+#endif
+
+static mp_obj_t triac_realtime_fun(size_t n_args, const mp_obj_t *args) {
+    // Core running the real-time engine (edges, firing, PowerAnalyzer DMA, Supervisor). It can be
+    // moved to core1 while no Controller, PowerAnalyzer or Supervisor is active, and returns to core0 on soft reset.
+    if(n_args==1){
+        mp_int_t core = mp_obj_get_int(args[0]);
+        if(core!=0 && core!=1) mp_raise_ValueError(MP_ERROR_TEXT("Invalid core!"));
+        if(core!=triac_realtime_core()){
+            if(core==0) mp_raise_ValueError(MP_ERROR_TEXT("The engine returns to core0 on soft reset only!"));
+            if(triac_controller_running() || triac_power_analyzer_active() || triac_supervisor_armed()){
+                mp_raise_ValueError(MP_ERROR_TEXT("Stop the Controllers, the PowerAnalyzer and the Supervisor first!"));
+            }
+            if(!triac_realtime_start()) mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("core1 in use"));
+        }
+    }
+    return MP_OBJ_NEW_SMALL_INT(triac_realtime_core());
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_realtime_obj, 0, 1, triac_realtime_fun);
+
+static mp_obj_t triac_firing_stats_fun(void) {
+    // (pulses, mean lateness, max lateness), in us, since the last call. Resets the
+    // firing telemetry.
+    triac_telemetry_source_t telemetry;
+    triac_telemetry_read(TRIAC_TLM_FIRE, &telemetry, 1);
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(telemetry.count),
+        mp_obj_new_int_from_uint(telemetry.count ? telemetry.latency_sum/telemetry.count : 0),
+        mp_obj_new_int_from_uint(telemetry.latency_max),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(triac_firing_stats_obj, triac_firing_stats_fun);
+
+static uint8_t triac_telemetry_source(mp_obj_t source_in) {
+    mp_int_t source = mp_obj_get_int(source_in);
+    if(source<0 || source>=TRIAC_TLM_SOURCES) mp_raise_ValueError(MP_ERROR_TEXT("Invalid telemetry source!"));
+    return source;
+}
+
+static mp_obj_t triac_telemetry_fun(mp_obj_t source_in) {
+    // (count, worst duration in us, worst latency in us, faults, durations, latencies) of the
+    // interruptions of a source (TLM_*), histograms as tuples of TLM_BUCKETS log2 buckets:
+    // bucket 0 counts 0us, bucket b [2**(b-1), 2**b)us, the last one is open ended
+    triac_telemetry_source_t telemetry;
+    triac_telemetry_read(triac_telemetry_source(source_in), &telemetry, 0);
+    mp_obj_t durations[TRIAC_TLM_BUCKETS];
+    mp_obj_t latencies[TRIAC_TLM_BUCKETS];
+    for(uint i=0; i<TRIAC_TLM_BUCKETS; i++){
+        durations[i] = mp_obj_new_int_from_uint(telemetry.duration[i]);
+        latencies[i] = mp_obj_new_int_from_uint(telemetry.latency[i]);
+    }
+    mp_obj_t tuple[6] = {
+        mp_obj_new_int_from_uint(telemetry.count),
+        mp_obj_new_float(telemetry.duration_max/1000.0f),
+        mp_obj_new_int_from_uint(telemetry.latency_max),
+        mp_obj_new_int_from_uint(telemetry.faults),
+        mp_obj_new_tuple(TRIAC_TLM_BUCKETS, durations),
+        mp_obj_new_tuple(TRIAC_TLM_BUCKETS, latencies),
+    };
+    return mp_obj_new_tuple(6, tuple);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(triac_telemetry_obj, triac_telemetry_fun);
+
+static mp_obj_t triac_telemetry_into_fun(mp_obj_t source_in, mp_obj_t buf_in) {
+    // Same, without allocating, into an array('I') of at least TLM_WORDS: count, worst duration
+    // in ns, worst latency in us, sum of the latencies in us, faults, the two histograms
+    uint8_t source = triac_telemetry_source(source_in);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    if((bufinfo.typecode!='I' && bufinfo.typecode!='L') || bufinfo.len<sizeof(triac_telemetry_source_t)){
+        mp_raise_ValueError(MP_ERROR_TEXT("Needs an array('I') of TLM_WORDS!"));
+    }
+    triac_telemetry_read(source, (triac_telemetry_source_t*)bufinfo.buf, 0);
+    return MP_OBJ_NEW_SMALL_INT(TRIAC_TLM_WORDS);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(triac_telemetry_into_obj, triac_telemetry_into_fun);
+
+static mp_obj_t triac_telemetry_reset_fun(size_t n_args, const mp_obj_t *args) {
+    // Clears all the sources. late_us: latency counted as a fault, 20us by default
+    mp_int_t late = (n_args==1) ? mp_obj_get_int(args[0]) : triac_telemetry_late();
+    if(late<0) mp_raise_ValueError(MP_ERROR_TEXT("Invalid late threshold!"));
+    triac_telemetry_reset(late);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_telemetry_reset_obj, 0, 1, triac_telemetry_reset_fun);
 
 static const mp_rom_map_elem_t triac_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_Triac) },
 
     { MP_ROM_QSTR(MP_QSTR_Controller), MP_ROM_PTR(&mp_triac_controller_type) },
     { MP_ROM_QSTR(MP_QSTR_PowerAnalyzer), MP_ROM_PTR(&mp_triac_power_analyzer_type) },
+    { MP_ROM_QSTR(MP_QSTR_Supervisor), MP_ROM_PTR(&mp_triac_supervisor_type) },
+    #if MICROPY_PY_TRIAC_TEST_HOOKS
+    { MP_ROM_QSTR(MP_QSTR_burst_pattern), MP_ROM_PTR(&triac_burst_pattern_obj) },
+    { MP_ROM_QSTR(MP_QSTR_block_stats), MP_ROM_PTR(&triac_block_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_frame_stats), MP_ROM_PTR(&triac_frame_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_harmonics), MP_ROM_PTR(&triac_harmonics_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pll_track), MP_ROM_PTR(&triac_pll_track_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ramp_profile), MP_ROM_PTR(&triac_ramp_profile_obj) },
+    { MP_ROM_QSTR(MP_QSTR_curve), MP_ROM_PTR(&triac_curve_obj) },
+    #endif
+    { MP_ROM_QSTR(MP_QSTR_realtime), MP_ROM_PTR(&triac_realtime_obj) },
+    { MP_ROM_QSTR(MP_QSTR_firing_stats), MP_ROM_PTR(&triac_firing_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_telemetry), MP_ROM_PTR(&triac_telemetry_obj) },
+    { MP_ROM_QSTR(MP_QSTR_telemetry_into), MP_ROM_PTR(&triac_telemetry_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_telemetry_reset), MP_ROM_PTR(&triac_telemetry_reset_obj) },
+
+    { MP_ROM_QSTR(MP_QSTR_PHASE), MP_ROM_INT(TRIAC_MODE_PHASE) },
+    { MP_ROM_QSTR(MP_QSTR_BURST), MP_ROM_INT(TRIAC_MODE_BURST) },
+    { MP_ROM_QSTR(MP_QSTR_SYNC_GPIO), MP_ROM_INT(TRIAC_SYNC_GPIO) },
+    { MP_ROM_QSTR(MP_QSTR_SYNC_ADC), MP_ROM_INT(TRIAC_SYNC_ADC) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_EDGE), MP_ROM_INT(TRIAC_TLM_EDGE) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_FIRE), MP_ROM_INT(TRIAC_TLM_FIRE) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_CROSS), MP_ROM_INT(TRIAC_TLM_CROSS) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_ANALYZER), MP_ROM_INT(TRIAC_TLM_ANALYZER) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_SUPERVISOR), MP_ROM_INT(TRIAC_TLM_SUPERVISOR) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_BUCKETS), MP_ROM_INT(TRIAC_TLM_BUCKETS) },
+    { MP_ROM_QSTR(MP_QSTR_TLM_WORDS), MP_ROM_INT(TRIAC_TLM_WORDS) },
 };
 static MP_DEFINE_CONST_DICT(triac_module_globals, triac_module_globals_table);
 
@@ -5,59 +5,109 @@
 #include "py/mphal.h"
 #include "py/obj.h"
 #include "pico/time.h"
+#include "hardware/sync.h"
+#include "triac_dsp.h"
+
+// Power levels are expressed in 1/TRIAC_LEVEL_MAX steps of the full power
+#define TRIAC_LEVEL_BITS (10)
+#define TRIAC_LEVEL_MAX (1<<TRIAC_LEVEL_BITS)
+// Calibrated curves: delay fraction (0..65535 of the half period) for
+// TRIAC_CALIBRATION_POINTS equally spaced power levels, interpolated in between
+#define TRIAC_CALIBRATION_POINTS (65)
+
+// Firing modes
+#define TRIAC_MODE_PHASE (0) // leading-edge phase control, every half-cycle
+#define TRIAC_MODE_BURST (1) // integral half-cycles, fired at the zero-cross
+
+// Zero-cross sources
+#define TRIAC_SYNC_GPIO (0) // sense pin edges
+#define TRIAC_SYNC_ADC (1)  // PowerAnalyzer voltage crossings, interpolated between samples
+
+// Burst-fire cycle distributor: first order sigma-delta over half-cycles.
+// Returns 1 if the next half-cycle shall conduct. For a constant level, exactly
+// level half-cycles conduct on every TRIAC_LEVEL_MAX, as evenly spread as possible.
+static inline uint8_t triac_burst_step(uint16_t *accumulator, uint16_t level) {
+    *accumulator += level;
+    if(*accumulator>=TRIAC_LEVEL_MAX){
+        *accumulator -= TRIAC_LEVEL_MAX;
+        return 1;
+    }
+    return 0;
+}
 
 typedef struct _mp_triac_controller_obj_t {
     mp_obj_base_t base;
     uint8_t sense_pin;
     uint8_t percent;
+    uint16_t level;
+    uint8_t mode;
     uint32_t watchdog;
+    uint16_t *calibration; // NULL: uses the ideal sine TRIAC_POWERLINE curve
+    float ramp_rate; // slew of the level changes, in %/s, 0: jumps
+    uint8_t s_curve;
 } mp_triac_controller_obj_t;
 
+// Defaults and limits for the window (sample pairs per analysis), the zero-cross
+// aligned waveform size and the number of window summaries kept in the history ring
 #define POWER_ANALYZER_BUFFER_SIZE (600)
 #define POWER_ANALYZER_HISTO_SIZE (100)
+#define POWER_ANALYZER_HISTORY_SIZE (16)
+#define POWER_ANALYZER_MIN_BUFFER_SIZE (16)
+#define POWER_ANALYZER_MAX_BUFFER_SIZE (8192)
+#define POWER_ANALYZER_MAX_HISTORY_SIZE (1024)
+#define POWER_ANALYZER_INVALID_WINDOW (0xFFFFFFFF)
+#define POWER_ANALYZER_MAX_STREAM_SIZE (32768)
+// One voltage and up to 3 current inputs, sampled round-robin into interleaved frames
+#define POWER_ANALYZER_MAX_CURRENTS (3)
 
 typedef struct _mp_triac_power_analyzer_doublebuffer_obj_t {
-    // for db[i_phase], this structure is modified constantly inside the interruption
+    // for db[i_phase], this structure is modified by the DMA interruption
     // for db[u_phase], this structure can be accessed in userspace, but only
     // while u_phase remains constant during the copy
 
-    // Raw data buffers. Only to be used while in interruption
-    int16_t voltage_buffer[POWER_ANALYZER_BUFFER_SIZE];
-    int16_t current_buffer[POWER_ANALYZER_BUFFER_SIZE];
     // Histo: from a zero-crossing, sums the waveforms (minus offset)
-    // for db[phase], it reflects ready data. For out-of-phase, it will be modified by interruption
-    int32_t histo_voltage[POWER_ANALYZER_HISTO_SIZE];
-    int32_t histo_current[POWER_ANALYZER_HISTO_SIZE];
-    uint8_t histo_count;
-    // Partial statistic calculated inside the interruption, while the data is still beeing sampled
-    uint32_t i_sumV;
-    uint32_t i_sumC;
-    int32_t i_sumP;
-    int16_t i_maxV;
-    int16_t i_maxC;
-    int32_t i_maxP;
-    int16_t i_minV;
-    int16_t i_minC;
-    int32_t i_minP;
-    uint16_t i_histoPos;
-    int16_t i_lastV;
-    uint32_t i_sqsumV;
-    uint32_t i_sqsumC;
+    int32_t *histo_voltage;
+    int32_t *histo_current;
+    uint16_t histo_count;
+    // Harmonics: Goertzel bank locked to the voltage fundamental, over harmonic_pairs pairs
+    uint8_t harmonic_count; // 0: not analyzed
+    uint32_t harmonic_pairs;
+    float period; // in pairs
+    triac_goertzel_t harmonics[TRIAC_DSP_MAX_HARMONICS];
 } mp_triac_power_analyzer_doublebuffer_obj_t;
 
+// Raw results of one window, kept in the history ring
+typedef struct _mp_triac_power_analyzer_summary_t {
+    uint32_t window; // window number, POWER_ANALYZER_INVALID_WINDOW while being written
+    uint32_t timestamp_ms;
+    uint64_t squaresum_voltage;
+    uint64_t squaresum_current;
+    int64_t sum_power;
+    int16_t pos_peak_voltage;
+    int16_t neg_peak_voltage;
+    int16_t pos_peak_current;
+    int16_t neg_peak_current;
+} mp_triac_power_analyzer_summary_t;
+
 typedef struct _mp_triac_power_analyzer_obj_t {
     mp_obj_base_t base;
     uint8_t voltage_pin;
-    uint8_t current_pin;
-    uint16_t sample_rate;
+    uint8_t current_pin; // first current input, the one all the single-current results refer to
+    uint8_t current_count;
+    uint8_t current_pins[POWER_ANALYZER_MAX_CURRENTS];
+    uint8_t channels; // samples per frame: voltage and currents
+    uint32_t sample_rate; // frames per second
+    uint16_t window_size;
+    uint16_t histo_size;
+    uint16_t history_size;
+    uint8_t harmonic_count; // harmonics analyzed on each window, 0: disabled
     float voltage_multiplier;
     float current_multiplier;
     float power_multiplier;
+    float current_multipliers[POWER_ANALYZER_MAX_CURRENTS]; // [0] is current_multiplier
 
-    uint8_t interrupt_count;
     uint8_t i_phase;
     uint8_t u_phase;
-    uint16_t mbp; // Main Buffer Position
     mp_triac_power_analyzer_doublebuffer_obj_t db[2];
     // Offset: avg(readings)
     uint16_t offset_voltage;
@@ -71,18 +121,178 @@ typedef struct _mp_triac_power_analyzer_obj_t {
     int16_t neg_peak_current;
     int32_t neg_peak_power;
     // Squaresum: sum( (readings-offset)^2 )
-    uint32_t squaresum_voltage;
-    uint32_t squaresum_current;
-    int32_t sum_power;
+    uint64_t squaresum_voltage;
+    uint64_t squaresum_current;
+    int64_t sum_power;
+    // Per current input, against the shared voltage ([0] repeats the fields above)
+    uint16_t offset_currents[POWER_ANALYZER_MAX_CURRENTS];
+    int16_t pos_peak_currents[POWER_ANALYZER_MAX_CURRENTS];
+    int16_t neg_peak_currents[POWER_ANALYZER_MAX_CURRENTS];
+    uint64_t squaresum_currents[POWER_ANALYZER_MAX_CURRENTS];
+    int64_t sum_power_currents[POWER_ANALYZER_MAX_CURRENTS];
+
+    // Energy (first current input): accumulated over all windows, in raw units*frames at energy_rate frames/s
+    int64_t energy_active;
+    uint64_t energy_apparent;
+    uint64_t energy_pairs;
+    uint32_t energy_rate;
+    uint32_t persist_period_ms; // 0: no periodic persistence
+    uint32_t persist_last_ms;
+
+    // Streaming: every captured frame goes into a single-producer (interrupt) single-consumer
+    // ring of (voltage, currents...) int16 raw readings, drained through the stream protocol.
+    // Whole blocks that don't fit are dropped and counted.
+    int16_t *stream_buffer; // stream_channels*stream_size values, NULL: not streaming
+    uint32_t stream_size; // in frames, power of 2
+    uint8_t stream_channels;
+    volatile uint32_t stream_head; // frames written, free running
+    volatile uint32_t stream_tail; // frames read, free running
+    volatile uint8_t stream_writing; // a block is being copied in, the ring can't be replaced
+    uint32_t stream_dropped_blocks;
+    uint32_t stream_dropped_pairs;
 
     uint8_t running;
-    struct repeating_timer timer;
+    volatile uint32_t window_count;
+    volatile uint8_t updating; // set while the results are written, see the window_count readers
+    mp_triac_power_analyzer_summary_t *history; // history_size entries, window k at k%history_size
+
+    // ADC round-robin capture: the ADC free-runs over all inputs and a pair of chained
+    // DMA channels fills dma_buffer[0] and dma_buffer[1] alternately with (interleaved) frames
+    uint8_t voltage_slot; // position of the voltage sample in each frame
+    uint8_t current_slots[POWER_ANALYZER_MAX_CURRENTS];
+    int8_t dma_channel[2];
+    uint16_t *dma_buffer[2]; // channels*window_size samples each
 } mp_triac_power_analyzer_obj_t;
 
 extern const mp_obj_type_t mp_triac_controller_type;
+// Packed snapshot written by PowerAnalyzer.snapshot(), little-endian, no padding.
+// struct format: "<IHHQQqHHhhhhiiI" (56 bytes)
+typedef struct _mp_triac_power_analyzer_snapshot_t {
+    uint32_t window;
+    uint16_t window_size;
+    uint16_t histo_count;
+    uint64_t squaresum_voltage;
+    uint64_t squaresum_current;
+    int64_t sum_power;
+    uint16_t offset_voltage;
+    uint16_t offset_current;
+    int16_t pos_peak_voltage;
+    int16_t neg_peak_voltage;
+    int16_t pos_peak_current;
+    int16_t neg_peak_current;
+    int32_t pos_peak_power;
+    int32_t neg_peak_power;
+    uint32_t timestamp_ms;
+} mp_triac_power_analyzer_snapshot_t;
+
 extern const mp_obj_type_t mp_triac_power_analyzer_type;
 
 void triac_power_analyzer_deinit();
+uint32_t triac_power_analyzer_window_count(void);
+float triac_power_analyzer_mean_power(void);
 void triac_global_init(void);
+uint8_t triac_power_analyzer_active(void);
+uint32_t triac_power_analyzer_window_us(void);
+// Real-time engine, see triac_realtime.c
+extern spin_lock_t *triac_spin_lock; // data shared with the engine core, if it is core1
+void triac_realtime_init(void);
+uint8_t triac_realtime_core(void);
+uint8_t triac_realtime_start(void);
+void triac_realtime_run(void (*function)(uint32_t), uint32_t argument);
+void triac_controller_engine_attach(void);
+uint8_t triac_controller_running(void);
+// Calibration blobs, see Controller.calibration()
+uint16_t *triac_controller_parse_calibration(mp_obj_t blob);
+mp_obj_t triac_controller_calibration_blob(const uint16_t *calibration);
+#if MICROPY_PY_TRIAC_TEST_HOOKS
+uint32_t triac_controller_curve_delay(const uint16_t *calibration, uint32_t level);
+#endif
+
+// ISR telemetry, see triac_telemetry.c
+#define TRIAC_TLM_EDGE (0) // zero-cross edges, faults: missed edges
+#define TRIAC_TLM_FIRE (1) // gate pulse starts, faults: later than the late threshold
+#define TRIAC_TLM_CROSS (2) // predicted crossings of ADC synchronized Controllers, faults: late
+#define TRIAC_TLM_ANALYZER (3) // PowerAnalyzer DMA blocks, faults: a block waited for another
+#define TRIAC_TLM_SUPERVISOR (4) // Supervisor periodic checks, faults: late
+#define TRIAC_TLM_SOURCES (5)
+#define TRIAC_TLM_BUCKETS (16) // log2 histograms, in us
+#define TRIAC_TLM_WORDS (sizeof(triac_telemetry_source_t)/sizeof(uint32_t))
+
+// All uint32, the layout of Triac.telemetry_into()
+typedef struct _triac_telemetry_source_t {
+    uint32_t count;
+    uint32_t duration_max; // cycles, ns once read
+    uint32_t latency_max; // us
+    uint32_t latency_sum; // us
+    uint32_t faults;
+    uint32_t duration[TRIAC_TLM_BUCKETS];
+    uint32_t latency[TRIAC_TLM_BUCKETS];
+} triac_telemetry_source_t;
+
+void triac_telemetry_init(void);
+void triac_telemetry_core_init(void);
+void triac_telemetry_reset(uint32_t late_us);
+uint32_t triac_telemetry_late(void);
+// start at the entry of the interruption, end with the latency in us (-1: not applicable)
+uint32_t triac_telemetry_start(void);
+void triac_telemetry_end(uint8_t source, uint32_t start, int32_t latency, uint32_t faults);
+void triac_telemetry_read(uint8_t source, triac_telemetry_source_t *out, uint8_t reset);
+
+// Safety supervisor, see triac_supervisor.c
+#define ALARM_ID_INVALID (-1)
+#define TRIAC_SUPERVISOR_EVENTS (32)
+#define TRIAC_EVENT_OVERCURRENT (1) // rms current of an input above max_current
+#define TRIAC_EVENT_PEAK (2) // peak current of an input above max_peak
+#define TRIAC_EVENT_OFFSET (3) // DC level of a current sensor too far from current_zero
+#define TRIAC_EVENT_ZERO_CROSS (4) // no zero-cross on a Controller for zero_cross_us
+#define TRIAC_EVENT_FREQUENCY (5) // locked frequency of a Controller out of range
+#define TRIAC_EVENT_ANALYZER (6) // no PowerAnalyzer window for analyzer_us
+#define TRIAC_EVENT_MANUAL (7) // tripped from Python
+#define TRIAC_EVENT_REARM (8)
+
+typedef struct _triac_supervisor_event_t {
+    uint32_t sequence;
+    uint32_t timestamp_ms;
+    uint8_t code;
+    uint8_t channel; // current input or sense pin
+    float value; // A, us or Hz, as the limit it broke
+} triac_supervisor_event_t;
+
+typedef struct _mp_triac_supervisor_obj_t {
+    mp_obj_base_t base;
+    volatile uint8_t armed;
+    // limits, 0 disables each check
+    float max_current; // A rms, per current input
+    float max_peak; // A
+    float max_dc; // A, of the sensor DC level against current_zero
+    uint16_t current_zero; // raw ADC reading of the current sensors at 0A
+    float min_frequency;
+    float max_frequency;
+    uint32_t zero_cross_us;
+    uint32_t analyzer_us;
+    uint32_t period_us; // of the zero-cross and analyzer checks
+    alarm_id_t alarm;
+    uint64_t due; // of the next check
+    uint64_t armed_since; // the zero-cross loss is counted from there until the first crossing
+    uint32_t last_window;
+    uint64_t last_window_time;
+    // event ring, event k at k%TRIAC_SUPERVISOR_EVENTS, written under triac_spin_lock
+    volatile uint32_t event_count;
+    triac_supervisor_event_t events[TRIAC_SUPERVISOR_EVENTS];
+} mp_triac_supervisor_obj_t;
+
+extern const mp_obj_type_t mp_triac_supervisor_type;
+void triac_supervisor_init(void);
+uint8_t triac_supervisor_armed(void);
+void triac_supervisor_window(const mp_triac_power_analyzer_obj_t *analyzer);
+void triac_supervisor_check_window(uint32_t window_us);
+alarm_pool_t *triac_controller_alarm_pool(void);
+void triac_controller_trip(uint32_t tripped);
+uint8_t triac_controller_tripped(void);
+uint8_t triac_controller_check_sync(uint64_t now, uint64_t since, uint32_t timeout, float min_frequency, float max_frequency, uint8_t *pin, float *value);
+// Controllers synchronized to the PowerAnalyzer (pin mask), and its rising voltage crossings
+// (times in us, TRIAC_PLL_SHIFT fixed point), called from its DMA interruption
+uint32_t triac_controller_adc_synced(void);
+void triac_controller_adc_crossings(int64_t first, int64_t last, uint32_t count);
 
 #endif // MICROPY_INCLUDED_EXTMOD_MODMACHINE_H
@@ -8,6 +8,7 @@
 #include "py/runtime.h"
 #include "py/mpprint.h"
 #include "triac.h"
+#include "modrp2.h"
 #include "pico/time.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
@@ -15,11 +16,11 @@
 #include "hardware/regs/intctrl.h"
 
 #define INVALIDPIN 255
-#define ALARM_ID_INVALID (-1)
 
 #define TRIAC_TIMING_SIZE (32)
 #define TRIAC_MAX_PINS (32)
 #define TRIAC_MAX_DELTA (0x0FFFFFFFULL)
+#define TRIAC_NOMINAL_HALF_PERIOD (10000) // us, the PLL tracks 33Hz..75Hz around it
 
 static const uint16_t TRIAC_POWERLINE[101] = {65534, 57933, 55906, 54461, 53296,
     52299, 51418, 50620, 49888, 49207, 48567, 47963, 47389, 46840, 46313, 45806,
@@ -37,58 +38,109 @@ typedef struct {
     volatile uint32_t sense_pin;
     volatile uint32_t trigger_pins;
     volatile uint8_t polarity;
+    volatile uint8_t mode;
+    volatile uint16_t burst_accumulator;
     // activation variables, interruption-side
     volatile uint64_t interrupt_watchdog_limit;
     volatile uint32_t interrupt_on_time;
-    volatile uint32_t interrupt_time_to_activate[2];
+    volatile uint32_t interrupt_delay;
+    volatile uint16_t interrupt_level;
     volatile alarm_id_t alarm_activate;
     volatile alarm_id_t alarm_deactivate;
+    volatile alarm_id_t alarm_cross;
+    volatile uint64_t cross_target;
+    volatile uint64_t fire_target;
     // activation variables, user-side
     volatile uint8_t user_beeing_written;
     volatile uint64_t user_watchdog_limit;
     volatile uint32_t user_on_time;
-    volatile uint32_t user_time_to_activate[2];
+    volatile uint32_t user_delay; // 0: off, else 1 + firing delay in 1/65536 of the half-cycle
+    volatile uint16_t user_level; // target of the ramp
+    volatile uint32_t user_ramp_rate;
+    volatile uint8_t user_s_curve;
+    const uint16_t *volatile user_curve; // calibration, NULL: TRIAC_POWERLINE
     // detection statistics
     volatile uint32_t ignore_timing;
     volatile uint8_t timing_index;
     volatile uint64_t last_crosses[2];
     volatile uint32_t last_timings[TRIAC_TIMING_SIZE];
     volatile uint32_t max_dt;
+    // zero-cross tracking, fed by the sense pin edges or by the PowerAnalyzer voltage
+    triac_pll_t pll;
+    volatile uint64_t active_since; // us, for a zero-cross that never came
+    // level actually applied, slew limited towards user_level
+    triac_ramp_t ramp;
 } TriacData;
 static volatile TriacData triac_data[TRIAC_MAX_PINS];
+// Calibration tables published in triac_data[].user_curve, kept alive while the engine may read
+// them, even once their Controller is collected (one per pin, TRIAC_MAX_PINS)
+MP_REGISTER_ROOT_POINTER(void *triac_controller_curves[32]);
 static alarm_pool_t *triac_alarm_pool; 
+static alarm_pool_t *triac_core1_alarm_pool = NULL;
+static volatile uint32_t triac_adc_sync_pins = 0;
+// set by the Supervisor: gates off and no firing until it is re-armed
+static volatile uint8_t triac_tripped = 0;
+
+// Interpolates, in fixed point, the delay fraction (0..65535 of the half period) for a power level
+// (0..TRIAC_LEVEL_MAX), from a table with segments+1 equally spaced points
+static uint32_t triac_controller_lookup_delay(const uint16_t *table, uint32_t segments, uint32_t level){
+    if(level>=TRIAC_LEVEL_MAX) return table[segments];
+    uint32_t pos = level*segments;
+    uint32_t index = pos>>TRIAC_LEVEL_BITS;
+    int32_t frac = pos&(TRIAC_LEVEL_MAX-1);
+    int32_t a = table[index];
+    int32_t b = table[index+1];
+    return a + ((b-a)*frac)/TRIAC_LEVEL_MAX;
+}
+
+// Firing delay of a level: 0 off, else 1 + delay fraction. The interruption turns it into a
+// time, from the predicted half-cycle, and stays off while the zero-cross tracking is not locked
+static uint32_t triac_controller_level_delay(uint8_t mode, const uint16_t *calibration, uint32_t level){
+    if(level==0) return 0;
+    if(level>=TRIAC_LEVEL_MAX) return 1;
+    // the burst distributor works directly with the level, the delay is not used
+    if(mode==TRIAC_MODE_BURST) return 0;
+    if(calibration!=NULL) return 1+triac_controller_lookup_delay(calibration, TRIAC_CALIBRATION_POINTS-1, level);
+    return 1+triac_controller_lookup_delay(TRIAC_POWERLINE, 100, level);
+}
 
 // Interrupt... stuff =================================================================================
 
 static int64_t triac_timer_irq_deactivate(alarm_id_t id, void *user_data){
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_TRIAC);
     TriacData *data = (TriacData*)user_data;
     data->alarm_deactivate = ALARM_ID_INVALID;
     gpio_put_masked(data->trigger_pins, data->polarity?0:0xFFFFFFFF); //0:0xFFFFFFFF
+    rp2_cpu_exit(cpu);
     return 0;
 }
 
 static int64_t triac_timer_irq_activate(alarm_id_t id, void *user_data){
+    uint32_t tlm = triac_telemetry_start();
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_TRIAC);
     TriacData *data = (TriacData*)user_data;
     data->alarm_activate = ALARM_ID_INVALID;
+    if(triac_tripped){ // may have been scheduled right before the trip
+        rp2_cpu_exit(cpu);
+        return 0;
+    }
     gpio_put_masked(data->trigger_pins, data->polarity?0xFFFFFFFF:0); // 0xFFFFFFFF:0
     
+    uint64_t now = time_us_64();
+    uint32_t late = now - data->fire_target; // how late the gate pulse starts
     absolute_time_t t;
-    update_us_since_boot(&t, time_us_64()+data->interrupt_on_time);
+    update_us_since_boot(&t, now+data->interrupt_on_time);
     data->alarm_deactivate = alarm_pool_add_alarm_at(triac_alarm_pool, t, triac_timer_irq_deactivate, (void*)data, true);
+    triac_telemetry_end(TRIAC_TLM_FIRE, tlm, late, late>triac_telemetry_late());
+    rp2_cpu_exit(cpu);
     return 0;
 }
 
 
-inline static void triac_gpio_irq_handler(uint8_t gpio, uint8_t events){
-    uint64_t now = time_us_64();
-    volatile TriacData *data = &triac_data[gpio];
-    uint64_t delta = now - data->last_crosses[data->timing_index&1];
-    if(delta<data->ignore_timing) return; // too soon, probably another zero cross
-    if(delta>data->max_dt) delta = data->max_dt;
-    data->timing_index = (data->timing_index+1)%TRIAC_TIMING_SIZE;
-    data->last_crosses[data->timing_index&1] = now;
-    data->last_timings[data->timing_index] = delta;
-
+// Starts a half-cycle, right after the crossing in data->pll.cross: cancels the pending
+// pulses and schedules the next one, either at the crossing (burst) or at the firing delay
+// from it, as a fraction of the predicted half-cycle (phase)
+static void triac_half_cycle(TriacData *data, uint64_t now){
     if(data->alarm_activate!=ALARM_ID_INVALID){
         alarm_pool_cancel_alarm(triac_alarm_pool, data->alarm_activate);
         data->alarm_activate = ALARM_ID_INVALID;
@@ -102,19 +154,102 @@ inline static void triac_gpio_irq_handler(uint8_t gpio, uint8_t events){
     if(!data->user_beeing_written){
         data->interrupt_watchdog_limit = data->user_watchdog_limit;
         data->interrupt_on_time = data->user_on_time;
-        data->interrupt_time_to_activate[0] = data->user_time_to_activate[0];
-        data->interrupt_time_to_activate[1] = data->user_time_to_activate[1];
+        data->interrupt_delay = data->user_delay;
+        data->interrupt_level = data->user_level;
+        triac_ramp_target(&data->ramp, data->user_level, data->user_ramp_rate, data->user_s_curve);
     }
 
-    if(data->interrupt_watchdog_limit<now) return;
-    if(data->interrupt_time_to_activate[0]==0 || data->interrupt_time_to_activate[1]==0 || data->interrupt_on_time==0) return;
-
+    if(data->interrupt_watchdog_limit<now || triac_tripped){
+        // stopped: the next start ramps up from zero again
+        triac_ramp_reset(&data->ramp, 0);
+        return;
+    }
+    // stepped even without a ramp, so enabling one starts from the applied level
+    uint16_t level = triac_ramp_step(&data->ramp, data->pll.half_period>>TRIAC_PLL_SHIFT);
+    if(data->ramp.rate){
+        data->interrupt_level = level;
+        data->interrupt_delay = triac_controller_level_delay(data->mode, data->user_curve, level);
+    }
     absolute_time_t t;
-    update_us_since_boot(&t, now+data->interrupt_time_to_activate[data->timing_index&1]);
+    if(data->mode==TRIAC_MODE_BURST){
+        // whole half-cycles: fires right at the zero-cross, if the distributor says so
+        uint16_t accumulator = data->burst_accumulator;
+        uint8_t fire = triac_burst_step(&accumulator, data->interrupt_level);
+        data->burst_accumulator = accumulator;
+        if(!fire || data->interrupt_on_time==0) return;
+        data->fire_target = now+1;
+        update_us_since_boot(&t, now+1);
+        data->alarm_activate = alarm_pool_add_alarm_at(triac_alarm_pool, t, triac_timer_irq_activate, (void*)data, true);
+        return;
+    }
+    if(data->interrupt_delay==0 || data->interrupt_on_time==0 || data->pll.locked<TRIAC_PLL_LOCK_COUNT) return;
+
+    // the prediction already moved to the next crossing, this half-cycle has the other parity
+    int64_t half = triac_pll_half(&data->pll, data->pll.parity^1);
+    uint64_t fire = (data->pll.cross + ((half*(data->interrupt_delay-1))>>16))>>TRIAC_PLL_SHIFT;
+    if(fire<=now) fire = now+1;
+    data->fire_target = fire;
+    update_us_since_boot(&t, fire);
     data->alarm_activate = alarm_pool_add_alarm_at(triac_alarm_pool, t, triac_timer_irq_activate, (void*)data, true);
 }
 
+// ADC synchronized controllers have no edges: this alarm runs at each predicted crossing
+static int64_t triac_timer_irq_cross(alarm_id_t id, void *user_data){
+    uint32_t tlm = triac_telemetry_start();
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_TRIAC);
+    TriacData *data = (TriacData*)user_data;
+    triac_pll_t *pll = &data->pll;
+    data->alarm_cross = ALARM_ID_INVALID;
+    uint64_t now = time_us_64();
+    uint32_t late = now - data->cross_target;
+    int64_t t = (int64_t)now<<TRIAC_PLL_SHIFT;
+    uint64_t at = now+TRIAC_NOMINAL_HALF_PERIOD;
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    uint8_t crossed = 0;
+    if(pll->started){
+        // predictions left behind (e.g. by a re-acquisition) are skipped
+        while(triac_pll_predict(pll)<t-pll->half_period/2) triac_pll_advance(pll);
+        // the prediction may also have moved a bit later since the alarm was set
+        if(triac_pll_predict(pll)<=t+pll->half_period/4){
+            pll->cross = triac_pll_predict(pll);
+            triac_pll_advance(pll);
+            crossed = 1;
+        }
+        at = triac_pll_predict(pll)>>TRIAC_PLL_SHIFT;
+        if(at<=now) at = now+1;
+    }
+    spin_unlock(triac_spin_lock, state);
+    if(crossed) triac_half_cycle(data, now);
+    absolute_time_t next;
+    update_us_since_boot(&next, at);
+    data->cross_target = at;
+    data->alarm_cross = alarm_pool_add_alarm_at(triac_alarm_pool, next, triac_timer_irq_cross, (void*)data, true);
+    triac_telemetry_end(TRIAC_TLM_CROSS, tlm, late, late>triac_telemetry_late());
+    rp2_cpu_exit(cpu);
+    return 0;
+}
+
+inline static void triac_gpio_irq_handler(uint8_t gpio, uint8_t events){
+    uint64_t now = time_us_64();
+    volatile TriacData *data = &triac_data[gpio];
+    uint64_t delta = now - data->last_crosses[data->timing_index&1];
+    if(delta<data->ignore_timing) return; // too soon, probably another zero cross
+    if(delta>data->max_dt) delta = data->max_dt;
+    data->timing_index = (data->timing_index+1)%TRIAC_TIMING_SIZE;
+    data->last_crosses[data->timing_index&1] = now;
+    data->last_timings[data->timing_index] = delta;
+
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    uint8_t accepted = triac_pll_edge((triac_pll_t*)&data->pll, (int64_t)now<<TRIAC_PLL_SHIFT);
+    spin_unlock(triac_spin_lock, state);
+    if(!accepted && data->pll.locked>=TRIAC_PLL_LOCK_COUNT){
+        return; // an outlier, the lock holds
+    }
+    triac_half_cycle((TriacData*)data, now);
+}
+
 static void triac_gpio_irq_listener(void) {
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_TRIAC);
     uint8_t core = get_core_num();
     io_bank0_irq_ctrl_hw_t *irq_ctrl_base = core ? &io_bank0_hw->proc1_irq_ctrl : &io_bank0_hw->proc0_irq_ctrl;
     for (uint8_t gpio = 0; gpio < NUM_BANK0_GPIOS; gpio+=8) {
@@ -122,28 +257,38 @@ static void triac_gpio_irq_listener(void) {
         for(uint8_t i=gpio;events8 && i<gpio+8;i++) {
             uint32_t events = events8 & 0xfu;
             if (events && triac_data[i].active){
+                uint32_t tlm = triac_telemetry_start();
+                uint32_t missed = triac_data[i].pll.missed;
                 gpio_acknowledge_irq(i, events);
                 triac_gpio_irq_handler(i, events);
+                triac_telemetry_end(TRIAC_TLM_EDGE, tlm, -1, triac_data[i].pll.missed-missed);
             }
             events8 >>= 4;
         }
     }
+    rp2_cpu_exit(cpu);
 }
 
 static inline void reset_triac_data(uint8_t pin){
     triac_data[pin].active = 0;
     triac_data[pin].sense_pin = pin;
     triac_data[pin].polarity = 0;
+    triac_data[pin].mode = TRIAC_MODE_PHASE;
+    triac_data[pin].burst_accumulator = 0;
     triac_data[pin].trigger_pins = 0;
     triac_data[pin].interrupt_watchdog_limit = 0;
     triac_data[pin].interrupt_on_time = 1000;
-    triac_data[pin].interrupt_time_to_activate[0] = 0;
-    triac_data[pin].interrupt_time_to_activate[1] = 0;
+    triac_data[pin].interrupt_delay = 0;
+    triac_data[pin].interrupt_level = 0;
     triac_data[pin].user_beeing_written = 0;
     triac_data[pin].user_watchdog_limit = 0;
     triac_data[pin].user_on_time = 1000;
-    triac_data[pin].user_time_to_activate[0] = 0;
-    triac_data[pin].user_time_to_activate[1] = 0;
+    triac_data[pin].user_delay = 0;
+    triac_data[pin].user_level = 0;
+    triac_data[pin].user_ramp_rate = 0;
+    triac_data[pin].user_s_curve = 0;
+    triac_data[pin].user_curve = NULL;
+    MP_STATE_PORT(triac_controller_curves)[pin] = NULL;
     triac_data[pin].ignore_timing = 4000;
     triac_data[pin].timing_index = 0;
     triac_data[pin].last_crosses[0] = 0;
@@ -151,15 +296,28 @@ static inline void reset_triac_data(uint8_t pin){
     triac_data[pin].max_dt = 100*1000;
     triac_data[pin].alarm_activate = ALARM_ID_INVALID;
     triac_data[pin].alarm_deactivate = ALARM_ID_INVALID;
+    triac_data[pin].alarm_cross = ALARM_ID_INVALID;
+    triac_data[pin].fire_target = 0;
+    triac_data[pin].cross_target = 0;
     for(uint8_t i=0; i<TRIAC_TIMING_SIZE; i++){
         triac_data[pin].last_timings[i] = 0;
     }
+    triac_pll_reset((triac_pll_t*)&triac_data[pin].pll, TRIAC_NOMINAL_HALF_PERIOD, 1);
+    triac_ramp_reset((triac_ramp_t*)&triac_data[pin].ramp, 0);
 }
 
 void triac_global_init(void) {
+    triac_supervisor_init();
+    triac_realtime_init();
+    triac_telemetry_init();
+    triac_tripped = 0;
     for(uint8_t i=0; i<TRIAC_MAX_PINS; i++){
         reset_triac_data(i);
     }
+    if(triac_core1_alarm_pool!=NULL){
+        alarm_pool_destroy(triac_core1_alarm_pool);
+        triac_core1_alarm_pool = NULL;
+    }
     triac_alarm_pool = alarm_pool_get_default();
     irq_add_shared_handler(IO_IRQ_BANK0, triac_gpio_irq_listener, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY+10);
     irq_set_enabled(IO_IRQ_BANK0, true);
@@ -168,6 +326,53 @@ void triac_global_init(void) {
     #endif
 }
 
+// Runs on core1 when the real-time engine moves there, with no Controller active: the
+// alarms get a pool that interrupts core1, and the edges are enabled for core1 only
+void triac_controller_engine_attach(void) {
+    triac_core1_alarm_pool = alarm_pool_create_with_unused_hardware_alarm(PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS);
+    triac_alarm_pool = triac_core1_alarm_pool;
+    triac_telemetry_core_init();
+    for(uint8_t i=0; i<NUM_BANK0_GPIOS; i++){
+        gpio_set_irq_enabled(i, 0xF, false);
+    }
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+uint8_t triac_controller_running(void) {
+    for(uint8_t i=0; i<TRIAC_MAX_PINS; i++){
+        if(triac_data[i].active) return 1;
+    }
+    return 0;
+}
+
+alarm_pool_t *triac_controller_alarm_pool(void) {
+    return triac_alarm_pool;
+}
+
+// Supervisor trip, on the engine core: any interruption that was scheduling a pulse has
+// completed, so cancelling the pending pulses after setting the flag leaves none behind
+void triac_controller_trip(uint32_t tripped) {
+    triac_tripped = tripped;
+    if(!tripped) return;
+    for(uint8_t i=0; i<TRIAC_MAX_PINS; i++){
+        volatile TriacData *data = &triac_data[i];
+        if(!data->active) continue;
+        if(data->alarm_activate!=ALARM_ID_INVALID){
+            alarm_pool_cancel_alarm(triac_alarm_pool, data->alarm_activate);
+            data->alarm_activate = ALARM_ID_INVALID;
+        }
+        if(data->alarm_deactivate!=ALARM_ID_INVALID){
+            alarm_pool_cancel_alarm(triac_alarm_pool, data->alarm_deactivate);
+            data->alarm_deactivate = ALARM_ID_INVALID;
+        }
+        gpio_put_masked(data->trigger_pins, data->polarity?0:0xFFFFFFFF);
+    }
+}
+
+uint8_t triac_controller_tripped(void) {
+    return triac_tripped;
+}
+
 static uint32_t triac_controller_read_average_timings(uint8_t trigger, uint32_t *phases){
     if(!triac_data[trigger].active) return 0;
     uint8_t initial_timing_index, final_timing_index;
@@ -177,7 +382,7 @@ static uint32_t triac_controller_read_average_timings(uint8_t trigger, uint32_t
         initial_timing_index = triac_data[trigger].timing_index;
         last_crosses[0] = triac_data[trigger].last_crosses[0];
         last_crosses[1] = triac_data[trigger].last_crosses[1];
-        for(uint i=0; i<TRIAC_TIMING_SIZE; i++) last_timings[i] = triac_data[trigger].last_timings[1];
+        for(uint i=0; i<TRIAC_TIMING_SIZE; i++) last_timings[i] = triac_data[trigger].last_timings[i];
         final_timing_index = triac_data[trigger].timing_index;
     }while(initial_timing_index!=final_timing_index);
     uint64_t now = time_us_64();
@@ -195,6 +400,135 @@ static uint32_t triac_controller_read_average_timings(uint8_t trigger, uint32_t
     return (sum0+sum1)/TRIAC_TIMING_SIZE;
 }
 
+// Copy of the zero-cross tracking state, returns 0 if it is not locked
+static uint8_t triac_controller_read_pll(uint8_t trigger, triac_pll_t *pll){
+    if(!triac_data[trigger].active) return 0;
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    *pll = *(triac_pll_t*)&triac_data[trigger].pll;
+    spin_unlock(triac_spin_lock, state);
+    return pll->locked>=TRIAC_PLL_LOCK_COUNT;
+}
+
+// Supervisor check of the zero-cross tracking, on the engine core: returns the event
+// (0 if none) of the first active Controller with no crossing for timeout us, or with a
+// locked frequency out of [min_frequency, max_frequency]. 0 disables each check.
+uint8_t triac_controller_check_sync(uint64_t now, uint64_t since, uint32_t timeout, float min_frequency, float max_frequency, uint8_t *pin, float *value) {
+    // since: a pin with no zero-cross yet is lost timeout after since (arming), or its activation
+    for(uint8_t i=0; i<TRIAC_MAX_PINS; i++){
+        if(!triac_data[i].active) continue;
+        triac_pll_t pll;
+        triac_controller_read_pll(i, &pll);
+        int64_t age;
+        if(pll.started){
+            age = (((int64_t)now<<TRIAC_PLL_SHIFT) - pll.last)>>TRIAC_PLL_SHIFT;
+        }else{
+            uint64_t start = (triac_data[i].active_since>since) ? triac_data[i].active_since : since;
+            age = (int64_t)(now-start);
+        }
+        if(timeout && age>(int64_t)timeout){
+            *pin = i;
+            *value = age;
+            return TRIAC_EVENT_ZERO_CROSS;
+        }
+        if(!pll.started || pll.locked<TRIAC_PLL_LOCK_COUNT) continue;
+        float frequency = 500000.0f*(1<<TRIAC_PLL_SHIFT)/pll.half_period;
+        if((min_frequency>0 && frequency<min_frequency) || (max_frequency>0 && frequency>max_frequency)){
+            *pin = i;
+            *value = frequency;
+            return TRIAC_EVENT_FREQUENCY;
+        }
+    }
+    return 0;
+}
+
+uint32_t triac_controller_adc_synced(void){
+    return triac_adc_sync_pins;
+}
+
+void triac_controller_adc_crossings(int64_t first, int64_t last, uint32_t count){
+    if(count==0) return;
+    int64_t half = (count>1) ? (last-first)/(2*(count-1)) : 0;
+    uint32_t pins = triac_adc_sync_pins;
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    for(uint8_t i=0; pins; i++, pins>>=1){
+        if(pins&1) triac_pll_observe((triac_pll_t*)&triac_data[i].pll, last, half);
+    }
+    spin_unlock(triac_spin_lock, state);
+}
+
+
+// Power curves ======================================================================================
+
+static void triac_controller_set_level(mp_triac_controller_obj_t *self, uint32_t level){
+    if(level>TRIAC_LEVEL_MAX) level = TRIAC_LEVEL_MAX;
+    self->level = level;
+    self->percent = (level*100+TRIAC_LEVEL_MAX/2)/TRIAC_LEVEL_MAX;
+
+    uint32_t delay = triac_controller_level_delay(self->mode, self->calibration, level);
+    MP_STATE_PORT(triac_controller_curves)[self->sense_pin] = self->calibration;
+    triac_data[self->sense_pin].user_beeing_written = 1;
+    triac_data[self->sense_pin].user_delay = delay;
+    triac_data[self->sense_pin].user_level = level;
+    triac_data[self->sense_pin].user_curve = self->calibration;
+    triac_data[self->sense_pin].user_ramp_rate = triac_ramp_rate(self->ramp_rate*TRIAC_LEVEL_MAX/100.0f);
+    triac_data[self->sense_pin].user_s_curve = self->s_curve;
+    triac_data[self->sense_pin].user_watchdog_limit = time_us_64()+self->watchdog;
+    triac_data[self->sense_pin].user_beeing_written = 0;
+}
+
+// Calibration blob: 'T','C', version, number of points, points (uint16 LE), 16 bit sum of the points
+#define TRIAC_CALIBRATION_VERSION (1)
+#define TRIAC_CALIBRATION_BLOB_SIZE (4+2*TRIAC_CALIBRATION_POINTS+2)
+
+// Validated table of a blob, NULL for None
+uint16_t *triac_controller_parse_calibration(mp_obj_t blob){
+    if(blob==mp_const_none) return NULL;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(blob, &bufinfo, MP_BUFFER_READ);
+    const uint8_t *buf = bufinfo.buf;
+    if(bufinfo.len!=TRIAC_CALIBRATION_BLOB_SIZE || buf[0]!='T' || buf[1]!='C'
+        || buf[2]!=TRIAC_CALIBRATION_VERSION || buf[3]!=TRIAC_CALIBRATION_POINTS){
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid calibration data"));
+    }
+    uint16_t sum = 0;
+    uint16_t *table = m_new(uint16_t, TRIAC_CALIBRATION_POINTS);
+    for(uint i=0; i<TRIAC_CALIBRATION_POINTS; i++){
+        table[i] = buf[4+2*i] | (buf[5+2*i]<<8);
+        sum += table[i];
+        if(i>0 && table[i]>table[i-1]){
+            mp_raise_ValueError(MP_ERROR_TEXT("calibration curve is not monotonic"));
+        }
+    }
+    if(sum!=(buf[TRIAC_CALIBRATION_BLOB_SIZE-2] | (buf[TRIAC_CALIBRATION_BLOB_SIZE-1]<<8))){
+        mp_raise_ValueError(MP_ERROR_TEXT("calibration checksum mismatch"));
+    }
+    return table;
+}
+
+mp_obj_t triac_controller_calibration_blob(const uint16_t *calibration){
+    if(calibration==NULL) return mp_const_none;
+    uint8_t buf[TRIAC_CALIBRATION_BLOB_SIZE];
+    uint16_t sum = 0;
+    buf[0] = 'T';
+    buf[1] = 'C';
+    buf[2] = TRIAC_CALIBRATION_VERSION;
+    buf[3] = TRIAC_CALIBRATION_POINTS;
+    for(uint i=0; i<TRIAC_CALIBRATION_POINTS; i++){
+        buf[4+2*i] = calibration[i]&0xFF;
+        buf[5+2*i] = calibration[i]>>8;
+        sum += calibration[i];
+    }
+    buf[TRIAC_CALIBRATION_BLOB_SIZE-2] = sum&0xFF;
+    buf[TRIAC_CALIBRATION_BLOB_SIZE-1] = sum>>8;
+    return mp_obj_new_bytes(buf, TRIAC_CALIBRATION_BLOB_SIZE);
+}
+
+#if MICROPY_PY_TRIAC_TEST_HOOKS
+// Firing delay of a level in phase mode, as the interruption gets it, for Triac.curve()
+uint32_t triac_controller_curve_delay(const uint16_t *calibration, uint32_t level){
+    return triac_controller_level_delay(TRIAC_MODE_PHASE, calibration, level);
+}
+#endif
 
 // General configs ======================================================================================
 
@@ -203,8 +537,32 @@ static void mp_triac_controller_print(const mp_print_t *print, mp_obj_t self_in,
     mp_printf(print, "Triac.Controller(sense=%d,trigger=%d)", self->sense_pin, triac_data[self->sense_pin].trigger_pins);
 }
 
+// Both run on the real-time engine core, as the edge interruptions are enabled per core
+static void triac_controller_attach_edges(uint32_t pin){
+    gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true);
+}
+
+static void triac_controller_detach(uint32_t pin){
+    // Disable all interruptions, reset the data
+    gpio_set_irq_enabled(pin, 0xF, false);
+    triac_adc_sync_pins &= ~(1UL<<pin);
+    if(triac_data[pin].alarm_cross!=ALARM_ID_INVALID){
+        alarm_pool_cancel_alarm(triac_alarm_pool, triac_data[pin].alarm_cross);
+    }
+    if(triac_data[pin].alarm_activate!=ALARM_ID_INVALID){
+        alarm_pool_cancel_alarm(triac_alarm_pool, triac_data[pin].alarm_activate);
+    }
+    if(triac_data[pin].alarm_deactivate!=ALARM_ID_INVALID){
+        alarm_pool_cancel_alarm(triac_alarm_pool, triac_data[pin].alarm_deactivate);
+    }
+    gpio_put_masked(triac_data[pin].trigger_pins, triac_data[pin].polarity?0:0xFFFFFFFF);
+    triac_data[pin].user_watchdog_limit = 0; // so the last call does not fire
+    triac_gpio_irq_handler(pin, 0xF);
+    reset_triac_data(pin);
+}
+
 static void mp_triac_controller_init_helper(mp_obj_base_t* self_obj, size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_sense_pin, ARG_trigger_pins, ARG_polarity, ARG_percent, ARG_watchdogUs, ARG_onTimeUs, ARG_ignoreTimeUs};
+    enum { ARG_sense_pin, ARG_trigger_pins, ARG_polarity, ARG_percent, ARG_watchdogUs, ARG_onTimeUs, ARG_ignoreTimeUs, ARG_calibration, ARG_mode, ARG_sync};
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_sense_pin, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
         { MP_QSTR_trigger_pins, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
@@ -213,6 +571,9 @@ static void mp_triac_controller_init_helper(mp_obj_base_t* self_obj, size_t n_ar
         { MP_QSTR_watchdogUs, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 500000} },
         { MP_QSTR_onTimeUs, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 300} },
         { MP_QSTR_ignoreTimeUs, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 4000} },
+        { MP_QSTR_calibration, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_mode, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = TRIAC_MODE_PHASE} },
+        { MP_QSTR_sync, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = TRIAC_SYNC_GPIO} },
     };
 
     mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t *)self_obj;
@@ -231,6 +592,10 @@ static void mp_triac_controller_init_helper(mp_obj_base_t* self_obj, size_t n_ar
     if(watchdogUs<0) mp_raise_ValueError(MP_ERROR_TEXT("invalid watchdog time limit"));
     if(onTimeUs<0 || onTimeUs>50000) mp_raise_ValueError(MP_ERROR_TEXT("invalid on-time"));
     if(ignoreTimeUs<0 || ignoreTimeUs>50000) mp_raise_ValueError(MP_ERROR_TEXT("invalid double-cross ignore time"));
+    int mode = args[ARG_mode].u_int;
+    if(mode!=TRIAC_MODE_PHASE && mode!=TRIAC_MODE_BURST) mp_raise_ValueError(MP_ERROR_TEXT("invalid mode"));
+    int sync = args[ARG_sync].u_int;
+    if(sync!=TRIAC_SYNC_GPIO && sync!=TRIAC_SYNC_ADC) mp_raise_ValueError(MP_ERROR_TEXT("invalid sync source"));
 
     uint32_t trigger_pins = 0;
     if(mp_obj_is_type(args[ARG_trigger_pins].u_obj, &mp_type_list)){
@@ -255,30 +620,29 @@ static void mp_triac_controller_init_helper(mp_obj_base_t* self_obj, size_t n_ar
     }
 
     if(self->sense_pin!=INVALIDPIN){
-        // Disable all interruptions, reset the data
-        gpio_set_irq_enabled(self->sense_pin,0xF, false);
-        if(triac_data[self->sense_pin].alarm_activate!=ALARM_ID_INVALID){
-            alarm_pool_cancel_alarm(triac_alarm_pool, triac_data[self->sense_pin].alarm_activate);
-        }
-        if(triac_data[self->sense_pin].alarm_deactivate!=ALARM_ID_INVALID){
-            alarm_pool_cancel_alarm(triac_alarm_pool, triac_data[self->sense_pin].alarm_deactivate);
-        }
-        gpio_put_masked(triac_data[self->sense_pin].trigger_pins, triac_data[self->sense_pin].polarity?0:0xFFFFFFFF);
-        triac_gpio_irq_handler(self->sense_pin, 0xF);
-        reset_triac_data(self->sense_pin);
+        triac_realtime_run(triac_controller_detach, self->sense_pin);
     }
 
+    if(args[ARG_calibration].u_obj!=MP_OBJ_NULL){
+        self->calibration = triac_controller_parse_calibration(args[ARG_calibration].u_obj);
+    }
     self->percent = percent;
+    self->level = (percent*TRIAC_LEVEL_MAX)/100;
+    self->mode = mode;
     self->sense_pin = sense;
     self->watchdog = watchdogUs;
 
     reset_triac_data(self->sense_pin);
     triac_data[self->sense_pin].trigger_pins = trigger_pins;
     triac_data[self->sense_pin].active = 1;
+    triac_data[self->sense_pin].active_since = time_us_64();
     triac_data[self->sense_pin].polarity = (args[ARG_polarity].u_int!=0) ? 1 : 0;
+    triac_data[self->sense_pin].mode = mode;
     triac_data[self->sense_pin].user_watchdog_limit = 0;
     triac_data[self->sense_pin].user_on_time = onTimeUs;
     triac_data[self->sense_pin].ignore_timing = ignoreTimeUs;
+    // the ADC measures both half-cycles alike, only the detector edges may be skewed
+    triac_pll_reset((triac_pll_t*)&triac_data[self->sense_pin].pll, TRIAC_NOMINAL_HALF_PERIOD, sync==TRIAC_SYNC_GPIO);
 
     gpio_init_mask(triac_data[self->sense_pin].trigger_pins);
     gpio_put_masked(triac_data[self->sense_pin].trigger_pins, triac_data[self->sense_pin].polarity ? 0:0xFFFFFFFF);
@@ -287,7 +651,16 @@ static void mp_triac_controller_init_helper(mp_obj_base_t* self_obj, size_t n_ar
     gpio_init(self->sense_pin);
     gpio_set_dir(self->sense_pin, false);
     gpio_set_pulls(self->sense_pin, false, false);
-    gpio_set_irq_enabled(self->sense_pin, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true);
+    if(sync==TRIAC_SYNC_ADC){
+        // fed by the PowerAnalyzer, the half-cycles are timed by the predictions
+        absolute_time_t t;
+        update_us_since_boot(&t, time_us_64()+TRIAC_NOMINAL_HALF_PERIOD);
+        triac_data[self->sense_pin].cross_target = to_us_since_boot(t);
+        triac_data[self->sense_pin].alarm_cross = alarm_pool_add_alarm_at(triac_alarm_pool, t, triac_timer_irq_cross, (void*)&triac_data[self->sense_pin], true);
+        triac_adc_sync_pins |= 1UL<<self->sense_pin;
+    } else {
+        triac_realtime_run(triac_controller_attach_edges, self->sense_pin);
+    }
 
 }
 
@@ -301,8 +674,8 @@ MP_DEFINE_CONST_FUN_OBJ_KW(triac_controller_init_obj, 1, mp_triac_controller_ini
 static mp_obj_t mp_triac_controller_close(mp_obj_t self_in) {
     mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(self_in);
     if(self->sense_pin==INVALIDPIN) return mp_const_none;
-    
-    
+    triac_realtime_run(triac_controller_detach, self->sense_pin);
+    self->sense_pin = INVALIDPIN;
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_controller_close_obj, mp_triac_controller_close);
@@ -312,6 +685,9 @@ static mp_obj_t mp_triac_controller_make_new(const mp_obj_type_t *type, size_t n
     // create new Graphicscontroller object
     mp_triac_controller_obj_t *self = mp_obj_malloc(mp_triac_controller_obj_t, &mp_triac_controller_type);
     self->sense_pin = INVALIDPIN;
+    self->calibration = NULL;
+    self->ramp_rate = 0.0f;
+    self->s_curve = 0;
     mp_map_t kw_args;
     mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
     mp_triac_controller_init_helper(&self->base, n_args, args, &kw_args);
@@ -329,40 +705,61 @@ static mp_obj_t triac_controller_percent(size_t n_args, const mp_obj_t *args) {
         }
         if(percent<0) percent = 0;
         if(percent>100) percent = 100;
-        self->percent = percent;
+        triac_controller_set_level(self, (percent*TRIAC_LEVEL_MAX)/100);
+    }
+    return MP_OBJ_NEW_SMALL_INT(self->percent);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_controller_percent_obj, 1, 2, triac_controller_percent);
 
-        if(percent==0){
-            triac_data[self->sense_pin].user_beeing_written = 1;
-            triac_data[self->sense_pin].user_time_to_activate[0] = 0;
-            triac_data[self->sense_pin].user_time_to_activate[1] = 0;
-            triac_data[self->sense_pin].user_watchdog_limit = time_us_64()+self->watchdog;
-            triac_data[self->sense_pin].user_beeing_written = 0;
-        } else if(percent==100){
-            triac_data[self->sense_pin].user_beeing_written = 1;
-            triac_data[self->sense_pin].user_time_to_activate[0] = 1;
-            triac_data[self->sense_pin].user_time_to_activate[1] = 1;
-            triac_data[self->sense_pin].user_watchdog_limit = time_us_64()+self->watchdog;
-            triac_data[self->sense_pin].user_beeing_written = 0;
-        } else {
-            uint32_t times[2];
-            triac_controller_read_average_timings(self->sense_pin, times);
-            times[0] = 1+((times[0]*TRIAC_POWERLINE[percent])>>16);
-            times[1] = 1+((times[1]*TRIAC_POWERLINE[percent])>>16);
+static mp_obj_t triac_controller_level(size_t n_args, const mp_obj_t *args) {
+    mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(args[0]);
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+    if(n_args==2){
+        mp_int_t level = 0;
+        if(!mp_obj_get_int_maybe(args[1], &level)){
+            mp_raise_TypeError(MP_ERROR_TEXT("level needs to be integer"));
+        }
+        if(level<0) level = 0;
+        triac_controller_set_level(self, level);
+    }
+    return MP_OBJ_NEW_SMALL_INT(self->level);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_controller_level_obj, 1, 2, triac_controller_level);
+
+static mp_obj_t triac_controller_calibration(size_t n_args, const mp_obj_t *args) {
+    mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(args[0]);
+    if(n_args==2){
+        self->calibration = triac_controller_parse_calibration(args[1]);
+        if(self->sense_pin!=INVALIDPIN) triac_controller_set_level(self, self->level);
+    }
+    return triac_controller_calibration_blob(self->calibration);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_controller_calibration_obj, 1, 2, triac_controller_calibration);
 
+static mp_obj_t triac_controller_mode(size_t n_args, const mp_obj_t *args) {
+    mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(args[0]);
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+    if(n_args==2){
+        mp_int_t mode = mp_obj_get_int(args[1]);
+        if(mode!=TRIAC_MODE_PHASE && mode!=TRIAC_MODE_BURST) mp_raise_ValueError(MP_ERROR_TEXT("invalid mode"));
+        if(mode!=self->mode){
+            self->mode = mode;
             triac_data[self->sense_pin].user_beeing_written = 1;
-            triac_data[self->sense_pin].user_time_to_activate[0] = times[0];
-            triac_data[self->sense_pin].user_time_to_activate[1] = times[1];
-            triac_data[self->sense_pin].user_watchdog_limit = time_us_64()+self->watchdog;
+            triac_data[self->sense_pin].mode = mode;
+            triac_data[self->sense_pin].burst_accumulator = 0;
             triac_data[self->sense_pin].user_beeing_written = 0;
+            triac_controller_set_level(self, self->level);
         }
     }
-    return MP_OBJ_NEW_SMALL_INT(self->percent);
+    return MP_OBJ_NEW_SMALL_INT(self->mode);
 }
-MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_controller_percent_obj, 1, 2, triac_controller_percent);
-
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_controller_mode_obj, 1, 2, triac_controller_mode);
 
 static mp_obj_t triac_controller_half_period(mp_obj_t self_obj) {
     mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(self_obj);
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+    triac_pll_t pll;
+    if(triac_controller_read_pll(self->sense_pin, &pll)) return mp_obj_new_int(pll.half_period>>TRIAC_PLL_SHIFT);
     return mp_obj_new_int(triac_controller_read_average_timings(self->sense_pin, NULL));
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_controller_half_period_obj,  triac_controller_half_period);
@@ -370,12 +767,75 @@ MP_DEFINE_CONST_FUN_OBJ_1(triac_controller_half_period_obj,  triac_controller_ha
 
 static mp_obj_t triac_controller_frequency(mp_obj_t self_obj) {
     mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(self_obj);
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+    triac_pll_t pll;
+    if(triac_controller_read_pll(self->sense_pin, &pll)){
+        return mp_obj_new_float(500000.0f*(1<<TRIAC_PLL_SHIFT) / (float)pll.half_period);
+    }
     int timing = triac_controller_read_average_timings(self->sense_pin, NULL);
     if(timing<=0) return mp_obj_new_float(0.0);
     return mp_obj_new_float(500000.0 / (float)timing);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_controller_frequency_obj,  triac_controller_frequency);
 
+// Slew limit of the level changes, stepped in the interruption at each half-cycle, so
+// percent()/level() only set the target. ramp() -> (rate in %/s, s_curve, applied percent)
+// ramp(rate, s_curve=False, full_power=0): rate in W/s if the full power (W) is given, 0: jumps
+static mp_obj_t triac_controller_ramp(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_rate, ARG_s_curve, ARG_full_power };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_rate, MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_s_curve, MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_full_power, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+    };
+    mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args-1, pos_args+1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+
+    if(args[ARG_rate].u_obj!=MP_OBJ_NULL){
+        float rate = mp_obj_get_float(args[ARG_rate].u_obj);
+        if(rate<0.0f) mp_raise_ValueError(MP_ERROR_TEXT("invalid ramp rate"));
+        if(args[ARG_full_power].u_obj!=MP_OBJ_NULL){
+            float full_power = mp_obj_get_float(args[ARG_full_power].u_obj);
+            if(full_power<=0.0f) mp_raise_ValueError(MP_ERROR_TEXT("invalid full power"));
+            rate = rate*100.0f/full_power;
+        }
+        self->ramp_rate = rate;
+        self->s_curve = args[ARG_s_curve].u_bool;
+        // the watchdog is not refreshed, a stopped controller stays stopped
+        triac_data[self->sense_pin].user_beeing_written = 1;
+        triac_data[self->sense_pin].user_ramp_rate = triac_ramp_rate(self->ramp_rate*TRIAC_LEVEL_MAX/100.0f);
+        triac_data[self->sense_pin].user_s_curve = self->s_curve;
+        triac_data[self->sense_pin].user_beeing_written = 0;
+    }
+    int32_t applied = triac_data[self->sense_pin].ramp.level>>TRIAC_RAMP_SHIFT;
+    mp_obj_t result[3] = {
+        mp_obj_new_float(self->ramp_rate),
+        mp_obj_new_bool(self->s_curve),
+        MP_OBJ_NEW_SMALL_INT((applied*100+TRIAC_LEVEL_MAX/2)/TRIAC_LEVEL_MAX),
+    };
+    return mp_obj_new_tuple(3, result);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(triac_controller_ramp_obj, 1, triac_controller_ramp);
+
+// Zero-cross tracking: (frequency, last phase error in us, skew in us, locked)
+static mp_obj_t triac_controller_pll(mp_obj_t self_obj) {
+    mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(self_obj);
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+    triac_pll_t pll;
+    uint8_t locked = triac_controller_read_pll(self->sense_pin, &pll);
+    const float scale = 1.0f/(1<<TRIAC_PLL_SHIFT);
+    mp_obj_t result[4] = {
+        mp_obj_new_float(500000.0f / (pll.half_period*scale)),
+        mp_obj_new_float(pll.error*scale),
+        mp_obj_new_float(pll.skew*scale),
+        mp_obj_new_bool(locked),
+    };
+    return mp_obj_new_tuple(4, result);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_controller_pll_obj,  triac_controller_pll);
+
 // static mp_obj_t triac_controller_get_height(mp_obj_t self_obj) {
 //     mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(self_obj);
 //     return MP_OBJ_NEW_SMALL_INT(self->height);
@@ -386,16 +846,116 @@ MP_DEFINE_CONST_FUN_OBJ_1(triac_controller_frequency_obj,  triac_controller_freq
 
 // Main methods =====================================================================
 
+// Sweeps the firing delay, measuring the real power with the PowerAnalyzer on each step,
+// and builds the (monotonic) power->delay curve used by percent()/level()
+static mp_obj_t triac_controller_calibrate(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_analyzer, ARG_steps, ARG_settleMs };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_analyzer, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_steps, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 32} },
+        { MP_QSTR_settleMs, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 300} },
+    };
+    mp_triac_controller_obj_t *self = (mp_triac_controller_obj_t*) MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args-1, pos_args+1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if(self->sense_pin==INVALIDPIN) mp_raise_TypeError(MP_ERROR_TEXT("object closed. re-init first!"));
+    // the sweep moves the firing delay, that burst mode doesn't use
+    if(self->mode!=TRIAC_MODE_PHASE) mp_raise_ValueError(MP_ERROR_TEXT("calibration needs phase mode"));
+    if(!mp_obj_is_type(args[ARG_analyzer].u_obj, &mp_triac_power_analyzer_type)){
+        mp_raise_TypeError(MP_ERROR_TEXT("analyzer needs to be a PowerAnalyzer"));
+    }
+    mp_triac_power_analyzer_obj_t *analyzer = MP_OBJ_TO_PTR(args[ARG_analyzer].u_obj);
+    if(!analyzer->running) mp_raise_ValueError(MP_ERROR_TEXT("PowerAnalyzer is not running"));
+    int steps = args[ARG_steps].u_int;
+    int settle = args[ARG_settleMs].u_int;
+    if(steps<2 || steps>255) mp_raise_ValueError(MP_ERROR_TEXT("invalid number of steps"));
+    if(settle<0 || settle>10000) mp_raise_ValueError(MP_ERROR_TEXT("invalid settle time"));
+    triac_pll_t pll;
+    if(!triac_controller_read_pll(self->sense_pin, &pll)){
+        mp_raise_ValueError(MP_ERROR_TEXT("no zero-cross detected"));
+    }
+
+    // step i fires with a delay of i/steps of the half period (0: full power, steps: off)
+    float *power = m_new(float, steps+1);
+    uint16_t previous_level = self->level;
+    for(int i=0; i<=steps; i++){
+        uint32_t delay = 0;
+        if(i<steps) delay = 1+(65535U*i)/steps;
+        // The watchdog only covers this step: if interrupted, the triac stops by itself
+        triac_data[self->sense_pin].user_beeing_written = 1;
+        triac_data[self->sense_pin].user_delay = delay;
+        triac_data[self->sense_pin].user_ramp_rate = 0;
+        triac_data[self->sense_pin].user_watchdog_limit = time_us_64()+(settle+2000)*1000ULL;
+        triac_data[self->sense_pin].user_beeing_written = 0;
+
+        mp_hal_delay_ms(settle);
+        // waits for a window that was entirely sampled with this setting
+        uint32_t window = triac_power_analyzer_window_count();
+        uint32_t start = mp_hal_ticks_ms();
+        while(triac_power_analyzer_window_count()-window<2){
+            if(mp_hal_ticks_ms()-start>1000){
+                triac_controller_set_level(self, 0);
+                mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("PowerAnalyzer stalled"));
+            }
+            mp_hal_delay_ms(1);
+        }
+        power[i] = triac_power_analyzer_mean_power();
+    }
+    triac_controller_set_level(self, 0);
+
+    // forcing a monotonic (non increasing with the delay) curve, from full power to zero
+    float full = power[0];
+    if(full<=0.0f) mp_raise_ValueError(MP_ERROR_TEXT("no power measured"));
+    power[steps] = 0.0f;
+    for(int i=1; i<steps; i++){
+        if(power[i]>power[i-1]) power[i] = power[i-1];
+        if(power[i]<0.0f) power[i] = 0.0f;
+    }
+
+    // inverting: for each power point, the delay that produces it
+    uint16_t *table = m_new(uint16_t, TRIAC_CALIBRATION_POINTS);
+    int i = steps;
+    for(uint k=0; k<TRIAC_CALIBRATION_POINTS; k++){
+        float target = full*k/(TRIAC_CALIBRATION_POINTS-1);
+        while(i>0 && power[i-1]<target) i--;
+        float delay;
+        if(k==TRIAC_CALIBRATION_POINTS-1 || i==0){
+            delay = 0.0f;
+        } else if(power[i-1]<=power[i]){
+            delay = (float)i/steps;
+        } else {
+            // power[i-1] >= target >= power[i]
+            delay = (i-(target-power[i])/(power[i-1]-power[i]))/steps;
+        }
+        uint32_t value = delay*65535.0f;
+        if(value>65534) value = 65534;
+        if(k>0 && value>table[k-1]) value = table[k-1];
+        table[k] = value;
+    }
+    table[0] = 65534;
+    m_del(float, power, steps+1);
+    self->calibration = table;
+    triac_controller_set_level(self, previous_level);
+    return triac_controller_calibration_blob(self->calibration);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(triac_controller_calibrate_obj, 2, triac_controller_calibrate);
+
 
 static const mp_rom_map_elem_t triac_controller_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_init), MP_ROM_PTR(&triac_controller_init_obj) },
     { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&triac_controller_close_obj) },
     // Getters / Setters
     { MP_ROM_QSTR(MP_QSTR_percent), MP_ROM_PTR(&triac_controller_percent_obj) },
+    { MP_ROM_QSTR(MP_QSTR_level), MP_ROM_PTR(&triac_controller_level_obj) },
+    { MP_ROM_QSTR(MP_QSTR_calibration), MP_ROM_PTR(&triac_controller_calibration_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mode), MP_ROM_PTR(&triac_controller_mode_obj) },
     { MP_ROM_QSTR(MP_QSTR_halfPeriod), MP_ROM_PTR(&triac_controller_half_period_obj) },
     { MP_ROM_QSTR(MP_QSTR_frequency), MP_ROM_PTR(&triac_controller_frequency_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pll), MP_ROM_PTR(&triac_controller_pll_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ramp), MP_ROM_PTR(&triac_controller_ramp_obj) },
     // Main methods
-    
+    { MP_ROM_QSTR(MP_QSTR_calibrate), MP_ROM_PTR(&triac_controller_calibrate_obj) },
 };
 MP_DEFINE_CONST_DICT(mp_triac_controller_locals_dict, triac_controller_locals_dict_table);
 
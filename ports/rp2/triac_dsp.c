@@ -0,0 +1,510 @@
+#include <math.h>
+#include "triac_dsp.h"
+
+// Chunk size for the 32 bit partial sums: each of the two accumulators takes half of
+// the chunk, so 128 * 4095^2 stays below 2^31 and the 64 bit totals are only touched
+// once per chunk (64 bit adds are expensive on the M0+).
+#define TRIAC_DSP_CHUNK_PAIRS (256)
+#define TRIAC_DSP_SAMPLE_MASK (0x0FFF)
+
+void triac_block_stats(const uint16_t *samples, uint32_t pairs, triac_block_stats_t *stats) {
+    stats->count = pairs;
+    stats->sum[0] = 0;
+    stats->sum[1] = 0;
+    stats->sqsum[0] = 0;
+    stats->sqsum[1] = 0;
+    stats->cross = 0;
+    if(pairs==0){
+        stats->min[0] = stats->min[1] = 0;
+        stats->max[0] = stats->max[1] = 0;
+        return;
+    }
+    uint32_t minA = TRIAC_DSP_SAMPLE_MASK, minB = TRIAC_DSP_SAMPLE_MASK, maxA = 0, maxB = 0;
+
+    while(pairs>0){
+        uint32_t n = (pairs>TRIAC_DSP_CHUNK_PAIRS) ? TRIAC_DSP_CHUNK_PAIRS : pairs;
+        pairs -= n;
+        // two independent accumulator sets (even and odd pairs), so consecutive
+        // multiply-accumulates don't depend on each other
+        uint32_t sumA0 = 0, sumB0 = 0, sqA0 = 0, sqB0 = 0, crossAB0 = 0;
+        uint32_t sumA1 = 0, sumB1 = 0, sqA1 = 0, sqB1 = 0, crossAB1 = 0;
+        const uint16_t *end = samples + 2*(n&~1U);
+        while(samples<end){
+            uint32_t a0 = samples[0]&TRIAC_DSP_SAMPLE_MASK;
+            uint32_t b0 = samples[1]&TRIAC_DSP_SAMPLE_MASK;
+            uint32_t a1 = samples[2]&TRIAC_DSP_SAMPLE_MASK;
+            uint32_t b1 = samples[3]&TRIAC_DSP_SAMPLE_MASK;
+            samples += 4;
+            sumA0 += a0;
+            sumB0 += b0;
+            sqA0 += a0*a0;
+            sqB0 += b0*b0;
+            crossAB0 += a0*b0;
+            sumA1 += a1;
+            sumB1 += b1;
+            sqA1 += a1*a1;
+            sqB1 += b1*b1;
+            crossAB1 += a1*b1;
+            if(a0<minA) minA = a0;
+            if(a0>maxA) maxA = a0;
+            if(b0<minB) minB = b0;
+            if(b0>maxB) maxB = b0;
+            if(a1<minA) minA = a1;
+            if(a1>maxA) maxA = a1;
+            if(b1<minB) minB = b1;
+            if(b1>maxB) maxB = b1;
+        }
+        if(n&1){
+            uint32_t a0 = samples[0]&TRIAC_DSP_SAMPLE_MASK;
+            uint32_t b0 = samples[1]&TRIAC_DSP_SAMPLE_MASK;
+            samples += 2;
+            sumA0 += a0;
+            sumB0 += b0;
+            sqA0 += a0*a0;
+            sqB0 += b0*b0;
+            crossAB0 += a0*b0;
+            if(a0<minA) minA = a0;
+            if(a0>maxA) maxA = a0;
+            if(b0<minB) minB = b0;
+            if(b0>maxB) maxB = b0;
+        }
+        stats->sum[0] += sumA0+sumA1;
+        stats->sum[1] += sumB0+sumB1;
+        stats->sqsum[0] += (uint64_t)sqA0+sqA1;
+        stats->sqsum[1] += (uint64_t)sqB0+sqB1;
+        stats->cross += (uint64_t)crossAB0+crossAB1;
+    }
+    stats->min[0] = minA;
+    stats->min[1] = minB;
+    stats->max[0] = maxA;
+    stats->max[1] = maxB;
+}
+
+uint64_t triac_block_stats_centered_sqsum(const triac_block_stats_t *stats, uint8_t channel) {
+    if(stats->count==0) return 0;
+    // sum((x-m)^2) = sum(x^2) - sum(x)^2/n. sum(x) < 2^44 for any usable
+    // window, so the square is split to stay within 64 bits.
+    uint64_t sum = stats->sum[channel];
+    uint64_t correction = (sum/stats->count)*sum + ((sum%stats->count)*sum)/stats->count;
+    return stats->sqsum[channel] - correction;
+}
+
+int64_t triac_block_stats_centered_cross(const triac_block_stats_t *stats) {
+    if(stats->count==0) return 0;
+    uint64_t sumA = stats->sum[0];
+    uint64_t sumB = stats->sum[1];
+    uint64_t correction = (sumA/stats->count)*sumB + ((sumA%stats->count)*sumB)/stats->count;
+    return (int64_t)(stats->cross - correction);
+}
+
+// Generic frame loop, inlined with a constant number of channels so the inner loop unrolls
+static inline __attribute__((always_inline)) void triac_frame_stats_loop(const uint16_t *samples, uint32_t frames, const uint8_t channels, uint8_t reference, triac_frame_stats_t *stats) {
+    uint32_t min[TRIAC_DSP_MAX_CHANNELS], max[TRIAC_DSP_MAX_CHANNELS];
+    for(uint8_t ch=0; ch<channels; ch++){
+        min[ch] = TRIAC_DSP_SAMPLE_MASK;
+        max[ch] = 0;
+    }
+    while(frames>0){
+        // 256 * 4095^2 still fits the 32 bit partial sums
+        uint32_t n = (frames>TRIAC_DSP_CHUNK_PAIRS) ? TRIAC_DSP_CHUNK_PAIRS : frames;
+        frames -= n;
+        uint32_t sum[TRIAC_DSP_MAX_CHANNELS] = {0}, sqsum[TRIAC_DSP_MAX_CHANNELS] = {0}, cross[TRIAC_DSP_MAX_CHANNELS] = {0};
+        const uint16_t *end = samples + channels*n;
+        while(samples<end){
+            uint32_t r = samples[reference]&TRIAC_DSP_SAMPLE_MASK;
+            for(uint8_t ch=0; ch<channels; ch++){
+                uint32_t x = samples[ch]&TRIAC_DSP_SAMPLE_MASK;
+                sum[ch] += x;
+                sqsum[ch] += x*x;
+                cross[ch] += x*r;
+                if(x<min[ch]) min[ch] = x;
+                if(x>max[ch]) max[ch] = x;
+            }
+            samples += channels;
+        }
+        for(uint8_t ch=0; ch<channels; ch++){
+            stats->sum[ch] += sum[ch];
+            stats->sqsum[ch] += sqsum[ch];
+            stats->cross[ch] += cross[ch];
+        }
+    }
+    for(uint8_t ch=0; ch<channels; ch++){
+        stats->min[ch] = min[ch];
+        stats->max[ch] = max[ch];
+    }
+}
+
+void triac_frame_stats(const uint16_t *samples, uint32_t frames, uint8_t channels, uint8_t reference, triac_frame_stats_t *stats) {
+    stats->count = frames;
+    stats->channels = channels;
+    stats->reference = reference;
+    for(uint8_t ch=0; ch<TRIAC_DSP_MAX_CHANNELS; ch++){
+        stats->sum[ch] = 0;
+        stats->sqsum[ch] = 0;
+        stats->cross[ch] = 0;
+        stats->min[ch] = 0;
+        stats->max[ch] = 0;
+    }
+    if(frames==0) return;
+    if(channels==2){
+        // the pair kernel is unrolled further
+        triac_block_stats_t pair;
+        triac_block_stats(samples, frames, &pair);
+        for(uint8_t ch=0; ch<2; ch++){
+            stats->sum[ch] = pair.sum[ch];
+            stats->sqsum[ch] = pair.sqsum[ch];
+            stats->min[ch] = pair.min[ch];
+            stats->max[ch] = pair.max[ch];
+        }
+        stats->cross[reference] = pair.sqsum[reference];
+        stats->cross[reference^1] = pair.cross;
+    } else if(channels==3){
+        triac_frame_stats_loop(samples, frames, 3, reference, stats);
+    } else {
+        triac_frame_stats_loop(samples, frames, 4, reference, stats);
+    }
+}
+
+uint64_t triac_frame_stats_centered_sqsum(const triac_frame_stats_t *stats, uint8_t channel) {
+    if(stats->count==0) return 0;
+    uint64_t sum = stats->sum[channel];
+    uint64_t correction = (sum/stats->count)*sum + ((sum%stats->count)*sum)/stats->count;
+    return stats->sqsum[channel] - correction;
+}
+
+int64_t triac_frame_stats_centered_cross(const triac_frame_stats_t *stats, uint8_t channel) {
+    if(stats->count==0) return 0;
+    uint64_t sumA = stats->sum[channel];
+    uint64_t sumB = stats->sum[stats->reference];
+    uint64_t correction = (sumA/stats->count)*sumB + ((sumA%stats->count)*sumB)/stats->count;
+    return (int64_t)(stats->cross[channel] - correction);
+}
+
+// Harmonic analysis ==========================================================================
+
+#define TRIAC_DSP_COEFF_SHIFT (28)
+#define TRIAC_DSP_PI (3.14159265358979f)
+
+void triac_rising_crossings(const uint16_t *samples, uint32_t frames, uint8_t stride, uint8_t slot, int16_t offset, int16_t hysteresis, triac_crossings_t *crossings) {
+    crossings->count = 0;
+    crossings->first = 0;
+    crossings->last = 0;
+    uint8_t armed = 0;
+    int32_t last = 0;
+    samples += slot;
+    for(uint32_t i=0; i<frames; i++){
+        int32_t v = (int32_t)(samples[stride*i]&TRIAC_DSP_SAMPLE_MASK) - offset;
+        if(v < -hysteresis){
+            armed = 1;
+        } else if(armed && v>=0 && last<0){
+            // linear interpolation between the last negative sample and this one
+            uint32_t position = ((i-1)<<16) + (uint32_t)(((-last)<<16)/(v-last));
+            if(crossings->count==0) crossings->first = position;
+            crossings->last = position;
+            crossings->count++;
+            armed = 0;
+        }
+        last = v;
+    }
+}
+
+void triac_goertzel_setup(triac_goertzel_t *bank, uint8_t count, float period) {
+    for(uint8_t h=0; h<count; h++){
+        float omega = 2.0f*TRIAC_DSP_PI*(h+1)/period;
+        bank[h].omega = omega;
+        bank[h].coeff = (int32_t)(2.0f*cosf(omega)*(1<<TRIAC_DSP_COEFF_SHIFT) + 0.5f);
+    }
+}
+
+void triac_goertzel_run(const uint16_t *samples, uint32_t frames, uint8_t stride, const uint8_t slot[2], const int16_t offset[2], triac_goertzel_t *bank, uint8_t count) {
+    // One harmonic at a time, both channels together: the four states stay in registers.
+    // The states grow up to frames*2048*period/(4*pi), so they need 64 bits.
+    for(uint8_t h=0; h<count; h++){
+        int64_t coeff = bank[h].coeff;
+        int64_t a1 = 0, a2 = 0, b1 = 0, b2 = 0;
+        const uint16_t *sample = samples;
+        for(uint32_t i=0; i<frames; i++){
+            int32_t a = (int32_t)(sample[slot[0]]&TRIAC_DSP_SAMPLE_MASK) - offset[0];
+            int32_t b = (int32_t)(sample[slot[1]]&TRIAC_DSP_SAMPLE_MASK) - offset[1];
+            sample += stride;
+            int64_t a0 = a + ((coeff*a1 + (1<<(TRIAC_DSP_COEFF_SHIFT-1))) >> TRIAC_DSP_COEFF_SHIFT) - a2;
+            int64_t b0 = b + ((coeff*b1 + (1<<(TRIAC_DSP_COEFF_SHIFT-1))) >> TRIAC_DSP_COEFF_SHIFT) - b2;
+            a2 = a1;
+            a1 = a0;
+            b2 = b1;
+            b1 = b0;
+        }
+        bank[h].s1[0] = a1;
+        bank[h].s2[0] = a2;
+        bank[h].s1[1] = b1;
+        bank[h].s2[1] = b2;
+    }
+}
+
+uint32_t triac_harmonic_analysis(const uint16_t *samples, uint32_t frames, uint8_t stride, const uint8_t slot[2], const int16_t offset[2], uint8_t reference, int16_t hysteresis, triac_goertzel_t *bank, uint8_t count, float *period) {
+    triac_crossings_t crossings;
+    triac_rising_crossings(samples, frames, stride, slot[reference], offset[reference], hysteresis, &crossings);
+    if(crossings.count<2) return 0;
+    uint32_t span = crossings.last - crossings.first;
+    uint32_t start = (crossings.first + 0xFFFF)>>16;
+    uint32_t length = (span + 0x8000)>>16;
+    if(start+length>frames) length = frames-start;
+    *period = span/(65536.0f*(crossings.count-1));
+    triac_goertzel_setup(bank, count, *period);
+    triac_goertzel_run(samples+stride*start, length, stride, slot, offset, bank, count);
+    return length;
+}
+
+static float triac_wrap_phase(float phase) {
+    phase = fmodf(phase, 2.0f*TRIAC_DSP_PI);
+    if(phase>TRIAC_DSP_PI) phase -= 2.0f*TRIAC_DSP_PI;
+    if(phase<-TRIAC_DSP_PI) phase += 2.0f*TRIAC_DSP_PI;
+    return phase;
+}
+
+void triac_harmonic_results(const triac_goertzel_t *bank, uint8_t count, uint32_t frames, uint8_t reference, float (*result)[4]) {
+    if(frames<2) return;
+    float reference_phase = 0.0f;
+    for(uint8_t h=0; h<count; h++){
+        float omega = bank[h].omega;
+        // y = s1 - s2*e^(-jw) is the DFT rotated by w*(frames-1)
+        float rotation = omega*(frames-1);
+        float cos_r = cosf(rotation), sin_r = sinf(rotation);
+        for(uint8_t ch=0; ch<2; ch++){
+            float s1 = (float)bank[h].s1[ch];
+            float s2 = (float)bank[h].s2[ch];
+            float y_re = s1 - s2*cosf(omega);
+            float y_im = s2*sinf(omega);
+            float x_re = y_re*cos_r + y_im*sin_r;
+            float x_im = y_im*cos_r - y_re*sin_r;
+            result[h][2*ch] = 2.0f*sqrtf(x_re*x_re + x_im*x_im)/frames;
+            result[h][2*ch+1] = atan2f(x_im, x_re);
+        }
+        if(h==0) reference_phase = result[0][2*reference+1];
+        result[h][1] = triac_wrap_phase(result[h][1] - (h+1)*reference_phase);
+        result[h][3] = triac_wrap_phase(result[h][3] - (h+1)*reference_phase);
+    }
+}
+
+// Zero-cross PLL ===============================================================================
+// With a phase gain of 1/2 and a frequency gain of 1/16 the loop is slightly overdamped
+// (poles at ~0.85): a frequency step settles in about 20 half-cycles, and the jitter of a
+// single edge moves the prediction by half of it.
+#define TRIAC_PLL_KP (1)
+#define TRIAC_PLL_KI (4)
+#define TRIAC_PLL_KS (3)
+
+void triac_pll_reset(triac_pll_t *pll, uint32_t half_period, uint8_t skew_tracking) {
+    pll->half_period = (int64_t)half_period<<TRIAC_PLL_SHIFT;
+    pll->min_half = pll->half_period - pll->half_period/4;
+    pll->max_half = pll->half_period + pll->half_period/2;
+    pll->next = 0;
+    pll->cross = 0;
+    pll->last = 0;
+    pll->skew = 0;
+    pll->error = 0;
+    pll->parity = 0;
+    pll->started = 0;
+    pll->locked = 0;
+    pll->misses = 0;
+    pll->missed = 0;
+    pll->kp = TRIAC_PLL_KP;
+    pll->ki = TRIAC_PLL_KI;
+    pll->ks = skew_tracking ? TRIAC_PLL_KS : 0;
+}
+
+static inline int64_t triac_pll_skew(const triac_pll_t *pll, uint8_t parity) {
+    return parity ? pll->skew : -pll->skew;
+}
+
+int64_t triac_pll_predict(const triac_pll_t *pll) {
+    return pll->next + triac_pll_skew(pll, pll->parity);
+}
+
+int64_t triac_pll_half(const triac_pll_t *pll, uint8_t parity) {
+    return pll->half_period - 2*triac_pll_skew(pll, parity);
+}
+
+void triac_pll_advance(triac_pll_t *pll) {
+    pll->next += pll->half_period;
+    pll->parity ^= 1;
+}
+
+// Restarts the loop from a crossing at t. The interval from the last accepted one, as a
+// whole number of half-cycles, gives a new estimate of the half period.
+static void triac_pll_acquire(triac_pll_t *pll, int64_t t) {
+    int64_t interval = t - pll->last;
+    if(pll->started && interval>0){
+        int64_t count = (interval + pll->half_period/2)/pll->half_period;
+        if(count<1) count = 1;
+        int64_t half = interval/count;
+        if(half>=pll->min_half && half<=pll->max_half) pll->half_period = half;
+    }
+    pll->started = 1;
+    pll->last = t;
+    pll->cross = t;
+    pll->next = t - triac_pll_skew(pll, pll->parity);
+    pll->error = 0;
+    pll->locked = 0;
+    pll->misses = 0;
+}
+
+// Number of half-cycles from pll->next to the prediction nearest to t
+static int32_t triac_pll_nearest(const triac_pll_t *pll, int64_t t) {
+    int64_t delta = t - pll->next;
+    int64_t half = pll->half_period;
+    if(delta>-half/2 && delta<half/2) return 0;
+    return (delta + (delta>0 ? half/2 : -half/2))/half;
+}
+
+// Checks a phase error against the lock window. Returns 0 if the measurement is rejected,
+// then the caller re-acquires if the lock was lost (locked==0).
+static uint8_t triac_pll_accept(triac_pll_t *pll, int64_t error) {
+    if(error>pll->half_period/4 || error<-pll->half_period/4){
+        if(pll->locked<TRIAC_PLL_LOCK_COUNT || ++pll->misses>TRIAC_PLL_MAX_MISSES) pll->locked = 0;
+        return 0;
+    }
+    pll->misses = 0;
+    pll->error = error;
+    if(pll->locked<TRIAC_PLL_LOCK_COUNT && error<pll->half_period/32 && error>-pll->half_period/32) pll->locked++;
+    return 1;
+}
+
+static void triac_pll_limit(triac_pll_t *pll) {
+    if(pll->half_period<pll->min_half) pll->half_period = pll->min_half;
+    if(pll->half_period>pll->max_half) pll->half_period = pll->max_half;
+    int32_t max_skew = pll->half_period/8;
+    if(pll->skew>max_skew) pll->skew = max_skew;
+    if(pll->skew<-max_skew) pll->skew = -max_skew;
+}
+
+uint8_t triac_pll_edge(triac_pll_t *pll, int64_t t) {
+    if(!pll->started){
+        triac_pll_acquire(pll, t);
+        triac_pll_advance(pll);
+        return 0;
+    }
+    // missed edges: the prediction runs free over them
+    int32_t skipped = triac_pll_nearest(pll, t);
+    if(skipped>0) pll->missed += skipped;
+    if(skipped<0 || skipped>TRIAC_PLL_MAX_MISSES){
+        // an edge for a crossing that was already taken, or a long gap
+        if(skipped>0 || pll->locked<TRIAC_PLL_LOCK_COUNT){
+            triac_pll_acquire(pll, t);
+            triac_pll_advance(pll);
+        }
+        return 0;
+    }
+    for(int32_t i=0; i<skipped; i++) triac_pll_advance(pll);
+
+    int64_t predicted = triac_pll_predict(pll);
+    int64_t error = t - predicted;
+    if(!triac_pll_accept(pll, error)){
+        if(pll->locked==0){
+            triac_pll_acquire(pll, t);
+            triac_pll_advance(pll);
+        }
+        return 0;
+    }
+    pll->half_period += error>>pll->ki;
+    if(pll->ks) pll->skew += (pll->parity ? error : -error)>>pll->ks;
+    triac_pll_limit(pll);
+    pll->next += error>>pll->kp;
+    pll->cross = predicted + (error>>pll->kp);
+    pll->last = t;
+    triac_pll_advance(pll);
+    return 1;
+}
+
+uint8_t triac_pll_observe(triac_pll_t *pll, int64_t t, int64_t half_period) {
+    if(half_period>=pll->min_half && half_period<=pll->max_half){
+        pll->half_period += (half_period-pll->half_period)>>pll->kp;
+    }
+    if(!pll->started){
+        triac_pll_acquire(pll, t);
+        return 0;
+    }
+    int32_t offset = triac_pll_nearest(pll, t);
+    uint8_t parity = (pll->parity + offset)&1;
+    int64_t predicted = pll->next + offset*pll->half_period + triac_pll_skew(pll, parity);
+    int64_t error = t - predicted;
+    if(!triac_pll_accept(pll, error)){
+        if(pll->locked==0){
+            // keeps the prediction on the half-cycle grid, in phase with t
+            pll->next += error;
+            pll->last = t;
+            pll->error = 0;
+        }
+        return 0;
+    }
+    if(half_period==0) pll->half_period += error>>pll->ki;
+    if(pll->ks) pll->skew += (parity ? error : -error)>>pll->ks;
+    triac_pll_limit(pll);
+    pll->next += error>>pll->kp;
+    pll->last = t;
+    return 1;
+}
+
+// Level ramp ==========================================================================================
+
+void triac_ramp_reset(triac_ramp_t *ramp, uint16_t level) {
+    ramp->level = (int32_t)level<<TRIAC_RAMP_SHIFT;
+    ramp->start = ramp->level;
+    ramp->target = ramp->level;
+    ramp->progress = 1<<TRIAC_RAMP_SHIFT;
+    ramp->progress_rate = 0;
+    ramp->rate = 0;
+    ramp->s_curve = 0;
+}
+
+void triac_ramp_target(triac_ramp_t *ramp, uint16_t target, uint32_t rate, uint8_t s_curve) {
+    int32_t t = (int32_t)target<<TRIAC_RAMP_SHIFT;
+    if(t==ramp->target && rate==ramp->rate && s_curve==ramp->s_curve) return;
+    ramp->target = t;
+    ramp->rate = rate;
+    ramp->s_curve = s_curve;
+    ramp->start = ramp->level;
+    ramp->progress = 0;
+    // the steepest slope of the smoothstep is 3/2 of the average one
+    uint32_t span = (t>ramp->level) ? t-ramp->level : ramp->level-t;
+    uint64_t progress_rate = span ? (((uint64_t)rate<<(TRIAC_RAMP_SHIFT+1))/(3ULL*span)) : 0;
+    if(progress_rate>0xFFFFFFFFULL) progress_rate = 0xFFFFFFFFULL;
+    ramp->progress_rate = progress_rate ? progress_rate : 1;
+}
+
+uint16_t triac_ramp_step(triac_ramp_t *ramp, uint32_t elapsed) {
+    if(ramp->level!=ramp->target){
+        if(ramp->rate==0){
+            ramp->level = ramp->target;
+        } else if(!ramp->s_curve){
+            int64_t step = ((uint64_t)ramp->rate*elapsed)>>TRIAC_RAMP_TIME_SHIFT;
+            if(step==0) step = 1;
+            if(ramp->level<ramp->target){
+                ramp->level = (ramp->target-ramp->level>step) ? ramp->level+step : ramp->target;
+            } else {
+                ramp->level = (ramp->level-ramp->target>step) ? ramp->level-step : ramp->target;
+            }
+        } else {
+            uint64_t progress = ramp->progress + (((uint64_t)ramp->progress_rate*elapsed)>>TRIAC_RAMP_TIME_SHIFT);
+            if(progress>=(1<<TRIAC_RAMP_SHIFT)){
+                ramp->progress = 1<<TRIAC_RAMP_SHIFT;
+                ramp->level = ramp->target;
+            } else {
+                // smoothstep: p^2*(3-2p), all in 16 bit fractions
+                uint64_t p = progress;
+                uint64_t s = (p*p*((3ULL<<TRIAC_RAMP_SHIFT)-2*p))>>(2*TRIAC_RAMP_SHIFT);
+                ramp->progress = progress;
+                ramp->level = ramp->start + (((int64_t)(ramp->target-ramp->start)*(int64_t)s)>>TRIAC_RAMP_SHIFT);
+            }
+        }
+    }
+    return (ramp->level + (1<<(TRIAC_RAMP_SHIFT-1)))>>TRIAC_RAMP_SHIFT;
+}
+
+uint32_t triac_ramp_rate(float levels_per_s) {
+    if(levels_per_s<=0.0f) return 0;
+    float rate = levels_per_s*(float)(1<<TRIAC_RAMP_SHIFT)*((float)(1<<TRIAC_RAMP_TIME_SHIFT)/1000000.0f);
+    if(rate>=4294967040.0f) return 0xFFFFFF00UL;
+    if(rate<1.0f) return 1;
+    return rate;
+}
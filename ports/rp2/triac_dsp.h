@@ -0,0 +1,149 @@
+#ifndef MICROPY_INCLUDED_RP2_TRIAC_DSP_H
+#define MICROPY_INCLUDED_RP2_TRIAC_DSP_H
+
+#include <stdint.h>
+
+// Raw (not centered) statistics of a block of interleaved sample pairs (a0, b0, a1, b1, ...)
+typedef struct _triac_block_stats_t {
+    uint32_t count;     // number of pairs
+    uint64_t sum[2];    // sum(x)
+    uint64_t sqsum[2];  // sum(x^2)
+    uint64_t cross;     // sum(a*b)
+    uint16_t min[2];
+    uint16_t max[2];
+} triac_block_stats_t;
+
+// One pass over the block. Samples are 12 bit ADC readings (upper bits are masked out).
+void triac_block_stats(const uint16_t *samples, uint32_t pairs, triac_block_stats_t *stats);
+
+// Centered values, from the raw sums: sum((x-mean)^2) and sum((a-mean_a)*(b-mean_b))
+uint64_t triac_block_stats_centered_sqsum(const triac_block_stats_t *stats, uint8_t channel);
+int64_t triac_block_stats_centered_cross(const triac_block_stats_t *stats);
+
+// Same statistics for frames of 2 to TRIAC_DSP_MAX_CHANNELS interleaved channels, where the
+// cross-products are taken against one reference channel (cross[reference] is its sqsum)
+#define TRIAC_DSP_MAX_CHANNELS (4)
+
+typedef struct _triac_frame_stats_t {
+    uint32_t count;     // number of frames
+    uint8_t channels;
+    uint8_t reference;
+    uint64_t sum[TRIAC_DSP_MAX_CHANNELS];
+    uint64_t sqsum[TRIAC_DSP_MAX_CHANNELS];
+    uint64_t cross[TRIAC_DSP_MAX_CHANNELS]; // sum(x*reference)
+    uint16_t min[TRIAC_DSP_MAX_CHANNELS];
+    uint16_t max[TRIAC_DSP_MAX_CHANNELS];
+} triac_frame_stats_t;
+
+void triac_frame_stats(const uint16_t *samples, uint32_t frames, uint8_t channels, uint8_t reference, triac_frame_stats_t *stats);
+uint64_t triac_frame_stats_centered_sqsum(const triac_frame_stats_t *stats, uint8_t channel);
+int64_t triac_frame_stats_centered_cross(const triac_frame_stats_t *stats, uint8_t channel);
+
+// Harmonic analysis ==========================================================================
+// A bank of Goertzel filters, one per harmonic of the reference channel frequency. The
+// fundamental is measured from the rising zero-crossings, and the analyzed segment is cut
+// to a whole number of cycles, so there is no need for a window function.
+// Samples are frames of stride interleaved channels, two of which (slot[0], slot[1]) are analyzed.
+
+#define TRIAC_DSP_MAX_HARMONICS (16)
+
+typedef struct _triac_goertzel_t {
+    int32_t coeff;      // 2*cos(omega), Q28
+    float omega;        // radians per frame
+    int64_t s1[2];      // filter state of each analyzed channel
+    int64_t s2[2];
+} triac_goertzel_t;
+
+// Rising zero-crossings of one channel, positions in frames as 16.16 fixed point
+typedef struct _triac_crossings_t {
+    uint32_t count;
+    uint32_t first;
+    uint32_t last;
+} triac_crossings_t;
+
+// A crossing needs the (offset removed) signal to go below -hysteresis before going positive
+void triac_rising_crossings(const uint16_t *samples, uint32_t frames, uint8_t stride, uint8_t slot, int16_t offset, int16_t hysteresis, triac_crossings_t *crossings);
+
+// Harmonic h (1..count) of a period (in frames) is bank[h-1]
+void triac_goertzel_setup(triac_goertzel_t *bank, uint8_t count, float period);
+void triac_goertzel_run(const uint16_t *samples, uint32_t frames, uint8_t stride, const uint8_t slot[2], const int16_t offset[2], triac_goertzel_t *bank, uint8_t count);
+
+// Locks to slot[reference] and runs the bank over whole cycles. Returns the number of
+// analyzed frames (0 if less than two crossings were found) and the period, in frames.
+uint32_t triac_harmonic_analysis(const uint16_t *samples, uint32_t frames, uint8_t stride, const uint8_t slot[2], const int16_t offset[2], uint8_t reference, int16_t hysteresis, triac_goertzel_t *bank, uint8_t count, float *period);
+
+// Peak amplitude and phase (cosine, radians) of each harmonic and channel, into
+// result[h-1][4] = {amplitude0, phase0, amplitude1, phase1}. Phases are relative to the
+// fundamental of the reference channel (phase - h*reference_phase), within [-pi, pi].
+void triac_harmonic_results(const triac_goertzel_t *bank, uint8_t count, uint32_t frames, uint8_t reference, float (*result)[4]);
+
+// Zero-cross PLL =============================================================================
+// Second order (phase and frequency) tracking of the mains half-cycles, fed with measured
+// zero-crossings. Times are in us as 48.16 fixed point. Crossings alternate between two
+// parities (e.g. rising and falling), which the zero-cross detector may space unevenly:
+// crossings of parity 1 are expected skew after the nominal ones, parity 0 skew before.
+
+#define TRIAC_PLL_SHIFT (16)
+#define TRIAC_PLL_LOCK_COUNT (8)    // consecutive accepted crossings to declare a lock
+#define TRIAC_PLL_MAX_MISSES (3)    // outliers tolerated while locked, before re-acquiring
+
+typedef struct _triac_pll_t {
+    int64_t half_period;    // estimated half period
+    int64_t next;           // predicted nominal time of the next crossing
+    int64_t cross;          // filtered time of the last crossing
+    int64_t last;           // last accepted measurement
+    int64_t min_half;       // limits for the half period estimate
+    int64_t max_half;
+    int32_t skew;
+    int32_t error;          // last phase error, measured - predicted
+    uint8_t parity;         // parity of the next crossing
+    uint8_t started;
+    uint8_t locked;         // consecutive accepted crossings, up to TRIAC_PLL_LOCK_COUNT
+    uint8_t misses;
+    uint32_t missed;        // crossings with no edge, run over by the prediction
+    uint8_t kp, ki, ks;     // loop gains, as right shifts of the error (ks = 0: no skew tracking)
+} triac_pll_t;
+
+// half_period is the nominal one, in us; the estimate is kept within -25%..+50% of it
+void triac_pll_reset(triac_pll_t *pll, uint32_t half_period, uint8_t skew_tracking);
+// A crossing measured at t, expected around pll->next (e.g. a GPIO edge): updates the loop
+// and advances the prediction to the following crossing. Returns 1 if it was accepted.
+uint8_t triac_pll_edge(triac_pll_t *pll, int64_t t);
+// A crossing measured at t, at any number of half-cycles from pll->next (e.g. a delayed
+// ADC measurement), with an independent half period measurement (0 if none).
+// The prediction is corrected but not advanced. Returns 1 if it was accepted.
+uint8_t triac_pll_observe(triac_pll_t *pll, int64_t t, int64_t half_period);
+// Advances the prediction one half-cycle without a measurement (flywheel)
+void triac_pll_advance(triac_pll_t *pll);
+// Predicted time of the next crossing, and length of the half-cycle after a crossing of parity
+int64_t triac_pll_predict(const triac_pll_t *pll);
+int64_t triac_pll_half(const triac_pll_t *pll, uint8_t parity);
+
+// Level ramp ================================================================================
+// Slew limited power level, stepped once per half-cycle by the firing interruption. Levels
+// are 16.16 fixed point. The S-curve (smoothstep) starts and ends each move with zero slope,
+// its steepest point moving at the rate.
+
+#define TRIAC_RAMP_SHIFT (16)
+#define TRIAC_RAMP_TIME_SHIFT (20) // rates are per 2^20us
+
+typedef struct _triac_ramp_t {
+    int32_t level;          // applied level
+    int32_t start;          // level at the start of the current move (S-curve)
+    int32_t target;
+    uint32_t progress;      // of the current move, 0..1<<TRIAC_RAMP_SHIFT (S-curve)
+    uint32_t progress_rate; // per 2^20us (S-curve)
+    uint32_t rate;          // levels per 2^20us, 0: no ramp, the level jumps to the target
+    uint8_t s_curve;
+} triac_ramp_t;
+
+// Jumps to level (integer), with no ramp configured
+void triac_ramp_reset(triac_ramp_t *ramp, uint16_t level);
+// A new target (integer level) or rate starts a new move from the applied level
+void triac_ramp_target(triac_ramp_t *ramp, uint16_t target, uint32_t rate, uint8_t s_curve);
+// Advances elapsed us, returns the applied level, rounded to an integer
+uint16_t triac_ramp_step(triac_ramp_t *ramp, uint32_t elapsed);
+// Rate, in levels per 2^20us, for a slew of levels_per_s (saturates, 0 if <= 0)
+uint32_t triac_ramp_rate(float levels_per_s);
+
+#endif // MICROPY_INCLUDED_RP2_TRIAC_DSP_H
@@ -8,12 +8,17 @@
 #include "py/mphal.h"
 #include "py/runtime.h"
 #include "py/mpprint.h"
+#include "py/builtin.h"
+#include "py/stream.h"
 #include "triac.h"
+#include "triac_dsp.h"
+#include "modrp2.h"
 #include "pico/time.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
 #include "hardware/adc.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
 #include "hardware/regs/adc.h"
 #include "hardware/timer.h"
 #include "hardware/structs/iobank0.h"
@@ -22,166 +27,578 @@
 #define INVALIDPIN (255)
 #define MAX_NUM_CHANNELS (4)
 #define INVALID_DMA_CHANNEL (-1)
+// ADC: 48MHz clock, 96 cycles per conversion, shared by all inputs of a frame
+#define ADC_CLOCK_HZ (48000000)
+#define ADC_MAX_FRAME_RATE(channels) (ADC_CLOCK_HZ/96/(channels))
+#define ADC_MIN_FRAME_RATE(channels) (ADC_CLOCK_HZ/65536/(channels)+1)
+// DMA_IRQ_0 is used by rp2.DMA
+#define TRIAC_DMA_IRQ_INDEX (1)
+#define TRIAC_DMA_IRQ (DMA_IRQ_1)
+#define RMS_PER_PEAK (0.70710678f)
+
 static mp_triac_power_analyzer_obj_t tpa_singleton = {
-    {&mp_triac_power_analyzer_type}, INVALIDPIN, INVALIDPIN, 0, /*0, 0,*/ 1.0f, 1.0f, 1.0f,
-    0, 0, 1, 0,
-    {{{0}, {0},   {0}, {0}, 0,   0, 0, 0,  0, 0, 0,  0, 0, 0,  0,   0, 0, 0},
-    {{0}, {0},   {0}, {0}, 0,   0, 0, 0,  0, 0, 0,  0, 0, 0,  0,   0, 0, 0}},
-    0, 0,   0, 0, 0,   0, 0, 0,   0, 0, 0,   0
+    .base = {&mp_triac_power_analyzer_type},
+    .voltage_pin = INVALIDPIN,
+    .current_pin = INVALIDPIN,
+    .current_count = 1,
+    .current_pins = {INVALIDPIN, INVALIDPIN, INVALIDPIN},
+    .channels = 2,
+    .voltage_multiplier = 1.0f,
+    .current_multiplier = 1.0f,
+    .current_multipliers = {1.0f, 1.0f, 1.0f},
+    .power_multiplier = 1.0f,
+    .i_phase = 0,
+    .u_phase = 1,
+    .dma_channel = {INVALID_DMA_CHANNEL, INVALID_DMA_CHANNEL},
 };
 
+// DMA buffers, histos and history ring live in a single block, kept alive by this root pointer
+MP_REGISTER_ROOT_POINTER(void *triac_power_analyzer_memory);
+// File the energy accumulators are periodically saved to
+MP_REGISTER_ROOT_POINTER(mp_obj_t triac_power_analyzer_energy_path);
+// Raw sample ring of the streaming mode
+MP_REGISTER_ROOT_POINTER(void *triac_power_analyzer_stream);
 
-// Interrupt stuff
-static uint32_t volatile intcount = 0;
-
-static bool mp_triac_power_analyzer_timer_tick(struct repeating_timer *rt) {
-    // Interrupt logic:
-    // Main part: ADC sampling
-    // results from current_reads[i-1] are in the result.
-    // This interrupt shall read voltage_reads[i] and prepare for current_reads[i], for next interruption
-    // Meanwhile we wait for voltage_read, we can calculate partial results of do a full calculation
-    // Also: We can lose a few samples while preparing the results, the
-    // more important is the cadence between reads in a set of samples
-    // Secondary part: Double buffering and interrupt processing
-    // Since the end of sampling is taking too long and potentially interfering with
-    // I2C display communication timing, the processing is beeing split per index
-    // and being processed with double buffering.
-    uint16_t last_current_reading = adc_hw->result;
-    hw_write_masked(&adc_hw->cs, tpa_singleton.voltage_pin << ADC_CS_AINSEL_LSB, ADC_CS_AINSEL_BITS);
-    hw_set_bits(&adc_hw->cs, ADC_CS_START_ONCE_BITS);
+MP_DECLARE_CONST_FUN_OBJ_1(triac_power_analyzer_persist_energy_obj);
 
+
+// Interrupt stuff
+static void mp_triac_power_analyzer_process_block(const uint16_t *block, uint64_t completed) {
+    // Called for each completed DMA block, while the other one is being filled.
+    // completed: time when the DMA finished, i.e. right after the last conversion.
     uint64_t start = time_us_64();
 
     mp_triac_power_analyzer_doublebuffer_obj_t *iobj = &tpa_singleton.db[tpa_singleton.i_phase];
-    mp_triac_power_analyzer_doublebuffer_obj_t *uobj = &tpa_singleton.db[tpa_singleton.u_phase];
-    tpa_singleton.interrupt_count++;
-    if(tpa_singleton.mbp==0xFFFF){
-        // First time running, or if running right after a sample.
-        // last_current_reading is probably invalid... only doing initializations
-        // at least i_phase and u_phase should be already be in the right places
-        memset(iobj->histo_voltage, 0, sizeof(int32_t)*POWER_ANALYZER_HISTO_SIZE);
-        memset(iobj->histo_current, 0, sizeof(int32_t)*POWER_ANALYZER_HISTO_SIZE);
-        iobj->histo_count = 0;
-
-        iobj->i_sumV = 0;
-        iobj->i_sumC = 0;
-        iobj->i_sumP = 0;
-        iobj->i_maxV = 0;
-        iobj->i_maxC = 0;
-        iobj->i_maxP = 0;
-        iobj->i_minV = 0;
-        iobj->i_minC = 0;
-        iobj->i_minP = 0;
-        iobj->i_histoPos = 0;
-        iobj->i_lastV = 0;
-        iobj->i_sqsumV = 0;
-        iobj->i_sqsumC = 0;
-
-        tpa_singleton.mbp = 0;
-    } else if(tpa_singleton.mbp < POWER_ANALYZER_BUFFER_SIZE){
-        // Registering and getting the last position in the interrupt buffer
-        int16_t v = iobj->voltage_buffer[tpa_singleton.mbp];
-        int16_t c = last_current_reading&0x0FFF;
-        iobj->current_buffer[tpa_singleton.mbp] = c;
-
-        // Dealing only with "current sample" first
-        if(tpa_singleton.mbp==0){
-            iobj->i_sumV = v;
-            iobj->i_sumC = c;
-            iobj->i_maxV = v;
-            iobj->i_maxC = c;
-            iobj->i_minV = v;
-            iobj->i_minC = c;
-        } else {
-            iobj->i_sumV += v;
-            iobj->i_sumC += c;
-            if(v>iobj->i_maxV)iobj->i_maxV = v;
-            if(v<iobj->i_minV)iobj->i_minV = v;
-            if(c>iobj->i_maxC)iobj->i_maxC = c;
-            if(c<iobj->i_minC)iobj->i_minC = c;
-        }
-        // And then dealing with last sampling period
-        v = uobj->voltage_buffer[tpa_singleton.mbp]-tpa_singleton.offset_voltage;
-        c = uobj->current_buffer[tpa_singleton.mbp]-tpa_singleton.offset_current;
+    uint16_t window_size = tpa_singleton.window_size;
+    uint16_t histo_size = tpa_singleton.histo_size;
+    uint8_t channels = tpa_singleton.channels;
+    uint8_t vslot = tpa_singleton.voltage_slot;
+    uint8_t cslot = tpa_singleton.current_slots[0];
+
+    // Offsets, extremes, square sums and cross-products against the voltage, in a single pass
+    triac_frame_stats_t stats;
+    triac_frame_stats(block, window_size, channels, vslot, &stats);
+    int16_t offset_voltage = stats.sum[vslot]/window_size;
+    int16_t offset_current = stats.sum[cslot]/window_size;
+
+    // Instantaneous power peaks and the zero-cross aligned waveforms need the offsets
+    memset(iobj->histo_voltage, 0, sizeof(int32_t)*histo_size);
+    memset(iobj->histo_current, 0, sizeof(int32_t)*histo_size);
+    iobj->histo_count = 0;
+    int32_t maxP = INT32_MIN, minP = INT32_MAX;
+    uint16_t histoPos = 0;
+    int16_t lastV = (block[vslot]&0x0FFF)-offset_voltage;
+    for(uint i=0; i<window_size; i++){
+        int16_t v = (block[channels*i+vslot]&0x0FFF)-offset_voltage;
+        int16_t c = (block[channels*i+cslot]&0x0FFF)-offset_current;
         int32_t p = v*c;
-        if(tpa_singleton.mbp==0){
-            iobj->i_maxP = p;
-            iobj->i_minP = p;
-            iobj->i_lastV = v;
-        } else {
-            if(p>iobj->i_maxP) iobj->i_maxP = p;
-            if(p<iobj->i_minP) iobj->i_minP = p;
-        }
-        iobj->i_sqsumV += v*v;
-        iobj->i_sqsumC += c*c;
-        iobj->i_sumP += p;
+        if(p>maxP) maxP = p;
+        if(p<minP) minP = p;
 
-        if(iobj->i_histoPos==0){
-            if(iobj->i_lastV<0 && v>0 && ((tpa_singleton.mbp+POWER_ANALYZER_HISTO_SIZE)<POWER_ANALYZER_BUFFER_SIZE)){
+        if(histoPos==0){
+            if(lastV<0 && v>0 && ((i+histo_size)<window_size)){
                 iobj->histo_voltage[0] += v;
                 iobj->histo_current[0] += c;
-                iobj->i_histoPos = 1;
+                histoPos = 1;
                 iobj->histo_count++;
             }
         } else {
-            if(iobj->i_histoPos>=POWER_ANALYZER_HISTO_SIZE){
-                iobj->i_histoPos = 0;
+            if(histoPos>=histo_size){
+                histoPos = 0;
             } else {
-                iobj->histo_voltage[iobj->i_histoPos] += v;
-                iobj->histo_current[iobj->i_histoPos] += c;
-                iobj->i_histoPos++;
+                iobj->histo_voltage[histoPos] += v;
+                iobj->histo_current[histoPos] += c;
+                histoPos++;
             }
         }
-        iobj->i_lastV = v;
-
-        tpa_singleton.mbp++;
-    }
-    if(tpa_singleton.mbp>=POWER_ANALYZER_BUFFER_SIZE){
-        tpa_singleton.offset_voltage = iobj->i_sumV/POWER_ANALYZER_BUFFER_SIZE;
-        tpa_singleton.offset_current = iobj->i_sumC/POWER_ANALYZER_BUFFER_SIZE;
-        tpa_singleton.pos_peak_voltage = iobj->i_maxV - tpa_singleton.offset_voltage;
-        tpa_singleton.pos_peak_current = iobj->i_maxC - tpa_singleton.offset_current;
-        tpa_singleton.neg_peak_voltage = iobj->i_minV - tpa_singleton.offset_voltage;
-        tpa_singleton.neg_peak_current = iobj->i_minC - tpa_singleton.offset_current;
-        tpa_singleton.pos_peak_power = iobj->i_maxP;
-        tpa_singleton.neg_peak_power = iobj->i_minP;
-        tpa_singleton.squaresum_voltage = iobj->i_sqsumV;
-        tpa_singleton.squaresum_current = iobj->i_sqsumC;
-        tpa_singleton.sum_power = iobj->i_sumP;
-
-        tpa_singleton.mbp=0xFFFF;
-        // switching user and interrupt buffer contexts
-        tpa_singleton.u_phase = tpa_singleton.i_phase;
-        tpa_singleton.i_phase = (tpa_singleton.i_phase)?0:1;
-        intcount--;
+        lastV = v;
+    }
+
+    // Harmonics, locked to the measured voltage fundamental
+    iobj->harmonic_count = 0;
+    int16_t hysteresis = (stats.max[vslot]-offset_voltage)/4;
+    if(tpa_singleton.harmonic_count>0 && hysteresis>0){
+        const uint8_t slot[2] = {vslot, cslot};
+        const int16_t offset[2] = {offset_voltage, offset_current};
+        iobj->harmonic_pairs = triac_harmonic_analysis(block, window_size, channels, slot, offset, 0, hysteresis,
+            iobj->harmonics, tpa_singleton.harmonic_count, &iobj->period);
+        if(iobj->harmonic_pairs>1) iobj->harmonic_count = tpa_singleton.harmonic_count;
+    }
+
+    // Voltage crossings, as absolute times, for the controllers synchronized to the ADC
+    if(triac_controller_adc_synced() && hysteresis>0 && tpa_singleton.sample_rate>0){
+        triac_crossings_t crossings;
+        triac_rising_crossings(block, window_size, channels, vslot, offset_voltage, hysteresis, &crossings);
+        if(crossings.count>0){
+            int64_t frame_us = ((int64_t)1000000<<TRIAC_PLL_SHIFT)/tpa_singleton.sample_rate;
+            // the voltage of the last frame was converted channels-1-vslot conversions before the end
+            int64_t end = ((int64_t)completed<<TRIAC_PLL_SHIFT) - frame_us*(channels-1-vslot)/channels;
+            int64_t last_frame = (int64_t)(window_size-1)<<16;
+            int64_t first = end - (((last_frame-crossings.first)*frame_us)>>16);
+            int64_t last = end - (((last_frame-crossings.last)*frame_us)>>16);
+            triac_controller_adc_crossings(first, last, crossings.count);
+        }
+    }
+
+    tpa_singleton.updating = 1;
+    tpa_singleton.offset_voltage = offset_voltage;
+    tpa_singleton.offset_current = offset_current;
+    tpa_singleton.pos_peak_voltage = stats.max[vslot] - offset_voltage;
+    tpa_singleton.pos_peak_current = stats.max[cslot] - offset_current;
+    tpa_singleton.neg_peak_voltage = stats.min[vslot] - offset_voltage;
+    tpa_singleton.neg_peak_current = stats.min[cslot] - offset_current;
+    tpa_singleton.pos_peak_power = maxP;
+    tpa_singleton.neg_peak_power = minP;
+    tpa_singleton.squaresum_voltage = triac_frame_stats_centered_sqsum(&stats, vslot);
+    tpa_singleton.squaresum_current = triac_frame_stats_centered_sqsum(&stats, cslot);
+    tpa_singleton.sum_power = triac_frame_stats_centered_cross(&stats, cslot);
+    for(uint i=0; i<tpa_singleton.current_count; i++){
+        uint8_t slot = tpa_singleton.current_slots[i];
+        uint16_t offset = stats.sum[slot]/window_size;
+        tpa_singleton.offset_currents[i] = offset;
+        tpa_singleton.pos_peak_currents[i] = stats.max[slot] - offset;
+        tpa_singleton.neg_peak_currents[i] = stats.min[slot] - offset;
+        tpa_singleton.squaresum_currents[i] = triac_frame_stats_centered_sqsum(&stats, slot);
+        tpa_singleton.sum_power_currents[i] = triac_frame_stats_centered_cross(&stats, slot);
+    }
+
+    // Summary of this window into the history ring. The entry is marked invalid
+    // while being written, so readers can detect it being overwritten.
+    uint32_t window = tpa_singleton.window_count;
+    mp_triac_power_analyzer_summary_t *entry = &tpa_singleton.history[window%tpa_singleton.history_size];
+    entry->window = POWER_ANALYZER_INVALID_WINDOW;
+    entry->timestamp_ms = start/1000;
+    entry->squaresum_voltage = tpa_singleton.squaresum_voltage;
+    entry->squaresum_current = tpa_singleton.squaresum_current;
+    entry->sum_power = tpa_singleton.sum_power;
+    entry->pos_peak_voltage = tpa_singleton.pos_peak_voltage;
+    entry->neg_peak_voltage = tpa_singleton.neg_peak_voltage;
+    entry->pos_peak_current = tpa_singleton.pos_peak_current;
+    entry->neg_peak_current = tpa_singleton.neg_peak_current;
+    entry->window = window;
+
+    // Energy accumulators: active from the exact power sum, apparent from the rms product
+    uint64_t apparent = sqrtf((float)tpa_singleton.squaresum_voltage*(float)tpa_singleton.squaresum_current);
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    tpa_singleton.energy_active += tpa_singleton.sum_power;
+    tpa_singleton.energy_apparent += apparent;
+    tpa_singleton.energy_pairs += window_size;
+    spin_unlock(triac_spin_lock, state);
+    if(tpa_singleton.persist_period_ms && (entry->timestamp_ms-tpa_singleton.persist_last_ms)>=tpa_singleton.persist_period_ms){
+        tpa_singleton.persist_last_ms = entry->timestamp_ms;
+        mp_sched_schedule(MP_OBJ_FROM_PTR(&triac_power_analyzer_persist_energy_obj), mp_const_none);
+    }
+
+    triac_supervisor_window(&tpa_singleton);
+
+    // switching user and interrupt buffer contexts
+    tpa_singleton.u_phase = tpa_singleton.i_phase;
+    tpa_singleton.i_phase = (tpa_singleton.i_phase)?0:1;
+    tpa_singleton.window_count = window+1;
+    __dmb();
+    tpa_singleton.updating = 0;
+}
+
+static void mp_triac_power_analyzer_stream_block(const uint16_t *block) {
+    // Producer side of the stream ring, whole blocks only so the stream has no holes inside a window.
+    // The block is reserved and published under the lock, the copy runs outside it: stream_writing
+    // keeps the ring from being replaced meanwhile, when the engine runs on core1
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    int16_t *ring = tpa_singleton.stream_buffer;
+    uint32_t frames = tpa_singleton.window_size;
+    uint32_t head = tpa_singleton.stream_head;
+    uint32_t mask = tpa_singleton.stream_size-1;
+    if(ring==NULL){
+        spin_unlock(triac_spin_lock, state);
+        return;
+    }
+    if(tpa_singleton.stream_size-(head-tpa_singleton.stream_tail)<frames){
+        tpa_singleton.stream_dropped_blocks++;
+        tpa_singleton.stream_dropped_pairs += frames;
+        spin_unlock(triac_spin_lock, state);
+        return;
+    }
+    tpa_singleton.stream_writing = 1;
+    spin_unlock(triac_spin_lock, state);
+
+    // reordered to voltage first, then the currents in the order they were given
+    uint8_t channels = tpa_singleton.channels;
+    uint8_t order[1+POWER_ANALYZER_MAX_CURRENTS];
+    order[0] = tpa_singleton.voltage_slot;
+    for(uint i=1; i<channels; i++){
+        order[i] = tpa_singleton.current_slots[i-1];
+    }
+    for(uint32_t i=0; i<frames; i++){
+        int16_t *out = &ring[channels*((head+i)&mask)];
+        const uint16_t *in = &block[channels*i];
+        for(uint ch=0; ch<channels; ch++){
+            out[ch] = in[order[ch]];
+        }
+    }
+
+    state = spin_lock_blocking(triac_spin_lock);
+    tpa_singleton.stream_head = head+frames;
+    tpa_singleton.stream_writing = 0;
+    spin_unlock(triac_spin_lock, state);
+}
+
+static void mp_triac_power_analyzer_dma_irq(void) {
+    uint32_t tlm = triac_telemetry_start();
+    uint8_t cpu = rp2_cpu_enter(RP2_CPU_ANALYZER);
+    uint64_t completed = time_us_64();
+    // Each channel, when done, has already chained to the other one. Rewinding it
+    // (without triggering) makes it ready to be chained back into its own buffer.
+    uint32_t blocks = 0;
+    for(uint i=0; i<2; i++){
+        int channel = tpa_singleton.dma_channel[i];
+        if(channel==INVALID_DMA_CHANNEL || !dma_irqn_get_channel_status(TRIAC_DMA_IRQ_INDEX, channel)) continue;
+        dma_irqn_acknowledge_channel(TRIAC_DMA_IRQ_INDEX, channel);
+        dma_channel_set_write_addr(channel, tpa_singleton.dma_buffer[i], false);
+        mp_triac_power_analyzer_stream_block(tpa_singleton.dma_buffer[i]);
+        mp_triac_power_analyzer_process_block(tpa_singleton.dma_buffer[i], completed);
+        blocks++;
+    }
+    // both blocks pending: one of them waited a whole window, its buffer was being refilled
+    if(blocks) triac_telemetry_end(TRIAC_TLM_ANALYZER, tlm, -1, blocks>1);
+    rp2_cpu_exit(cpu);
+}
+
+// The DMA interruption is taken by the real-time engine core. The whole window is processed in it,
+// so it runs below the zero-cross (GPIO) and gate alarm (timer) interruptions, that can preempt it
+// (the priorities are per core, set where it is enabled)
+static void mp_triac_power_analyzer_set_irq(uint32_t enabled) {
+    irq_set_priority(TRIAC_DMA_IRQ, enabled ? PICO_LOWEST_IRQ_PRIORITY : PICO_DEFAULT_IRQ_PRIORITY);
+    irq_set_enabled(TRIAC_DMA_IRQ, enabled!=0);
+}
+
+static void mp_triac_power_analyzer_stop_capture(void) {
+    adc_run(false);
+    for(uint i=0; i<2; i++){
+        int channel = tpa_singleton.dma_channel[i];
+        if(channel==INVALID_DMA_CHANNEL) continue;
+        dma_irqn_set_channel_enabled(TRIAC_DMA_IRQ_INDEX, channel, false);
+        // breaking the chain before aborting, so the other channel is not re-triggered
+        dma_channel_config config = dma_get_channel_config(channel);
+        channel_config_set_chain_to(&config, channel);
+        dma_channel_set_config(channel, &config, false);
+    }
+    for(uint i=0; i<2; i++){
+        int channel = tpa_singleton.dma_channel[i];
+        if(channel==INVALID_DMA_CHANNEL) continue;
+        dma_channel_abort(channel);
+        dma_irqn_acknowledge_channel(TRIAC_DMA_IRQ_INDEX, channel);
+        dma_channel_unclaim(channel);
+        tpa_singleton.dma_channel[i] = INVALID_DMA_CHANNEL;
+    }
+    irq_set_enabled(TRIAC_DMA_IRQ, false);
+    triac_realtime_run(mp_triac_power_analyzer_set_irq, 0);
+    irq_remove_handler(TRIAC_DMA_IRQ, mp_triac_power_analyzer_dma_irq);
+    adc_set_round_robin(0);
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_fifo_drain();
+}
+
+static void mp_triac_power_analyzer_start_capture(uint32_t sample_rate) {
+    for(uint i=0; i<2; i++){
+        tpa_singleton.dma_channel[i] = dma_claim_unused_channel(false);
+        if(tpa_singleton.dma_channel[i]<0){
+            tpa_singleton.dma_channel[i] = INVALID_DMA_CHANNEL;
+            mp_triac_power_analyzer_stop_capture();
+            mp_raise_OSError(MP_EBUSY);
+        }
+    }
+    // Round-robin starts from the selected input and goes up, so the inputs come in
+    // ascending order in each frame: the slot of an input is the number of inputs below it
+    uint32_t mask = 1U<<tpa_singleton.voltage_pin;
+    for(uint i=0; i<tpa_singleton.current_count; i++){
+        mask |= 1U<<tpa_singleton.current_pins[i];
+    }
+    tpa_singleton.voltage_slot = __builtin_popcount(mask&((1U<<tpa_singleton.voltage_pin)-1));
+    for(uint i=0; i<tpa_singleton.current_count; i++){
+        tpa_singleton.current_slots[i] = __builtin_popcount(mask&((1U<<tpa_singleton.current_pins[i])-1));
+    }
+    adc_select_input(__builtin_ctz(mask));
+    adc_set_round_robin(mask);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv((float)ADC_CLOCK_HZ/((float)tpa_singleton.channels*sample_rate)-1.0f);
+    adc_fifo_drain();
+
+    for(uint i=0; i<2; i++){
+        int channel = tpa_singleton.dma_channel[i];
+        dma_channel_config config = dma_channel_get_default_config(channel);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+        channel_config_set_dreq(&config, DREQ_ADC);
+        channel_config_set_chain_to(&config, tpa_singleton.dma_channel[i^1]);
+        dma_channel_configure(channel, &config, tpa_singleton.dma_buffer[i], &adc_hw->fifo, tpa_singleton.channels*tpa_singleton.window_size, false);
+        dma_irqn_acknowledge_channel(TRIAC_DMA_IRQ_INDEX, channel);
+        dma_irqn_set_channel_enabled(TRIAC_DMA_IRQ_INDEX, channel, true);
+    }
+    irq_add_shared_handler(TRIAC_DMA_IRQ, mp_triac_power_analyzer_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    triac_realtime_run(mp_triac_power_analyzer_set_irq, 1);
+
+    dma_channel_start(tpa_singleton.dma_channel[0]);
+    adc_run(true);
+}
+
+// Accessors for the other Triac parts (calibration) =====================================================
+
+uint8_t triac_power_analyzer_active(void) {
+    return tpa_singleton.running;
+}
+
+uint32_t triac_power_analyzer_window_count(void) {
+    return tpa_singleton.window_count;
+}
+
+uint32_t triac_power_analyzer_window_us(void) {
+    // 0 while stopped
+    if(!tpa_singleton.running || tpa_singleton.sample_rate==0) return 0;
+    return (uint64_t)tpa_singleton.window_size*1000000/tpa_singleton.sample_rate;
+}
+
+float triac_power_analyzer_mean_power(void) {
+    // Average instantaneous power of the last complete window, in raw ADC units
+    uint32_t initial_window, final_window;
+    int64_t sum_power;
+    do{
+        initial_window = tpa_singleton.window_count;
+        sum_power = tpa_singleton.sum_power;
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    return (float)sum_power/tpa_singleton.window_size;
+}
+
+// Energy metering ======================================================================================
+
+// Energy blob: 'T','E', version, 0, rate (uint32), active (int64), apparent (uint64), pairs (uint64),
+// all little-endian, then the 16 bit sum of the preceding bytes
+#define TRIAC_ENERGY_VERSION (1)
+#define TRIAC_ENERGY_BLOB_SIZE (4+4+3*8+2)
+
+static uint64_t triac_power_analyzer_rescale(uint64_t value, uint32_t from, uint32_t to) {
+    return (value/from)*to + ((value%from)*to)/from;
+}
+
+static void triac_power_analyzer_energy_set(int64_t active, uint64_t apparent, uint64_t pairs, uint32_t rate) {
+    // Accumulators are kept in pairs of the current sample rate, so a new rate rescales them
+    if(rate!=0 && tpa_singleton.energy_rate!=0 && rate!=tpa_singleton.energy_rate){
+        uint32_t to = tpa_singleton.energy_rate;
+        active = (active<0) ? -(int64_t)triac_power_analyzer_rescale(-active, rate, to) : (int64_t)triac_power_analyzer_rescale(active, rate, to);
+        apparent = triac_power_analyzer_rescale(apparent, rate, to);
+        pairs = triac_power_analyzer_rescale(pairs, rate, to);
+    } else if(tpa_singleton.energy_rate==0){
+        tpa_singleton.energy_rate = rate;
+    }
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    tpa_singleton.energy_active = active;
+    tpa_singleton.energy_apparent = apparent;
+    tpa_singleton.energy_pairs = pairs;
+    spin_unlock(triac_spin_lock, state);
+}
+
+static void triac_power_analyzer_energy_rate(uint32_t rate) {
+    // Called with the capture stopped
+    uint32_t from = tpa_singleton.energy_rate;
+    tpa_singleton.energy_rate = rate;
+    triac_power_analyzer_energy_set(tpa_singleton.energy_active, tpa_singleton.energy_apparent, tpa_singleton.energy_pairs, from);
+}
+
+static void triac_power_analyzer_energy_read(int64_t *active, uint64_t *apparent, uint64_t *pairs) {
+    uint32_t initial_window, final_window;
+    do{
+        initial_window = tpa_singleton.window_count;
+        *active = tpa_singleton.energy_active;
+        *apparent = tpa_singleton.energy_apparent;
+        *pairs = tpa_singleton.energy_pairs;
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+}
+
+static mp_obj_t triac_power_analyzer_energy_blob(void) {
+    int64_t active;
+    uint64_t apparent, pairs;
+    triac_power_analyzer_energy_read(&active, &apparent, &pairs);
+    uint8_t buf[TRIAC_ENERGY_BLOB_SIZE];
+    uint64_t values[3] = {(uint64_t)active, apparent, pairs};
+    buf[0] = 'T';
+    buf[1] = 'E';
+    buf[2] = TRIAC_ENERGY_VERSION;
+    buf[3] = 0;
+    for(uint i=0; i<4; i++){
+        buf[4+i] = (tpa_singleton.energy_rate>>(8*i))&0xFF;
+    }
+    for(uint v=0; v<3; v++){
+        for(uint i=0; i<8; i++){
+            buf[8+8*v+i] = (values[v]>>(8*i))&0xFF;
+        }
+    }
+    uint16_t sum = 0;
+    for(uint i=0; i<TRIAC_ENERGY_BLOB_SIZE-2; i++){
+        sum += buf[i];
+    }
+    buf[TRIAC_ENERGY_BLOB_SIZE-2] = sum&0xFF;
+    buf[TRIAC_ENERGY_BLOB_SIZE-1] = sum>>8;
+    return mp_obj_new_bytes(buf, TRIAC_ENERGY_BLOB_SIZE);
+}
+
+static mp_obj_t triac_power_analyzer_persist_energy(mp_obj_t arg) {
+    // Scheduled from the interrupt: saves the accumulators (littlefs spreads the writes over the flash)
+    mp_obj_t path = MP_STATE_PORT(triac_power_analyzer_energy_path);
+    if(path==MP_OBJ_NULL) return mp_const_none;
+    nlr_buf_t nlr;
+    if(nlr_push(&nlr)==0){
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(triac_power_analyzer_energy_blob(), &bufinfo, MP_BUFFER_READ);
+        mp_obj_t open_args[2] = {path, MP_OBJ_NEW_QSTR(MP_QSTR_wb)};
+        mp_obj_t file = mp_vfs_open(2, open_args, (mp_map_t *)&mp_const_empty_map);
+        mp_stream_write(file, bufinfo.buf, bufinfo.len, MP_STREAM_RW_WRITE);
+        mp_stream_close(file);
+        nlr_pop();
     } else {
-        // Done everything we could, so waiting for the prepared ADC sample...
-        while (!(adc_hw->cs & ADC_CS_READY_BITS))
-            tight_loop_contents();
-        uint16_t voltage_reading = adc_hw->result;
-        // As fast as possible, prepare the current sampling
-        hw_write_masked(&adc_hw->cs, tpa_singleton.current_pin << ADC_CS_AINSEL_LSB, ADC_CS_AINSEL_BITS);
-        hw_set_bits(&adc_hw->cs, ADC_CS_START_ONCE_BITS);
-        iobj->voltage_buffer[tpa_singleton.mbp] = voltage_reading&0x0FFF;
+        mp_printf(MICROPY_ERROR_PRINTER, "PowerAnalyzer: energy not saved\n");
+        mp_obj_print_exception(MICROPY_ERROR_PRINTER, MP_OBJ_FROM_PTR(nlr.ret_val));
+    }
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_persist_energy_obj, triac_power_analyzer_persist_energy);
+
+// Streaming ============================================================================================
+
+static void triac_power_analyzer_stream_set(int16_t *buffer, uint32_t size) {
+    // Waits for a block being copied by the other core, the interrupted one has none
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    while(tpa_singleton.stream_writing){
+        spin_unlock(triac_spin_lock, state);
+        tight_loop_contents();
+        state = spin_lock_blocking(triac_spin_lock);
+    }
+    tpa_singleton.stream_buffer = buffer;
+    tpa_singleton.stream_size = size;
+    tpa_singleton.stream_channels = tpa_singleton.channels;
+    tpa_singleton.stream_head = 0;
+    tpa_singleton.stream_tail = 0;
+    tpa_singleton.stream_dropped_blocks = 0;
+    tpa_singleton.stream_dropped_pairs = 0;
+    spin_unlock(triac_spin_lock, state);
+    MP_STATE_PORT(triac_power_analyzer_stream) = buffer;
+}
+
+static mp_uint_t triac_power_analyzer_stream_read(mp_obj_t self_in, void *buf_in, mp_uint_t size, int *errcode) {
+    // Consumer side: whole (voltage, currents...) frames only, never blocks
+    if(tpa_singleton.stream_buffer==NULL){
+        *errcode = MP_EPERM;
+        return MP_STREAM_ERROR;
+    }
+    size_t frame_size = tpa_singleton.stream_channels*sizeof(int16_t);
+    if(size<frame_size){
+        *errcode = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+    uint32_t tail = tpa_singleton.stream_tail;
+    uint32_t available = tpa_singleton.stream_head-tail;
+    __dmb();
+    if(available==0){
+        *errcode = MP_EAGAIN;
+        return MP_STREAM_ERROR;
+    }
+    uint32_t frames = size/frame_size;
+    if(frames>available) frames = available;
+    uint32_t mask = tpa_singleton.stream_size-1;
+    uint8_t *buf = buf_in;
+    for(uint32_t done=0; done<frames;){
+        // up to the end of the ring in one copy
+        uint32_t start = (tail+done)&mask;
+        uint32_t chunk = tpa_singleton.stream_size-start;
+        if(chunk>frames-done) chunk = frames-done;
+        memcpy(buf+done*frame_size, &tpa_singleton.stream_buffer[tpa_singleton.stream_channels*start], chunk*frame_size);
+        done += chunk;
+    }
+    __dmb();
+    tpa_singleton.stream_tail = tail+frames;
+    return frames*frame_size;
+}
+
+static mp_uint_t triac_power_analyzer_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    if(request==MP_STREAM_POLL){
+        mp_uint_t ret = 0;
+        if((arg&MP_STREAM_POLL_RD) && tpa_singleton.stream_buffer!=NULL && tpa_singleton.stream_head!=tpa_singleton.stream_tail){
+            ret |= MP_STREAM_POLL_RD;
+        }
+        return ret;
     }
-    uint32_t dt = time_us_64()-start;
-    if(dt>intcount) intcount = dt;
-    return true;
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
 }
 
+static const mp_stream_p_t triac_power_analyzer_stream_p = {
+    .read = triac_power_analyzer_stream_read,
+    .ioctl = triac_power_analyzer_stream_ioctl,
+    .is_text = false,
+};
+
 // General configs ======================================================================================
 
+static void mp_triac_power_analyzer_release_memory(void) {
+    // Capture must be stopped before this. The GC reclaims the block once unreferenced.
+    MP_STATE_PORT(triac_power_analyzer_memory) = NULL;
+    for(uint i=0; i<2; i++){
+        tpa_singleton.dma_buffer[i] = NULL;
+        tpa_singleton.db[i].histo_voltage = NULL;
+        tpa_singleton.db[i].histo_current = NULL;
+        tpa_singleton.db[i].histo_count = 0;
+    }
+    tpa_singleton.history = NULL;
+}
+
+static void mp_triac_power_analyzer_allocate_memory(uint16_t window_size, uint16_t histo_size, uint16_t history_size) {
+    // One block: history ring first (8-byte aligned fields), then histos, then DMA buffers
+    size_t history_bytes = sizeof(mp_triac_power_analyzer_summary_t)*history_size;
+    size_t histo_bytes = sizeof(int32_t)*histo_size;
+    size_t dma_bytes = sizeof(uint16_t)*tpa_singleton.channels*window_size;
+    uint8_t *memory = m_malloc0(history_bytes + 4*histo_bytes + 2*dma_bytes);
+    MP_STATE_PORT(triac_power_analyzer_memory) = memory;
+
+    tpa_singleton.history = (mp_triac_power_analyzer_summary_t *)memory;
+    for(uint i=0; i<history_size; i++){
+        tpa_singleton.history[i].window = POWER_ANALYZER_INVALID_WINDOW;
+    }
+    memory += history_bytes;
+    for(uint i=0; i<2; i++){
+        tpa_singleton.db[i].histo_voltage = (int32_t *)memory;
+        memory += histo_bytes;
+        tpa_singleton.db[i].histo_current = (int32_t *)memory;
+        memory += histo_bytes;
+        tpa_singleton.db[i].histo_count = 0;
+    }
+    for(uint i=0; i<2; i++){
+        tpa_singleton.dma_buffer[i] = (uint16_t *)memory;
+        memory += dma_bytes;
+    }
+    tpa_singleton.window_size = window_size;
+    tpa_singleton.histo_size = histo_size;
+    tpa_singleton.history_size = history_size;
+}
+
 static void mp_triac_power_analyzer_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_triac_power_analyzer_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    mp_printf(print, "PowerAnalyzer(volt=%d,amp=%d)", self->voltage_pin, self->current_pin);
+    mp_printf(print, "PowerAnalyzer(volt=%d,amp=%d", self->voltage_pin, self->current_pin);
+    for(uint i=1; i<self->current_count; i++){
+        mp_printf(print, ",%d", self->current_pins[i]);
+    }
+    mp_printf(print, ")");
 }
 
 static void mp_triac_power_analyzer_init_helper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_voltage_pin, ARG_current_pin, ARG_sample_rate, ARG_analized_samples, ARG_histo_size};
+    enum { ARG_voltage_pin, ARG_current_pin, ARG_sample_rate, ARG_analized_samples, ARG_histo_size, ARG_history};
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_voltage_pin,      MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
-        { MP_QSTR_current_pin,      MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 1} },
+        { MP_QSTR_current_pin,      MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
         { MP_QSTR_sample_rate,      MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 6000} },
+        { MP_QSTR_analized_samples, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = POWER_ANALYZER_BUFFER_SIZE} },
+        { MP_QSTR_histo_size,       MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = POWER_ANALYZER_HISTO_SIZE} },
+        { MP_QSTR_history,          MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = POWER_ANALYZER_HISTORY_SIZE} },
     };
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -189,39 +606,77 @@ static void mp_triac_power_analyzer_init_helper(size_t n_args, const mp_obj_t *p
     if(args[ARG_voltage_pin].u_int<0 || args[ARG_voltage_pin].u_int>=MAX_NUM_CHANNELS){
         mp_raise_ValueError(MP_ERROR_TEXT("Invalid Voltage ADC input!"));
     }
-    if(args[ARG_current_pin].u_int<0 || args[ARG_current_pin].u_int>=MAX_NUM_CHANNELS){
-        mp_raise_ValueError(MP_ERROR_TEXT("Invalid Current ADC input!"));
+    // current_pin: one ADC input, or a tuple/list of up to POWER_ANALYZER_MAX_CURRENTS inputs
+    size_t current_count = 1;
+    mp_obj_t *current_items = &args[ARG_current_pin].u_obj;
+    if(!mp_obj_is_int(args[ARG_current_pin].u_obj)){
+        mp_obj_get_array(args[ARG_current_pin].u_obj, &current_count, &current_items);
     }
-    if(args[ARG_voltage_pin].u_int==args[ARG_current_pin].u_int){
-        mp_raise_ValueError(MP_ERROR_TEXT("Voltage and Current channels must be different!"));
+    if(current_count<1 || current_count>POWER_ANALYZER_MAX_CURRENTS){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid number of Current ADC inputs!"));
     }
-    if(args[ARG_sample_rate].u_int<0 || args[ARG_sample_rate].u_int>=100000){
+    uint32_t used_inputs = 1U<<args[ARG_voltage_pin].u_int;
+    uint8_t current_pins[POWER_ANALYZER_MAX_CURRENTS];
+    for(size_t i=0; i<current_count; i++){
+        mp_int_t pin = mp_obj_get_int(current_items[i]);
+        if(pin<0 || pin>=MAX_NUM_CHANNELS){
+            mp_raise_ValueError(MP_ERROR_TEXT("Invalid Current ADC input!"));
+        }
+        if(used_inputs&(1U<<pin)){
+            mp_raise_ValueError(MP_ERROR_TEXT("Voltage and Current channels must be different!"));
+        }
+        used_inputs |= 1U<<pin;
+        current_pins[i] = pin;
+    }
+    uint8_t channels = 1+current_count;
+    if(args[ARG_sample_rate].u_int<ADC_MIN_FRAME_RATE(channels) || args[ARG_sample_rate].u_int>ADC_MAX_FRAME_RATE(channels)){
         mp_raise_ValueError(MP_ERROR_TEXT("Invalid sample rate!"));
     }
-    tpa_singleton.mbp = 0xFFFF;
-
-    tpa_singleton.db[0].histo_count = 0;
-    tpa_singleton.db[1].histo_count = 0;
+    mp_int_t window_size = args[ARG_analized_samples].u_int;
+    if(window_size<POWER_ANALYZER_MIN_BUFFER_SIZE || window_size>POWER_ANALYZER_MAX_BUFFER_SIZE){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid number of analized samples!"));
+    }
+    mp_int_t histo_size = args[ARG_histo_size].u_int;
+    if(histo_size<1 || histo_size>=window_size){
+        mp_raise_ValueError(MP_ERROR_TEXT("Histo size must be smaller than analized samples!"));
+    }
+    mp_int_t history_size = args[ARG_history].u_int;
+    if(history_size<1 || history_size>POWER_ANALYZER_MAX_HISTORY_SIZE){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid history size!"));
+    }
+    triac_supervisor_check_window((uint64_t)window_size*1000000/args[ARG_sample_rate].u_int);
+    if(tpa_singleton.running){
+        tpa_singleton.running = 0;
+        mp_triac_power_analyzer_stop_capture();
+    }
 
+    if(tpa_singleton.stream_size!=0 && (tpa_singleton.stream_size<window_size || tpa_singleton.stream_channels!=channels)){
+        triac_power_analyzer_stream_set(NULL, 0);
+    }
     tpa_singleton.voltage_pin = args[ARG_voltage_pin].u_int;
-    tpa_singleton.current_pin = args[ARG_current_pin].u_int;
+    tpa_singleton.current_pin = current_pins[0];
+    tpa_singleton.current_count = current_count;
+    tpa_singleton.channels = channels;
+    for(uint i=0; i<POWER_ANALYZER_MAX_CURRENTS; i++){
+        tpa_singleton.current_pins[i] = (i<current_count) ? current_pins[i] : INVALIDPIN;
+    }
+    mp_triac_power_analyzer_release_memory();
+    mp_triac_power_analyzer_allocate_memory(window_size, histo_size, history_size);
 
     adc_gpio_init(26+tpa_singleton.voltage_pin);
-    adc_gpio_init(26+tpa_singleton.current_pin);
+    for(uint i=0; i<current_count; i++){
+        adc_gpio_init(26+current_pins[i]);
+    }
     adc_init();
-    adc_set_clkdiv(0);
 
-    if(tpa_singleton.sample_rate!=0){
-        tpa_singleton.sample_rate = 0;
-        cancel_repeating_timer(&tpa_singleton.timer);
-    }
-    if(add_repeating_timer_us(-(int)(1000000U / args[ARG_sample_rate].u_int), mp_triac_power_analyzer_timer_tick, NULL, &tpa_singleton.timer)){
-        tpa_singleton.sample_rate = args[ARG_sample_rate].u_int;
-    } else {
-        mp_raise_ValueError(MP_ERROR_TEXT("Error starting timer!"));
-    }
+    triac_power_analyzer_energy_rate(args[ARG_sample_rate].u_int);
+    mp_triac_power_analyzer_start_capture(args[ARG_sample_rate].u_int);
+    tpa_singleton.sample_rate = args[ARG_sample_rate].u_int;
     tpa_singleton.voltage_multiplier = 1.0f;
     tpa_singleton.current_multiplier = 1.0f;
+    for(uint i=0; i<POWER_ANALYZER_MAX_CURRENTS; i++){
+        tpa_singleton.current_multipliers[i] = 1.0f;
+    }
     tpa_singleton.power_multiplier = tpa_singleton.voltage_multiplier*tpa_singleton.current_multiplier;
     tpa_singleton.running = 1;
 }
@@ -233,16 +688,22 @@ static mp_obj_t mp_triac_power_analyzer_init(size_t n_args, const mp_obj_t *args
 MP_DEFINE_CONST_FUN_OBJ_KW(triac_power_analyzer_init_obj, 1, mp_triac_power_analyzer_init);
 
 static mp_obj_t mp_triac_power_analyzer_close(mp_obj_t self_in) {
-    tpa_singleton.running = 0;
-
-    if(tpa_singleton.sample_rate!=0){
-        cancel_repeating_timer(&tpa_singleton.timer);
-        tpa_singleton.sample_rate = 0;
+    if(tpa_singleton.running){
+        tpa_singleton.running = 0;
+        mp_triac_power_analyzer_stop_capture();
     }
+    tpa_singleton.sample_rate = 0;
+    tpa_singleton.persist_period_ms = 0;
+    MP_STATE_PORT(triac_power_analyzer_energy_path) = MP_OBJ_NULL;
+    triac_power_analyzer_stream_set(NULL, 0);
+    mp_triac_power_analyzer_release_memory();
 
     adc_init();
     tpa_singleton.voltage_pin = INVALIDPIN;
     tpa_singleton.current_pin = INVALIDPIN;
+    for(uint i=0; i<POWER_ANALYZER_MAX_CURRENTS; i++){
+        tpa_singleton.current_pins[i] = INVALIDPIN;
+    }
 
     return mp_const_none;
 }
@@ -255,6 +716,7 @@ MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_close_obj, mp_triac_power_analyze
 
 static mp_obj_t mp_triac_power_analyzer_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     // create new Graphicscontroller object
+    // There is a single ADC, so a single analyzer: more current inputs go in current_pin
     if(n_args!=0){
         mp_map_t kw_args;
         mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
@@ -274,21 +736,35 @@ static mp_obj_t triac_power_analyzer_current_pin(mp_obj_t self_obj) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_current_pin_obj,  triac_power_analyzer_current_pin);
 
+static mp_obj_t triac_power_analyzer_current_pins(mp_obj_t self_obj) {
+    mp_obj_t pins[POWER_ANALYZER_MAX_CURRENTS];
+    for(uint i=0; i<tpa_singleton.current_count; i++){
+        pins[i] = MP_OBJ_NEW_SMALL_INT(tpa_singleton.current_pins[i]);
+    }
+    return mp_obj_new_tuple(tpa_singleton.current_count, pins);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_current_pins_obj,  triac_power_analyzer_current_pins);
+
 static mp_obj_t triac_power_analyzer_sample_rate(mp_obj_t self_obj) {
     return mp_obj_new_int(tpa_singleton.sample_rate);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_sample_rate_obj,  triac_power_analyzer_sample_rate);
 
 static mp_obj_t triac_power_analyzer_analized_samples(mp_obj_t self_obj) {
-    return mp_obj_new_int(POWER_ANALYZER_BUFFER_SIZE);
+    return mp_obj_new_int(tpa_singleton.window_size);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_analized_samples_obj,  triac_power_analyzer_analized_samples);
 
 static mp_obj_t triac_power_analyzer_histo_size(mp_obj_t self_obj) {
-    return mp_obj_new_int(POWER_ANALYZER_HISTO_SIZE);
+    return mp_obj_new_int(tpa_singleton.histo_size);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_histo_size_obj,  triac_power_analyzer_histo_size);
 
+static mp_obj_t triac_power_analyzer_history_size(mp_obj_t self_obj) {
+    return mp_obj_new_int(tpa_singleton.history_size);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_history_size_obj,  triac_power_analyzer_history_size);
+
 static mp_obj_t triac_power_analyzer_running(mp_obj_t self_obj) {
     // mp_printf(&mp_sys_stdout_print, "running\n");
     return tpa_singleton.running ? mp_const_true : mp_const_false;
@@ -307,47 +783,68 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_power_analyzer_voltage_mult_obj, 1, 2,
 static mp_obj_t triac_power_analyzer_current_mult(size_t n_args, const mp_obj_t *args) {
     if(n_args==2){
         tpa_singleton.current_multiplier = mp_obj_get_float(args[1]);
+        tpa_singleton.current_multipliers[0] = tpa_singleton.current_multiplier;
         tpa_singleton.power_multiplier = tpa_singleton.voltage_multiplier*tpa_singleton.current_multiplier;
     }
     return mp_obj_new_float(tpa_singleton.current_multiplier);
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_power_analyzer_current_mult_obj, 1, 2, triac_power_analyzer_current_mult);
 
+static mp_obj_t triac_power_analyzer_channel_mult(size_t n_args, const mp_obj_t *args) {
+    // channel_mult(index[, value]): multiplier of each current input, channel_mult(0) is current_mult()
+    mp_int_t index = mp_obj_get_int(args[1]);
+    if(index<0 || index>=tpa_singleton.current_count){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid current channel!"));
+    }
+    if(n_args==3){
+        tpa_singleton.current_multipliers[index] = mp_obj_get_float(args[2]);
+        if(index==0){
+            tpa_singleton.current_multiplier = tpa_singleton.current_multipliers[0];
+            tpa_singleton.power_multiplier = tpa_singleton.voltage_multiplier*tpa_singleton.current_multiplier;
+        }
+    }
+    return mp_obj_new_float(tpa_singleton.current_multipliers[index]);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_power_analyzer_channel_mult_obj, 2, 3, triac_power_analyzer_channel_mult);
+
 static mp_obj_t triac_power_analyzer_get_offsets(mp_obj_t self_obj) {
-    uint8_t initial_phase, final_phase;
+    uint32_t initial_window, final_window;
     uint16_t offset_voltage, offset_current;
     do{
-        initial_phase = tpa_singleton.interrupt_count;
+        initial_window = tpa_singleton.window_count;
         offset_voltage = tpa_singleton.offset_voltage;
         offset_current = tpa_singleton.offset_current;
-        final_phase = tpa_singleton.interrupt_count;
-    }while(initial_phase!=final_phase);
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
 
     mp_obj_t result_dict[3 * 2];
     result_dict[0] = MP_ROM_QSTR(MP_QSTR_v);
     result_dict[1] = mp_obj_new_int(offset_voltage);
     result_dict[2] = MP_ROM_QSTR(MP_QSTR_c);
     result_dict[3] = mp_obj_new_int(offset_current);
+    // worst interruption duration, in us, see Triac.telemetry()
+    triac_telemetry_source_t telemetry;
+    triac_telemetry_read(TRIAC_TLM_ANALYZER, &telemetry, 0);
     result_dict[4] = MP_ROM_QSTR(MP_QSTR_i);
-    result_dict[5] = mp_obj_new_int(intcount);
+    result_dict[5] = mp_obj_new_int(telemetry.duration_max/1000);
     return mp_obj_dict_make_new(&mp_type_dict, 0, 3, result_dict);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_get_offsets_obj,  triac_power_analyzer_get_offsets);
 
 static mp_obj_t triac_power_analyzer_get_peaks(mp_obj_t self_obj) {
-    uint8_t initial_phase, final_phase;
+    uint32_t initial_window, final_window;
     uint16_t pos_peak_voltage, pos_peak_current, neg_peak_voltage, neg_peak_current;
     int32_t pos_peak_power, neg_peak_power;
     do{
-        initial_phase = tpa_singleton.u_phase;
+        initial_window = tpa_singleton.window_count;
         pos_peak_voltage = tpa_singleton.pos_peak_voltage;
         pos_peak_current = tpa_singleton.pos_peak_current;
         pos_peak_power = tpa_singleton.pos_peak_power;
         neg_peak_voltage = tpa_singleton.neg_peak_voltage;
         neg_peak_current = tpa_singleton.neg_peak_current;
         neg_peak_power = tpa_singleton.neg_peak_power;
-        final_phase = tpa_singleton.u_phase;
-    }while(initial_phase!=final_phase);
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
 
     mp_obj_t result_dict[6 * 2];
     result_dict[0] = MP_ROM_QSTR(MP_QSTR_p_v);
@@ -367,17 +864,17 @@ static mp_obj_t triac_power_analyzer_get_peaks(mp_obj_t self_obj) {
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_get_peaks_obj,  triac_power_analyzer_get_peaks);
 
 static mp_obj_t triac_power_analyzer_get_rms(mp_obj_t self_obj) {
-    uint8_t initial_phase, final_phase;
-    int32_t sum_power;
-    uint32_t squaresum_voltage, squaresum_current;
+    uint32_t initial_window, final_window;
+    int64_t sum_power;
+    uint64_t squaresum_voltage, squaresum_current;
     do{
-        initial_phase = tpa_singleton.u_phase;
+        initial_window = tpa_singleton.window_count;
         squaresum_voltage = tpa_singleton.squaresum_voltage;
         squaresum_current = tpa_singleton.squaresum_current;
         sum_power = tpa_singleton.sum_power;
-        final_phase = tpa_singleton.u_phase;
-    }while(initial_phase!=final_phase);
-    float samplenr = (float)POWER_ANALYZER_BUFFER_SIZE;
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    float samplenr = (float)tpa_singleton.window_size;
     mp_obj_t result_dict[3 * 2];
     result_dict[0] = MP_ROM_QSTR(MP_QSTR_v);
     result_dict[1] = mp_obj_new_float( sqrt(squaresum_voltage/samplenr)*tpa_singleton.voltage_multiplier );
@@ -390,14 +887,59 @@ static mp_obj_t triac_power_analyzer_get_rms(mp_obj_t self_obj) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_get_rms_obj,  triac_power_analyzer_get_rms);
 
+static mp_obj_t triac_power_analyzer_get_channels(mp_obj_t self_obj) {
+    // One dict per current input: pin, offset, rms current, real power against the shared voltage, peaks
+    uint32_t initial_window, final_window;
+    uint8_t count = tpa_singleton.current_count;
+    uint16_t offset[POWER_ANALYZER_MAX_CURRENTS];
+    int16_t pos_peak[POWER_ANALYZER_MAX_CURRENTS], neg_peak[POWER_ANALYZER_MAX_CURRENTS];
+    uint64_t squaresum[POWER_ANALYZER_MAX_CURRENTS];
+    int64_t sum_power[POWER_ANALYZER_MAX_CURRENTS];
+    do{
+        initial_window = tpa_singleton.window_count;
+        for(uint i=0; i<count; i++){
+            offset[i] = tpa_singleton.offset_currents[i];
+            pos_peak[i] = tpa_singleton.pos_peak_currents[i];
+            neg_peak[i] = tpa_singleton.neg_peak_currents[i];
+            squaresum[i] = tpa_singleton.squaresum_currents[i];
+            sum_power[i] = tpa_singleton.sum_power_currents[i];
+        }
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+
+    float samplenr = (float)tpa_singleton.window_size;
+    mp_obj_t list = mp_obj_new_list(count, NULL);
+    for(uint i=0; i<count; i++){
+        float multiplier = tpa_singleton.current_multipliers[i];
+        mp_obj_t result_dict[6 * 2];
+        result_dict[0] = MP_ROM_QSTR(MP_QSTR_pin);
+        result_dict[1] = MP_OBJ_NEW_SMALL_INT(tpa_singleton.current_pins[i]);
+        result_dict[2] = MP_ROM_QSTR(MP_QSTR_o);
+        result_dict[3] = MP_OBJ_NEW_SMALL_INT(offset[i]);
+        result_dict[4] = MP_ROM_QSTR(MP_QSTR_c);
+        result_dict[5] = mp_obj_new_float( sqrt(squaresum[i]/samplenr)*multiplier );
+        result_dict[6] = MP_ROM_QSTR(MP_QSTR_p);
+        result_dict[7] = mp_obj_new_float( (sum_power[i]/samplenr)*tpa_singleton.voltage_multiplier*multiplier );
+        result_dict[8] = MP_ROM_QSTR(MP_QSTR_p_c);
+        result_dict[9] = mp_obj_new_float(pos_peak[i]*multiplier);
+        result_dict[10] = MP_ROM_QSTR(MP_QSTR_n_c);
+        result_dict[11] = mp_obj_new_float(neg_peak[i]*multiplier);
+        mp_obj_list_store(list, MP_OBJ_NEW_SMALL_INT(i), mp_obj_dict_make_new(&mp_type_dict, 0, 6, result_dict));
+    }
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_get_channels_obj,  triac_power_analyzer_get_channels);
+
 static mp_obj_t triac_power_analyzer_voltage_histo(mp_obj_t self_obj) {
     uint8_t initial_phase, final_phase;
     int32_t *voltage_histo;
-    uint8_t histo_count;
-    voltage_histo = m_malloc(4*POWER_ANALYZER_HISTO_SIZE);
+    uint16_t histo_count;
+    uint16_t histo_size = tpa_singleton.histo_size;
+    if(histo_size==0) return mp_const_none;
+    voltage_histo = m_malloc(sizeof(int32_t)*histo_size);
     do{
         initial_phase = tpa_singleton.u_phase;
-        for(uint i=0; i<POWER_ANALYZER_HISTO_SIZE; i++){
+        for(uint i=0; i<histo_size; i++){
             voltage_histo[i] = tpa_singleton.db[tpa_singleton.u_phase].histo_voltage[i];
         }
         histo_count = tpa_singleton.db[tpa_singleton.u_phase].histo_count;
@@ -407,9 +949,9 @@ static mp_obj_t triac_power_analyzer_voltage_histo(mp_obj_t self_obj) {
     if(histo_count==0) return mp_const_none;
 
     mp_obj_list_t *objlist = m_new_obj(mp_obj_list_t);
-    mp_obj_list_init(objlist, POWER_ANALYZER_HISTO_SIZE);
+    mp_obj_list_init(objlist, histo_size);
     mp_obj_t list = MP_OBJ_FROM_PTR(objlist);
-    for(uint i=0; i<POWER_ANALYZER_HISTO_SIZE; i++){
+    for(uint i=0; i<histo_size; i++){
         objlist->items[i] = mp_obj_new_float(voltage_histo[i]*tpa_singleton.voltage_multiplier/histo_count);
     }
     m_free(voltage_histo);
@@ -420,11 +962,13 @@ MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_voltage_histo_obj,  triac_power_a
 static mp_obj_t triac_power_analyzer_current_histo(mp_obj_t self_obj) {
     uint8_t initial_phase, final_phase;
     int32_t *current_histo;
-    uint8_t histo_count;
-    current_histo = m_malloc(sizeof(int32_t)*POWER_ANALYZER_HISTO_SIZE);
+    uint16_t histo_count;
+    uint16_t histo_size = tpa_singleton.histo_size;
+    if(histo_size==0) return mp_const_none;
+    current_histo = m_malloc(sizeof(int32_t)*histo_size);
     do{
         initial_phase = tpa_singleton.u_phase;
-        for(uint i=0; i<POWER_ANALYZER_HISTO_SIZE; i++){
+        for(uint i=0; i<histo_size; i++){
             current_histo[i] = tpa_singleton.db[tpa_singleton.u_phase].histo_current[i];
         }
         histo_count = tpa_singleton.db[tpa_singleton.u_phase].histo_count;
@@ -434,9 +978,9 @@ static mp_obj_t triac_power_analyzer_current_histo(mp_obj_t self_obj) {
     if(histo_count==0) return mp_const_none;
 
     mp_obj_list_t *objlist = m_new_obj(mp_obj_list_t);
-    mp_obj_list_init(objlist, POWER_ANALYZER_HISTO_SIZE);
+    mp_obj_list_init(objlist, histo_size);
     mp_obj_t list = MP_OBJ_FROM_PTR(objlist);
-    for(uint i=0; i<POWER_ANALYZER_HISTO_SIZE; i++){
+    for(uint i=0; i<histo_size; i++){
         objlist->items[i] = mp_obj_new_float(current_histo[i]*tpa_singleton.current_multiplier/histo_count);
     }
     m_free(current_histo);
@@ -445,6 +989,390 @@ static mp_obj_t triac_power_analyzer_current_histo(mp_obj_t self_obj) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_current_histo_obj,  triac_power_analyzer_current_histo);
 
+static mp_obj_t triac_power_analyzer_history(size_t n_args, const mp_obj_t *args) {
+    // List of (window, timestamp_ms, rms_v, rms_c, power) for the last windows, oldest first
+    if(tpa_singleton.history==NULL) return mp_const_none;
+    uint32_t count = tpa_singleton.history_size;
+    if(n_args==2){
+        mp_int_t n = mp_obj_get_int(args[1]);
+        if(n<0) mp_raise_ValueError(MP_ERROR_TEXT("Invalid number of windows!"));
+        if((mp_uint_t)n<count) count = n;
+    }
+    uint32_t latest = tpa_singleton.window_count;
+    if(count>latest) count = latest;
+    float samplenr = (float)tpa_singleton.window_size;
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for(uint32_t window=latest-count; window!=latest; window++){
+        mp_triac_power_analyzer_summary_t *entry = &tpa_singleton.history[window%tpa_singleton.history_size];
+        volatile uint32_t *entry_window = &entry->window;
+        if(*entry_window!=window) continue;
+        mp_triac_power_analyzer_summary_t summary = *entry;
+        // overwritten by the interrupt while copying: that window is gone
+        if(*entry_window!=window) continue;
+
+        mp_obj_t tuple[5];
+        tuple[0] = mp_obj_new_int_from_uint(summary.window);
+        tuple[1] = mp_obj_new_int_from_uint(summary.timestamp_ms);
+        tuple[2] = mp_obj_new_float( sqrt(summary.squaresum_voltage/samplenr)*tpa_singleton.voltage_multiplier );
+        tuple[3] = mp_obj_new_float( sqrt(summary.squaresum_current/samplenr)*tpa_singleton.current_multiplier );
+        tuple[4] = mp_obj_new_float( (summary.sum_power/samplenr)*tpa_singleton.power_multiplier );
+        mp_obj_list_append(list, mp_obj_new_tuple(5, tuple));
+    }
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_power_analyzer_history_obj, 1, 2, triac_power_analyzer_history);
+
+static mp_obj_t triac_power_analyzer_window_count_get(mp_obj_t self_obj) {
+    return mp_obj_new_int_from_uint(tpa_singleton.window_count);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_window_count_obj,  triac_power_analyzer_window_count_get);
+
+static mp_obj_t triac_power_analyzer_harmonics(size_t n_args, const mp_obj_t *args) {
+    // Number of harmonics analyzed on each window (0 disables the analysis)
+    if(n_args==2){
+        mp_int_t count = mp_obj_get_int(args[1]);
+        if(count<0 || count>TRIAC_DSP_MAX_HARMONICS){
+            mp_raise_ValueError(MP_ERROR_TEXT("Invalid number of harmonics!"));
+        }
+        tpa_singleton.harmonic_count = count;
+    }
+    return mp_obj_new_int(tpa_singleton.harmonic_count);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_power_analyzer_harmonics_obj, 1, 2, triac_power_analyzer_harmonics);
+
+static mp_obj_t triac_power_analyzer_get_harmonics(mp_obj_t self_obj) {
+    // RMS magnitude and phase (relative to the voltage fundamental) of each harmonic, THD and
+    // the power factor split into displacement (fundamentals) and distortion (current THD)
+    uint32_t initial_window, final_window;
+    triac_goertzel_t bank[TRIAC_DSP_MAX_HARMONICS];
+    uint8_t count;
+    uint32_t pairs;
+    float period;
+    do{
+        initial_window = tpa_singleton.window_count;
+        const mp_triac_power_analyzer_doublebuffer_obj_t *uobj = &tpa_singleton.db[tpa_singleton.u_phase];
+        count = uobj->harmonic_count;
+        pairs = uobj->harmonic_pairs;
+        period = uobj->period;
+        memcpy(bank, uobj->harmonics, sizeof(triac_goertzel_t)*count);
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    if(count==0) return mp_const_none;
+
+    float result[TRIAC_DSP_MAX_HARMONICS][4];
+    // analyzed as (voltage, first current)
+    const uint8_t vslot = 0, cslot = 1;
+    triac_harmonic_results(bank, count, pairs, vslot, result);
+
+    mp_obj_t voltage = mp_obj_new_list(count, NULL);
+    mp_obj_t current = mp_obj_new_list(count, NULL);
+    float distortion_v = 0.0f, distortion_c = 0.0f;
+    for(uint h=0; h<count; h++){
+        float rms_v = result[h][2*vslot]*RMS_PER_PEAK;
+        float rms_c = result[h][2*cslot]*RMS_PER_PEAK;
+        if(h>0){
+            distortion_v += rms_v*rms_v;
+            distortion_c += rms_c*rms_c;
+        }
+        mp_obj_t tuple[2];
+        tuple[0] = mp_obj_new_float(rms_v*tpa_singleton.voltage_multiplier);
+        tuple[1] = mp_obj_new_float(result[h][2*vslot+1]);
+        mp_obj_list_store(voltage, MP_OBJ_NEW_SMALL_INT(h), mp_obj_new_tuple(2, tuple));
+        tuple[0] = mp_obj_new_float(rms_c*tpa_singleton.current_multiplier);
+        tuple[1] = mp_obj_new_float(result[h][2*cslot+1]);
+        mp_obj_list_store(current, MP_OBJ_NEW_SMALL_INT(h), mp_obj_new_tuple(2, tuple));
+    }
+    float fundamental_v = result[0][2*vslot]*RMS_PER_PEAK;
+    float fundamental_c = result[0][2*cslot]*RMS_PER_PEAK;
+    float thd_v = (fundamental_v>0.0f) ? sqrtf(distortion_v)/fundamental_v : 0.0f;
+    float thd_c = (fundamental_c>0.0f) ? sqrtf(distortion_c)/fundamental_c : 0.0f;
+
+    mp_obj_t result_dict[7 * 2];
+    result_dict[0] = MP_ROM_QSTR(MP_QSTR_f);
+    result_dict[1] = mp_obj_new_float(tpa_singleton.sample_rate/period);
+    result_dict[2] = MP_ROM_QSTR(MP_QSTR_v);
+    result_dict[3] = voltage;
+    result_dict[4] = MP_ROM_QSTR(MP_QSTR_c);
+    result_dict[5] = current;
+    result_dict[6] = MP_ROM_QSTR(MP_QSTR_thd_v);
+    result_dict[7] = mp_obj_new_float(thd_v);
+    result_dict[8] = MP_ROM_QSTR(MP_QSTR_thd_c);
+    result_dict[9] = mp_obj_new_float(thd_c);
+    result_dict[10] = MP_ROM_QSTR(MP_QSTR_pf_disp);
+    result_dict[11] = mp_obj_new_float(cosf(result[0][2*cslot+1]));
+    result_dict[12] = MP_ROM_QSTR(MP_QSTR_pf_dist);
+    result_dict[13] = mp_obj_new_float(1.0f/sqrtf(1.0f+thd_c*thd_c));
+    return mp_obj_dict_make_new(&mp_type_dict, 0, 7, result_dict);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_get_harmonics_obj,  triac_power_analyzer_get_harmonics);
+
+static mp_obj_t triac_power_analyzer_energy(mp_obj_t self_obj) {
+    // Active (Wh) and apparent (VAh) energy and measured time (s), with the current multipliers
+    int64_t active;
+    uint64_t apparent, pairs;
+    triac_power_analyzer_energy_read(&active, &apparent, &pairs);
+    float rate = tpa_singleton.energy_rate ? (float)tpa_singleton.energy_rate : 1.0f;
+    float seconds = pairs/rate;
+    mp_obj_t result_dict[3 * 2];
+    result_dict[0] = MP_ROM_QSTR(MP_QSTR_wh);
+    result_dict[1] = mp_obj_new_float( (float)active/(rate*3600.0f)*tpa_singleton.power_multiplier );
+    result_dict[2] = MP_ROM_QSTR(MP_QSTR_vah);
+    result_dict[3] = mp_obj_new_float( (float)apparent/(rate*3600.0f)*tpa_singleton.power_multiplier );
+    result_dict[4] = MP_ROM_QSTR(MP_QSTR_s);
+    result_dict[5] = mp_obj_new_float(seconds);
+    return mp_obj_dict_make_new(&mp_type_dict, 0, 3, result_dict);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_energy_obj,  triac_power_analyzer_energy);
+
+static mp_obj_t triac_power_analyzer_energy_reset(mp_obj_t self_obj) {
+    triac_power_analyzer_energy_set(0, 0, 0, 0);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_energy_reset_obj,  triac_power_analyzer_energy_reset);
+
+static mp_obj_t triac_power_analyzer_energy_snapshot(mp_obj_t self_obj) {
+    return triac_power_analyzer_energy_blob();
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_energy_snapshot_obj,  triac_power_analyzer_energy_snapshot);
+
+static mp_obj_t triac_power_analyzer_energy_restore(mp_obj_t self_obj, mp_obj_t blob) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(blob, &bufinfo, MP_BUFFER_READ);
+    const uint8_t *buf = bufinfo.buf;
+    if(bufinfo.len!=TRIAC_ENERGY_BLOB_SIZE || buf[0]!='T' || buf[1]!='E' || buf[2]!=TRIAC_ENERGY_VERSION){
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid energy data"));
+    }
+    uint16_t sum = 0;
+    for(uint i=0; i<TRIAC_ENERGY_BLOB_SIZE-2; i++){
+        sum += buf[i];
+    }
+    if(sum!=(buf[TRIAC_ENERGY_BLOB_SIZE-2] | (buf[TRIAC_ENERGY_BLOB_SIZE-1]<<8))){
+        mp_raise_ValueError(MP_ERROR_TEXT("energy checksum mismatch"));
+    }
+    uint32_t rate = 0;
+    for(uint i=0; i<4; i++){
+        rate |= (uint32_t)buf[4+i]<<(8*i);
+    }
+    uint64_t values[3] = {0, 0, 0};
+    for(uint v=0; v<3; v++){
+        for(uint i=0; i<8; i++){
+            values[v] |= (uint64_t)buf[8+8*v+i]<<(8*i);
+        }
+    }
+    triac_power_analyzer_energy_set((int64_t)values[0], values[1], values[2], rate);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_energy_restore_obj,  triac_power_analyzer_energy_restore);
+
+static mp_obj_t triac_power_analyzer_energy_persist(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // Saves energy_snapshot() to a file every period seconds (path=None stops it)
+    enum { ARG_path, ARG_period };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_path,   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_period, MP_ARG_INT, {.u_int = 60} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args-1, pos_args+1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    tpa_singleton.persist_period_ms = 0;
+    if(args[ARG_path].u_obj==mp_const_none){
+        MP_STATE_PORT(triac_power_analyzer_energy_path) = MP_OBJ_NULL;
+        return mp_const_none;
+    }
+    if(!mp_obj_is_str(args[ARG_path].u_obj)){
+        mp_raise_TypeError(MP_ERROR_TEXT("path must be a string"));
+    }
+    if(args[ARG_period].u_int<1 || args[ARG_period].u_int>86400){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid persistence period!"));
+    }
+    MP_STATE_PORT(triac_power_analyzer_energy_path) = args[ARG_path].u_obj;
+    tpa_singleton.persist_last_ms = mp_hal_ticks_ms();
+    tpa_singleton.persist_period_ms = args[ARG_period].u_int*1000;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(triac_power_analyzer_energy_persist_obj, 1, triac_power_analyzer_energy_persist);
+
+static mp_obj_t triac_power_analyzer_stream(size_t n_args, const mp_obj_t *args) {
+    // stream(frames): allocates a ring of frames (power of 2) and starts streaming, stream(0) stops.
+    // Returns the ring size.
+    if(n_args==2){
+        mp_int_t size = mp_obj_get_int(args[1]);
+        if(size!=0 && (size<0 || size>POWER_ANALYZER_MAX_STREAM_SIZE || (size&(size-1))!=0)){
+            mp_raise_ValueError(MP_ERROR_TEXT("Stream size must be a power of 2!"));
+        }
+        if(size!=0 && size<tpa_singleton.window_size){
+            mp_raise_ValueError(MP_ERROR_TEXT("Stream must hold at least one window!"));
+        }
+        triac_power_analyzer_stream_set(NULL, 0);
+        if(size!=0){
+            triac_power_analyzer_stream_set(m_new(int16_t, tpa_singleton.channels*size), size);
+        }
+    }
+    return mp_obj_new_int(tpa_singleton.stream_size);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_power_analyzer_stream_obj, 1, 2, triac_power_analyzer_stream);
+
+static mp_obj_t triac_power_analyzer_stream_stats(mp_obj_t self_obj) {
+    // (frames available, frames streamed, dropped blocks, dropped frames)
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    uint32_t head = tpa_singleton.stream_head;
+    uint32_t tail = tpa_singleton.stream_tail;
+    uint32_t dropped_blocks = tpa_singleton.stream_dropped_blocks;
+    uint32_t dropped_pairs = tpa_singleton.stream_dropped_pairs;
+    spin_unlock(triac_spin_lock, state);
+    mp_obj_t tuple[4];
+    tuple[0] = mp_obj_new_int_from_uint(head-tail);
+    tuple[1] = mp_obj_new_int_from_uint(head);
+    tuple[2] = mp_obj_new_int_from_uint(dropped_blocks);
+    tuple[3] = mp_obj_new_int_from_uint(dropped_pairs);
+    return mp_obj_new_tuple(4, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_power_analyzer_stream_stats_obj,  triac_power_analyzer_stream_stats);
+
+
+// Readout into preallocated buffers, so polling loops do not allocate ===============
+
+static float *triac_power_analyzer_float_buffer(mp_obj_t buf_obj, size_t min_len) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_obj, &bufinfo, MP_BUFFER_WRITE);
+    if(bufinfo.typecode!='f'){
+        mp_raise_ValueError(MP_ERROR_TEXT("Buffer must be array('f')!"));
+    }
+    if(bufinfo.len/sizeof(float)<min_len){
+        mp_raise_ValueError(MP_ERROR_TEXT("Buffer too small!"));
+    }
+    return bufinfo.buf;
+}
+
+static mp_obj_t triac_power_analyzer_rms_into(mp_obj_t self_obj, mp_obj_t buf_obj) {
+    // [v, c, p], same values as get_rms()
+    float *out = triac_power_analyzer_float_buffer(buf_obj, 3);
+    uint32_t initial_window, final_window;
+    int64_t sum_power;
+    uint64_t squaresum_voltage, squaresum_current;
+    do{
+        initial_window = tpa_singleton.window_count;
+        squaresum_voltage = tpa_singleton.squaresum_voltage;
+        squaresum_current = tpa_singleton.squaresum_current;
+        sum_power = tpa_singleton.sum_power;
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    float samplenr = (float)tpa_singleton.window_size;
+    out[0] = sqrt(squaresum_voltage/samplenr)*tpa_singleton.voltage_multiplier;
+    out[1] = sqrt(squaresum_current/samplenr)*tpa_singleton.current_multiplier;
+    out[2] = (sum_power/samplenr)*tpa_singleton.power_multiplier;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_rms_into_obj,  triac_power_analyzer_rms_into);
+
+static mp_obj_t triac_power_analyzer_peaks_into(mp_obj_t self_obj, mp_obj_t buf_obj) {
+    // [p_v, p_c, p_p, n_v, n_c, n_p], same values as get_peaks()
+    float *out = triac_power_analyzer_float_buffer(buf_obj, 6);
+    uint32_t initial_window, final_window;
+    int16_t pos_peak_voltage, pos_peak_current, neg_peak_voltage, neg_peak_current;
+    int32_t pos_peak_power, neg_peak_power;
+    do{
+        initial_window = tpa_singleton.window_count;
+        pos_peak_voltage = tpa_singleton.pos_peak_voltage;
+        pos_peak_current = tpa_singleton.pos_peak_current;
+        pos_peak_power = tpa_singleton.pos_peak_power;
+        neg_peak_voltage = tpa_singleton.neg_peak_voltage;
+        neg_peak_current = tpa_singleton.neg_peak_current;
+        neg_peak_power = tpa_singleton.neg_peak_power;
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    out[0] = pos_peak_voltage*tpa_singleton.voltage_multiplier;
+    out[1] = pos_peak_current*tpa_singleton.current_multiplier;
+    out[2] = pos_peak_power*tpa_singleton.power_multiplier;
+    out[3] = neg_peak_voltage*tpa_singleton.voltage_multiplier;
+    out[4] = neg_peak_current*tpa_singleton.current_multiplier;
+    out[5] = neg_peak_power*tpa_singleton.power_multiplier;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_peaks_into_obj,  triac_power_analyzer_peaks_into);
+
+static mp_obj_t triac_power_analyzer_offsets_into(mp_obj_t self_obj, mp_obj_t buf_obj) {
+    // [v, c] in raw ADC units
+    float *out = triac_power_analyzer_float_buffer(buf_obj, 2);
+    uint32_t initial_window, final_window;
+    uint16_t offset_voltage, offset_current;
+    do{
+        initial_window = tpa_singleton.window_count;
+        offset_voltage = tpa_singleton.offset_voltage;
+        offset_current = tpa_singleton.offset_current;
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    out[0] = offset_voltage;
+    out[1] = offset_current;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_offsets_into_obj,  triac_power_analyzer_offsets_into);
+
+static mp_obj_t triac_power_analyzer_histo_into(mp_obj_t buf_obj, bool voltage) {
+    // Fills histo_size scaled samples and returns the number of averaged waveforms (0: none, buffer untouched)
+    uint16_t histo_size = tpa_singleton.histo_size;
+    float *out = triac_power_analyzer_float_buffer(buf_obj, histo_size);
+    uint32_t initial_window, final_window;
+    uint16_t histo_count;
+    float scale;
+    do{
+        initial_window = tpa_singleton.window_count;
+        const mp_triac_power_analyzer_doublebuffer_obj_t *uobj = &tpa_singleton.db[tpa_singleton.u_phase];
+        histo_count = uobj->histo_count;
+        if(histo_count==0) return MP_OBJ_NEW_SMALL_INT(0);
+        const int32_t *histo = voltage ? uobj->histo_voltage : uobj->histo_current;
+        scale = (voltage ? tpa_singleton.voltage_multiplier : tpa_singleton.current_multiplier)/histo_count;
+        for(uint i=0; i<histo_size; i++){
+            out[i] = histo[i]*scale;
+        }
+        final_window = tpa_singleton.window_count;
+    }while(initial_window!=final_window || tpa_singleton.updating);
+    return MP_OBJ_NEW_SMALL_INT(histo_count);
+}
+
+static mp_obj_t triac_power_analyzer_voltage_histo_into(mp_obj_t self_obj, mp_obj_t buf_obj) {
+    return triac_power_analyzer_histo_into(buf_obj, true);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_voltage_histo_into_obj,  triac_power_analyzer_voltage_histo_into);
+
+static mp_obj_t triac_power_analyzer_current_histo_into(mp_obj_t self_obj, mp_obj_t buf_obj) {
+    return triac_power_analyzer_histo_into(buf_obj, false);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_current_histo_into_obj,  triac_power_analyzer_current_histo_into);
+
+static mp_obj_t triac_power_analyzer_snapshot(mp_obj_t self_obj, mp_obj_t buf_obj) {
+    // Raw results of the last window, see mp_triac_power_analyzer_snapshot_t for the layout
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_obj, &bufinfo, MP_BUFFER_WRITE);
+    if(bufinfo.len<sizeof(mp_triac_power_analyzer_snapshot_t)){
+        mp_raise_ValueError(MP_ERROR_TEXT("Buffer too small!"));
+    }
+    mp_triac_power_analyzer_snapshot_t snapshot;
+    uint32_t final_window;
+    do{
+        snapshot.window = tpa_singleton.window_count;
+        snapshot.window_size = tpa_singleton.window_size;
+        snapshot.histo_count = tpa_singleton.db[tpa_singleton.u_phase].histo_count;
+        snapshot.squaresum_voltage = tpa_singleton.squaresum_voltage;
+        snapshot.squaresum_current = tpa_singleton.squaresum_current;
+        snapshot.sum_power = tpa_singleton.sum_power;
+        snapshot.offset_voltage = tpa_singleton.offset_voltage;
+        snapshot.offset_current = tpa_singleton.offset_current;
+        snapshot.pos_peak_voltage = tpa_singleton.pos_peak_voltage;
+        snapshot.neg_peak_voltage = tpa_singleton.neg_peak_voltage;
+        snapshot.pos_peak_current = tpa_singleton.pos_peak_current;
+        snapshot.neg_peak_current = tpa_singleton.neg_peak_current;
+        snapshot.pos_peak_power = tpa_singleton.pos_peak_power;
+        snapshot.neg_peak_power = tpa_singleton.neg_peak_power;
+        snapshot.timestamp_ms = (tpa_singleton.history && snapshot.window) ?
+            tpa_singleton.history[(snapshot.window-1)%tpa_singleton.history_size].timestamp_ms : 0;
+        final_window = tpa_singleton.window_count;
+    }while(snapshot.window!=final_window || tpa_singleton.updating);
+    memcpy(bufinfo.buf, &snapshot, sizeof(snapshot));
+    return MP_OBJ_NEW_SMALL_INT(sizeof(snapshot));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(triac_power_analyzer_snapshot_obj,  triac_power_analyzer_snapshot);
+
 
 // Main methods =====================================================================
 
@@ -455,18 +1383,44 @@ static const mp_rom_map_elem_t triac_power_analyzer_locals_dict_table[] = {
     // Getters / Setters
     { MP_ROM_QSTR(MP_QSTR_voltage_pin), MP_ROM_PTR(&triac_power_analyzer_voltage_pin_obj) },
     { MP_ROM_QSTR(MP_QSTR_current_pin), MP_ROM_PTR(&triac_power_analyzer_current_pin_obj) },
+    { MP_ROM_QSTR(MP_QSTR_current_pins), MP_ROM_PTR(&triac_power_analyzer_current_pins_obj) },
     { MP_ROM_QSTR(MP_QSTR_sample_rate), MP_ROM_PTR(&triac_power_analyzer_sample_rate_obj) },
     { MP_ROM_QSTR(MP_QSTR_analized_samples), MP_ROM_PTR(&triac_power_analyzer_analized_samples_obj) },
     { MP_ROM_QSTR(MP_QSTR_histo_size), MP_ROM_PTR(&triac_power_analyzer_histo_size_obj) },
+    { MP_ROM_QSTR(MP_QSTR_history_size), MP_ROM_PTR(&triac_power_analyzer_history_size_obj) },
     { MP_ROM_QSTR(MP_QSTR_running), MP_ROM_PTR(&triac_power_analyzer_running_obj) },
     { MP_ROM_QSTR(MP_QSTR_voltage_mult), MP_ROM_PTR(&triac_power_analyzer_voltage_mult_obj) },
     { MP_ROM_QSTR(MP_QSTR_current_mult), MP_ROM_PTR(&triac_power_analyzer_current_mult_obj) },
+    { MP_ROM_QSTR(MP_QSTR_channel_mult), MP_ROM_PTR(&triac_power_analyzer_channel_mult_obj) },
+    { MP_ROM_QSTR(MP_QSTR_harmonics), MP_ROM_PTR(&triac_power_analyzer_harmonics_obj) },
     // Main methods
     { MP_ROM_QSTR(MP_QSTR_get_offsets), MP_ROM_PTR(&triac_power_analyzer_get_offsets_obj) },
     { MP_ROM_QSTR(MP_QSTR_get_peaks), MP_ROM_PTR(&triac_power_analyzer_get_peaks_obj) },
     { MP_ROM_QSTR(MP_QSTR_get_rms), MP_ROM_PTR(&triac_power_analyzer_get_rms_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get_channels), MP_ROM_PTR(&triac_power_analyzer_get_channels_obj) },
     { MP_ROM_QSTR(MP_QSTR_voltage_histo), MP_ROM_PTR(&triac_power_analyzer_voltage_histo_obj) },
     { MP_ROM_QSTR(MP_QSTR_current_histo), MP_ROM_PTR(&triac_power_analyzer_current_histo_obj) },
+    { MP_ROM_QSTR(MP_QSTR_history), MP_ROM_PTR(&triac_power_analyzer_history_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get_harmonics), MP_ROM_PTR(&triac_power_analyzer_get_harmonics_obj) },
+    // Energy metering
+    { MP_ROM_QSTR(MP_QSTR_energy), MP_ROM_PTR(&triac_power_analyzer_energy_obj) },
+    { MP_ROM_QSTR(MP_QSTR_energy_reset), MP_ROM_PTR(&triac_power_analyzer_energy_reset_obj) },
+    { MP_ROM_QSTR(MP_QSTR_energy_snapshot), MP_ROM_PTR(&triac_power_analyzer_energy_snapshot_obj) },
+    { MP_ROM_QSTR(MP_QSTR_energy_restore), MP_ROM_PTR(&triac_power_analyzer_energy_restore_obj) },
+    { MP_ROM_QSTR(MP_QSTR_energy_persist), MP_ROM_PTR(&triac_power_analyzer_energy_persist_obj) },
+    { MP_ROM_QSTR(MP_QSTR_window_count), MP_ROM_PTR(&triac_power_analyzer_window_count_obj) },
+    // Readout into preallocated buffers
+    { MP_ROM_QSTR(MP_QSTR_rms_into), MP_ROM_PTR(&triac_power_analyzer_rms_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_peaks_into), MP_ROM_PTR(&triac_power_analyzer_peaks_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_offsets_into), MP_ROM_PTR(&triac_power_analyzer_offsets_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_voltage_histo_into), MP_ROM_PTR(&triac_power_analyzer_voltage_histo_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_current_histo_into), MP_ROM_PTR(&triac_power_analyzer_current_histo_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_snapshot), MP_ROM_PTR(&triac_power_analyzer_snapshot_obj) },
+    // Streaming of raw samples
+    { MP_ROM_QSTR(MP_QSTR_stream), MP_ROM_PTR(&triac_power_analyzer_stream_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream_stats), MP_ROM_PTR(&triac_power_analyzer_stream_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
 };
 MP_DEFINE_CONST_DICT(mp_triac_power_analyzer_locals_dict, triac_power_analyzer_locals_dict_table);
 
@@ -476,5 +1430,6 @@ MP_DEFINE_CONST_OBJ_TYPE(
     MP_TYPE_FLAG_NONE,
     make_new, mp_triac_power_analyzer_make_new,
     print, mp_triac_power_analyzer_print,
+    protocol, &triac_power_analyzer_stream_p,
     locals_dict, &mp_triac_power_analyzer_locals_dict
     );
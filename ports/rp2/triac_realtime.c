@@ -0,0 +1,106 @@
+#include "py/mpconfig.h"
+#include "py/mpthread.h"
+#include "triac.h"
+#include "modrp2.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+
+// Real-time engine ===================================================================================
+// The zero-cross edges, the firing alarms and the PowerAnalyzer DMA interruptions run on the core
+// that owns the engine: core0 by default, sharing it with the interpreter, the GC and the display.
+// Moved to core1, nothing else runs there, and core0 hands it work through a mailbox: one request
+// slot in shared memory (the SIO FIFO of core1 is taken by the flash lockout).
+
+typedef struct _triac_mailbox_t {
+    void (*volatile function)(uint32_t);
+    volatile uint32_t argument;
+    volatile uint32_t request;  // written by core0
+    volatile uint32_t done;     // written by core1, equal to request when idle
+} triac_mailbox_t;
+
+static triac_mailbox_t triac_mailbox;
+static volatile uint8_t triac_engine_core = 0;
+spin_lock_t *triac_spin_lock = NULL;
+
+#if MICROPY_PY_THREAD
+// Only marks core1 as taken for _thread, it is never called
+static void *triac_realtime_core1_entry(void *arg) {
+    return NULL;
+}
+#endif
+
+static void triac_realtime_core1_main(void) {
+    // runs from flash, so flash writes have to pause it too
+    multicore_lockout_victim_init();
+    triac_controller_engine_attach();
+    __dmb();
+    triac_mailbox.done = triac_mailbox.request;
+    __sev();
+    for(;;){
+        uint8_t cpu = rp2_cpu_enter(RP2_CPU_IDLE);
+        __wfe();
+        rp2_cpu_exit(cpu);
+        uint32_t request = triac_mailbox.request;
+        if(request!=triac_mailbox.done){
+            __dmb();
+            triac_mailbox.function(triac_mailbox.argument);
+            __dmb();
+            triac_mailbox.done = request;
+            __sev();
+        }
+    }
+}
+
+void triac_realtime_init(void) {
+    // Soft reset: core1 is stopped (also by _thread) and everything goes back to core0
+    if(triac_spin_lock==NULL){
+        triac_spin_lock = spin_lock_init(spin_lock_claim_unused(true));
+    }
+    if(triac_engine_core!=0){
+        multicore_reset_core1();
+        #if MICROPY_PY_THREAD
+        if(core1_entry==triac_realtime_core1_entry) core1_entry = NULL;
+        #endif
+        triac_engine_core = 0;
+    }
+    triac_mailbox.done = triac_mailbox.request;
+}
+
+uint8_t triac_realtime_core(void) {
+    return triac_engine_core;
+}
+
+uint8_t triac_realtime_start(void) {
+    // Returns 0 if core1 is in use
+    if(triac_engine_core==1) return 1;
+    #if MICROPY_PY_THREAD
+    if(core1_entry!=NULL) return 0;
+    core1_entry = triac_realtime_core1_entry;
+    #endif
+    triac_mailbox.request = triac_mailbox.done+1;
+    multicore_reset_core1();
+    multicore_launch_core1(triac_realtime_core1_main);
+    while(triac_mailbox.done!=triac_mailbox.request){
+        __wfe();
+    }
+    triac_engine_core = 1;
+    return 1;
+}
+
+void triac_realtime_run(void (*function)(uint32_t), uint32_t argument) {
+    // From core0 only, waits for the function to complete on the engine core
+    if(triac_engine_core==0 || get_core_num()==1){
+        function(argument);
+        return;
+    }
+    triac_mailbox.function = function;
+    triac_mailbox.argument = argument;
+    __dmb();
+    uint32_t request = triac_mailbox.request+1;
+    triac_mailbox.request = request;
+    __sev();
+    while(triac_mailbox.done!=request){
+        __wfe();
+    }
+    __dmb();
+}
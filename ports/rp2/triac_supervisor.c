@@ -0,0 +1,317 @@
+#include <math.h>
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "triac.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+// Safety supervisor ==================================================================================
+// Checks the analyzer results and the zero-cross tracking against limits, all in the interruptions
+// of the real-time engine: the currents at the end of each PowerAnalyzer window (DMA interruption),
+// the zero-cross and the analyzer itself from a periodic alarm. The first broken limit trips the
+// Controllers: gates off right away, and no firing until rearm(). Latency: one analyzer window for
+// the currents, period_us for the rest, none of it depends on the interpreter. So that the currents
+// trip within a half-cycle, the current limits refuse analyzer windows longer than that.
+
+#define TRIAC_SUPERVISOR_MAINS_HZ (60.0f) // the shortest half-cycle, without max_frequency
+
+static mp_triac_supervisor_obj_t tsv_singleton = {
+    .base = {&mp_triac_supervisor_type},
+    .armed = 0,
+    .current_zero = 2048,
+    .period_us = 5000,
+    .alarm = ALARM_ID_INVALID,
+};
+
+static void triac_supervisor_log(uint8_t code, uint8_t channel, float value){
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    uint32_t sequence = tsv_singleton.event_count;
+    triac_supervisor_event_t *event = &tsv_singleton.events[sequence%TRIAC_SUPERVISOR_EVENTS];
+    event->sequence = sequence;
+    event->timestamp_ms = time_us_64()/1000;
+    event->code = code;
+    event->channel = channel;
+    event->value = value;
+    tsv_singleton.event_count = sequence+1;
+    spin_unlock(triac_spin_lock, state);
+}
+
+// On the engine core: only the first cause is logged, until rearm()
+static void triac_supervisor_fault(uint8_t code, uint8_t channel, float value){
+    if(triac_controller_tripped()) return;
+    triac_controller_trip(1);
+    triac_supervisor_log(code, channel, value);
+}
+
+// Called from the PowerAnalyzer DMA interruption, with the results of a window just written
+void triac_supervisor_window(const mp_triac_power_analyzer_obj_t *analyzer){
+    if(!tsv_singleton.armed) return;
+    float frames = analyzer->window_size;
+    for(uint i=0; i<analyzer->current_count; i++){
+        float multiplier = fabsf(analyzer->current_multipliers[i]);
+        if(tsv_singleton.max_current>0){
+            float rms = sqrtf(analyzer->squaresum_currents[i]/frames)*multiplier;
+            if(rms>tsv_singleton.max_current) triac_supervisor_fault(TRIAC_EVENT_OVERCURRENT, i, rms);
+        }
+        if(tsv_singleton.max_peak>0){
+            int32_t peak = analyzer->pos_peak_currents[i];
+            if(-analyzer->neg_peak_currents[i]>peak) peak = -analyzer->neg_peak_currents[i];
+            if(peak*multiplier>tsv_singleton.max_peak) triac_supervisor_fault(TRIAC_EVENT_PEAK, i, peak*multiplier);
+        }
+        if(tsv_singleton.max_dc>0){
+            float dc = ((int32_t)analyzer->offset_currents[i]-tsv_singleton.current_zero)*multiplier;
+            if(fabsf(dc)>tsv_singleton.max_dc) triac_supervisor_fault(TRIAC_EVENT_OFFSET, i, dc);
+        }
+    }
+}
+
+static int64_t triac_supervisor_irq_check(alarm_id_t id, void *user_data){
+    if(!tsv_singleton.armed){
+        tsv_singleton.alarm = ALARM_ID_INVALID;
+        return 0;
+    }
+    uint32_t tlm = triac_telemetry_start();
+    uint64_t now = time_us_64();
+    uint32_t late = now - tsv_singleton.due;
+    tsv_singleton.due += tsv_singleton.period_us;
+    uint8_t pin;
+    float value;
+    uint8_t code = triac_controller_check_sync(now, tsv_singleton.armed_since, tsv_singleton.zero_cross_us, tsv_singleton.min_frequency, tsv_singleton.max_frequency, &pin, &value);
+    if(code) triac_supervisor_fault(code, pin, value);
+
+    // a stopped PowerAnalyzer is not a stall, a running one has to complete windows
+    uint32_t window = triac_power_analyzer_window_count();
+    if(!triac_power_analyzer_active() || window!=tsv_singleton.last_window){
+        tsv_singleton.last_window = window;
+        tsv_singleton.last_window_time = now;
+    }else if(tsv_singleton.analyzer_us && now-tsv_singleton.last_window_time>tsv_singleton.analyzer_us){
+        triac_supervisor_fault(TRIAC_EVENT_ANALYZER, 0, now-tsv_singleton.last_window_time);
+    }
+    triac_telemetry_end(TRIAC_TLM_SUPERVISOR, tlm, late, late>triac_telemetry_late());
+    return -(int64_t)tsv_singleton.period_us; // negative: from the time it was due, so the checks don't drift
+}
+
+// Both run on the real-time engine core, with its alarm pool
+static void triac_supervisor_start(uint32_t unused){
+    tsv_singleton.last_window = triac_power_analyzer_window_count();
+    tsv_singleton.last_window_time = time_us_64();
+    tsv_singleton.armed_since = tsv_singleton.last_window_time;
+    tsv_singleton.armed = 1;
+    tsv_singleton.due = tsv_singleton.last_window_time+tsv_singleton.period_us;
+    tsv_singleton.alarm = alarm_pool_add_alarm_in_us(triac_controller_alarm_pool(), tsv_singleton.period_us, triac_supervisor_irq_check, NULL, true);
+}
+
+static void triac_supervisor_stop(uint32_t unused){
+    tsv_singleton.armed = 0;
+    if(tsv_singleton.alarm!=ALARM_ID_INVALID){
+        alarm_pool_cancel_alarm(triac_controller_alarm_pool(), tsv_singleton.alarm);
+        tsv_singleton.alarm = ALARM_ID_INVALID;
+    }
+}
+
+static void triac_supervisor_manual_trip(uint32_t unused){
+    triac_supervisor_fault(TRIAC_EVENT_MANUAL, 0, 0.0f);
+}
+
+static void triac_supervisor_rearm_engine(uint32_t unused){
+    // On the core of the checks, with its interruptions off: the alarm never sees half of the 64 bits
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    tsv_singleton.last_window_time = time_us_64();
+    spin_unlock(triac_spin_lock, state);
+    triac_controller_trip(0);
+}
+
+void triac_supervisor_init(void) {
+    // Soft reset, before the alarm pools are reset: disarmed, empty log
+    triac_supervisor_stop(0);
+    tsv_singleton.event_count = 0;
+}
+
+uint8_t triac_supervisor_armed(void) {
+    return tsv_singleton.armed;
+}
+
+static void triac_supervisor_check_limits(float max_current, float max_peak, float max_frequency, uint32_t window_us) {
+    if(max_current<=0 && max_peak<=0) return;
+    float half_cycle_us = 500000.0f/((max_frequency>0) ? max_frequency : TRIAC_SUPERVISOR_MAINS_HZ);
+    if(window_us>half_cycle_us){
+        mp_raise_ValueError(MP_ERROR_TEXT("Analyzer window longer than a half-cycle!"));
+    }
+}
+
+// For a PowerAnalyzer about to be configured, while armed
+void triac_supervisor_check_window(uint32_t window_us) {
+    if(!tsv_singleton.armed) return;
+    triac_supervisor_check_limits(tsv_singleton.max_current, tsv_singleton.max_peak, tsv_singleton.max_frequency, window_us);
+}
+
+static void mp_triac_supervisor_init_helper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_max_current, ARG_max_peak, ARG_max_dc, ARG_current_zero, ARG_min_frequency, ARG_max_frequency, ARG_zero_cross_us, ARG_analyzer_us, ARG_period_us};
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_max_current,   MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_max_peak,      MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_max_dc,        MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_current_zero,  MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 2048} },
+        { MP_QSTR_min_frequency, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_max_frequency, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_zero_cross_us, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_analyzer_us,   MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_period_us,     MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 5000} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    float limits[5];
+    static const uint8_t limit_args[5] = {ARG_max_current, ARG_max_peak, ARG_max_dc, ARG_min_frequency, ARG_max_frequency};
+    for(uint i=0; i<5; i++){
+        mp_obj_t value = args[limit_args[i]].u_obj;
+        limits[i] = (value==MP_OBJ_NULL || value==mp_const_none) ? 0.0f : mp_obj_get_float(value);
+        if(limits[i]<0) mp_raise_ValueError(MP_ERROR_TEXT("Invalid limit!"));
+    }
+    if(limits[3]>0 && limits[4]>0 && limits[3]>=limits[4]){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid frequency range!"));
+    }
+    if(args[ARG_current_zero].u_int<0 || args[ARG_current_zero].u_int>4095){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid current zero!"));
+    }
+    if(args[ARG_zero_cross_us].u_int<0 || args[ARG_analyzer_us].u_int<0){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid timeout!"));
+    }
+    if(args[ARG_period_us].u_int<100 || args[ARG_period_us].u_int>1000000){
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid period!"));
+    }
+    triac_supervisor_check_limits(limits[0], limits[1], limits[4], triac_power_analyzer_window_us());
+
+    triac_realtime_run(triac_supervisor_stop, 0);
+    tsv_singleton.max_current = limits[0];
+    tsv_singleton.max_peak = limits[1];
+    tsv_singleton.max_dc = limits[2];
+    tsv_singleton.min_frequency = limits[3];
+    tsv_singleton.max_frequency = limits[4];
+    tsv_singleton.current_zero = args[ARG_current_zero].u_int;
+    tsv_singleton.zero_cross_us = args[ARG_zero_cross_us].u_int;
+    tsv_singleton.analyzer_us = args[ARG_analyzer_us].u_int;
+    tsv_singleton.period_us = args[ARG_period_us].u_int;
+    triac_realtime_run(triac_supervisor_start, 0);
+}
+
+static mp_obj_t mp_triac_supervisor_init(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    mp_triac_supervisor_init_helper(n_args - 1, args + 1, kw_args);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(triac_supervisor_init_obj, 1, mp_triac_supervisor_init);
+
+static mp_obj_t mp_triac_supervisor_close(mp_obj_t self_in) {
+    // Stops the checks, a trip stays latched until rearm()
+    triac_realtime_run(triac_supervisor_stop, 0);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_supervisor_close_obj, mp_triac_supervisor_close);
+
+static mp_obj_t mp_triac_supervisor_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    // There is a single supervisor, over all the Controllers and the PowerAnalyzer
+    if(n_args!=0 || n_kw!=0){
+        mp_map_t kw_args;
+        mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+        mp_triac_supervisor_init_helper(n_args, args, &kw_args);
+    }
+    return MP_OBJ_FROM_PTR(&tsv_singleton);
+}
+
+static void mp_triac_supervisor_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mp_printf(print, "Supervisor(%s, %s, events=%u)", tsv_singleton.armed ? "armed" : "disarmed",
+        triac_controller_tripped() ? "tripped" : "ok", (unsigned)tsv_singleton.event_count);
+}
+
+// Main methods =====================================================================================
+static mp_obj_t triac_supervisor_tripped(mp_obj_t self_obj) {
+    return mp_obj_new_bool(triac_controller_tripped());
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_supervisor_tripped_obj, triac_supervisor_tripped);
+
+static mp_obj_t triac_supervisor_armed_fun(mp_obj_t self_obj) {
+    return mp_obj_new_bool(tsv_singleton.armed);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_supervisor_armed_obj, triac_supervisor_armed_fun);
+
+static mp_obj_t triac_supervisor_trip(mp_obj_t self_obj) {
+    triac_realtime_run(triac_supervisor_manual_trip, 0);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_supervisor_trip_obj, triac_supervisor_trip);
+
+static mp_obj_t triac_supervisor_rearm(mp_obj_t self_obj) {
+    // Firing resumes at the next half-cycle of each Controller
+    if(!triac_controller_tripped()) return mp_const_none;
+    triac_realtime_run(triac_supervisor_rearm_engine, 0);
+    triac_supervisor_log(TRIAC_EVENT_REARM, 0, 0.0f);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_supervisor_rearm_obj, triac_supervisor_rearm);
+
+static mp_obj_t triac_supervisor_event_count(mp_obj_t self_obj) {
+    return mp_obj_new_int_from_uint(tsv_singleton.event_count);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(triac_supervisor_event_count_obj, triac_supervisor_event_count);
+
+static mp_obj_t triac_supervisor_events(size_t n_args, const mp_obj_t *args) {
+    // [(sequence, timestamp_ms, code, channel, value), ...] oldest first, from sequence
+    // number since on, as far as the ring still has them
+    uint32_t since = (n_args==2) ? mp_obj_get_int(args[1]) : 0;
+    triac_supervisor_event_t events[TRIAC_SUPERVISOR_EVENTS];
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    uint32_t count = tsv_singleton.event_count;
+    uint32_t first = (count>TRIAC_SUPERVISOR_EVENTS) ? count-TRIAC_SUPERVISOR_EVENTS : 0;
+    if(since>first) first = since;
+    if(first>count) first = count;
+    for(uint32_t k=first; k<count; k++){
+        events[k-first] = tsv_singleton.events[k%TRIAC_SUPERVISOR_EVENTS];
+    }
+    spin_unlock(triac_spin_lock, state);
+
+    mp_obj_t list = mp_obj_new_list(count-first, NULL);
+    for(uint32_t i=0; i<count-first; i++){
+        mp_obj_t tuple[5] = {
+            mp_obj_new_int_from_uint(events[i].sequence),
+            mp_obj_new_int_from_uint(events[i].timestamp_ms),
+            MP_OBJ_NEW_SMALL_INT(events[i].code),
+            MP_OBJ_NEW_SMALL_INT(events[i].channel),
+            mp_obj_new_float(events[i].value),
+        };
+        mp_obj_list_store(list, MP_OBJ_NEW_SMALL_INT(i), mp_obj_new_tuple(5, tuple));
+    }
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(triac_supervisor_events_obj, 1, 2, triac_supervisor_events);
+
+
+static const mp_rom_map_elem_t triac_supervisor_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_init), MP_ROM_PTR(&triac_supervisor_init_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&triac_supervisor_close_obj) },
+    // Main methods
+    { MP_ROM_QSTR(MP_QSTR_armed), MP_ROM_PTR(&triac_supervisor_armed_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tripped), MP_ROM_PTR(&triac_supervisor_tripped_obj) },
+    { MP_ROM_QSTR(MP_QSTR_trip), MP_ROM_PTR(&triac_supervisor_trip_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rearm), MP_ROM_PTR(&triac_supervisor_rearm_obj) },
+    { MP_ROM_QSTR(MP_QSTR_events), MP_ROM_PTR(&triac_supervisor_events_obj) },
+    { MP_ROM_QSTR(MP_QSTR_event_count), MP_ROM_PTR(&triac_supervisor_event_count_obj) },
+    // Event codes
+    { MP_ROM_QSTR(MP_QSTR_OVERCURRENT), MP_ROM_INT(TRIAC_EVENT_OVERCURRENT) },
+    { MP_ROM_QSTR(MP_QSTR_PEAK), MP_ROM_INT(TRIAC_EVENT_PEAK) },
+    { MP_ROM_QSTR(MP_QSTR_OFFSET), MP_ROM_INT(TRIAC_EVENT_OFFSET) },
+    { MP_ROM_QSTR(MP_QSTR_ZERO_CROSS), MP_ROM_INT(TRIAC_EVENT_ZERO_CROSS) },
+    { MP_ROM_QSTR(MP_QSTR_FREQUENCY), MP_ROM_INT(TRIAC_EVENT_FREQUENCY) },
+    { MP_ROM_QSTR(MP_QSTR_ANALYZER), MP_ROM_INT(TRIAC_EVENT_ANALYZER) },
+    { MP_ROM_QSTR(MP_QSTR_MANUAL), MP_ROM_INT(TRIAC_EVENT_MANUAL) },
+    { MP_ROM_QSTR(MP_QSTR_REARM), MP_ROM_INT(TRIAC_EVENT_REARM) },
+};
+MP_DEFINE_CONST_DICT(mp_triac_supervisor_locals_dict, triac_supervisor_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_triac_supervisor_type,
+    MP_QSTR_Supervisor,
+    MP_TYPE_FLAG_NONE,
+    make_new, mp_triac_supervisor_make_new,
+    print, mp_triac_supervisor_print,
+    locals_dict, &mp_triac_supervisor_locals_dict
+    );
@@ -0,0 +1,77 @@
+#include <string.h>
+#include "py/mpconfig.h"
+#include "triac.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
+
+// ISR telemetry =======================================================================================
+// Each interruption of the real-time engine measures its duration in CPU cycles (SysTick, free
+// running on the engine core) and, when it was due at a known time, its latency in us. Both go
+// into log2 histograms, with the worst cases and a fault count per source: missed edges, late
+// alarms, analyzer overruns. The tables are fixed, the readers copy them under the spin lock.
+
+static triac_telemetry_source_t triac_telemetry[TRIAC_TLM_SOURCES];
+static uint32_t triac_telemetry_late_us = 20;
+static uint32_t triac_telemetry_cycles_per_us = 125;
+
+void triac_telemetry_core_init(void) {
+    // Same setting as machine.bitstream, which may restart the count (one odd sample)
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->csr = 5; // CPU clock, no interruption
+}
+
+void triac_telemetry_init(void) {
+    triac_telemetry_core_init();
+    triac_telemetry_reset(20);
+}
+
+void triac_telemetry_reset(uint32_t late_us) {
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    memset(triac_telemetry, 0, sizeof(triac_telemetry));
+    triac_telemetry_late_us = late_us;
+    triac_telemetry_cycles_per_us = clock_get_hz(clk_sys)/1000000;
+    if(triac_telemetry_cycles_per_us==0) triac_telemetry_cycles_per_us = 1;
+    spin_unlock(triac_spin_lock, state);
+}
+
+uint32_t triac_telemetry_late(void) {
+    return triac_telemetry_late_us;
+}
+
+uint32_t triac_telemetry_start(void) {
+    return systick_hw->cvr;
+}
+
+// Bucket 0: 0, bucket b: [2^(b-1), 2^b), the last one open ended
+static inline uint8_t triac_telemetry_bucket(uint32_t value) {
+    if(value==0) return 0;
+    uint8_t bucket = 32-__builtin_clz(value);
+    return (bucket<TRIAC_TLM_BUCKETS) ? bucket : TRIAC_TLM_BUCKETS-1;
+}
+
+void triac_telemetry_end(uint8_t source, uint32_t start, int32_t latency, uint32_t faults) {
+    uint32_t cycles = (start-systick_hw->cvr)&0x00FFFFFF; // counts down
+    uint32_t us = cycles/triac_telemetry_cycles_per_us;
+    triac_telemetry_source_t *entry = &triac_telemetry[source];
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    entry->count++;
+    entry->faults += faults;
+    if(cycles>entry->duration_max) entry->duration_max = cycles;
+    entry->duration[triac_telemetry_bucket(us)]++;
+    if(latency>=0){
+        entry->latency_sum += latency;
+        if((uint32_t)latency>entry->latency_max) entry->latency_max = latency;
+        entry->latency[triac_telemetry_bucket(latency)]++;
+    }
+    spin_unlock(triac_spin_lock, state);
+}
+
+void triac_telemetry_read(uint8_t source, triac_telemetry_source_t *out, uint8_t reset) {
+    uint32_t state = spin_lock_blocking(triac_spin_lock);
+    *out = triac_telemetry[source];
+    if(reset) memset(&triac_telemetry[source], 0, sizeof(triac_telemetry_source_t));
+    uint32_t cycles_per_us = triac_telemetry_cycles_per_us;
+    spin_unlock(triac_spin_lock, state);
+    out->duration_max = ((uint64_t)out->duration_max*1000)/cycles_per_us;
+}
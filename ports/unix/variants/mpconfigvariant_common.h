@@ -101,6 +101,7 @@
 // Enable the unix-specific "time" module.
 #define MICROPY_PY_TIME                (1)
 #define MICROPY_PY_TIME_TIME_TIME_NS   (1)
+#define MICROPY_PY_TIME_NORMALIZE      (1)
 #define MICROPY_PY_TIME_CUSTOM_SLEEP   (1)
 #define MICROPY_PY_TIME_INCLUDEFILE    "ports/unix/modtime.c"
 
@@ -1582,6 +1582,11 @@ typedef double mp_float_t;
 #define MICROPY_PY_TIME_GMTIME_LOCALTIME_MKTIME (0)
 #endif
 
+// Whether to provide time.normalize/add functions
+#ifndef MICROPY_PY_TIME_NORMALIZE
+#define MICROPY_PY_TIME_NORMALIZE (MICROPY_PY_TIME_GMTIME_LOCALTIME_MKTIME)
+#endif
+
 // Whether to provide time.time/time_ns functions
 #ifndef MICROPY_PY_TIME_TIME_TIME_NS
 #define MICROPY_PY_TIME_TIME_TIME_NS (0)
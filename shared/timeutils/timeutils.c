@@ -81,6 +81,15 @@ void timeutils_seconds_since_2000_to_struct_time(mp_uint_t t, timeutils_struct_t
     tm->tm_min = seconds / 60 % 60;
     tm->tm_sec = seconds % 60;
 
+    timeutils_days_since_2000_to_struct_time(days + LEAPOCH / 86400, tm);
+}
+
+// Fills in the date part of tm (year, month, mday, weekday and yearday) from a
+// signed number of days since 2000-01-01. The time of day is left untouched.
+// tm_year is 16 bits: callers keep days within years 0 to 65535.
+void timeutils_days_since_2000_to_struct_time(mp_int_t days, timeutils_struct_time_t *tm) {
+    days -= LEAPOCH / 86400;
+
     mp_int_t wday = (days + 2) % 7;   // Mar 1, 2000 was a Wednesday (2)
     if (wday < 0) {
         wday += 7;
@@ -143,6 +152,36 @@ void timeutils_seconds_since_2000_to_struct_time(mp_uint_t t, timeutils_struct_t
     tm->tm_yday = timeutils_year_day(tm->tm_year, tm->tm_mon, tm->tm_mday);
 }
 
+static inline mp_int_t timeutils_floor_div(mp_int_t a, mp_int_t b) {
+    mp_int_t q = a / b;
+    if ((a % b) < 0) {
+        q--;
+    }
+    return q;
+}
+
+// returns the number of days, as a signed integer, since 2000-01-01
+// month and mday may be out of range (eg month 13, mday 0 or mday 400): they
+// carry into the year and month arithmetically, without walking the calendar,
+// so any date costs the same.
+mp_int_t timeutils_days_since_2000(mp_int_t year, mp_int_t month, mp_int_t mday) {
+    month--; // make month zero based
+    mp_int_t carry = timeutils_floor_div(month, 12);
+    year += carry;
+    month -= carry * 12;
+
+    mp_int_t years = year - 2000;
+    mp_int_t days = years * 365
+        + timeutils_floor_div(years + 3, 4) // add a day each 4 years starting with 2001
+        - timeutils_floor_div(years + 99, 100) // subtract a day each 100 years starting with 2001
+        + timeutils_floor_div(years + 399, 400) // add a day each 400 years starting with 2001
+        + days_since_jan1[month] + mday - 1;
+    if (month >= 2 && timeutils_is_leap_year(year)) {
+        days++;
+    }
+    return days;
+}
+
 // returns the number of seconds, as an integer, since 2000-01-01
 mp_uint_t timeutils_seconds_since_2000(mp_uint_t year, mp_uint_t month,
     mp_uint_t date, mp_uint_t hour, mp_uint_t minute, mp_uint_t second) {
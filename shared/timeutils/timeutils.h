@@ -49,6 +49,13 @@ mp_uint_t timeutils_year_day(mp_uint_t year, mp_uint_t month, mp_uint_t date);
 void timeutils_seconds_since_2000_to_struct_time(mp_uint_t t,
     timeutils_struct_time_t *tm);
 
+// Only the date fields of tm are set; days may be negative.
+void timeutils_days_since_2000_to_struct_time(mp_int_t days,
+    timeutils_struct_time_t *tm);
+
+// Year is absolute, month/mday are 1-based and may be out of range.
+mp_int_t timeutils_days_since_2000(mp_int_t year, mp_int_t month, mp_int_t mday);
+
 // Year is absolute, month/date are 1-based, hour/minute/second are 0-based.
 mp_uint_t timeutils_seconds_since_2000(mp_uint_t year, mp_uint_t month,
     mp_uint_t date, mp_uint_t hour, mp_uint_t minute, mp_uint_t second);
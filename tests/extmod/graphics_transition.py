@@ -0,0 +1,83 @@
+# Test Graphics.transition, composing frames between two sprites.
+
+try:
+    from Graphics import Sprite, transition, SLIDE, WIPE, DITHER
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+
+def sprite(data):
+    s = Sprite(width=8, height=8, stride=1)
+    s.buffer()[:] = bytes(data)
+    return s
+
+
+old = sprite(range(1, 9))
+new = sprite(range(11, 19))
+dest = sprite(range(1, 9))
+frames = []
+
+
+def send():
+    frames.append(list(dest.buffer()))
+
+
+def run(*args, **kwargs):
+    dest.buffer()[:] = old.buffer()
+    frames.clear()
+    transition(dest, old, new, *args, send=send, **kwargs)
+    for f in frames:
+        print(f)
+
+
+# slides, both directions
+run(SLIDE, 2)
+run(SLIDE, 2, direction=-1)
+
+# wipes
+run(WIPE, 4)
+run(WIPE, 4, direction=-1)
+
+# only a band of columns changes
+run(SLIDE, 2, x=2, width=4)
+
+# ordered dither from blank to full
+old = sprite([0] * 8)
+new = sprite([255] * 8)
+run(DITHER, 2)
+
+# rows past the height of the destination are left alone
+dest = Sprite(width=8, height=6, stride=1)
+dest.buffer()[:] = bytes([0x80] * 8)
+old = Sprite(width=8, height=6, stride=1)
+new = Sprite(width=8, height=6, stride=1)
+new.buffer()[:] = bytes([0x55] * 8)
+transition(dest, old, new, WIPE, 1)
+print(list(dest.buffer()))
+
+# errors
+try:
+    transition(dest, old, Sprite(width=4, height=8, stride=1))
+except ValueError:
+    print("ValueError")
+try:
+    transition(dest, old, new, 7)
+except ValueError:
+    print("ValueError")
+try:
+    transition(dest, old, new, SLIDE, 0)
+except ValueError:
+    print("ValueError")
+try:
+    transition(Sprite(raw=b"\x08\x08\x01" + bytes(8)), old, new)
+except TypeError:
+    print("TypeError")
+
+# only machine I2C buses are sent to directly, other streams are refused
+import io
+
+try:
+    transition(dest, old, new, i2c=io.BytesIO())
+except ValueError:
+    print("ValueError")
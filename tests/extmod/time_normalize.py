@@ -0,0 +1,54 @@
+# test time.normalize() and time.add()
+
+try:
+    import time
+
+    time.normalize
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+# lists are updated in place
+t = [2023, 12, 31, 23, 59, 60]
+print(time.normalize(t) is t, t)
+
+# weekday and yearday are recomputed when present
+print(time.normalize([2024, 2, 28, 24, 0, 0, 0, 0]))
+print(time.normalize((2024, 13, 1, 0, 0, 0, 0, 0)))
+print(time.normalize((2024, 3, 0, 0, 0, 0, 0, 0, -1)))
+
+# fields carry both ways, however far out of range they are
+print(time.normalize([2000, 1, 1, 0, 0, -1]))
+print(time.normalize([2000, 1, 1000, 0, -1441, 0]))
+print(time.normalize([2100, 0, 366, 0, 0, 0]))
+print(time.normalize([2199, 12, 31, 23, 59, 59, 0, 0]))
+
+# add a duration
+print(time.add([2024, 2, 28, 12, 0, 0], 86400))
+print(time.add([2024, 2, 28, 12, 0, 0], -86400 * 60))
+print(time.add((2023, 1, 31, 0, 0, 0, 0, 0), 3600 * 24 * 30))
+
+# a long duration, across leap years
+print(time.add((2030, 6, 15, 8, 30, 0, 0, 0), 123456789))
+
+# the year stays in [0, 65535], both ways
+print(time.normalize([0, 1, 1, 0, 0, 0, 0, 0]))
+print(time.normalize([65535, 12, 31, 23, 59, 59, 0, 0]))
+print(time.normalize([1, -11, 1, 0, 0, 0]))
+for t in (
+    [0, 1, 1, 0, 0, -1],
+    [65535, 12, 31, 23, 59, 60],
+    [-1, 1, 1, 0, 0, 0],
+    [65535, 13, 1, 0, 0, 0],
+    [2000, 1, 1 << 29, 0, 0, 0],
+    [1 << 29, 1, 1, 0, 0, 0],
+):
+    try:
+        time.normalize(t)
+    except OverflowError:
+        print("OverflowError")
+
+try:
+    time.normalize((2000, 1, 1))
+except TypeError:
+    print("TypeError")
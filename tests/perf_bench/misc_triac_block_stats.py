@@ -0,0 +1,46 @@
+# Triac PowerAnalyzer block statistics kernel over a synthetic 50Hz window.
+# Needs an rp2 build made with TRIAC_TEST_HOOKS=1.
+
+try:
+    import Triac
+    from array import array
+    import math
+
+    Triac.block_stats
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def synthetic(pairs):
+    # 2 periods of voltage and lagging current, 12 bit around mid-scale
+    buf = array("H", bytearray(4 * pairs))
+    w = 4 * math.pi / pairs
+    for i in range(pairs):
+        buf[2 * i] = 2048 + int(1800 * math.sin(i * w))
+        buf[2 * i + 1] = 2048 + int(1500 * math.sin(i * w - 0.5))
+    return buf
+
+
+bm_params = {
+    (50, 10): (10, 256),
+    (100, 10): (40, 1024),
+    (1000, 10): (400, 1024),
+    (5000, 10): (400, 4096),
+}
+
+
+def bm_setup(params):
+    loops, pairs = params
+    buf = synthetic(pairs)
+    stats = None
+
+    def run():
+        nonlocal stats
+        for _ in range(loops):
+            stats = Triac.block_stats(buf)
+
+    def result():
+        return loops * pairs // 1000, (stats[0], stats[1], stats[5])
+
+    return run, result
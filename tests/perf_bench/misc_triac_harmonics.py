@@ -0,0 +1,49 @@
+# Triac PowerAnalyzer harmonic analysis (Goertzel bank) over a synthetic distorted window.
+# Needs an rp2 build made with TRIAC_TEST_HOOKS=1.
+
+try:
+    import Triac
+    from array import array
+    import math
+
+    Triac.harmonics
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def synthetic(pairs, period):
+    # voltage with 3rd and 5th harmonics, current with a phase-angle-like 3rd
+    buf = array("H", bytearray(4 * pairs))
+    for i in range(pairs):
+        w = 2 * math.pi * i / period
+        a = 2048 + 1500 * math.cos(w) + 150 * math.cos(3 * w) + 60 * math.cos(5 * w)
+        b = 2048 + 1200 * math.cos(w - 0.4) + 400 * math.cos(3 * w + 1.0)
+        buf[2 * i] = int(a + 0.5)
+        buf[2 * i + 1] = int(b + 0.5)
+    return buf
+
+
+bm_params = {
+    (50, 10): (2, 512, 3),
+    (100, 10): (8, 1024, 7),
+    (1000, 10): (80, 1024, 7),
+    (5000, 10): (80, 4096, 15),
+}
+
+
+def bm_setup(params):
+    loops, pairs, count = params
+    buf = synthetic(pairs, 128)
+    result = None
+
+    def run():
+        nonlocal result
+        for _ in range(loops):
+            result = Triac.harmonics(buf, count)
+
+    def result_out():
+        period, bins = result
+        return loops * pairs // 1000, (round(period), round(bins[0][0]), round(bins[2][0]))
+
+    return run, result_out
@@ -0,0 +1,77 @@
+# Test the asyncio menu engine with a fake display: widgets, coalesced redraws and results.
+
+try:
+    import asyncio
+    import amenu
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+
+class Font:
+    def calculateSize(self, text):
+        return (len(text) * 6, 8, len(text) * 6)
+
+    def height(self):
+        return 8
+
+    def lineHeight(self):
+        return 10
+
+    def print(self, text, x, y):
+        pass
+
+
+class Display:
+    def width(self):
+        return 128
+
+    def height(self):
+        return 64
+
+    def clear(self, *args):
+        pass
+
+    def display(self):
+        pass
+
+    def rect(self, *args):
+        pass
+
+    def copyFrom(self, *args):
+        pass
+
+
+async def main():
+    ui = amenu.UI(Display(), Font(), fps=10)
+    ui.start()
+    updates = []
+    task = asyncio.create_task(ui.run(amenu.ValueInput(ui, 5, min_val=0, max_val=8, on_update=updates.append)))
+    await asyncio.sleep_ms(20)
+    frames = ui.frames
+    print(frames)
+    # a burst of keys within one frame period is drawn once
+    for i in range(5):
+        ui.key(amenu.RIGHT)
+    await asyncio.sleep_ms(250)
+    print(ui.frames - frames, updates)
+    # no change, no frame
+    frames = ui.frames
+    await asyncio.sleep_ms(250)
+    print(ui.frames - frames)
+    ui.key(amenu.OK)
+    print(await task)
+
+    task = asyncio.create_task(ui.menu([["a", None, None, None, None], ["b", None, None, None, None]]))
+    await asyncio.sleep_ms(20)
+    ui.key(amenu.LEFT)
+    ui.key(amenu.OK)
+    print(await task)
+    task = asyncio.create_task(ui.run(amenu.ValueInput(ui, 5)))
+    await asyncio.sleep_ms(20)
+    ui.key(amenu.CANCEL)
+    print(await task)
+    ui.stop()
+
+
+asyncio.run(main())
@@ -0,0 +1,33 @@
+# Test the Input.Buttons API with unconnected pins: validation, idle state and an empty event ring.
+
+try:
+    import Input
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+B = Input.Buttons
+
+for args, kwargs in (
+    ((), {}),
+    (((14, 15, 16, 17, 18, 19, 20, 21, 22),), {}),
+    (((14, 14),), {}),
+    (((14,),), {"debounce_ms": 0}),
+    (((14,),), {"repeat_ms": 1}),
+    (((14,),), {"repeat_delay_ms": -1}),
+):
+    try:
+        B(*args, **kwargs)
+    except (TypeError, ValueError) as e:
+        print(type(e).__name__)
+
+# pulled up, active low: nothing held
+b = B((14, 15), debounce_ms=10, repeat_delay_ms=0)
+print(b.held(), b.any(), b.dropped())
+print(b.get_event(0), b.get_event(20))
+print(b.read(Input.Buttons.EVENT_SIZE))
+print(Input.PRESS, Input.RELEASE, Input.REPEAT, Input.CHORD, b.EVENT_SIZE)
+print(B((14,)) is b)
+b.close()
+b.close()
+print(b.held())
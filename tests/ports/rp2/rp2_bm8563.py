@@ -0,0 +1,39 @@
+# Test rp2.BM8563 argument checks, on a bus with nothing at the address.
+
+import io
+import rp2
+from machine import I2C
+
+try:
+    rp2.BM8563
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+i2c = I2C(0)
+
+for args, kwargs in (
+    ((None,), {}),
+    ((1,), {}),
+    ((io.BytesIO(),), {}),
+    ((i2c,), {"address": 200}),
+):
+    try:
+        rp2.BM8563(*args, **kwargs)
+    except ValueError:
+        print("ValueError")
+
+# the control registers are written at creation
+try:
+    rp2.BM8563(i2c, address=0x0B)
+except OSError:
+    print("OSError")
+
+# init=False leaves the chip untouched, so nothing is sent until it is used
+rtc = rp2.BM8563(i2c, address=0x0B, init=False)
+try:
+    rtc.datetime()
+except OSError:
+    print("OSError")
+
+print(rp2.BM8563.ALARM, rp2.BM8563.TIMER)
@@ -0,0 +1,38 @@
+# Test rp2.CPUAccounting: sleeping, collecting and running bytecode land in their own sources.
+
+import gc
+import rp2
+import time
+
+try:
+    rp2.CPUAccounting
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+acc = rp2.CPUAccounting()
+print(acc is rp2.CPUAccounting(), len(acc.stats()) == acc.SOURCES)
+
+try:
+    acc.stats(2)
+except ValueError:
+    print("ValueError")
+
+acc.stats(reset=True)
+t = time.ticks_us()
+time.sleep_ms(100)
+gc.collect()
+x = 0
+for i in range(2000):
+    x += i
+elapsed = time.ticks_diff(time.ticks_us(), t)
+s = acc.stats()
+print(s[acc.IDLE] > 80000, s[acc.GC] > 0, s[acc.PYTHON] > 0)
+# everything the core did is in one of the sources
+print(abs(sum(s) - elapsed) < elapsed // 10)
+
+acc.close()
+try:
+    acc.stats()
+except ValueError:
+    print("ValueError")
@@ -0,0 +1,56 @@
+# Test rp2.I2CQueue on a bus with nothing at the address: the transaction fails in the background.
+
+import rp2
+import struct
+import time
+from machine import I2C
+
+try:
+    rp2.I2CQueue
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+i2c = I2C(0)
+
+for kwargs in ({"depth": 0}, {"depth": 17}, {"callback": 1}):
+    try:
+        rp2.I2CQueue(i2c, **kwargs)
+    except ValueError:
+        print("ValueError")
+try:
+    rp2.I2CQueue(None)
+except TypeError:
+    print("TypeError")
+
+done = []
+q = rp2.I2CQueue(i2c, depth=2, callback=lambda q: done.append(q))
+print(q.read(q.RECORD_SIZE))
+
+for args in ((0x0B,), (200, b"\x00")):
+    try:
+        q.submit(*args)
+    except ValueError:
+        print("ValueError")
+
+buf = bytearray(2)
+tags = [q.submit(0x0B, b"\x00"), q.submit(0x0B, b"\x00", buf)]
+print(tags)
+print(q.wait(1000), q.pending(), all(q.done(t) for t in tags))
+for i in range(2):
+    tag, status = struct.unpack("<Hh", q.read(q.RECORD_SIZE))
+    print(tag, status < 0)
+time.sleep_ms(10)
+print(len(done), done[0] is q)
+
+# the blocking methods still work once the queue is idle
+try:
+    i2c.writeto(0x0B, b"\x00")
+except OSError:
+    print("OSError")
+
+q.close()
+try:
+    q.submit(0x0B, b"\x00")
+except ValueError:
+    print("ValueError")
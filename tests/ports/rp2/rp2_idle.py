@@ -0,0 +1,49 @@
+# Test rp2.Idle: sleeping through time.sleep_ms, with and without the clock divided.
+
+import rp2
+import time
+
+try:
+    rp2.Idle
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+for divider in (0, 256):
+    try:
+        rp2.Idle(divider=divider)
+    except ValueError:
+        print("ValueError")
+
+for divider in (1, 4):
+    idle = rp2.Idle(divider=divider)
+    print(idle.divider())
+    idle.stats(True)
+    t = time.ticks_ms()
+    for _ in range(10):
+        time.sleep_ms(5)
+    elapsed = time.ticks_diff(time.ticks_ms(), t)
+    sleeps, lowered, asleep_us, timed, mean_us, max_us = idle.stats()
+    # the waits were still on time, spent mostly asleep and woken by the alarm
+    print(50 <= elapsed < 70, sleeps >= 10, asleep_us > 30000, timed >= 10, mean_us <= max_us)
+    idle.close()
+
+# an enabled state machine is clocked from clk_sys, so the clock is not lowered under it
+@rp2.asm_pio()
+def spin():
+    nop()
+
+
+sm = rp2.StateMachine(0, spin)
+sm.active(1)
+idle = rp2.Idle(divider=4)
+idle.stats(True)
+for _ in range(10):
+    time.sleep_ms(5)
+print(idle.stats()[1])
+idle.close()
+sm.active(0)
+rp2.PIO(0).remove_program(spin)
+
+print(rp2.Idle() is rp2.Idle())
+rp2.Idle().close()
@@ -0,0 +1,34 @@
+# Test rp2.Idle with a UART enabled: clk_peri follows clk_sys, so the clock must not be lowered and
+# the bytes sent across the idle period must come back intact (internal loopback, no wiring needed).
+
+import rp2
+import sys
+import time
+from machine import UART, mem32
+
+try:
+    rp2.Idle
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+UART1_CR = (0x40078000 if "RP2350" in sys.implementation._machine else 0x40038000) + 0x30
+UARTCR_LBE = 1 << 7
+
+uart = UART(1, 115200, tx=4, rx=5)
+mem32[UART1_CR] |= UARTCR_LBE
+uart.read()
+
+idle = rp2.Idle(divider=8)
+idle.stats(True)
+data = b"0123456789abcdef" * 2
+uart.write(data)
+for _ in range(10):
+    time.sleep_ms(5)
+sleeps, lowered, asleep_us, timed, mean_us, max_us = idle.stats()
+print(sleeps >= 10, lowered)
+print(uart.read() == data)
+idle.close()
+
+mem32[UART1_CR] &= ~UARTCR_LBE
+uart.deinit()
@@ -0,0 +1,40 @@
+# Test rp2.QuadEncoder with unconnected (pulled up) pins: a still knob, value(x) and validation.
+
+import rp2
+
+try:
+    rp2.QuadEncoder
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+for args, kwargs in (
+    ((-1, 16), {}),
+    ((99, 16), {}),
+    ((1, 16), {"freq": 0}),
+    ((1, 16), {"window_ms": 0}),
+):
+    try:
+        rp2.QuadEncoder(*args, **kwargs)
+    except ValueError as e:
+        print("ValueError")
+
+enc = rp2.QuadEncoder(1, 16)
+print(enc.value(), enc.velocity(), enc.acceleration(), enc.changes())
+enc.value(100)
+print(enc.value())
+
+# the state machine belongs to the encoder
+try:
+    rp2.StateMachine(1)
+except ValueError:
+    print("ValueError")
+
+enc.close()
+try:
+    enc.value()
+except ValueError:
+    print("ValueError")
+enc = rp2.QuadEncoder(1, 16, invert=True)
+print(enc.value())
+enc.close()
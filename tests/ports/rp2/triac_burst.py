@@ -0,0 +1,40 @@
+# Test the Triac burst-fire (integral half-cycle) distributor.
+
+try:
+    import Triac
+    Triac.burst_pattern  # only in builds with the test hooks
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+LEVEL_MAX = 1024
+
+
+def max_run(pattern, value):
+    longest = 0
+    run = 0
+    for p in pattern:
+        run = run + 1 if p == value else 0
+        if run > longest:
+            longest = run
+    return longest
+
+
+print(Triac.PHASE, Triac.BURST)
+print(Triac.burst_pattern(0, 8), Triac.burst_pattern(LEVEL_MAX, 8))
+
+for level in (1, 3, 100, 256, 341, 512, 683, 768, 1000, 1023):
+    pattern = Triac.burst_pattern(level, 4 * LEVEL_MAX)
+    # long-run power fraction is exact over whole periods of the distributor
+    on = sum(pattern)
+    # evenly spread: conduction and pause runs never exceed the ideal ceiling
+    on_run = max_run(pattern, 1)
+    off_run = max_run(pattern, 0)
+    ideal_on = -(-level // (LEVEL_MAX - level))
+    ideal_off = -(-(LEVEL_MAX - level) // level)
+    print(level, on == 4 * level, on_run, off_run, on_run <= ideal_on, off_run <= ideal_off)
+
+try:
+    Triac.burst_pattern(LEVEL_MAX + 1, 1)
+except ValueError:
+    print("ValueError")
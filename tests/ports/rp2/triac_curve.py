@@ -0,0 +1,83 @@
+# Test the calibration curves of the Controller: level lookup, blob round-trip and invalid blobs.
+
+try:
+    import Triac
+    import struct
+
+    Triac.curve  # only in builds with the test hooks
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+LEVEL_MAX = 1024
+POINTS = 65
+
+
+def blob(points, version=1, count=POINTS, checksum=None):
+    data = bytearray(b"TC" + bytes((version, count)))
+    for p in points:
+        data += struct.pack("<H", p)
+    if checksum is None:
+        checksum = sum(points) & 0xFFFF
+    return bytes(data + struct.pack("<H", checksum))
+
+
+def reference(points, level):
+    # 0: off, else 1 + the delay interpolated between the points, truncated as in C
+    if level == 0:
+        return 0
+    if level >= LEVEL_MAX:
+        return 1
+    pos = level * (len(points) - 1)
+    index = pos // LEVEL_MAX
+    frac = pos % LEVEL_MAX
+    step = (points[index + 1] - points[index]) * frac
+    step = -(-step // LEVEL_MAX) if step < 0 else step // LEVEL_MAX
+    return 1 + points[index] + step
+
+
+# without calibration: the ideal sine curve
+out, delays = Triac.curve(None, (0, 1, 512, LEVEL_MAX))
+print(out, delays)
+
+# calibrated curves are interpolated between their points, and dumped back unchanged
+levels = range(0, LEVEL_MAX + 1, 7)
+for points in (
+    [65534 - 1000 * i for i in range(POINTS)],
+    [65534 - (i * i * 15) for i in range(POINTS)],
+    [40000] * 20 + [30000] * 25 + [0] * 20,
+):
+    b = blob(points)
+    out, delays = Triac.curve(b, levels)
+    print(out == b, delays == [reference(points, level) for level in levels])
+print(Triac.curve(blob([65534] * POINTS), (1, 1023))[1])
+
+# invalid blobs
+points = [65534 - 1000 * i for i in range(POINTS)]
+bad = bytearray(blob(points))
+bad[12] ^= 0x01
+rising = list(points)
+rising[10] = rising[9] + 1
+for b in (
+    blob(points)[:-1],
+    b"XC" + blob(points)[2:],
+    blob(points, version=2),
+    blob(points, count=POINTS - 1),
+    blob(rising),
+    bad,
+):
+    try:
+        Triac.curve(b, ())
+    except ValueError as er:
+        print("ValueError", er)
+try:
+    Triac.curve(123, ())
+except TypeError:
+    print("TypeError")
+
+# levels out of range
+for level in (-1, LEVEL_MAX + 1):
+    try:
+        Triac.curve(None, (level,))
+    except ValueError as er:
+        print("ValueError", er)
@@ -0,0 +1,60 @@
+# Test the PowerAnalyzer energy accumulators: snapshot/restore blobs and reset.
+
+try:
+    import Triac
+    import struct
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+RATE = 6000
+
+
+def blob(active, apparent, pairs, rate=RATE):
+    data = struct.pack("<2sBBIqQQ", b"TE", 1, 0, rate, active, apparent, pairs)
+    return data + struct.pack("<H", sum(data) & 0xFFFF)
+
+
+def show(pa):
+    energy = pa.energy()
+    print([(key, round(energy[key], 2)) for key in sorted(energy)])
+
+
+pa = Triac.PowerAnalyzer()
+pa.energy_reset()
+show(pa)
+
+# 1kWh of active energy and 1.2kVAh of apparent energy over one hour, in raw units
+hour = RATE * 3600
+saved = blob(1000 * hour, 1200 * hour, hour)
+print(len(saved))
+pa.energy_restore(saved)
+show(pa)
+print(pa.energy_snapshot() == saved)
+
+# exported energy is negative
+saved = blob(-250 * hour, 300 * hour, hour // 2)
+pa.energy_restore(saved)
+show(pa)
+print(pa.energy_snapshot() == saved)
+
+pa.energy_reset()
+show(pa)
+
+bad = bytearray(saved)
+bad[10] ^= 1
+for data in (bad, saved[:-1], b"TC" + saved[2:]):
+    try:
+        pa.energy_restore(data)
+    except ValueError:
+        print("ValueError")
+
+pa.energy_persist(None)
+try:
+    pa.energy_persist(123)
+except TypeError:
+    print("TypeError")
+try:
+    pa.energy_persist("/energy.bin", 0)
+except ValueError:
+    print("ValueError")
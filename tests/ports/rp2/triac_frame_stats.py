@@ -0,0 +1,61 @@
+# Test the PowerAnalyzer N-channel frame statistics kernel against a Python reference.
+
+try:
+    import Triac
+    from array import array
+    Triac.frame_stats  # only in builds with the test hooks
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def synthetic(frames, channels):
+    buf = array("H", bytearray(2 * channels * frames))
+    seed = 7
+    for i in range(len(buf)):
+        seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF
+        buf[i] = seed % 4096
+    return buf
+
+
+def reference(buf, channels, ref):
+    frames = len(buf) // channels
+    data = [buf[ch::channels] for ch in range(channels)]
+    r = data[ref]
+    sums = tuple(sum(x) for x in data)
+    sqsums = tuple(sum(v * v for v in x) for x in data)
+    cross = tuple(sum(x[i] * r[i] for i in range(frames)) for x in data)
+    return (
+        frames,
+        sums,
+        tuple(min(x) for x in data),
+        tuple(max(x) for x in data),
+        sqsums,
+        cross,
+        tuple(sqsums[ch] - sums[ch] * sums[ch] // frames for ch in range(channels)),
+        tuple(cross[ch] - sums[ch] * sums[ref] // frames for ch in range(channels)),
+    )
+
+
+def close(x, y):
+    return all(abs(a - b) <= 1 for a, b in zip(x, y))
+
+
+for channels in (2, 3, 4):
+    for frames, ref in ((1, 0), (255, channels - 1), (256, 1), (257, 0), (700, channels - 1)):
+        buf = synthetic(frames, channels)
+        got = Triac.frame_stats(buf, channels, ref)
+        expected = reference(buf, channels, ref)
+        print(channels, frames, ref, got[:6] == expected[:6] and close(got[6], expected[6]) and close(got[7], expected[7]))
+
+# two channels agree with the pair kernel
+buf = synthetic(333, 2)
+pair = Triac.block_stats(buf)
+frame = Triac.frame_stats(buf, 2, 0)
+print(frame[1] == pair[1], frame[4] == pair[4], frame[5][1] == pair[5], frame[7][1] == pair[7])
+
+for args in ((array("H", [1, 2, 3]), 2, 0), (array("H", [1, 2, 3]), 3, 3), (array("H", [1] * 5), 5, 0)):
+    try:
+        Triac.frame_stats(*args)
+    except ValueError:
+        print("ValueError")
@@ -0,0 +1,78 @@
+# Test the PowerAnalyzer harmonic analysis (Goertzel bank locked to the
+# fundamental of the first channel) against synthetic signals.
+
+try:
+    import Triac
+    from array import array
+    import math
+    Triac.harmonics  # only in builds with the test hooks
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def synthetic(pairs, period, harmonics_a, harmonics_b):
+    # harmonics: list of (order, amplitude, phase) around mid-scale
+    buf = array("H", bytearray(4 * pairs))
+    for i in range(pairs):
+        w = 2 * math.pi * i / period
+        a = 2048 + sum(amp * math.cos(h * w + ph) for h, amp, ph in harmonics_a)
+        b = 2048 + sum(amp * math.cos(h * w + ph) for h, amp, ph in harmonics_b)
+        buf[2 * i] = min(max(int(a + 0.5), 0), 4095)
+        buf[2 * i + 1] = min(max(int(b + 0.5), 0), 4095)
+    return buf
+
+
+def wrap(phase):
+    while phase > math.pi:
+        phase -= 2 * math.pi
+    while phase < -math.pi:
+        phase += 2 * math.pi
+    return phase
+
+
+def check(pairs, period, harmonics_a, harmonics_b, count=7):
+    measured_period, result = Triac.harmonics(synthetic(pairs, period, harmonics_a, harmonics_b), count)
+    print("period", abs(measured_period - period) < 0.05 * period / 100)
+    ref = harmonics_a[0][2]
+    for h in range(1, count + 1):
+        line = [h]
+        for channel, harmonics in ((0, harmonics_a), (1, harmonics_b)):
+            amplitude, phase = result[h - 1][2 * channel], result[h - 1][2 * channel + 1]
+            expected = [(amp, ph) for order, amp, ph in harmonics if order == h]
+            if expected:
+                amp, ph = expected[0]
+                line.append(abs(amplitude - amp) < 0.01 * amp + 1)
+                line.append(abs(wrap(phase - wrap(ph - h * ref))) < 0.02)
+            else:
+                line.append(amplitude < 3)
+        print(*line)
+    # THD of the second channel
+    fundamental = result[0][2]
+    thd = math.sqrt(sum(r[2] ** 2 for r in result[1:])) / fundamental
+    expected = math.sqrt(sum(amp**2 for order, amp, ph in harmonics_b if order > 1)) / harmonics_b[0][1]
+    print("thd", abs(thd - expected) < 0.005)
+
+
+# 50Hz at 6000 pairs/s, not a whole number of cycles in the window
+check(
+    600,
+    120.37,
+    [(1, 1500, 0.3), (3, 150, 1.0), (5, 60, -0.5)],
+    [(1, 1000, -0.2), (3, 300, 2.0)],
+)
+# 60Hz, lagging current with odd harmonics (phase-angle firing)
+check(
+    1000,
+    100.0,
+    [(1, 1800, -1.0)],
+    [(1, 900, -1.6), (3, 250, 0.4), (5, 120, 2.5), (7, 60, -2.9)],
+)
+
+# no zero-crossing: no lock
+print(Triac.harmonics(array("H", [2048, 2048] * 300), 3))
+
+try:
+    Triac.harmonics(array("H", [2048, 2048] * 300), 0)
+except ValueError:
+    print("ValueError")
@@ -0,0 +1,59 @@
+# Test the zero-cross tracking (PLL) of the Controller against synthetic edge times.
+
+try:
+    import Triac
+    from array import array
+    Triac.pll_track  # only in builds with the test hooks
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def edges(start, halves, skew=0, jitter=0, drop=(), glitch=()):
+    # halves: list of (count, half period in us); odd edges are skew late, even ones skew early
+    out = array("I")
+    t = start
+    seed = 12345
+    n = 0
+    for count, half in halves:
+        for i in range(count):
+            seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF
+            noise = (seed % (2 * jitter + 1)) - jitter if jitter else 0
+            if n not in drop:
+                out.append(int(t + (skew if n & 1 else -skew) + noise) & 0xFFFFFFFF)
+            if n in glitch:
+                out.append(int(t + 3000) & 0xFFFFFFFF)
+            t += half
+            n += 1
+    expected = t + (skew if n & 1 else -skew)
+    return out, int(expected) & 0xFFFFFFFF
+
+
+def check(name, nominal, buf, expected, half, skew=0):
+    result = Triac.pll_track(buf, nominal)
+    measured, measured_skew, error, locked, next_cross = result
+    late = (next_cross - expected + 0x80000000) % 0x100000000 - 0x80000000
+    print(name, locked, abs(measured - half) < 1, abs(measured_skew - skew) < 5, abs(late) < 6)
+
+
+# 50Hz, skewed detector with some jitter
+buf, expected = edges(1000, [(100, 10000)], skew=120, jitter=2)
+check("50Hz", 10000, buf, expected, 10000, 120)
+# 60Hz with a 50Hz nominal, then a step to 58Hz
+buf, expected = edges(1000, [(60, 1e6 / 120), (80, 1e6 / 116)], jitter=1)
+check("step", 10000, buf, expected, 1e6 / 116)
+# missing edges and spurious ones keep the lock
+buf, expected = edges(1000, [(120, 10000)], skew=50, drop=(50, 90, 91), glitch=(70,))
+check("gaps", 10000, buf, expected, 10000, 50)
+# the 32 bit edge times wrap around
+buf, expected = edges(0xFFFFFFFF - 400000, [(80, 10000)])
+check("wrap", 10000, buf, expected, 10000)
+
+# too few edges: no lock yet
+print(Triac.pll_track(array("I", [0, 10000, 20000]), 10000)[3])
+print(Triac.pll_track(array("I"), 10000))
+
+try:
+    Triac.pll_track(array("H", [0, 1]), 10000)
+except ValueError:
+    print("ValueError")
@@ -0,0 +1,44 @@
+# Test the level ramp of the Controller, stepped once per half-cycle.
+
+try:
+    import Triac
+    Triac.ramp_profile  # only in builds with the test hooks
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+def steps(profile, start):
+    return [b - a for a, b in zip([start] + profile, profile)]
+
+
+# 100%/s at 50Hz: about 10 levels per half-cycle, full power in one second
+p = Triac.ramp_profile(0, 1024, 100, 10000, 105)
+print(p[0], p[49], p[98], p.index(1024), p[-1])
+print(min(steps(p, 0)[:99]), max(steps(p, 0)))
+
+# no ramp: the level jumps
+print(Triac.ramp_profile(100, 900, 0, 10000, 3))
+
+# down, at 50%/s
+p = Triac.ramp_profile(1024, 0, 50, 10000, 210)
+print(p[0], p[99], p.index(0))
+
+# 60Hz: the same time, more half-cycles
+print(Triac.ramp_profile(0, 1024, 100, 8333, 130).index(1024))
+
+# S-curve: starts and ends slowly, with the same steepest slope, takes 1.5 times longer
+p = Triac.ramp_profile(0, 1024, 100, 10000, 160, True)
+s = steps(p, 0)
+end = p.index(1024)
+print(p[74], end, max(s), s[0], s[end - 1], min(s) >= 0)
+
+# a small change is as smooth
+p = Triac.ramp_profile(500, 520, 100, 10000, 6, True)
+print(p)
+
+for args in ((-1, 10, 1, 10000, 1), (0, 2000, 1, 10000, 1), (0, 10, -1, 10000, 1), (0, 10, 1, 10, 1), (0, 10, 1, 10000, -1)):
+    try:
+        Triac.ramp_profile(*args)
+    except ValueError:
+        print("ValueError")
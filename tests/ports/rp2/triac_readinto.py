@@ -0,0 +1,66 @@
+# Test that the PowerAnalyzer can be read into preallocated buffers without allocating.
+
+try:
+    import Triac
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+import gc
+import struct
+import time
+from array import array
+
+SNAPSHOT_FORMAT = "<IHHQQqHHhhhhiiI"
+
+pa = Triac.PowerAnalyzer(0, 1, 6000, analized_samples=300, histo_size=50)
+while pa.window_count() < 3:
+    time.sleep_ms(10)
+
+rms = array("f", [0] * 3)
+peaks = array("f", [0] * 6)
+offsets = array("f", [0] * 2)
+histo = array("f", [0] * pa.histo_size())
+snap = bytearray(struct.calcsize(SNAPSHOT_FORMAT))
+print(len(snap))
+
+
+def poll(n):
+    for _ in range(n):
+        pa.rms_into(rms)
+        pa.peaks_into(peaks)
+        pa.offsets_into(offsets)
+        pa.voltage_histo_into(histo)
+        pa.current_histo_into(histo)
+        pa.snapshot(snap)
+        time.sleep_ms(1)
+
+
+# Warm up, then a steady-state loop must not allocate
+poll(2)
+gc.collect()
+gc.disable()
+before = gc.mem_alloc()
+poll(100)
+after = gc.mem_alloc()
+gc.enable()
+print("alloc", after - before)
+
+# The packed snapshot agrees with the buffer readout
+fields = struct.unpack(SNAPSHOT_FORMAT, snap)
+print(fields[0] > 0, fields[1])
+print(0 <= offsets[0] < 4096, 0 <= offsets[1] < 4096)
+print(peaks[0] >= peaks[3], peaks[1] >= peaks[4], rms[0] >= 0, rms[1] >= 0)
+
+# Wrong buffer type or size
+for buf in (array("i", [0] * 3), array("f", [0] * 2), bytearray(10)):
+    try:
+        pa.rms_into(buf)
+    except ValueError:
+        print("ValueError")
+try:
+    pa.snapshot(bytearray(10))
+except ValueError:
+    print("ValueError")
+
+pa.close()
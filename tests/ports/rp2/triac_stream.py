@@ -0,0 +1,53 @@
+# Test the PowerAnalyzer raw sample streaming (SPSC ring drained through readinto).
+
+try:
+    import Triac
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+import time
+from array import array
+
+WINDOW = 300
+
+pa = Triac.PowerAnalyzer(0, 1, 6000, analized_samples=WINDOW)
+try:
+    pa.stream(1000)
+except ValueError:
+    print("ValueError")
+try:
+    pa.stream(256)
+except ValueError:
+    print("ValueError")
+print(pa.stream(2048))
+
+# Drain faster than the capture: nothing is dropped and the stream has no holes
+buf = array("h", [0] * 2 * 512)
+total = 0
+valid = True
+deadline = time.ticks_add(time.ticks_ms(), 1000)
+while time.ticks_diff(deadline, time.ticks_ms()) > 0:
+    n = pa.readinto(buf)
+    if n is None:
+        time.sleep_ms(5)
+        continue
+    samples = memoryview(buf)[: n // 2]
+    if min(samples) < 0 or max(samples) >= 4096:
+        valid = False
+    total += n // 4
+available, streamed, dropped_blocks, dropped_pairs = pa.stream_stats()
+print(valid, total + available == streamed, streamed % WINDOW == 0, streamed > 4000)
+print(dropped_blocks, dropped_pairs)
+
+# Not draining: whole windows are dropped and counted
+time.sleep_ms(1000)
+available, streamed, dropped_blocks, dropped_pairs = pa.stream_stats()
+print(available <= 2048, dropped_blocks > 0, dropped_pairs == dropped_blocks * WINDOW)
+
+print(pa.stream(0))
+try:
+    pa.readinto(buf)
+except OSError:
+    print("OSError")
+pa.close()
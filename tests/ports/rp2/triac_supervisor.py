@@ -0,0 +1,78 @@
+# Test the Triac safety supervisor: latched trips, re-arming and the event log.
+
+try:
+    import Triac
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+S = Triac.Supervisor
+
+
+def show(events):
+    print([(seq - start, code, channel, value) for seq, ms, code, channel, value in events])
+
+
+# no Controller and no PowerAnalyzer: only the manual trips get logged
+sv = S(max_current=10, zero_cross_us=50000, analyzer_us=500000)
+print(sv.armed(), sv.tripped())
+start = sv.event_count()
+sv.trip()
+print(sv.tripped())
+sv.trip()  # already tripped, not logged again
+show(sv.events(start))
+sv.rearm()
+sv.rearm()  # not tripped, not logged
+print(sv.tripped())
+show(sv.events(start))
+show(sv.events(start + 1))
+print(S() is sv)
+
+# the ring keeps the last events only
+for i in range(20):
+    sv.trip()
+    sv.rearm()
+events = sv.events()
+print(len(events), events[-1][0] - events[0][0], sv.event_count() - start)
+print(events[-1][2] == S.REARM, events[-2][2] == S.MANUAL)
+print(sv.events(sv.event_count()))
+
+# a closed supervisor keeps the trip latched
+sv.trip()
+sv.close()
+print(sv.armed(), sv.tripped())
+sv.rearm()
+print(sv.tripped())
+
+for kwargs in (
+    {"max_current": -1},
+    {"min_frequency": 60, "max_frequency": 50},
+    {"current_zero": 5000},
+    {"zero_cross_us": -1},
+    {"period_us": 10},
+):
+    try:
+        S(**kwargs)
+    except ValueError:
+        print("ValueError")
+print(sv.armed())
+
+# the current limits trip within a half-cycle: longer PowerAnalyzer windows are refused
+sv.rearm()
+pa = Triac.PowerAnalyzer(0, 1, 6000, analized_samples=300)  # 50ms
+for kwargs in ({"max_current": 10}, {"max_peak": 20}):
+    try:
+        S(**kwargs)
+    except ValueError:
+        print("ValueError")
+print(S(max_dc=1).armed())
+pa.init(0, 1, 6000, analized_samples=48, histo_size=16)  # 8ms, below the 60Hz half-cycle
+print(S(max_current=10).armed())
+try:
+    pa.init(0, 1, 6000, analized_samples=300)
+except ValueError:
+    print("ValueError")
+print(S(max_current=10, max_frequency=45).armed())
+pa.init(0, 1, 6000, analized_samples=64, histo_size=16)  # 10.7ms, below the 45Hz half-cycle
+sv.close()
+pa.close()
@@ -0,0 +1,48 @@
+# Test the ISR telemetry readout: layout, reset, and reading without allocation.
+
+try:
+    import Triac
+    import micropython
+    from array import array
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+print(Triac.TLM_BUCKETS, Triac.TLM_WORDS)
+Triac.telemetry_reset()
+
+# nothing is running: all sources are empty
+for source in (Triac.TLM_EDGE, Triac.TLM_FIRE, Triac.TLM_CROSS, Triac.TLM_ANALYZER, Triac.TLM_SUPERVISOR):
+    count, duration, latency, faults, durations, latencies = Triac.telemetry(source)
+    print(count, duration, latency, faults, len(durations), sum(durations), sum(latencies))
+print(Triac.firing_stats())
+
+# the same readout into a preallocated buffer, with the heap locked
+buf = array("I", [0xFFFFFFFF] * Triac.TLM_WORDS)
+micropython.heap_lock()
+words = Triac.telemetry_into(Triac.TLM_FIRE, buf)
+micropython.heap_unlock()
+print(words, sum(buf))
+
+# the supervisor alarm feeds its own source
+sv = Triac.Supervisor(period_us=1000)
+Triac.telemetry_reset(1000)
+t = array("I", [0] * Triac.TLM_WORDS)
+while Triac.telemetry_into(Triac.TLM_SUPERVISOR, t) and t[0] < 10:
+    pass
+sv.close()
+print(t[0] >= 10, t[4], sum(t[5 : 5 + Triac.TLM_BUCKETS]) == t[0])
+
+for args in ((-1,), (Triac.TLM_SUPERVISOR + 1,)):
+    try:
+        Triac.telemetry(*args)
+    except ValueError:
+        print("ValueError")
+try:
+    Triac.telemetry_into(Triac.TLM_FIRE, array("I", [0] * 4))
+except ValueError:
+    print("ValueError")
+try:
+    Triac.telemetry_reset(-1)
+except ValueError:
+    print("ValueError")